@@ -67,6 +67,8 @@ typedef struct _snd_pcm_hw_params snd_pcm_hw_params_t;
 typedef struct _snd_pcm_sw_params snd_pcm_sw_params_t;
 /** PCM status container */
  typedef struct _snd_pcm_status snd_pcm_status_t;
+/** PCM plugin chain statistics container */
+typedef struct _snd_pcm_stats snd_pcm_stats_t;
 /** PCM access types mask */
 typedef struct _snd_pcm_access_mask snd_pcm_access_mask_t;
 /** PCM formats mask */
@@ -1050,6 +1052,50 @@ snd_pcm_uframes_t snd_pcm_status_get_overrange(const snd_pcm_status_t *obj);
 
 /** \} */
 
+/**
+ * \defgroup PCM_Stats Plugin Chain Statistics
+ * \ingroup PCM
+ * See the \ref pcm_stats section for more details.
+ * \{
+ */
+
+/** PCM statistics operation */
+typedef enum _snd_pcm_stats_op {
+	/** Sample conversion, resampling or mixing done by the PCM itself */
+	SND_PCM_STATS_TRANSFER = 0,
+	/** #snd_pcm_mmap_commit(), the slaves included */
+	SND_PCM_STATS_MMAP_COMMIT,
+	/** #snd_pcm_avail_update(), the slaves included */
+	SND_PCM_STATS_AVAIL_UPDATE,
+	/** #snd_pcm_hwsync(), the slaves included */
+	SND_PCM_STATS_HWSYNC,
+	SND_PCM_STATS_LAST = SND_PCM_STATS_HWSYNC
+} snd_pcm_stats_op_t;
+
+int snd_pcm_stats_enable(snd_pcm_t *pcm, int enable);
+int snd_pcm_stats_reset(snd_pcm_t *pcm);
+int snd_pcm_stats(snd_pcm_t *pcm, unsigned int index, snd_pcm_stats_t *stats);
+const char *snd_pcm_stats_op_name(const snd_pcm_stats_op_t op);
+size_t snd_pcm_stats_sizeof(void);
+/** \hideinitializer
+ * \brief allocate an invalid #snd_pcm_stats_t using standard alloca
+ * \param ptr returned pointer
+ */
+#define snd_pcm_stats_alloca(ptr) __snd_alloca(ptr, snd_pcm_stats)
+int snd_pcm_stats_malloc(snd_pcm_stats_t **ptr);
+void snd_pcm_stats_free(snd_pcm_stats_t *obj);
+void snd_pcm_stats_copy(snd_pcm_stats_t *dst, const snd_pcm_stats_t *src);
+const char *snd_pcm_stats_get_name(const snd_pcm_stats_t *obj);
+snd_pcm_type_t snd_pcm_stats_get_type(const snd_pcm_stats_t *obj);
+unsigned long long snd_pcm_stats_get_calls(const snd_pcm_stats_t *obj, snd_pcm_stats_op_t op);
+unsigned long long snd_pcm_stats_get_time(const snd_pcm_stats_t *obj, snd_pcm_stats_op_t op);
+unsigned long long snd_pcm_stats_get_max_time(const snd_pcm_stats_t *obj, snd_pcm_stats_op_t op);
+unsigned long long snd_pcm_stats_get_frames(const snd_pcm_stats_t *obj);
+unsigned long long snd_pcm_stats_get_bytes(const snd_pcm_stats_t *obj);
+long snd_pcm_stats_get_latency(const snd_pcm_stats_t *obj);
+
+/** \} */
+
 /**
  * \defgroup PCM_Description Description Functions
  * \ingroup PCM
@@ -1150,6 +1196,49 @@ int snd_pcm_areas_copy(const snd_pcm_channel_area_t *dst_channels, snd_pcm_ufram
 
 /** \} */
 
+/**
+ * \defgroup PCM_Eventloop Event Loop
+ * \ingroup PCM
+ * See the \ref pcm page for more details.
+ * \{
+ */
+
+/** PCM event loop container */
+typedef struct _snd_pcm_eventloop snd_pcm_eventloop_t;
+
+/** Ready handle reported by #snd_pcm_eventloop_wait() */
+typedef struct _snd_pcm_eventloop_event {
+	/** PCM handle, NULL for descriptors added by #snd_pcm_eventloop_add_poll() */
+	snd_pcm_t *pcm;
+	/** private data given at the registration */
+	void *private_data;
+	/** PCM events from #snd_pcm_poll_descriptors_revents(), or the
+	    ORed events of the descriptors */
+	unsigned short revents;
+	/** result of #snd_pcm_avail_update() for a PCM, otherwise 0 */
+	snd_pcm_sframes_t avail;
+	/** the descriptors of the handle with their revents, valid until
+	    the next wait */
+	struct pollfd *pfds;
+	/** count of the descriptors */
+	unsigned int nfds;
+} snd_pcm_eventloop_event_t;
+
+int snd_pcm_eventloop_open(snd_pcm_eventloop_t **loopp);
+int snd_pcm_eventloop_close(snd_pcm_eventloop_t *loop);
+int snd_pcm_eventloop_add_pcm(snd_pcm_eventloop_t *loop, snd_pcm_t *pcm,
+			      void *private_data);
+int snd_pcm_eventloop_remove_pcm(snd_pcm_eventloop_t *loop, snd_pcm_t *pcm);
+int snd_pcm_eventloop_add_poll(snd_pcm_eventloop_t *loop,
+			       const struct pollfd *pfds, unsigned int nfds,
+			       void *private_data);
+int snd_pcm_eventloop_remove_poll(snd_pcm_eventloop_t *loop, void *private_data);
+int snd_pcm_eventloop_wait(snd_pcm_eventloop_t *loop,
+			   snd_pcm_eventloop_event_t *events,
+			   unsigned int space, int timeout);
+
+/** \} */
+
 /**
  * \defgroup PCM_Hook Hook Extension
  * \ingroup PCM
@@ -1236,6 +1325,22 @@ int snd_pcm_scope_s16_open(snd_pcm_t *pcm, const char *name,
 			   snd_pcm_scope_t **scopep);
 int16_t *snd_pcm_scope_s16_get_channel_buffer(snd_pcm_scope_t *scope,
 					      unsigned int channel);
+int snd_pcm_scope_peak_open(snd_pcm_t *pcm, const char *name,
+			    snd_pcm_scope_t **scopep);
+float snd_pcm_scope_peak_get_peak(snd_pcm_scope_t *scope, unsigned int channel);
+float snd_pcm_scope_peak_get_rms(snd_pcm_scope_t *scope, unsigned int channel);
+
+/** \} */
+
+/**
+ * \defgroup PCM_Multi Multi Plugin Extension
+ * \ingroup PCM
+ * See the \ref pcm_plugins_multi section for more details.
+ * \{
+ */
+
+int snd_pcm_multi_get_skew(snd_pcm_t *pcm, unsigned int slave,
+			   snd_pcm_sframes_t *skew, double *drift);
 
 /** \} */
 
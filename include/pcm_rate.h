@@ -38,7 +38,20 @@ extern "C" {
 /**
  * Protocol version
  */
-#define SND_PCM_RATE_PLUGIN_VERSION	0x010002
+#define SND_PCM_RATE_PLUGIN_VERSION	0x010003
+
+/** Flags returned by get_supported_formats */
+enum {
+	/** convert only interleaved areas */
+	SND_PCM_RATE_FLAG_INTERLEAVED = (1U << 0),
+	/** the input and output formats have to be identical */
+	SND_PCM_RATE_FLAG_SYNC_FORMATS = (1U << 1),
+	/**
+	 * convert accepts any number of input and output frames and
+	 * follows the ratio of the given counts (needed for adaptive mode)
+	 */
+	SND_PCM_RATE_FLAG_VARIABLE_FRAMES = (1U << 2),
+};
 
 /** hw_params information for a single side */
 typedef struct snd_pcm_rate_side_info {
@@ -114,6 +127,16 @@ typedef struct snd_pcm_rate_ops {
 	 * new ops since version 0x010002
 	 */
 	void (*dump)(void *obj, snd_output_t *out);
+	/**
+	 * return the formats accepted by convert as bit masks of
+	 * (1ULL << SND_PCM_FORMAT_XXX) and SND_PCM_RATE_FLAG_XXX flags;
+	 * other formats are converted by the rate PCM before and after
+	 * calling convert; optional, exclusive with convert_s16;
+	 * new ops since version 0x010003
+	 */
+	int (*get_supported_formats)(void *obj, uint64_t *in_formats,
+				     uint64_t *out_formats,
+				     unsigned int *flags);
 } snd_pcm_rate_ops_t;
 
 /** open function type */
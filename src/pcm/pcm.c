@@ -428,6 +428,53 @@ The function #snd_pcm_avail_delay() combines #snd_pcm_avail() and
 #snd_pcm_delay() and returns both values in sync.
 </p>
 
+\subsection pcm_stats Plugin chain statistics
+
+A PCM built from plugins can account where the time goes in its chain.
+The accounting is off by default; it is turned on for a whole chain with
+#snd_pcm_stats_enable(), for all PCMs opened from the configuration when
+defaults.pcm.stats is set to 1, or for all PCMs of a process when the
+environment variable LIBASOUND_PCM_STATS is set to a non-zero value.
+
+Each PCM of the chain counts the calls and the time spent in the
+operations listed in #snd_pcm_stats_op_t, and the frames and bytes its own
+conversion touched.  The time of an operation includes the time spent in
+the slaves, the difference to the next PCM of the chain is the cost of
+the PCM itself.  #snd_pcm_stats() takes a snapshot of the PCM at the
+given position in the chain (0 is the PCM itself, 1 its slave and so on)
+together with the latency this PCM adds on top of its slave.  The chain
+ends at a PCM without a single slave, like the hw or multi plugins.
+
+\subsection pcm_refine_cache Refinement cache
+
+Setting up a deep plugin chain refines the configuration space through
+every PCM of the chain, which can take milliseconds.  The refined spaces
+can be cached for the whole process; the cache is off by default and
+turned on for all PCMs opened from the configuration when
+defaults.pcm.refine_cache is set to 1, or for all PCMs of a process when
+the environment variable LIBASOUND_PCM_REFINE_CACHE is set to a non-zero
+value.  When the variable holds an absolute path, or when
+defaults.pcm.refine_cache_file names a file, the cache is loaded from the
+file at the first open and written back when a PCM is closed after the
+cache has changed.
+
+A refinement is looked up by the PCM and the whole requested space.  The
+PCM is identified by its name, stream, open mode and expanded definition
+together with those of its slaves, and for the hw PCMs by the sound cards
+present, the kernel and driver version and the device, so a change of the
+configuration files, a card hotplug or a kernel upgrade leads to new
+entries instead of stale ones.  Only the built-in plugins with a single
+slave and the hw and null PCMs are cached; PCMs from external modules,
+multi and share PCMs and all PCMs on top of them always refine.
+
+The space of a hw PCM also depends on state no key covers, like the HDMI
+ELD, USB altsettings or the constraints of other open streams of the
+card.  The refinements of chains ending in a hw PCM are therefore kept in
+memory only and never written to the file.  Installing the parameters is
+never cached; when it fails, the entries of the PCM and its slaves are
+dropped and snd_pcm_hw_params() refines and installs once more without
+the cache before it returns the error.
+
 \section pcm_action Managing the stream state
 
 The following functions directly and indirectly affect the stream state:
@@ -502,6 +549,15 @@ LIBASOUND_THREAD_SAFE=0 aplay foo.wav
 \endcode
 for making the debugging easier.
 
+The position readers #snd_pcm_avail(), #snd_pcm_delay(),
+#snd_pcm_avail_delay() and #snd_pcm_htimestamp() don't wait for a PCM
+which is busy in another thread, e.g. in #snd_pcm_writei() of the audio
+thread.  They return the values from the last call which updated the
+positions instead, as long as the stream wasn't started, stopped or
+repositioned meanwhile.  This can be disabled by passing 0 to the
+environment variable LIBASOUND_PCM_SNAPSHOT, so that these functions
+always wait for the other thread.
+
 \section pcm_dev_names PCM naming conventions
 
 The ALSA library uses a generic string representation for names of devices.
@@ -655,6 +711,7 @@ playback devices.
 #include <sys/mman.h>
 #include <limits.h>
 #include "pcm_local.h"
+#include "pcm_areas_simd.h"
 
 #ifndef DOC_HIDDEN
 /* return specific error codes for known bad PCM states */
@@ -695,6 +752,209 @@ static int bad_pcm_state(snd_pcm_t *pcm, unsigned int supported_states)
 		return err;
 	return -EBADFD;
 }
+
+/* frames between the application and the hardware pointer */
+static inline snd_pcm_sframes_t snapshot_queued(snd_pcm_t *pcm,
+					       snd_pcm_sframes_t avail)
+{
+	if (pcm->stream == SND_PCM_STREAM_PLAYBACK)
+		return (snd_pcm_sframes_t)pcm->buffer_size - avail;
+	return avail;
+}
+
+/* the delay at the published avail, see below */
+static inline snd_pcm_sframes_t snapshot_get_delay(snd_pcm_t *pcm,
+						   const snd_pcm_snapshot_t *s)
+{
+	snd_pcm_sframes_t delay = s->delay + snapshot_queued(pcm, s->avail);
+
+	/* plugins not counting the queued frames in the delay */
+	return delay < 0 ? 0 : delay;
+}
+
+#ifdef THREAD_SAFE_API
+/*
+ * Position snapshot
+ *
+ * A thread asking for the delay would otherwise wait as long as the audio
+ * thread holds the lock for a transfer.  Instead, the avail, delay and
+ * timestamp seen by the locked calls are published in pcm->snapshot under
+ * a sequence counter, and snd_pcm_avail(), snd_pcm_delay(),
+ * snd_pcm_avail_delay() and snd_pcm_htimestamp() return them when the lock
+ * is held by another thread.  The delay is stored relative to the queued
+ * frames, so it follows the avail published after it was measured.
+ * Everything else moving the positions (start, drop, rewind, an xrun, ...)
+ * invalidates the snapshot, and the readers wait for the lock again until
+ * the next update.
+ */
+static inline int snapshot_enabled(snd_pcm_t *pcm)
+{
+	return pcm->lock_enabled && pcm->need_lock && pcm->use_snapshot &&
+	       pcm->setup;
+}
+
+/* called with the lock held, so there is a single writer */
+static void snapshot_store(snd_pcm_t *pcm, const snd_pcm_snapshot_t *s)
+{
+	snd_pcm_snapshot_t *d = &pcm->snapshot;
+	unsigned int seq = d->seq;
+
+	__atomic_store_n(&d->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&d->valid, s->valid, __ATOMIC_RELAXED);
+	__atomic_store_n(&d->avail, s->avail, __ATOMIC_RELAXED);
+	__atomic_store_n(&d->delay, s->delay, __ATOMIC_RELAXED);
+	__atomic_store_n(&d->tstamp_avail, s->tstamp_avail, __ATOMIC_RELAXED);
+	__atomic_store_n(&d->tstamp.tv_sec, s->tstamp.tv_sec, __ATOMIC_RELAXED);
+	__atomic_store_n(&d->tstamp.tv_nsec, s->tstamp.tv_nsec, __ATOMIC_RELAXED);
+	__atomic_store_n(&d->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* copy a consistent snapshot, returns its valid flags */
+static unsigned int snapshot_load(snd_pcm_t *pcm, snd_pcm_snapshot_t *s)
+{
+	const snd_pcm_snapshot_t *d = &pcm->snapshot;
+	unsigned int seq, tries;
+
+	for (tries = 0; tries < 8; tries++) {
+		seq = __atomic_load_n(&d->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+		s->valid = __atomic_load_n(&d->valid, __ATOMIC_RELAXED);
+		s->avail = __atomic_load_n(&d->avail, __ATOMIC_RELAXED);
+		s->delay = __atomic_load_n(&d->delay, __ATOMIC_RELAXED);
+		s->tstamp_avail = __atomic_load_n(&d->tstamp_avail, __ATOMIC_RELAXED);
+		s->tstamp.tv_sec = __atomic_load_n(&d->tstamp.tv_sec, __ATOMIC_RELAXED);
+		s->tstamp.tv_nsec = __atomic_load_n(&d->tstamp.tv_nsec, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&d->seq, __ATOMIC_RELAXED) == seq)
+			return s->valid;
+	}
+	return 0;	/* being rewritten, wait for the lock instead */
+}
+
+/*
+ * Lock for a reader which can be served from the snapshot.  Returns 1
+ * without the lock when another thread holds it and the snapshot has
+ * all the wanted values, otherwise 0 with the lock taken.
+ */
+static int snapshot_lock(snd_pcm_t *pcm, unsigned int want,
+			 snd_pcm_snapshot_t *s)
+{
+	if (!snapshot_enabled(pcm)) {
+		snd_pcm_lock(pcm);
+		return 0;
+	}
+	if (pthread_mutex_trylock(&pcm->lock) == 0)
+		return 0;
+	if ((snapshot_load(pcm, s) & want) == want)
+		return 1;
+	pthread_mutex_lock(&pcm->lock);
+	return 0;
+}
+
+static void snapshot_invalidate(snd_pcm_t *pcm)
+{
+	snd_pcm_snapshot_t s;
+
+	if (!pcm->lock_enabled || !pcm->need_lock || !pcm->snapshot.valid)
+		return;
+	s = pcm->snapshot;
+	s.valid = 0;
+	snapshot_store(pcm, &s);
+}
+
+static void snapshot_avail(snd_pcm_t *pcm, snd_pcm_sframes_t avail)
+{
+	snd_pcm_snapshot_t s;
+
+	if (avail < 0) {
+		snapshot_invalidate(pcm);
+		return;
+	}
+	if (!snapshot_enabled(pcm))
+		return;
+	s = pcm->snapshot;
+	s.valid |= SND_PCM_SNAPSHOT_AVAIL;
+	s.avail = avail;
+	snapshot_store(pcm, &s);
+}
+
+/* the application pointer moved by the given frames */
+static void snapshot_commit(snd_pcm_t *pcm, snd_pcm_sframes_t frames)
+{
+	snd_pcm_snapshot_t s;
+
+	if (frames < 0) {
+		snapshot_invalidate(pcm);
+		return;
+	}
+	if (!snapshot_enabled(pcm) ||
+	    !(pcm->snapshot.valid & SND_PCM_SNAPSHOT_AVAIL))
+		return;
+	s = pcm->snapshot;
+	s.avail -= frames;
+	snapshot_store(pcm, &s);
+}
+
+/* a negative avail keeps the published one */
+static void snapshot_delay(snd_pcm_t *pcm, snd_pcm_sframes_t avail,
+			   snd_pcm_sframes_t delay)
+{
+	snd_pcm_snapshot_t s;
+
+	if (!snapshot_enabled(pcm))
+		return;
+	s = pcm->snapshot;
+	if (avail >= 0) {
+		s.valid |= SND_PCM_SNAPSHOT_AVAIL;
+		s.avail = avail;
+	} else if (!(s.valid & SND_PCM_SNAPSHOT_AVAIL)) {
+		return;
+	}
+	s.valid |= SND_PCM_SNAPSHOT_DELAY;
+	s.delay = delay - snapshot_queued(pcm, s.avail);
+	snapshot_store(pcm, &s);
+}
+
+static void snapshot_tstamp(snd_pcm_t *pcm, snd_pcm_uframes_t avail,
+			    const snd_htimestamp_t *tstamp)
+{
+	snd_pcm_snapshot_t s;
+
+	if (!snapshot_enabled(pcm))
+		return;
+	s = pcm->snapshot;
+	s.valid |= SND_PCM_SNAPSHOT_TSTAMP;
+	s.tstamp_avail = avail;
+	s.tstamp = *tstamp;
+	snapshot_store(pcm, &s);
+}
+
+static void snapshot_status(snd_pcm_t *pcm, const snd_pcm_status_t *status)
+{
+	switch (status->state) {
+	case SND_PCM_STATE_PREPARED:
+	case SND_PCM_STATE_RUNNING:
+	case SND_PCM_STATE_DRAINING:
+	case SND_PCM_STATE_PAUSED:
+		snapshot_delay(pcm, status->avail, status->delay);
+		snapshot_tstamp(pcm, status->avail, &status->tstamp);
+		break;
+	default:
+		snapshot_invalidate(pcm);
+		break;
+	}
+}
+#else /* THREAD_SAFE_API */
+#define snapshot_lock(pcm, want, s)		0
+#define snapshot_invalidate(pcm)		do {} while (0)
+#define snapshot_avail(pcm, avail)		do {} while (0)
+#define snapshot_commit(pcm, frames)		do {} while (0)
+#define snapshot_delay(pcm, avail, delay)	do {} while (0)
+#define snapshot_tstamp(pcm, avail, tstamp)	do {} while (0)
+#define snapshot_status(pcm, status)		do {} while (0)
+#endif /* THREAD_SAFE_API */
 #endif
 
 /**
@@ -761,6 +1021,8 @@ int snd_pcm_close(snd_pcm_t *pcm)
 		snd_async_handler_t *h = list_entry(pcm->async_handlers.next, snd_async_handler_t, hlist);
 		snd_async_del_handler(h);
 	}
+	if (pcm->refine_key)
+		snd_pcm_refine_cache_sync();
 	err = pcm->ops->close(pcm->op_arg);
 	if (err < 0)
 		res = err;
@@ -926,6 +1188,7 @@ int snd_pcm_hw_free(snd_pcm_t *pcm)
 	//        snd_pcm_state(pcm) == SND_PCM_STATE_PREPARED);
 	err = pcm->ops->hw_free(pcm->op_arg);
 	pcm->setup = 0;
+	snapshot_invalidate(pcm);
 	if (err < 0)
 		return err;
 	return 0;
@@ -980,6 +1243,7 @@ int snd_pcm_sw_params(snd_pcm_t *pcm, snd_pcm_sw_params_t *params)
 	pcm->silence_threshold = params->silence_threshold;
 	pcm->silence_size = params->silence_size;
 	pcm->boundary = params->boundary;
+	snapshot_invalidate(pcm);
 	__snd_pcm_unlock(pcm);
 	return 0;
 }
@@ -999,6 +1263,10 @@ int snd_pcm_status(snd_pcm_t *pcm, snd_pcm_status_t *status)
 	assert(pcm && status);
 	snd_pcm_lock(pcm);
 	err = pcm->fast_ops->status(pcm->fast_op_arg, status);
+	if (err < 0)
+		snapshot_invalidate(pcm);
+	else
+		snapshot_status(pcm, status);
 	snd_pcm_unlock(pcm);
 
 	return err;
@@ -1086,6 +1354,7 @@ link_warning(snd_pcm_hwsync, "Warning: snd_pcm_hwsync() is deprecated, consider
  */
 int snd_pcm_delay(snd_pcm_t *pcm, snd_pcm_sframes_t *delayp)
 {
+	snd_pcm_snapshot_t snap;
 	int err;
 
 	assert(pcm);
@@ -1093,8 +1362,16 @@ int snd_pcm_delay(snd_pcm_t *pcm, snd_pcm_sframes_t *delayp)
 		SNDMSG("PCM not set up");
 		return -EIO;
 	}
-	snd_pcm_lock(pcm);
+	if (snapshot_lock(pcm, SND_PCM_SNAPSHOT_AVAIL | SND_PCM_SNAPSHOT_DELAY,
+			  &snap)) {
+		*delayp = snapshot_get_delay(pcm, &snap);
+		return 0;
+	}
 	err = __snd_pcm_delay(pcm, delayp);
+	if (err < 0)
+		snapshot_invalidate(pcm);
+	else
+		snapshot_delay(pcm, -1, *delayp);
 	snd_pcm_unlock(pcm);
 	return err;
 }
@@ -1120,6 +1397,9 @@ int snd_pcm_resume(snd_pcm_t *pcm)
 		SNDMSG("PCM not set up");
 		return -EIO;
 	}
+	snd_pcm_lock(pcm);
+	snapshot_invalidate(pcm);
+	snd_pcm_unlock(pcm);
 	/* lock handled in the callback */
 	return pcm->fast_ops->resume(pcm->fast_op_arg);
 }
@@ -1138,6 +1418,7 @@ int snd_pcm_resume(snd_pcm_t *pcm)
  */
 int snd_pcm_htimestamp(snd_pcm_t *pcm, snd_pcm_uframes_t *avail, snd_htimestamp_t *tstamp)
 {
+	snd_pcm_snapshot_t snap;
 	int err;
 
 	assert(pcm);
@@ -1145,8 +1426,16 @@ int snd_pcm_htimestamp(snd_pcm_t *pcm, snd_pcm_uframes_t *avail, snd_htimestamp_
 		SNDMSG("PCM not set up");
 		return -EIO;
 	}
-	snd_pcm_lock(pcm);
+	if (snapshot_lock(pcm, SND_PCM_SNAPSHOT_TSTAMP, &snap)) {
+		*avail = snap.tstamp_avail;
+		*tstamp = snap.tstamp;
+		return 0;
+	}
 	err = pcm->fast_ops->htimestamp(pcm->fast_op_arg, avail, tstamp);
+	if (err < 0)
+		snapshot_invalidate(pcm);
+	else
+		snapshot_tstamp(pcm, *avail, tstamp);
 	snd_pcm_unlock(pcm);
 	return err;
 }
@@ -1172,6 +1461,7 @@ int snd_pcm_prepare(snd_pcm_t *pcm)
 		return err;
 	snd_pcm_lock(pcm);
 	err = pcm->fast_ops->prepare(pcm->fast_op_arg);
+	snapshot_invalidate(pcm);
 	snd_pcm_unlock(pcm);
 	return err;
 }
@@ -1196,6 +1486,7 @@ int snd_pcm_reset(snd_pcm_t *pcm)
 	}
 	snd_pcm_lock(pcm);
 	err = pcm->fast_ops->reset(pcm->fast_op_arg);
+	snapshot_invalidate(pcm);
 	snd_pcm_unlock(pcm);
 	return err;
 }
@@ -1221,6 +1512,7 @@ int snd_pcm_start(snd_pcm_t *pcm)
 		return err;
 	snd_pcm_lock(pcm);
 	err = __snd_pcm_start(pcm);
+	snapshot_invalidate(pcm);
 	snd_pcm_unlock(pcm);
 	return err;
 }
@@ -1253,6 +1545,7 @@ int snd_pcm_drop(snd_pcm_t *pcm)
 		return err;
 	snd_pcm_lock(pcm);
 	err = pcm->fast_ops->drop(pcm->fast_op_arg);
+	snapshot_invalidate(pcm);
 	snd_pcm_unlock(pcm);
 	return err;
 }
@@ -1284,6 +1577,9 @@ int snd_pcm_drain(snd_pcm_t *pcm)
 	err = bad_pcm_state(pcm, P_STATE_RUNNABLE);
 	if (err < 0)
 		return err;
+	snd_pcm_lock(pcm);
+	snapshot_invalidate(pcm);
+	snd_pcm_unlock(pcm);
 	/* lock handled in the callback */
 	return pcm->fast_ops->drain(pcm->fast_op_arg);
 }
@@ -1314,6 +1610,7 @@ int snd_pcm_pause(snd_pcm_t *pcm, int enable)
 		return err;
 	snd_pcm_lock(pcm);
 	err = pcm->fast_ops->pause(pcm->fast_op_arg, enable);
+	snapshot_invalidate(pcm);
 	snd_pcm_unlock(pcm);
 	return err;
 }
@@ -1374,6 +1671,7 @@ snd_pcm_sframes_t snd_pcm_rewind(snd_pcm_t *pcm, snd_pcm_uframes_t frames)
 		return err;
 	snd_pcm_lock(pcm);
 	result = pcm->fast_ops->rewind(pcm->fast_op_arg, frames);
+	snapshot_invalidate(pcm);
 	snd_pcm_unlock(pcm);
 	return result;
 }
@@ -1438,6 +1736,7 @@ snd_pcm_sframes_t snd_pcm_forward(snd_pcm_t *pcm, snd_pcm_uframes_t frames)
 		return err;
 	snd_pcm_lock(pcm);
 	result = pcm->fast_ops->forward(pcm->fast_op_arg, frames);
+	snapshot_invalidate(pcm);
 	snd_pcm_unlock(pcm);
 	return result;
 }
@@ -2515,6 +2814,9 @@ static int snd_pcm_open_conf(snd_pcm_t **pcmp, const char *name,
 				snd_dlobj_cache_put(open_func);
 			} else {
 				(*pcmp)->open_func = open_func;
+				/* the cache is optional, ignore a failure */
+				snd_pcm_refine_cache_setup(*pcmp, name, pcm_root,
+							   pcm_conf, lib != NULL);
 			}
 			err = 0;
 		} else {
@@ -2539,6 +2841,9 @@ static int snd_pcm_open_conf(snd_pcm_t **pcmp, const char *name,
 		err = snd_config_search(pcm_root, "defaults.pcm.minperiodtime", &tmp);
 		if (err >= 0)
 			snd_config_get_integer(tmp, &(*pcmp)->minperiodtime);
+		err = snd_config_search(pcm_root, "defaults.pcm.stats", &tmp);
+		if (err >= 0 && snd_config_get_bool(tmp) > 0)
+			snd_pcm_stats_enable(*pcmp, 1);
 		err = 0;
 	}
        _err:
@@ -2683,7 +2988,29 @@ int snd_pcm_new(snd_pcm_t **pcmp, snd_pcm_type_t type, const char *name,
 		}
 		pcm->lock_enabled = do_lock_enable;
 	}
+	{
+		/* $LIBASOUND_PCM_SNAPSHOT, evaluated once like above */
+		static int do_snapshot = -1;
+
+		if (do_snapshot == -1) {
+			char *p = getenv("LIBASOUND_PCM_SNAPSHOT");
+			do_snapshot = !p || *p != '0';
+		}
+		pcm->use_snapshot = do_snapshot;
+	}
 #endif
+	{
+		/* $LIBASOUND_PCM_STATS, evaluated once like above */
+		static int do_stats = -1;
+
+		if (do_stats == -1) {
+			char *p = getenv("LIBASOUND_PCM_STATS");
+			do_stats = p && *p && *p != '0';
+		}
+		/* the accounting is optional, ignore a failure */
+		if (do_stats)
+			pcm->stats = calloc(1, sizeof(*pcm->stats));
+	}
 	*pcmp = pcm;
 	return 0;
 }
@@ -2695,6 +3022,7 @@ int snd_pcm_free(snd_pcm_t *pcm)
 	free(pcm->hw.link_dst);
 	free(pcm->appl.link_dst);
 	snd_dlobj_cache_put(pcm->open_func);
+	free(pcm->stats);
 #ifdef THREAD_SAFE_API
 	pthread_mutex_destroy(&pcm->lock);
 #endif
@@ -2846,6 +3174,7 @@ snd_pcm_sframes_t snd_pcm_avail_update(snd_pcm_t *pcm)
 
 	snd_pcm_lock(pcm);
 	result = __snd_pcm_avail_update(pcm);
+	snapshot_avail(pcm, result);
 	snd_pcm_unlock(pcm);
 	return result;
 }
@@ -2868,18 +3197,21 @@ snd_pcm_sframes_t snd_pcm_avail(snd_pcm_t *pcm)
 {
 	int err;
 	snd_pcm_sframes_t result;
+	snd_pcm_snapshot_t snap;
 
 	assert(pcm);
 	if (CHECK_SANITY(! pcm->setup)) {
 		SNDMSG("PCM not set up");
 		return -EIO;
 	}
-	snd_pcm_lock(pcm);
+	if (snapshot_lock(pcm, SND_PCM_SNAPSHOT_AVAIL, &snap))
+		return snap.avail;
 	err = __snd_pcm_hwsync(pcm);
 	if (err < 0)
 		result = err;
 	else
 		result = __snd_pcm_avail_update(pcm);
+	snapshot_avail(pcm, result);
 	snd_pcm_unlock(pcm);
 	return result;
 }
@@ -2900,6 +3232,7 @@ int snd_pcm_avail_delay(snd_pcm_t *pcm,
 			snd_pcm_sframes_t *delayp)
 {
 	snd_pcm_sframes_t sf;
+	snd_pcm_snapshot_t snap;
 	int err;
 
 	assert(pcm && availp && delayp);
@@ -2907,7 +3240,12 @@ int snd_pcm_avail_delay(snd_pcm_t *pcm,
 		SNDMSG("PCM not set up");
 		return -EIO;
 	}
-	snd_pcm_lock(pcm);
+	if (snapshot_lock(pcm, SND_PCM_SNAPSHOT_AVAIL | SND_PCM_SNAPSHOT_DELAY,
+			  &snap)) {
+		*availp = snap.avail;
+		*delayp = snapshot_get_delay(pcm, &snap);
+		return 0;
+	}
 	err = __snd_pcm_hwsync(pcm);
 	if (err < 0)
 		goto unlock;
@@ -2921,7 +3259,10 @@ int snd_pcm_avail_delay(snd_pcm_t *pcm,
 		goto unlock;
 	*availp = sf;
 	err = 0;
+	snapshot_delay(pcm, sf, *delayp);
  unlock:
+	if (err < 0)
+		snapshot_invalidate(pcm);
 	snd_pcm_unlock(pcm);
 	return err;
 }
@@ -2947,22 +3288,10 @@ int snd_pcm_area_silence(const snd_pcm_channel_area_t *dst_area, snd_pcm_uframes
 	dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
 	width = snd_pcm_format_physical_width(format);
 	silence = snd_pcm_format_silence_64(format);
-        /*
-         * Iterate copying silent sample for sample data aligned to 64 bit.
-         * This is a fast path.
-         */
-        if (dst_area->step == (unsigned int) width &&
-            width != 24 &&
-            ((intptr_t)dst & 7) == 0) {
-		unsigned int dwords = samples * width / 64;
-		uint64_t *dstp = (uint64_t *)dst;
-		samples -= dwords * 64 / width;
-		while (dwords-- > 0)
-			*dstp++ = silence;
-		if (samples == 0)
-			return 0;
-		dst = (char *)dstp;
-	}
+	/* contiguous samples are filled with wide stores */
+	if (dst_area->step == (unsigned int) width && width % 8 == 0 &&
+	    dst_area->first % 8 == 0)
+		return snd_pcm_format_set_silence(format, dst, samples);
 	dst_step = dst_area->step / 8;
 	switch (width) {
 	case 4: {
@@ -3210,6 +3539,154 @@ int snd_pcm_area_copy(const snd_pcm_channel_area_t *dst_area, snd_pcm_uframes_t
 	return 0;
 }
 
+#ifndef DOC_HIDDEN
+static const areas_simd_kernel_t *areas_simd_kernel(void)
+{
+	static const areas_simd_kernel_t *kernel;
+	static int probed;
+	const areas_simd_kernel_t *k;
+
+	if (!probed) {
+		for (k = areas_simd_kernels; k->name; k++) {
+			if (k->available()) {
+				kernel = k;
+				break;
+			}
+		}
+		probed = 1;
+	}
+	return kernel;
+}
+
+/* number of channels from areas[0] on which are adjacent in one frame */
+static unsigned int areas_run(const snd_pcm_channel_area_t *areas,
+			      unsigned int channels, unsigned int width)
+{
+	unsigned int chn;
+
+	for (chn = 1; chn < channels; chn++) {
+		if (areas[chn].addr != areas[0].addr ||
+		    areas[chn].step != areas[0].step ||
+		    areas[chn].first != areas[chn - 1].first + width)
+			break;
+	}
+	return chn;
+}
+
+/* number of channels from areas[0] on which are contiguous on their own */
+static unsigned int areas_planar(const snd_pcm_channel_area_t *areas,
+				 unsigned int channels, unsigned int width)
+{
+	unsigned int chn;
+
+	for (chn = 0; chn < channels; chn++) {
+		if (!areas[chn].addr || areas[chn].step != width ||
+		    areas[chn].first % 8)
+			break;
+	}
+	return chn;
+}
+
+static int area_bytes(const snd_pcm_channel_area_t *area)
+{
+	return area->addr && area->first % 8 == 0 && area->step % 8 == 0;
+}
+
+/*
+ * copy the channels from the given areas on with one pass over the
+ * frames when they are interleaved on one side at least, returns the
+ * number of channels copied or 0 to leave them to the generic code
+ */
+static unsigned int areas_copy_fast(const snd_pcm_channel_area_t *dst_areas,
+				    snd_pcm_uframes_t dst_offset,
+				    const snd_pcm_channel_area_t *src_areas,
+				    snd_pcm_uframes_t src_offset,
+				    unsigned int channels, snd_pcm_uframes_t frames,
+				    unsigned int width)
+{
+	const areas_simd_kernel_t *k;
+	const char *srcs[AREAS_SIMD_MAX_CHANNELS];
+	char *dsts[AREAS_SIMD_MAX_CHANNELS];
+	unsigned int dst_run, src_run, chns, chn, done = 0;
+	size_t bytes = width / 8;
+	size_t dst_step = dst_areas->step / 8, src_step = src_areas->step / 8;
+	const char *src;
+	char *dst;
+
+	if (width % 8 || channels < 2)
+		return 0;
+	dst_run = areas_run(dst_areas, channels, width);
+	src_run = areas_run(src_areas, channels, width);
+
+	if (dst_run > 1 && src_run > 1) {
+		/* interleaved to interleaved */
+		chns = dst_run < src_run ? dst_run : src_run;
+		if (src_areas->step == dst_areas->step &&
+		    chns * width == src_areas->step)
+			return 0;	/* whole frames, one memcpy */
+		if (!area_bytes(dst_areas) || !area_bytes(src_areas))
+			return 0;
+		dst = snd_pcm_channel_area_addr(dst_areas, dst_offset);
+		src = snd_pcm_channel_area_addr(src_areas, src_offset);
+		if (dst != src || dst_step != src_step)
+			areas_copy_frames(dst, dst_step, src, src_step,
+					  chns * bytes, frames);
+		return chns;
+	}
+
+	if (dst_run > 1) {
+		/* planar to interleaved */
+		if (dst_run > AREAS_SIMD_MAX_CHANNELS)
+			dst_run = AREAS_SIMD_MAX_CHANNELS;
+		chns = areas_planar(src_areas, dst_run, width);
+		if (chns < 2 || !area_bytes(dst_areas))
+			return 0;
+		dst = snd_pcm_channel_area_addr(dst_areas, dst_offset);
+		for (chn = 0; chn < chns; chn++)
+			srcs[chn] = snd_pcm_channel_area_addr(&src_areas[chn],
+							      src_offset);
+		k = areas_simd_kernel();
+		if (k && chns == 2 && dst_step == 2 * bytes) {
+			if (width == 16)
+				done = k->interleave_16(frames, dst, srcs[0], srcs[1]);
+			else if (width == 32)
+				done = k->interleave_32(frames, dst, srcs[0], srcs[1]);
+			for (chn = 0; chn < chns; chn++)
+				srcs[chn] += done * bytes;
+		}
+		areas_interleave(dst + done * dst_step, dst_step, srcs, chns,
+				 bytes, frames - done);
+		return chns;
+	}
+
+	if (src_run > 1) {
+		/* interleaved to planar */
+		if (src_run > AREAS_SIMD_MAX_CHANNELS)
+			src_run = AREAS_SIMD_MAX_CHANNELS;
+		chns = areas_planar(dst_areas, src_run, width);
+		if (chns < 2 || !area_bytes(src_areas))
+			return 0;
+		src = snd_pcm_channel_area_addr(src_areas, src_offset);
+		for (chn = 0; chn < chns; chn++)
+			dsts[chn] = snd_pcm_channel_area_addr(&dst_areas[chn],
+							      dst_offset);
+		k = areas_simd_kernel();
+		if (k && chns == 2 && src_step == 2 * bytes) {
+			if (width == 16)
+				done = k->deinterleave_16(frames, dsts[0], dsts[1], src);
+			else if (width == 32)
+				done = k->deinterleave_32(frames, dsts[0], dsts[1], src);
+			for (chn = 0; chn < chns; chn++)
+				dsts[chn] += done * bytes;
+		}
+		areas_deinterleave(dsts, src + done * src_step, src_step, chns,
+				   bytes, frames - done);
+		return chns;
+	}
+	return 0;
+}
+#endif /* DOC_HIDDEN */
+
 /**
  * \brief Copy one or more areas
  * \param dst_areas destination areas specification (one for each channel)
@@ -3243,7 +3720,16 @@ int snd_pcm_areas_copy(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_
 		void *dst_addr = dst_areas->addr;
 		const snd_pcm_channel_area_t *dst_start = dst_areas;
 		int channels1 = channels;
-		unsigned int chns = 0;
+		unsigned int chns;
+
+		chns = areas_copy_fast(dst_areas, dst_offset, src_areas,
+				       src_offset, channels, frames, width);
+		if (chns) {
+			src_areas += chns;
+			dst_areas += chns;
+			channels -= chns;
+			continue;
+		}
 		while (dst_areas->step == step) {
 			channels1--;
 			chns++;
@@ -7162,6 +7648,7 @@ snd_pcm_sframes_t snd_pcm_mmap_commit(snd_pcm_t *pcm,
 		return err;
 	snd_pcm_lock(pcm);
 	result = __snd_pcm_mmap_commit(pcm, offset, frames);
+	snapshot_commit(pcm, result);
 	snd_pcm_unlock(pcm);
 	return result;
 }
@@ -7172,6 +7659,9 @@ snd_pcm_sframes_t __snd_pcm_mmap_commit(snd_pcm_t *pcm,
 					snd_pcm_uframes_t offset,
 					snd_pcm_uframes_t frames)
 {
+	snd_htimestamp_t start;
+	snd_pcm_sframes_t result;
+
 	assert(pcm);
 	if (CHECK_SANITY(offset != *pcm->appl.ptr % pcm->buffer_size)) {
 		SNDMSG("commit offset (%ld) doesn't match with appl_ptr (%ld) %% buf_size (%ld)",
@@ -7183,7 +7673,10 @@ snd_pcm_sframes_t __snd_pcm_mmap_commit(snd_pcm_t *pcm,
 		       snd_pcm_mmap_avail(pcm));
 		return -EPIPE;
 	}
-	return pcm->fast_ops->mmap_commit(pcm->fast_op_arg, offset, frames);
+	snd_pcm_stats_begin(pcm, &start);
+	result = pcm->fast_ops->mmap_commit(pcm->fast_op_arg, offset, frames);
+	snd_pcm_stats_end(pcm, SND_PCM_STATS_MMAP_COMMIT, &start, 0, 0);
+	return result;
 }
 
 int _snd_pcm_poll_descriptor(snd_pcm_t *pcm)
@@ -7262,6 +7755,7 @@ snd_pcm_sframes_t snd_pcm_read_areas(snd_pcm_t *pcm, const snd_pcm_channel_area_
 			goto _end;
 		}
 		avail = __snd_pcm_avail_update(pcm);
+		snapshot_avail(pcm, avail);
 		if (avail < 0) {
 			err = avail;
 			goto _end;
@@ -7286,6 +7780,7 @@ snd_pcm_sframes_t snd_pcm_read_areas(snd_pcm_t *pcm, const snd_pcm_channel_area_
 		if (! frames)
 			break;
 		err = func(pcm, areas, offset, frames);
+		snapshot_commit(pcm, err);
 		if (err < 0)
 			break;
 		frames = err;
@@ -7294,6 +7789,8 @@ snd_pcm_sframes_t snd_pcm_read_areas(snd_pcm_t *pcm, const snd_pcm_channel_area_
 		xfer += frames;
 	}
  _end:
+	if (err < 0 && err != -EAGAIN)
+		snapshot_invalidate(pcm);
 	__snd_pcm_unlock(pcm);
 	return xfer > 0 ? (snd_pcm_sframes_t) xfer : snd_pcm_check_error(pcm, err);
 }
@@ -7331,6 +7828,7 @@ snd_pcm_sframes_t snd_pcm_write_areas(snd_pcm_t *pcm, const snd_pcm_channel_area
 			goto _end;
 		}
 		avail = __snd_pcm_avail_update(pcm);
+		snapshot_avail(pcm, avail);
 		if (avail < 0) {
 			err = avail;
 			goto _end;
@@ -7354,6 +7852,7 @@ snd_pcm_sframes_t snd_pcm_write_areas(snd_pcm_t *pcm, const snd_pcm_channel_area
 		if (! frames)
 			break;
 		err = func(pcm, areas, offset, frames);
+		snapshot_commit(pcm, err);
 		if (err < 0)
 			break;
 		frames = err;
@@ -7374,6 +7873,8 @@ snd_pcm_sframes_t snd_pcm_write_areas(snd_pcm_t *pcm, const snd_pcm_channel_area
 		xfer += frames;
 	}
  _end:
+	if (err < 0 && err != -EAGAIN)
+		snapshot_invalidate(pcm);
 	__snd_pcm_unlock(pcm);
 	return xfer > 0 ? (snd_pcm_sframes_t) xfer : snd_pcm_check_error(pcm, err);
 }
@@ -0,0 +1,318 @@
+/*
+ *  PCM Interface - kernels for copying areas
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * The layouts snd_pcm_areas_copy() meets most: a run of channels which
+ * are adjacent in both buffers but with different frame sizes
+ * (interleaved to interleaved), planar channels into adjacent ones
+ * (planar to interleaved) and back (interleaved to planar).  The
+ * generic path copies such layouts channel by channel, sample by
+ * sample; these kernels walk the frames once.
+ *
+ * The scalar versions handle 1 to 8 byte samples.  The vector kernels
+ * cover stereo 16 and 32 bit samples and return the number of frames
+ * they processed, the caller finishes the tail with the scalar version.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+/* samples per frame handled by the scalar interleave kernels */
+#define AREAS_SIMD_MAX_CHANNELS	32
+
+/*
+ * scalar versions
+ */
+
+/* copy bytes from each src frame to each dst frame */
+static void areas_copy_frames(char *dst, size_t dst_step,
+			      const char *src, size_t src_step,
+			      size_t bytes, snd_pcm_uframes_t frames)
+{
+	/* constant sizes become plain moves */
+#define COPY_FRAMES(n) \
+	for (; frames > 0; frames--, dst += dst_step, src += src_step) \
+		memcpy(dst, src, n)
+	switch (bytes) {
+	case 2: COPY_FRAMES(2); break;
+	case 3: COPY_FRAMES(3); break;
+	case 4: COPY_FRAMES(4); break;
+	case 6: COPY_FRAMES(6); break;
+	case 8: COPY_FRAMES(8); break;
+	case 12: COPY_FRAMES(12); break;
+	case 16: COPY_FRAMES(16); break;
+	case 24: COPY_FRAMES(24); break;
+	case 32: COPY_FRAMES(32); break;
+	default: COPY_FRAMES(bytes); break;
+	}
+#undef COPY_FRAMES
+}
+
+/* planar channels into adjacent samples of each dst frame */
+static void areas_interleave(char *dst, size_t dst_step,
+			     const char *const *src, unsigned int channels,
+			     size_t bytes, snd_pcm_uframes_t frames)
+{
+	snd_pcm_uframes_t n;
+	unsigned int chn;
+
+#define INTERLEAVE(b) \
+	for (n = 0; n < frames; n++, dst += dst_step) \
+		for (chn = 0; chn < channels; chn++) \
+			memcpy(dst + chn * (b), src[chn] + n * (b), b)
+	switch (bytes) {
+	case 1: INTERLEAVE(1); break;
+	case 2: INTERLEAVE(2); break;
+	case 3: INTERLEAVE(3); break;
+	case 4: INTERLEAVE(4); break;
+	default: INTERLEAVE(bytes); break;
+	}
+#undef INTERLEAVE
+}
+
+/* adjacent samples of each src frame into planar channels */
+static void areas_deinterleave(char *const *dst, const char *src,
+			       size_t src_step, unsigned int channels,
+			       size_t bytes, snd_pcm_uframes_t frames)
+{
+	snd_pcm_uframes_t n;
+	unsigned int chn;
+
+#define DEINTERLEAVE(b) \
+	for (n = 0; n < frames; n++, src += src_step) \
+		for (chn = 0; chn < channels; chn++) \
+			memcpy(dst[chn] + n * (b), src + chn * (b), b)
+	switch (bytes) {
+	case 1: DEINTERLEAVE(1); break;
+	case 2: DEINTERLEAVE(2); break;
+	case 3: DEINTERLEAVE(3); break;
+	case 4: DEINTERLEAVE(4); break;
+	default: DEINTERLEAVE(bytes); break;
+	}
+#undef DEINTERLEAVE
+}
+
+/*
+ * vector kernels for two channels into packed stereo frames and back
+ */
+typedef unsigned int (areas_simd_interleave_t)(unsigned int frames, void *dst,
+					       const void *src0,
+					       const void *src1);
+typedef unsigned int (areas_simd_deinterleave_t)(unsigned int frames,
+						 void *dst0, void *dst1,
+						 const void *src);
+
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+#if defined(__x86_64__) || defined(__i386__)
+#define AREAS_SIMD_X86
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#define AREAS_SIMD_NEON
+#endif
+#endif
+
+#ifdef AREAS_SIMD_X86
+#include <immintrin.h>
+
+#define AREAS_SIMD_TARGET(isa)	__attribute__((target(isa)))
+
+static AREAS_SIMD_TARGET("sse2")
+unsigned int areas_sse2_interleave_16(unsigned int frames, void *dst,
+				      const void *src0, const void *src1)
+{
+	const int16_t *l = src0, *r = src1;
+	int16_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 8 <= frames; n += 8, d += 16) {
+		__m128i vl = _mm_loadu_si128((const __m128i *)(l + n));
+		__m128i vr = _mm_loadu_si128((const __m128i *)(r + n));
+
+		_mm_storeu_si128((__m128i *)d, _mm_unpacklo_epi16(vl, vr));
+		_mm_storeu_si128((__m128i *)(d + 8), _mm_unpackhi_epi16(vl, vr));
+	}
+	return n;
+}
+
+static AREAS_SIMD_TARGET("sse2")
+unsigned int areas_sse2_interleave_32(unsigned int frames, void *dst,
+				      const void *src0, const void *src1)
+{
+	const int32_t *l = src0, *r = src1;
+	int32_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 4 <= frames; n += 4, d += 8) {
+		__m128i vl = _mm_loadu_si128((const __m128i *)(l + n));
+		__m128i vr = _mm_loadu_si128((const __m128i *)(r + n));
+
+		_mm_storeu_si128((__m128i *)d, _mm_unpacklo_epi32(vl, vr));
+		_mm_storeu_si128((__m128i *)(d + 4), _mm_unpackhi_epi32(vl, vr));
+	}
+	return n;
+}
+
+static AREAS_SIMD_TARGET("sse2")
+unsigned int areas_sse2_deinterleave_16(unsigned int frames, void *dst0,
+					void *dst1, const void *src)
+{
+	const int16_t *s = src;
+	int16_t *l = dst0, *r = dst1;
+	unsigned int n;
+
+	for (n = 0; n + 8 <= frames; n += 8, s += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)s);
+		__m128i b = _mm_loadu_si128((const __m128i *)(s + 8));
+
+		/* sign extended halves pack back without saturating */
+		_mm_storeu_si128((__m128i *)(l + n),
+				 _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+						 _mm_srai_epi32(_mm_slli_epi32(b, 16), 16)));
+		_mm_storeu_si128((__m128i *)(r + n),
+				 _mm_packs_epi32(_mm_srai_epi32(a, 16),
+						 _mm_srai_epi32(b, 16)));
+	}
+	return n;
+}
+
+static AREAS_SIMD_TARGET("sse2")
+unsigned int areas_sse2_deinterleave_32(unsigned int frames, void *dst0,
+					void *dst1, const void *src)
+{
+	const int32_t *s = src;
+	int32_t *l = dst0, *r = dst1;
+	unsigned int n;
+
+	for (n = 0; n + 4 <= frames; n += 4, s += 8) {
+		__m128 a = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)s));
+		__m128 b = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(s + 4)));
+
+		_mm_storeu_si128((__m128i *)(l + n),
+				 _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))));
+		_mm_storeu_si128((__m128i *)(r + n),
+				 _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+	}
+	return n;
+}
+
+static int areas_simd_have_sse2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+}
+
+#endif /* AREAS_SIMD_X86 */
+
+#ifdef AREAS_SIMD_NEON
+#include <arm_neon.h>
+
+static unsigned int areas_neon_interleave_16(unsigned int frames, void *dst,
+					     const void *src0, const void *src1)
+{
+	const uint16_t *l = src0, *r = src1;
+	uint16_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 8 <= frames; n += 8, d += 16) {
+		uint16x8x2_t v = { { vld1q_u16(l + n), vld1q_u16(r + n) } };
+
+		vst2q_u16(d, v);
+	}
+	return n;
+}
+
+static unsigned int areas_neon_interleave_32(unsigned int frames, void *dst,
+					     const void *src0, const void *src1)
+{
+	const uint32_t *l = src0, *r = src1;
+	uint32_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 4 <= frames; n += 4, d += 8) {
+		uint32x4x2_t v = { { vld1q_u32(l + n), vld1q_u32(r + n) } };
+
+		vst2q_u32(d, v);
+	}
+	return n;
+}
+
+static unsigned int areas_neon_deinterleave_16(unsigned int frames, void *dst0,
+					       void *dst1, const void *src)
+{
+	const uint16_t *s = src;
+	uint16_t *l = dst0, *r = dst1;
+	unsigned int n;
+
+	for (n = 0; n + 8 <= frames; n += 8, s += 16) {
+		uint16x8x2_t v = vld2q_u16(s);
+
+		vst1q_u16(l + n, v.val[0]);
+		vst1q_u16(r + n, v.val[1]);
+	}
+	return n;
+}
+
+static unsigned int areas_neon_deinterleave_32(unsigned int frames, void *dst0,
+					       void *dst1, const void *src)
+{
+	const uint32_t *s = src;
+	uint32_t *l = dst0, *r = dst1;
+	unsigned int n;
+
+	for (n = 0; n + 4 <= frames; n += 4, s += 8) {
+		uint32x4x2_t v = vld2q_u32(s);
+
+		vst1q_u32(l + n, v.val[0]);
+		vst1q_u32(r + n, v.val[1]);
+	}
+	return n;
+}
+
+static int areas_simd_have_neon(void)
+{
+	return 1;
+}
+
+#endif /* AREAS_SIMD_NEON */
+
+/*
+ * kernel table, ordered by preference
+ */
+typedef struct {
+	const char *name;
+	int (*available)(void);
+	areas_simd_interleave_t *interleave_16;
+	areas_simd_interleave_t *interleave_32;
+	areas_simd_deinterleave_t *deinterleave_16;
+	areas_simd_deinterleave_t *deinterleave_32;
+} areas_simd_kernel_t;
+
+static const areas_simd_kernel_t areas_simd_kernels[] = {
+#ifdef AREAS_SIMD_X86
+	{ "sse2", areas_simd_have_sse2,
+	  areas_sse2_interleave_16, areas_sse2_interleave_32,
+	  areas_sse2_deinterleave_16, areas_sse2_deinterleave_32 },
+#endif
+#ifdef AREAS_SIMD_NEON
+	{ "neon", areas_simd_have_neon,
+	  areas_neon_interleave_16, areas_neon_interleave_32,
+	  areas_neon_deinterleave_16, areas_neon_deinterleave_32 },
+#endif
+	{ NULL, NULL, NULL, NULL, NULL, NULL }
+};
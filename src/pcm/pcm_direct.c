@@ -19,6 +19,7 @@
  *
  */
   
+#include "config.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
@@ -51,11 +52,6 @@ union semun {
 	struct seminfo  *__buf;  /* Buffer for IPC_INFO (Linux specific) */
 };
  
-/*
- * FIXME:
- *  add possibility to use futexes here
- */
-
 int snd_pcm_direct_semaphore_create_or_connect(snd_pcm_direct_t *dmix)
 {
 	union semun s;
@@ -133,6 +129,16 @@ retryget:
 			shmctl(dmix->shmid, IPC_SET, &buf);
 		}
 		dmix->shmptr->magic = SND_PCM_DIRECT_MAGIC;
+		/* the later clients follow the lock of the first one */
+		dmix->shmptr->lock.type = dmix->ipc_lock;
+		dmix->lock_futex = dmix->ipc_lock == SND_PCM_DIRECT_LOCK_FUTEX;
+		if (dmix->lock_futex) {
+			err = direct_futex_init(&dmix->shmptr->lock.futex);
+			if (err < 0) {
+				snd_pcm_direct_shm_discard(dmix);
+				return err;
+			}
+		}
 		return 1;
 	} else {
 		if (dmix->shmptr->magic != SND_PCM_DIRECT_MAGIC) {
@@ -140,6 +146,94 @@ retryget:
 			return -EINVAL;
 		}
 	}
+	dmix->lock_futex = dmix->shmptr->lock.type == SND_PCM_DIRECT_LOCK_FUTEX;
+	if (dmix->lock_futex && direct_futex_check(&dmix->shmptr->lock.futex) < 0) {
+		SNDERR("the futex lock of this instance needs clients of the same ABI");
+		snd_pcm_direct_shm_discard(dmix);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/*
+ *  memfd backed buffers, passed to the clients by the server
+ */
+
+#ifdef HAVE_MEMFD_CREATE
+static int memfd_hugetlb(const char *name, size_t size)
+{
+#ifdef MFD_HUGETLB
+	struct stat st;
+	int fd;
+
+	fd = memfd_create(name, MFD_CLOEXEC | MFD_HUGETLB);
+	if (fd < 0)
+		return -errno;
+	/* st_blksize is the huge page size, allocate the pages now so a
+	 * missing reservation fails here and not at the first access
+	 */
+	if (fstat(fd, &st) < 0 || st.st_blksize <= 0)
+		goto _err;
+	size = (size + st.st_blksize - 1) / st.st_blksize * st.st_blksize;
+	if (ftruncate(fd, size) < 0 || fallocate(fd, 0, 0, size) < 0)
+		goto _err;
+	return fd;
+ _err:
+	close(fd);
+	return -ENOMEM;
+#else
+	return -ENOSYS;
+#endif
+}
+#endif
+
+/*
+ * create a memfd for a shared buffer, with ipc_hugepages try the hugetlb
+ * pages first and fall back to normal pages
+ */
+int snd_pcm_direct_memfd_create(snd_pcm_direct_t *dmix, const char *name, size_t size)
+{
+#ifdef HAVE_MEMFD_CREATE
+	int fd, err;
+
+	if (dmix->ipc_hugepages) {
+		fd = memfd_hugetlb(name, size);
+		if (fd >= 0)
+			return fd;
+		SNDMSG("no huge pages for %s, using normal pages", name);
+	}
+	fd = memfd_create(name, MFD_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	if (ftruncate(fd, size) < 0) {
+		err = -errno;
+		close(fd);
+		return err;
+	}
+	return fd;
+#else
+	return -ENOSYS;
+#endif
+}
+
+/* map a whole memfd buffer */
+int snd_pcm_direct_memfd_map(int fd, void **ptr, size_t *size)
+{
+	struct stat st;
+	void *p;
+
+	if (fstat(fd, &st) < 0)
+		return -errno;
+	p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		return -errno;
+#ifdef MADV_HUGEPAGE
+	/* transparent huge pages, when the kernel allows them on shmem */
+	madvise(p, st.st_size, MADV_HUGEPAGE);
+#endif
+	mlock(p, st.st_size);
+	*ptr = p;
+	*size = st.st_size;
 	return 0;
 }
 
@@ -328,7 +422,8 @@ static void server_job(snd_pcm_direct_t *dmix)
 #else
 	while (--i >= 0) {
 #endif
-		if (i != dmix->server_fd && i != dmix->hw_fd)
+		if (i != dmix->server_fd && i != dmix->hw_fd &&
+		    (!dmix->shmptr->use_memfd || i != dmix->buffer_fd))
 			close(i);
 	}
 	
@@ -374,6 +469,10 @@ static void server_job(snd_pcm_direct_t *dmix)
 					pfds[current+1].fd = sck;
 					pfds[current+1].events = POLLIN | POLLERR | POLLHUP;
 					_snd_send_fd(sck, &buf, 1, dmix->hw_fd);
+					if (dmix->shmptr->use_memfd) {
+						buf = 'M';
+						_snd_send_fd(sck, &buf, 1, dmix->buffer_fd);
+					}
 					server_printf("DIRECT SERVER: fd sent ok\n");
 					current++;
 				}
@@ -484,6 +583,20 @@ int snd_pcm_direct_client_connect(snd_pcm_direct_t *dmix)
 		dmix->comm_fd = -1;
 		return ret;
 	}
+	if (dmix->shmptr->use_memfd) {
+		ret = snd_receive_fd(dmix->comm_fd, &buf, 1, &dmix->buffer_fd);
+		if (ret < 1 || buf != 'M' || dmix->buffer_fd < 0) {
+			close(dmix->hw_fd);
+			close(dmix->comm_fd);
+			dmix->comm_fd = -1;
+			return ret < 0 ? ret : -EINVAL;
+		}
+		/* the slave is opened as usual */
+		if (!dmix->shmptr->use_server) {
+			close(dmix->hw_fd);
+			dmix->hw_fd = -1;
+		}
+	}
 
 	dmix->client = 1;
 	return 0;
@@ -566,8 +679,7 @@ int snd_pcm_direct_slave_recover(snd_pcm_direct_t *direct)
 	int ret;
 	int semerr;
 
-	semerr = snd_pcm_direct_semaphore_down(direct,
-						   DIRECT_IPC_SEM_CLIENT);
+	semerr = snd_pcm_direct_lock(direct);
 	if (semerr < 0) {
 		SNDERR("SEMDOWN FAILED with err %d", semerr);
 		return semerr;
@@ -575,8 +687,7 @@ int snd_pcm_direct_slave_recover(snd_pcm_direct_t *direct)
 
 	if (snd_pcm_state(direct->spcm) != SND_PCM_STATE_XRUN) {
 		/* ignore... someone else already did recovery */
-		semerr = snd_pcm_direct_semaphore_up(direct,
-						     DIRECT_IPC_SEM_CLIENT);
+		semerr = snd_pcm_direct_unlock(direct);
 		if (semerr < 0) {
 			SNDERR("SEMUP FAILED with err %d", semerr);
 			return semerr;
@@ -587,8 +698,7 @@ int snd_pcm_direct_slave_recover(snd_pcm_direct_t *direct)
 	ret = snd_pcm_prepare(direct->spcm);
 	if (ret < 0) {
 		SNDERR("recover: unable to prepare slave");
-		semerr = snd_pcm_direct_semaphore_up(direct,
-						     DIRECT_IPC_SEM_CLIENT);
+		semerr = snd_pcm_direct_unlock(direct);
 		if (semerr < 0) {
 			SNDERR("SEMUP FAILED with err %d", semerr);
 			return semerr;
@@ -607,8 +717,7 @@ int snd_pcm_direct_slave_recover(snd_pcm_direct_t *direct)
 	ret = snd_pcm_start(direct->spcm);
 	if (ret < 0) {
 		SNDERR("recover: unable to start slave");
-		semerr = snd_pcm_direct_semaphore_up(direct,
-						     DIRECT_IPC_SEM_CLIENT);
+		semerr = snd_pcm_direct_unlock(direct);
 		if (semerr < 0) {
 			SNDERR("SEMUP FAILED with err %d", semerr);
 			return semerr;
@@ -616,8 +725,7 @@ int snd_pcm_direct_slave_recover(snd_pcm_direct_t *direct)
 		return ret;
 	}
 	direct->shmptr->s.recoveries++;
-	semerr = snd_pcm_direct_semaphore_up(direct,
-						 DIRECT_IPC_SEM_CLIENT);
+	semerr = snd_pcm_direct_unlock(direct);
 	if (semerr < 0) {
 		SNDERR("SEMUP FAILED with err %d", semerr);
 		return semerr;
@@ -868,12 +976,18 @@ int snd_pcm_direct_hw_refine(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 			params->cmask |= 1<<SND_PCM_HW_PARAM_ACCESS;
 	}
 	if (params->rmask & (1<<SND_PCM_HW_PARAM_FORMAT)) {
+		snd_pcm_format_t format = dshare->shmptr->hw.format;
+
 		if (snd_mask_empty(hw_param_mask(params, SND_PCM_HW_PARAM_FORMAT))) {
 			SNDERR("dshare format mask empty?");
 			return -EINVAL;
 		}
+		/* dsnoop converts to the client format itself */
+		if (dshare->type == SND_PCM_TYPE_DSNOOP &&
+		    dshare->u.dsnoop.format != SND_PCM_FORMAT_UNKNOWN)
+			format = dshare->u.dsnoop.format;
 		if (snd_mask_refine_set(hw_param_mask(params, SND_PCM_HW_PARAM_FORMAT),
-					dshare->shmptr->hw.format))
+					format))
 			params->cmask |= 1<<SND_PCM_HW_PARAM_FORMAT;
 	}
 	//snd_mask_none(hw_param_mask(params, SND_PCM_HW_PARAM_SUBFORMAT));
@@ -982,6 +1096,10 @@ int snd_pcm_direct_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 	params->rate_den = 1;
 	params->fifo_size = 0;
 	params->msbits = dmix->shmptr->s.msbits;
+	if (dmix->type == SND_PCM_TYPE_DSNOOP &&
+	    dmix->u.dsnoop.format != SND_PCM_FORMAT_UNKNOWN &&
+	    snd_pcm_format_width(dmix->u.dsnoop.format) < (int)params->msbits)
+		params->msbits = snd_pcm_format_width(dmix->u.dsnoop.format);
 	return 0;
 }
 
@@ -1030,6 +1148,12 @@ int snd_pcm_direct_set_chmap(snd_pcm_t *pcm, const snd_pcm_chmap_t *map)
 	return snd_pcm_set_chmap(dmix->spcm, map);
 }
 
+snd_pcm_t *snd_pcm_direct_get_slave(snd_pcm_t *pcm)
+{
+	snd_pcm_direct_t *dmix = pcm->private_data;
+	return dmix->spcm;
+}
+
 int snd_pcm_direct_prepare(snd_pcm_t *pcm)
 {
 	snd_pcm_direct_t *dmix = pcm->private_data;
@@ -1062,7 +1186,7 @@ int snd_pcm_direct_resume(snd_pcm_t *pcm)
 	snd_pcm_direct_t *dmix = pcm->private_data;
 	snd_pcm_t *spcm = dmix->spcm;
 
-	snd_pcm_direct_semaphore_down(dmix, DIRECT_IPC_SEM_CLIENT);
+	snd_pcm_direct_lock(dmix);
 	/* some buggy drivers require the device resumed before prepared;
 	 * when a device has RESUME flag and is in SUSPENDED state, resume
 	 * here but immediately drop to bring it to a sane active state.
@@ -1079,7 +1203,7 @@ int snd_pcm_direct_resume(snd_pcm_t *pcm)
 		snd_pcm_prepare(spcm);
 		snd_pcm_start(spcm);
 	}
-	snd_pcm_direct_semaphore_up(dmix, DIRECT_IPC_SEM_CLIENT);
+	snd_pcm_direct_unlock(dmix);
 	return -ENOSYS;
 }
 
@@ -1873,10 +1997,15 @@ int snd_pcm_direct_parse_open_conf(snd_config_t *root, snd_config_t *conf,
 	rec->ipc_key = 0;
 	rec->ipc_perm = 0600;
 	rec->ipc_gid = -1;
+	rec->ipc_lock = SND_PCM_DIRECT_LOCK_SEM;
+	rec->ipc_memfd = 0;
+	rec->ipc_hugepages = 0;
 	rec->slowptr = 1;
 	rec->max_periods = 0;
 	rec->var_periodsize = 0;
 	rec->direct_memory_access = 1;
+	rec->staged = 0;
+	rec->format = SND_PCM_FORMAT_UNKNOWN;
 
 	/* read defaults */
 	if (snd_config_search(root, "defaults.pcm.dmix_max_periods", &n) >= 0) {
@@ -1952,6 +2081,57 @@ int snd_pcm_direct_parse_open_conf(snd_config_t *root, snd_config_t *conf,
 			free(group);
 			continue;
 		}
+		if (strcmp(id, "ipc_lock") == 0) {
+			const char *str;
+			err = snd_config_get_string(n, &str);
+			if (err < 0) {
+				SNDERR("The field ipc_lock must be a string");
+				return err;
+			}
+			if (strcmp(str, "sem") == 0)
+				rec->ipc_lock = SND_PCM_DIRECT_LOCK_SEM;
+			else if (strcmp(str, "futex") == 0) {
+#ifdef DIRECT_FUTEX_SUPPORTED
+				rec->ipc_lock = SND_PCM_DIRECT_LOCK_FUTEX;
+#else
+				SNDERR("The futex lock is not supported on this system");
+				return -EINVAL;
+#endif
+			} else {
+				SNDERR("The field ipc_lock must be sem or futex");
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (strcmp(id, "ipc_shm") == 0) {
+			const char *str;
+			err = snd_config_get_string(n, &str);
+			if (err < 0) {
+				SNDERR("The field ipc_shm must be a string");
+				return err;
+			}
+			if (strcmp(str, "sysv") == 0)
+				rec->ipc_memfd = 0;
+			else if (strcmp(str, "memfd") == 0) {
+#ifdef HAVE_MEMFD_CREATE
+				rec->ipc_memfd = 1;
+#else
+				SNDERR("memfd is not supported on this system");
+				return -EINVAL;
+#endif
+			} else {
+				SNDERR("The field ipc_shm must be sysv or memfd");
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (strcmp(id, "ipc_hugepages") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return err;
+			rec->ipc_hugepages = err;
+			continue;
+		}
 		if (strcmp(id, "ipc_key_add_uid") == 0) {
 			if ((err = snd_config_get_bool(n)) < 0) {
 				SNDERR("The field ipc_key_add_uid must be a boolean type");
@@ -1968,6 +2148,28 @@ int snd_pcm_direct_parse_open_conf(snd_config_t *root, snd_config_t *conf,
 			rec->bindings = n;
 			continue;
 		}
+		if (strcmp(id, "format") == 0) {
+			const char *str, *type = NULL;
+			snd_config_t *t;
+			/* dshare opens capture streams, too */
+			if (snd_config_search(conf, "type", &t) >= 0)
+				snd_config_get_string(t, &type);
+			if (!type || strcmp(type, "dsnoop")) {
+				SNDERR("The field format is supported only by dsnoop");
+				return -EINVAL;
+			}
+			err = snd_config_get_string(n, &str);
+			if (err < 0) {
+				SNDERR("The field format must be a string");
+				return err;
+			}
+			rec->format = snd_pcm_format_value(str);
+			if (rec->format == SND_PCM_FORMAT_UNKNOWN) {
+				SNDERR("Invalid format %s", str);
+				return -EINVAL;
+			}
+			continue;
+		}
 		if (strcmp(id, "slowptr") == 0) {
 			err = snd_config_get_bool(n);
 			if (err < 0)
@@ -1997,6 +2199,13 @@ int snd_pcm_direct_parse_open_conf(snd_config_t *root, snd_config_t *conf,
 			rec->direct_memory_access = err;
 			continue;
 		}
+		if (strcmp(id, "staged") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return err;
+			rec->staged = err;
+			continue;
+		}
 		SNDERR("Unknown field %s", id);
 		return -EINVAL;
 	}
@@ -21,10 +21,15 @@
 
 #include "pcm_local.h"  
 #include "../timer/timer_local.h"
+#include "pcm_direct_lock.h"
 
 #define DIRECT_IPC_SEMS         1
 #define DIRECT_IPC_SEM_CLIENT   0
 
+/* lock of the running streams (ipc_lock) */
+#define SND_PCM_DIRECT_LOCK_SEM		0	/* the SysV semaphore */
+#define SND_PCM_DIRECT_LOCK_FUTEX	1	/* futex word in the shared memory */
+
 typedef void (mix_areas_t)(unsigned int size,
 			   volatile void *dst, void *src,
 			   volatile signed int *sum, size_t dst_step,
@@ -67,6 +72,7 @@ typedef struct {
 	char socket_name[256];			/* name of communication socket */
 	snd_pcm_type_t type;			/* PCM type (currently only hw) */
 	int use_server;
+	int use_memfd;				/* buffers in memfds passed by the server */
 	struct {
 		unsigned int format;
 		snd_interval_t rate;
@@ -112,7 +118,14 @@ typedef struct {
 		struct {
 			unsigned long long chn_mask;
 		} dshare;
+		struct {
+			unsigned int staged;	/* clients mix via staging rings */
+		} dmix;
 	} u;
+	struct {
+		unsigned int type;	/* SND_PCM_DIRECT_LOCK_*, set by the first client */
+		direct_futex_t futex;
+	} lock;
 } snd_pcm_direct_share_t;
 
 typedef struct snd_pcm_direct snd_pcm_direct_t;
@@ -124,6 +137,11 @@ struct snd_pcm_direct {
 	int ipc_gid;			/* IPC socket gid */
 	int semid;			/* IPC global semaphore identification */
 	int locked[DIRECT_IPC_SEMS];	/* local lock counter */
+	int ipc_lock;			/* requested lock of the running streams */
+	int lock_futex;			/* the streams lock with the futex */
+	int ipc_memfd;			/* requested memfd buffers */
+	int ipc_hugepages;		/* requested huge pages for the buffers */
+	int buffer_fd;			/* memfd of the shared buffers (server) */
 	int shmid;			/* IPC global shared memory identification */
 	snd_pcm_direct_share_t *shmptr;	/* pointer to shared memory area */
 	snd_pcm_t *spcm; 		/* slave PCM handle */
@@ -164,6 +182,7 @@ struct snd_pcm_direct {
 		struct {
 			int shmid_sum;			/* IPC global sum ring buffer memory identification */
 			signed int *sum_buffer;		/* shared sum buffer */
+			size_t sum_size;		/* mapped size of a memfd sum buffer */
 			mix_areas_16_t *mix_areas_16;
 			mix_areas_32_t *mix_areas_32;
 			mix_areas_24_t *mix_areas_24;
@@ -172,8 +191,20 @@ struct snd_pcm_direct {
 			mix_areas_32_t *remix_areas_32;
 			mix_areas_24_t *remix_areas_24;
 			mix_areas_u8_t *remix_areas_u8;
+			int shmid_stage;		/* IPC staging rings memory identification */
+			struct dmix_stage *stage;	/* shared staging rings (staged mode) */
+			int stage_slot;			/* our ring in the stage area */
+			signed int *stage_acc;		/* local sum for the mixer pass */
+			snd_pcm_channel_area_t *stage_areas; /* our ring as areas */
 		} dmix;
 		struct {
+			snd_pcm_format_t format;	/* client format (UNKNOWN = slave format) */
+			int conv_idx;			/* linear conversion index, -1 = copy */
+			int use_getput;			/* 24 bit containers, 20 bit samples */
+			unsigned int get_idx, put_idx;	/* get/put via S32 for use_getput */
+			int fast_idx;			/* vectorized conversion index, -1 = none */
+			void *gather;			/* slave samples gathered for fast_idx */
+			snd_pcm_channel_area_t *areas;	/* bound slave areas + gather areas */
 		} dsnoop;
 		struct {
 			unsigned long long chn_mask;
@@ -249,6 +280,12 @@ struct snd_pcm_direct {
 	snd1_pcm_direct_get_chmap
 #define snd_pcm_direct_set_chmap \
 	snd1_pcm_direct_set_chmap
+#define snd_pcm_direct_get_slave \
+	snd1_pcm_direct_get_slave
+#define snd_pcm_direct_memfd_create \
+	snd1_pcm_direct_memfd_create
+#define snd_pcm_direct_memfd_map \
+	snd1_pcm_direct_memfd_map
 
 int snd_pcm_direct_semaphore_create_or_connect(snd_pcm_direct_t *dmix);
 
@@ -293,8 +330,31 @@ static inline int snd_pcm_direct_semaphore_final(snd_pcm_direct_t *dmix, int sem
 	return snd_pcm_direct_semaphore_up(dmix, sem_num);
 }
 
+/*
+ * Lock the mixing and the slave recovery of the running streams.  The
+ * open and close keep the semaphore, they change the setup part of the
+ * shared memory which the running streams only read.
+ */
+static inline int snd_pcm_direct_lock(snd_pcm_direct_t *dmix)
+{
+	if (dmix->lock_futex)
+		return direct_futex_lock(&dmix->shmptr->lock.futex);
+	return snd_pcm_direct_semaphore_down(dmix, DIRECT_IPC_SEM_CLIENT);
+}
+
+static inline int snd_pcm_direct_unlock(snd_pcm_direct_t *dmix)
+{
+	if (dmix->lock_futex) {
+		direct_futex_unlock(&dmix->shmptr->lock.futex);
+		return 0;
+	}
+	return snd_pcm_direct_semaphore_up(dmix, DIRECT_IPC_SEM_CLIENT);
+}
+
 int snd_pcm_direct_shm_create_or_connect(snd_pcm_direct_t *dmix);
 int snd_pcm_direct_shm_discard(snd_pcm_direct_t *dmix);
+int snd_pcm_direct_memfd_create(snd_pcm_direct_t *dmix, const char *name, size_t size);
+int snd_pcm_direct_memfd_map(int fd, void **ptr, size_t *size);
 int snd_pcm_direct_server_create(snd_pcm_direct_t *dmix);
 int snd_pcm_direct_server_discard(snd_pcm_direct_t *dmix);
 int snd_pcm_direct_client_connect(snd_pcm_direct_t *dmix);
@@ -329,6 +389,7 @@ int snd_pcm_direct_open_secondary_client(snd_pcm_t **spcmp, snd_pcm_direct_t *dm
 snd_pcm_chmap_query_t **snd_pcm_direct_query_chmaps(snd_pcm_t *pcm);
 snd_pcm_chmap_t *snd_pcm_direct_get_chmap(snd_pcm_t *pcm);
 int snd_pcm_direct_set_chmap(snd_pcm_t *pcm, const snd_pcm_chmap_t *map);
+snd_pcm_t *snd_pcm_direct_get_slave(snd_pcm_t *pcm);
 int snd_pcm_direct_slave_recover(snd_pcm_direct_t *direct);
 int snd_pcm_direct_client_chk_xrun(snd_pcm_direct_t *direct, snd_pcm_t *pcm);
 int snd_timer_async(snd_timer_t *timer, int sig, pid_t pid);
@@ -338,10 +399,15 @@ struct snd_pcm_direct_open_conf {
 	key_t ipc_key;
 	mode_t ipc_perm;
 	int ipc_gid;
+	int ipc_lock;
+	int ipc_memfd;
+	int ipc_hugepages;
 	int slowptr;
 	int max_periods;
 	int var_periodsize;
 	int direct_memory_access;
+	int staged;
+	snd_pcm_format_t format;
 	snd_config_t *slave;
 	snd_config_t *bindings;
 };
@@ -0,0 +1,163 @@
+/*
+ *  PCM - Direct Stream Mixing - futex lock in the shared memory
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * A process-shared lock for the running streams of the direct plugins.
+ * It is a robust, process-shared pthread mutex: taking and releasing a
+ * free lock are a single atomic operation each, only the contended case
+ * enters the kernel (a shared futex).
+ *
+ * The SysV semaphore undoes the lock of a process which died holding
+ * it.  Here the kernel does the same through the robust futex list of
+ * the holding thread: the next locker gets EOWNERDEAD and takes the
+ * lock over.  No pid is interpreted by the waiters, so this works for
+ * clients in other pid namespaces too.
+ *
+ * The mutex layout depends on the ABI; the creator stores its ABI and
+ * a client with another one (a 32 bit client of a 64 bit instance)
+ * cannot use the lock.
+ */
+
+#include <errno.h>
+
+#if defined(__linux__) && defined(HAVE_LIBPTHREAD)
+#include <pthread.h>
+#define DIRECT_FUTEX_SUPPORTED
+#endif
+
+#define DIRECT_FUTEX_SPINS		100
+
+#ifdef DIRECT_FUTEX_SUPPORTED
+#define DIRECT_FUTEX_ABI	((unsigned int)(sizeof(pthread_mutex_t) | \
+						sizeof(long) << 16))
+#endif
+
+typedef struct {
+	unsigned int abi;	/* DIRECT_FUTEX_ABI of the creator, 0 = none */
+	unsigned int pad;
+	union {
+#ifdef DIRECT_FUTEX_SUPPORTED
+		pthread_mutex_t mutex;
+#endif
+		unsigned long long space[8];
+	} u;
+} direct_futex_t;
+
+#ifdef DIRECT_FUTEX_SUPPORTED
+
+static inline void direct_futex_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#endif
+}
+
+/* set up the lock in a cleared shared memory area */
+static inline int direct_futex_init(direct_futex_t *lock)
+{
+	pthread_mutexattr_t attr;
+	int err;
+
+	err = pthread_mutexattr_init(&attr);
+	if (err)
+		return -err;
+	err = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	if (!err)
+		err = pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	if (!err)
+		err = pthread_mutex_init(&lock->u.mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+	if (err)
+		return -err;
+	lock->abi = DIRECT_FUTEX_ABI;
+	return 0;
+}
+
+/* the lock of another client is usable by us */
+static inline int direct_futex_check(direct_futex_t *lock)
+{
+	return lock->abi == DIRECT_FUTEX_ABI ? 0 : -EINVAL;
+}
+
+/* the holder died, its mix of the period is lost but the lock goes on */
+static inline int direct_futex_owner_dead(direct_futex_t *lock)
+{
+	return -pthread_mutex_consistent(&lock->u.mutex);
+}
+
+static inline int direct_futex_lock(direct_futex_t *lock)
+{
+	int i, err;
+
+	for (i = 0; i < DIRECT_FUTEX_SPINS; i++) {
+		err = pthread_mutex_trylock(&lock->u.mutex);
+		if (err != EBUSY)
+			goto locked;
+		direct_futex_relax();
+	}
+	err = pthread_mutex_lock(&lock->u.mutex);
+ locked:
+	if (err == EOWNERDEAD)
+		return direct_futex_owner_dead(lock);
+	return -err;
+}
+
+/* take the lock if it is free or its holder died, -EBUSY otherwise */
+static inline int direct_futex_trylock(direct_futex_t *lock)
+{
+	int err = pthread_mutex_trylock(&lock->u.mutex);
+
+	if (err == EOWNERDEAD)
+		return direct_futex_owner_dead(lock);
+	return -err;
+}
+
+static inline void direct_futex_unlock(direct_futex_t *lock)
+{
+	pthread_mutex_unlock(&lock->u.mutex);
+}
+
+#else /* !DIRECT_FUTEX_SUPPORTED */
+
+static inline int direct_futex_init(direct_futex_t *lock ATTRIBUTE_UNUSED)
+{
+	return -ENOSYS;
+}
+
+static inline int direct_futex_check(direct_futex_t *lock ATTRIBUTE_UNUSED)
+{
+	return -ENOSYS;
+}
+
+static inline int direct_futex_lock(direct_futex_t *lock ATTRIBUTE_UNUSED)
+{
+	return -ENOSYS;
+}
+
+static inline int direct_futex_trylock(direct_futex_t *lock ATTRIBUTE_UNUSED)
+{
+	return -ENOSYS;
+}
+
+static inline void direct_futex_unlock(direct_futex_t *lock ATTRIBUTE_UNUSED)
+{
+}
+
+#endif /* DIRECT_FUTEX_SUPPORTED */
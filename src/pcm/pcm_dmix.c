@@ -41,6 +41,7 @@
 #include <sys/sem.h>
 #include <sys/wait.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/un.h>
 #include <sys/mman.h>
 #include "pcm_direct.h"
@@ -60,19 +61,78 @@ const char *_snd_module_pcm_dmix = "";
  */
 
 static int shm_sum_discard(snd_pcm_direct_t *dmix);
+static int shm_stage_create_or_connect(snd_pcm_direct_t *dmix);
+static int shm_stage_discard(snd_pcm_direct_t *dmix);
+static size_t shm_stage_size(snd_pcm_direct_t *dmix);
 
 /*
  *  sum ring buffer shared memory area 
  */
+static size_t shm_sum_size(snd_pcm_direct_t *dmix)
+{
+	return dmix->shmptr->s.channels *
+	       dmix->shmptr->s.buffer_size *
+	       sizeof(signed int);
+}
+
+/* with memfd, the staging rings follow the sum buffer in the same memfd */
+static size_t memfd_stage_offset(snd_pcm_direct_t *dmix)
+{
+	return (shm_sum_size(dmix) + 63) & ~(size_t)63;
+}
+
+static size_t memfd_sum_size(snd_pcm_direct_t *dmix)
+{
+	if (!dmix->shmptr->u.dmix.staged)
+		return shm_sum_size(dmix);
+	return memfd_stage_offset(dmix) + shm_stage_size(dmix);
+}
+
+/* the first client creates the memfd before it forks the server */
+static int memfd_sum_create(snd_pcm_direct_t *dmix)
+{
+	int fd = snd_pcm_direct_memfd_create(dmix, "alsa-dmix-sum",
+					     memfd_sum_size(dmix));
+	if (fd < 0)
+		return fd;
+	dmix->buffer_fd = fd;
+	dmix->shmptr->use_memfd = 1;
+	return 0;
+}
+
+/* the server keeps the memfd, the clients need only the mapping */
+static int memfd_sum_connect(snd_pcm_direct_t *dmix)
+{
+	struct stat st;
+	size_t size = memfd_sum_size(dmix);
+	void *ptr;
+	int err;
+
+	/* a client retrying as the first one may set up a larger buffer */
+	if (fstat(dmix->buffer_fd, &st) < 0)
+		err = -errno;
+	else if ((size_t)st.st_size < size && ftruncate(dmix->buffer_fd, size) < 0)
+		err = -errno;
+	else
+		err = snd_pcm_direct_memfd_map(dmix->buffer_fd, &ptr,
+					       &dmix->u.dmix.sum_size);
+	close(dmix->buffer_fd);
+	dmix->buffer_fd = -1;
+	if (err < 0)
+		return err;
+	dmix->u.dmix.sum_buffer = ptr;
+	return 0;
+}
+
 static int shm_sum_create_or_connect(snd_pcm_direct_t *dmix)
 {
 	struct shmid_ds buf;
 	int tmpid, err;
 	size_t size;
 
-	size = dmix->shmptr->s.channels *
-	       dmix->shmptr->s.buffer_size *
-	       sizeof(signed int);	
+	if (dmix->shmptr->use_memfd)
+		return memfd_sum_connect(dmix);
+	size = shm_sum_size(dmix);
 retryshm:
 	dmix->u.dmix.shmid_sum = shmget(dmix->ipc_key + 1, size,
 					IPC_CREAT | dmix->ipc_perm);
@@ -111,6 +171,12 @@ static int shm_sum_discard(snd_pcm_direct_t *dmix)
 	struct shmid_ds buf;
 	int ret = 0;
 
+	if (dmix->u.dmix.sum_size) {
+		munmap(dmix->u.dmix.sum_buffer, dmix->u.dmix.sum_size);
+		dmix->u.dmix.sum_buffer = (void *) -1;
+		dmix->u.dmix.sum_size = 0;
+		return 0;
+	}
 	if (dmix->u.dmix.shmid_sum < 0)
 		return -EINVAL;
 	if (dmix->u.dmix.sum_buffer != (void *) -1 && shmdt(dmix->u.dmix.sum_buffer) < 0)
@@ -130,13 +196,21 @@ static int shm_sum_discard(snd_pcm_direct_t *dmix)
 static void dmix_server_free(snd_pcm_direct_t *dmix)
 {
 	/* remove the memory region */
-	shm_sum_create_or_connect(dmix);
-	shm_sum_discard(dmix);
+	if (dmix->shmptr->use_memfd) {
+		/* the last reference goes with the server */
+		close(dmix->buffer_fd);
+	} else {
+		shm_sum_create_or_connect(dmix);
+		shm_sum_discard(dmix);
+	}
+	if (dmix->shmptr->u.dmix.staged && !dmix->shmptr->use_memfd) {
+		shm_stage_create_or_connect(dmix);
+		shm_stage_discard(dmix);
+	}
 }
 
 /*
  *  the main function of this plugin: mixing
- *  FIXME: optimize it for different architectures
  */
 
 #include "pcm_dmix_generic.c"
@@ -150,6 +224,8 @@ static void dmix_server_free(snd_pcm_direct_t *dmix)
 #define dmix_supported_format generic_dmix_supported_format
 #endif
 #endif
+#include "pcm_dmix_simd.c"
+#include "pcm_dmix_stage.c"
 
 static void mix_areas(snd_pcm_direct_t *dmix,
 		      const snd_pcm_channel_area_t *src_areas,
@@ -289,12 +365,12 @@ static void remix_areas(snd_pcm_direct_t *dmix,
 
 /*
  * if no concurrent access is allowed in the mixing routines, we need to protect
- * the area via semaphore
+ * the area via the streams lock
  */
 #ifndef DOC_HIDDEN
 #ifdef NO_CONCURRENT_ACCESS
-#define dmix_down_sem(dmix) snd_pcm_direct_semaphore_down(dmix, DIRECT_IPC_SEM_CLIENT)
-#define dmix_up_sem(dmix) snd_pcm_direct_semaphore_up(dmix, DIRECT_IPC_SEM_CLIENT)
+#define dmix_down_sem(dmix) snd_pcm_direct_lock(dmix)
+#define dmix_up_sem(dmix) snd_pcm_direct_unlock(dmix)
 #else
 #define dmix_down_sem(dmix)
 #define dmix_up_sem(dmix)
@@ -304,12 +380,25 @@ static void remix_areas(snd_pcm_direct_t *dmix,
 /*
  *  synchronize shm ring buffer with hardware
  */
+/* the mixing reads our buffer and reads and writes the slave one */
+static inline void dmix_stats_end(snd_pcm_t *pcm, const snd_htimestamp_t *start,
+				  snd_pcm_uframes_t frames)
+{
+	snd_pcm_direct_t *dmix = pcm->private_data;
+
+	if (pcm->stats)
+		snd_pcm_stats_add(pcm, SND_PCM_STATS_TRANSFER, start, frames,
+				  frames * (pcm->frame_bits +
+					    2 * dmix->spcm->frame_bits) / 8);
+}
+
 static void snd_pcm_dmix_sync_area(snd_pcm_t *pcm)
 {
 	snd_pcm_direct_t *dmix = pcm->private_data;
 	snd_pcm_uframes_t slave_hw_ptr, slave_appl_ptr, slave_size;
-	snd_pcm_uframes_t appl_ptr, size, transfer;
+	snd_pcm_uframes_t appl_ptr, size, transfer, frames;
 	const snd_pcm_channel_area_t *src_areas, *dst_areas;
+	snd_htimestamp_t start;
 	
 	/* calculate the size to transfer */
 	/* check the available size in the local buffer
@@ -317,7 +406,7 @@ static void snd_pcm_dmix_sync_area(snd_pcm_t *pcm)
 	 */
 	size = dmix->appl_ptr - dmix->last_appl_ptr;
 	if (! size)
-		return;
+		goto no_data;
 	if (size >= pcm->boundary / 2)
 		size = pcm->boundary - size;
 
@@ -337,7 +426,7 @@ static void snd_pcm_dmix_sync_area(snd_pcm_t *pcm)
 		dmix->slave_appl_ptr %= dmix->slave_boundary;
 		size = dmix->appl_ptr - dmix->last_appl_ptr;
 		if (! size)
-			return;
+			goto no_data;
 		if (size >= pcm->boundary / 2)
 			size = pcm->boundary - size;
 	}
@@ -358,14 +447,26 @@ static void snd_pcm_dmix_sync_area(snd_pcm_t *pcm)
 	if (slave_size < size)
 		size = slave_size;
 	if (! size)
-		return;
+		goto no_data;
 
 	/* add sample areas here */
+	snd_pcm_stats_begin(pcm, &start);
+	frames = size;
 	src_areas = snd_pcm_mmap_areas(pcm);
 	dst_areas = snd_pcm_mmap_areas(dmix->spcm);
 	appl_ptr = dmix->last_appl_ptr % pcm->buffer_size;
 	dmix->last_appl_ptr += size;
 	dmix->last_appl_ptr %= pcm->boundary;
+	if (dmix->u.dmix.stage) {
+		slave_appl_ptr = dmix->slave_appl_ptr;
+		dmix->slave_appl_ptr += size;
+		dmix->slave_appl_ptr %= dmix->slave_boundary;
+		stage_write(dmix, src_areas, appl_ptr, slave_appl_ptr, size,
+			    pcm->buffer_size);
+		stage_commit(dmix, slave_appl_ptr, dmix->slave_appl_ptr);
+		dmix_stats_end(pcm, &start, frames);
+		return;
+	}
 	slave_appl_ptr = dmix->slave_appl_ptr % dmix->slave_buffer_size;
 	dmix->slave_appl_ptr += size;
 	dmix->slave_appl_ptr %= dmix->slave_boundary;
@@ -386,6 +487,13 @@ static void snd_pcm_dmix_sync_area(snd_pcm_t *pcm)
 		appl_ptr %= pcm->buffer_size;
 	}
 	dmix_up_sem(dmix);
+	dmix_stats_end(pcm, &start, frames);
+	return;
+
+ no_data:
+	/* other clients may be waiting for the mixer pass */
+	if (dmix->u.dmix.stage)
+		stage_flush(dmix);
 }
 
 /*
@@ -621,6 +729,8 @@ static int snd_pcm_dmix_drop(snd_pcm_t *pcm)
 		return -EBADFD;
 	dmix->state = SND_PCM_STATE_SETUP;
 	snd_pcm_direct_timer_stop(dmix);
+	if (dmix->u.dmix.stage)
+		stage_deactivate(dmix);
 	return 0;
 }
 
@@ -774,6 +884,10 @@ static snd_pcm_sframes_t snd_pcm_dmix_rewind(snd_pcm_t *pcm, snd_pcm_uframes_t f
 	appl_ptr = dmix->last_appl_ptr % pcm->buffer_size;
 	dmix->slave_appl_ptr -= size;
 	dmix->slave_appl_ptr %= dmix->slave_boundary;
+	if (dmix->u.dmix.stage) {
+		stage_rewind(dmix, dmix->slave_appl_ptr);
+		goto remixed;
+	}
 	slave_appl_ptr = dmix->slave_appl_ptr % dmix->slave_buffer_size;
 	dmix_down_sem(dmix);
 	for (;;) {
@@ -793,6 +907,7 @@ static snd_pcm_sframes_t snd_pcm_dmix_rewind(snd_pcm_t *pcm, snd_pcm_uframes_t f
 	}
 	dmix_up_sem(dmix);
 
+ remixed:
 	snd_pcm_mmap_appl_backward(pcm, frames_to_remix);
 	result += frames_to_remix;
 	/* At this point last_appl_ptr and appl_ptr has to indicate the
@@ -836,6 +951,8 @@ static int snd_pcm_dmix_close(snd_pcm_t *pcm)
 		snd_timer_close(dmix->timer);
 	snd_pcm_direct_semaphore_down(dmix, DIRECT_IPC_SEM_CLIENT);
 	snd_pcm_close(dmix->spcm);
+	if (dmix->u.dmix.stage)
+		stage_close(dmix);
  	if (dmix->server)
  		snd_pcm_direct_server_discard(dmix);
  	if (dmix->client)
@@ -950,6 +1067,9 @@ static void snd_pcm_dmix_dump(snd_pcm_t *pcm, snd_output_t *out)
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
 	}
+	if (dmix->u.dmix.stage)
+		snd_output_printf(out, "Staged mixing, slot %d\n",
+				  dmix->u.dmix.stage_slot);
 	if (dmix->spcm)
 		snd_pcm_dump(dmix->spcm, out);
 }
@@ -970,6 +1090,7 @@ static const snd_pcm_ops_t snd_pcm_dmix_ops = {
 	.query_chmaps = snd_pcm_direct_query_chmaps,
 	.get_chmap = snd_pcm_direct_get_chmap,
 	.set_chmap = snd_pcm_direct_set_chmap,
+	.get_slave = snd_pcm_direct_get_slave,
 };
 
 static const snd_pcm_fast_ops_t snd_pcm_dmix_fast_ops = {
@@ -1049,8 +1170,14 @@ int snd_pcm_dmix_open(snd_pcm_t **pcmp, const char *name,
 	dmix->ipc_key = opts->ipc_key;
 	dmix->ipc_perm = opts->ipc_perm;
 	dmix->ipc_gid = opts->ipc_gid;
+	dmix->ipc_lock = opts->ipc_lock;
+	dmix->ipc_memfd = opts->ipc_memfd;
+	dmix->ipc_hugepages = opts->ipc_hugepages;
 	dmix->semid = -1;
 	dmix->shmid = -1;
+	dmix->buffer_fd = -1;
+	dmix->u.dmix.shmid_stage = -1;
+	dmix->u.dmix.stage_slot = -1;
 
 	ret = snd_pcm_new(&pcm, dmix->type = SND_PCM_TYPE_DMIX, name, stream, mode);
 	if (ret < 0)
@@ -1114,7 +1241,29 @@ int snd_pcm_dmix_open(snd_pcm_t **pcmp, const char *name,
 
 		dmix->spcm = spcm;
 
-		if (dmix->shmptr->use_server) {
+		/* decided before the memfd is sized, it may hold the rings */
+		dmix->shmptr->u.dmix.staged = 0;
+		if (opts->staged) {
+			if (stage_supported(dmix))
+				dmix->shmptr->u.dmix.staged = 1;
+			else
+				SNDERR("staged mixing needs an interleaved S16 or S32 native-endian slave, disabled");
+		}
+
+		if (!dmix->client) {
+			dmix->shmptr->use_memfd = 0;
+			if (dmix->ipc_memfd) {
+				ret = memfd_sum_create(dmix);
+				if (ret < 0) {
+					SNDERR("unable to create memfd sum buffer");
+					goto _err;
+				}
+			}
+		}
+
+		/* on a retry the server of the previous streams still runs */
+		if ((dmix->shmptr->use_server || dmix->shmptr->use_memfd) &&
+		    !dmix->client) {
 			dmix->server_free = dmix_server_free;
 		
 			ret = snd_pcm_direct_server_create(dmix);
@@ -1126,7 +1275,7 @@ int snd_pcm_dmix_open(snd_pcm_t **pcmp, const char *name,
 
 		dmix->shmptr->type = spcm->type;
 	} else {
-		if (dmix->shmptr->use_server) {
+		if (dmix->shmptr->use_server || dmix->shmptr->use_memfd) {
 			/* up semaphore to avoid deadlock */
 			snd_pcm_direct_semaphore_up(dmix, DIRECT_IPC_SEM_CLIENT);
 			ret = snd_pcm_direct_client_connect(dmix);
@@ -1136,6 +1285,8 @@ int snd_pcm_dmix_open(snd_pcm_t **pcmp, const char *name,
 			}
 			
 			snd_pcm_direct_semaphore_down(dmix, DIRECT_IPC_SEM_CLIENT);
+		}
+		if (dmix->shmptr->use_server) {
 			ret = snd_pcm_direct_open_secondary_client(&spcm, dmix, "dmix_client");
 			if (ret < 0)
 				goto _err;
@@ -1185,6 +1336,7 @@ int snd_pcm_dmix_open(snd_pcm_t **pcmp, const char *name,
 	}
 
 	mix_select_callbacks(dmix);
+	simd_mix_select_callbacks(dmix);
 		
 	pcm->poll_fd = dmix->poll_fd;
 	pcm->poll_events = POLLIN;	/* it's different than other plugins */
@@ -1196,6 +1348,14 @@ int snd_pcm_dmix_open(snd_pcm_t **pcmp, const char *name,
 	if (dmix->channels == UINT_MAX)
 		dmix->channels = dmix->shmptr->s.channels;
 
+	if (dmix->shmptr->u.dmix.staged) {
+		ret = stage_open(dmix);
+		if (ret < 0) {
+			SNDERR("unable to initialize staging rings");
+			goto _err;
+		}
+	}
+
 	snd_pcm_direct_semaphore_up(dmix, DIRECT_IPC_SEM_CLIENT);
 
 	*pcmp = pcm;
@@ -1210,8 +1370,13 @@ int snd_pcm_dmix_open(snd_pcm_t **pcmp, const char *name,
 		snd_pcm_direct_client_discard(dmix);
 	if (spcm)
 		snd_pcm_close(spcm);
-	if (dmix->u.dmix.shmid_sum >= 0)
+	if (dmix->u.dmix.shmid_sum >= 0 || dmix->u.dmix.sum_size)
 		shm_sum_discard(dmix);
+	if (dmix->buffer_fd >= 0)
+		close(dmix->buffer_fd);
+	if (dmix->u.dmix.shmid_stage >= 0 || dmix->u.dmix.stage_acc ||
+	    dmix->u.dmix.stage_areas)
+		stage_close(dmix);
 	if ((dmix->shmid >= 0) && (snd_pcm_direct_shm_discard(dmix))) {
 		if (snd_pcm_direct_semaphore_discard(dmix))
 			snd_pcm_direct_semaphore_final(dmix, DIRECT_IPC_SEM_CLIENT);
@@ -1241,6 +1406,9 @@ pcm.name {
 	ipc_key INT		# unique IPC key
 	ipc_key_add_uid BOOL	# add current uid to unique IPC key
 	ipc_perm INT		# IPC permissions (octal, default 0600)
+	ipc_lock STR		# lock of the running streams, sem (default) or futex
+	ipc_shm STR		# sum buffer in sysv (default) or memfd memory
+	ipc_hugepages BOOL	# huge pages for the memfd sum buffer
 	slave STR
 	# or
 	slave {			# Slave definition
@@ -1262,6 +1430,7 @@ pcm.name {
 		N INT		# maps slave channel to client channel N
 	}
 	slowptr BOOL		# slow but more precise pointer updates
+	staged BOOL		# mix via per-client staging rings
 }
 \endcode
 
@@ -1273,6 +1442,36 @@ added to the value set in <code>ipc_key</code>.  This will
 avoid the confliction of the same IPC key with different users
 concurrently.
 
+<code>ipc_lock</code> selects the lock the clients take while mixing
+and recovering the running slave.  The default \c sem is the SysV
+semaphore of the instance, \c futex is a robust process-shared mutex
+in the shared memory which enters the kernel only when it is contended
+(Linux only).  Opening and closing always serialize on the semaphore.
+The lock is decided by the first client opening the instance; with
+\c futex all clients must have the same ABI (no 32 bit clients of a
+64 bit instance).
+
+With <code>ipc_shm</code> set to \c memfd, the sum buffer is a memfd
+instead of a SysV segment keyed by <code>ipc_key</code> + 1, so it is
+not limited by kernel.shmmax and it cannot be left behind by crashed
+clients.  The first client starts a small server process which keeps
+the memfd and passes it to the other clients over its unix socket; the
+server exits with the last client.  The staging rings of
+<code>staged</code> mode are then kept in the same memfd.  With <code>ipc_hugepages</code> the
+buffer is allocated from the hugetlb pool, or advised for transparent
+huge pages when the pool is empty, which saves TLB misses in the mixing
+loops with large buffers.  Like <code>ipc_lock</code>, this is decided
+by the first client.
+
+When <code>staged</code> is set true, each client copies its data into
+a private ring in shared memory without taking any lock, and the sum
+is computed in a single vectorized pass over all rings instead of
+adding every sample into the shared sum buffer.  This reduces the
+contention with many clients.  It requires an interleaved \c S16 or
+\c S32 slave in the native byte order, and it is decided by the first
+client opening the dmix instance.  Up to 32 clients are supported in
+this mode.
+
 Note that the dmix plugin itself supports only a single configuration.
 That is, it supports only the fixed rate (default 48000), format
 (\c S16), channels (2), and period_time (125000).
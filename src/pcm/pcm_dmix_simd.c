@@ -0,0 +1,123 @@
+/*
+ * vectorized mixing code, selected at runtime from the CPU features
+ *
+ * The SIMD kernels are not atomic; they are used only when the mixing
+ * is serialized via the client semaphore (NO_CONCURRENT_ACCESS).
+ */
+
+#include "pcm_dmix_simd.h"
+
+#if defined(DMIX_SIMD_X86) || defined(DMIX_SIMD_NEON)
+#define DMIX_SIMD_ENABLED
+
+static const dmix_simd_kernel_t *simd_kernel_16;
+static const dmix_simd_kernel_t *simd_kernel_32;
+static const dmix_simd_kernel_t *simd_kernel_24;
+static const dmix_simd_kernel_t *simd_kernel_stage;
+
+static void simd_mix_init(void)
+{
+	static int probed = 0;
+	const dmix_simd_kernel_t *k;
+
+	if (probed)
+		return;
+	for (k = dmix_simd_kernels; k->name; k++) {
+		if (!k->available())
+			continue;
+		if (!simd_kernel_16 && k->mix_16)
+			simd_kernel_16 = k;
+		if (!simd_kernel_32 && k->mix_32)
+			simd_kernel_32 = k;
+		if (!simd_kernel_24 && k->mix_24)
+			simd_kernel_24 = k;
+		if (!simd_kernel_stage && k->add_16)
+			simd_kernel_stage = k;
+	}
+	probed = 1;
+}
+
+#endif
+
+#if defined(NO_CONCURRENT_ACCESS) && defined(DMIX_SIMD_ENABLED)
+
+/*
+ * process the contiguous part with the selected kernel, anything else
+ * (strided areas, the tail) with the generic native-endian code
+ */
+#define SIMD_MIX_AREAS(name, type, ssize, kernel, op, fallback)		\
+static void name(unsigned int size,					\
+		 volatile type *dst, type *src,				\
+		 volatile signed int *sum, size_t dst_step,		\
+		 size_t src_step, size_t sum_step)			\
+{									\
+	unsigned int done;						\
+									\
+	if (dst_step != ssize || src_step != ssize ||			\
+	    sum_step != sizeof(signed int)) {				\
+		fallback(size, dst, src, sum, dst_step, src_step, sum_step); \
+		return;							\
+	}								\
+	done = kernel->op(size, (type *)dst, src, (signed int *)sum);	\
+	if (done == size)						\
+		return;							\
+	fallback(size - done,						\
+		 (volatile type *)((char *)dst + done * ssize),		\
+		 (type *)((char *)src + done * ssize),			\
+		 sum + done, dst_step, src_step, sum_step);		\
+}
+
+SIMD_MIX_AREAS(simd_mix_areas_16, signed short, 2, simd_kernel_16, mix_16,
+	       generic_mix_areas_16_native)
+SIMD_MIX_AREAS(simd_remix_areas_16, signed short, 2, simd_kernel_16, remix_16,
+	       generic_remix_areas_16_native)
+SIMD_MIX_AREAS(simd_mix_areas_32, signed int, 4, simd_kernel_32, mix_32,
+	       generic_mix_areas_32_native)
+SIMD_MIX_AREAS(simd_remix_areas_32, signed int, 4, simd_kernel_32, remix_32,
+	       generic_remix_areas_32_native)
+SIMD_MIX_AREAS(simd_mix_areas_24, unsigned char, 3, simd_kernel_24, mix_24,
+	       generic_mix_areas_24)
+SIMD_MIX_AREAS(simd_remix_areas_24, unsigned char, 3, simd_kernel_24, remix_24,
+	       generic_remix_areas_24)
+
+#undef SIMD_MIX_AREAS
+
+/* override the callbacks chosen by mix_select_callbacks() where possible */
+static void simd_mix_select_callbacks(snd_pcm_direct_t *dmix)
+{
+	snd_pcm_format_t format = dmix->shmptr->s.format;
+
+	if (!dmix->direct_memory_access)
+		return;
+	simd_mix_init();
+	switch (format) {
+	case SND_PCM_FORMAT_S16_LE:
+	case SND_PCM_FORMAT_S16_BE:
+		if (!simd_kernel_16 || !snd_pcm_format_cpu_endian(format))
+			break;
+		dmix->u.dmix.mix_areas_16 = simd_mix_areas_16;
+		dmix->u.dmix.remix_areas_16 = simd_remix_areas_16;
+		break;
+	case SND_PCM_FORMAT_S32_LE:
+	case SND_PCM_FORMAT_S32_BE:
+		if (!simd_kernel_32 || !snd_pcm_format_cpu_endian(format))
+			break;
+		dmix->u.dmix.mix_areas_32 = simd_mix_areas_32;
+		dmix->u.dmix.remix_areas_32 = simd_remix_areas_32;
+		break;
+	case SND_PCM_FORMAT_S24_3LE:
+		if (!simd_kernel_24)
+			break;
+		dmix->u.dmix.mix_areas_24 = simd_mix_areas_24;
+		dmix->u.dmix.remix_areas_24 = simd_remix_areas_24;
+		break;
+	default:
+		break;
+	}
+}
+
+#else
+
+#define simd_mix_select_callbacks(x)	do { } while (0)
+
+#endif
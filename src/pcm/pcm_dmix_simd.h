@@ -0,0 +1,643 @@
+/**
+ * \file pcm/pcm_dmix_simd.h
+ * \ingroup PCM_Plugins
+ * \brief PCM Direct Stream Mixing (dmix) Plugin Interface - vectorized kernels
+ * \date 2026
+ */
+/*
+ *  PCM - Direct Stream Mixing
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * The kernels below work only on contiguous (interleaved) areas, i.e.
+ * dst and src advance by one sample and sum by one int per sample.
+ * They are not atomic, so the caller must hold the client semaphore.
+ * Each kernel returns the number of samples processed (a multiple of
+ * its vector width); the caller finishes the tail with a scalar loop.
+ *
+ * The semantics follow the generic native-endian callbacks:
+ *   mix:   if (!*dst) { *sum = s; *dst = src; }
+ *          else { *sum += s; *dst = saturate(*sum); }
+ *   remix: if (!*dst) { *sum = -s; *dst = -src; }
+ *          else { *sum -= s; *dst = saturate(*sum); }
+ * where s is the source sample scaled to the 24-bit (32-bit formats)
+ * or 16-bit sum range.
+ */
+
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+#if defined(__x86_64__) || defined(__i386__)
+#define DMIX_SIMD_X86
+#elif (defined(__aarch64__) || defined(__ARM_NEON)) && \
+      (!defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define DMIX_SIMD_NEON
+#endif
+#endif
+
+#ifdef DMIX_SIMD_X86
+#include <immintrin.h>
+#include <string.h>
+
+#define DMIX_SIMD_TARGET(isa)	__attribute__((target(isa)))
+
+static inline __attribute__((always_inline)) DMIX_SIMD_TARGET("sse2")
+__m128i dmix_sse2_select(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static inline __attribute__((always_inline)) DMIX_SIMD_TARGET("sse2")
+unsigned int dmix_sse2_16(unsigned int size, signed short *dst,
+			  const signed short *src, signed int *sum, int remix)
+{
+	const __m128i zero = _mm_setzero_si128();
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + n));
+		__m128i d = _mm_loadu_si128((const __m128i *)(dst + n));
+		__m128i z = _mm_cmpeq_epi16(d, zero);
+		__m128i zlo = _mm_unpacklo_epi16(z, z);
+		__m128i zhi = _mm_unpackhi_epi16(z, z);
+		__m128i slo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+		__m128i shi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+		__m128i lo = _mm_loadu_si128((const __m128i *)(sum + n));
+		__m128i hi = _mm_loadu_si128((const __m128i *)(sum + n + 4));
+
+		if (remix) {
+			lo = _mm_sub_epi32(lo, slo);
+			hi = _mm_sub_epi32(hi, shi);
+			slo = _mm_sub_epi32(zero, slo);
+			shi = _mm_sub_epi32(zero, shi);
+		} else {
+			lo = _mm_add_epi32(lo, slo);
+			hi = _mm_add_epi32(hi, shi);
+		}
+		lo = dmix_sse2_select(zlo, slo, lo);
+		hi = dmix_sse2_select(zhi, shi, hi);
+		_mm_storeu_si128((__m128i *)(sum + n), lo);
+		_mm_storeu_si128((__m128i *)(sum + n + 4), hi);
+		_mm_storeu_si128((__m128i *)(dst + n), _mm_packs_epi32(lo, hi));
+	}
+	return n;
+}
+
+static inline __attribute__((always_inline)) DMIX_SIMD_TARGET("sse2")
+__m128i dmix_sse2_saturate_24(__m128i v)
+{
+	__m128i out = _mm_slli_epi32(v, 8);
+	__m128i over = _mm_cmpgt_epi32(v, _mm_set1_epi32(0x7fffff));
+	__m128i under = _mm_cmpgt_epi32(_mm_set1_epi32(-0x800000), v);
+
+	out = dmix_sse2_select(over, _mm_set1_epi32(0x7fffffff), out);
+	return dmix_sse2_select(under, _mm_set1_epi32((int)0x80000000), out);
+}
+
+static inline __attribute__((always_inline)) DMIX_SIMD_TARGET("sse2")
+unsigned int dmix_sse2_32(unsigned int size, signed int *dst,
+			  const signed int *src, signed int *sum, int remix)
+{
+	const __m128i zero = _mm_setzero_si128();
+	unsigned int n;
+
+	for (n = 0; n + 4 <= size; n += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + n));
+		__m128i d = _mm_loadu_si128((const __m128i *)(dst + n));
+		__m128i z = _mm_cmpeq_epi32(d, zero);
+		__m128i v = _mm_srai_epi32(s, 8);
+		__m128i sm = _mm_loadu_si128((const __m128i *)(sum + n));
+
+		if (remix) {
+			sm = _mm_sub_epi32(sm, v);
+			v = _mm_sub_epi32(zero, v);
+			s = _mm_sub_epi32(zero, s);
+		} else {
+			sm = _mm_add_epi32(sm, v);
+		}
+		sm = dmix_sse2_select(z, v, sm);
+		_mm_storeu_si128((__m128i *)(sum + n), sm);
+		_mm_storeu_si128((__m128i *)(dst + n),
+				 dmix_sse2_select(z, s, dmix_sse2_saturate_24(sm)));
+	}
+	return n;
+}
+
+/*
+ * staged mixing: accumulate client rings into an int sum, then
+ * saturate the sum into the slave buffer
+ */
+static DMIX_SIMD_TARGET("sse2")
+unsigned int dmix_sse2_add_16(unsigned int size, signed int *acc,
+			      const signed short *src)
+{
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + n));
+		__m128i lo = _mm_loadu_si128((const __m128i *)(acc + n));
+		__m128i hi = _mm_loadu_si128((const __m128i *)(acc + n + 4));
+
+		lo = _mm_add_epi32(lo, _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+		hi = _mm_add_epi32(hi, _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+		_mm_storeu_si128((__m128i *)(acc + n), lo);
+		_mm_storeu_si128((__m128i *)(acc + n + 4), hi);
+	}
+	return n;
+}
+
+static DMIX_SIMD_TARGET("sse2")
+unsigned int dmix_sse2_add_32(unsigned int size, signed int *acc,
+			      const signed int *src)
+{
+	unsigned int n;
+
+	for (n = 0; n + 4 <= size; n += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + n));
+		__m128i a = _mm_loadu_si128((const __m128i *)(acc + n));
+
+		_mm_storeu_si128((__m128i *)(acc + n),
+				 _mm_add_epi32(a, _mm_srai_epi32(s, 8)));
+	}
+	return n;
+}
+
+static DMIX_SIMD_TARGET("sse2")
+unsigned int dmix_sse2_store_16(unsigned int size, signed short *dst,
+				const signed int *acc)
+{
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		__m128i lo = _mm_loadu_si128((const __m128i *)(acc + n));
+		__m128i hi = _mm_loadu_si128((const __m128i *)(acc + n + 4));
+
+		_mm_storeu_si128((__m128i *)(dst + n), _mm_packs_epi32(lo, hi));
+	}
+	return n;
+}
+
+static DMIX_SIMD_TARGET("sse2")
+unsigned int dmix_sse2_store_32(unsigned int size, signed int *dst,
+				const signed int *acc)
+{
+	unsigned int n;
+
+	for (n = 0; n + 4 <= size; n += 4) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(acc + n));
+
+		_mm_storeu_si128((__m128i *)(dst + n), dmix_sse2_saturate_24(a));
+	}
+	return n;
+}
+
+/*
+ * S24_3LE: expand four packed 3-byte samples into the upper bytes of
+ * four dwords (arithmetic shift does the sign extension) and compact
+ * them again on store.  Each step loads 16 bytes, so keep two samples
+ * of slack at the end of the buffers.
+ */
+static inline __attribute__((always_inline)) DMIX_SIMD_TARGET("ssse3")
+unsigned int dmix_ssse3_24(unsigned int size, unsigned char *dst,
+			   const unsigned char *src, signed int *sum,
+			   int remix)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i expand = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5,
+					     -1, 6, 7, 8, -1, 9, 10, 11);
+	const __m128i compact = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9,
+					      10, 12, 13, 14, -1, -1, -1, -1);
+	const __m128i max = _mm_set1_epi32(0x7fffff);
+	const __m128i min = _mm_set1_epi32(-0x800000);
+	unsigned int n;
+
+	for (n = 0; n + 6 <= size; n += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + n * 3));
+		__m128i d = _mm_loadu_si128((const __m128i *)(dst + n * 3));
+		__m128i sm = _mm_loadu_si128((const __m128i *)(sum + n));
+		__m128i z;
+		int tail;
+
+		s = _mm_srai_epi32(_mm_shuffle_epi8(s, expand), 8);
+		d = _mm_shuffle_epi8(d, expand);
+		z = _mm_cmpeq_epi32(d, zero);
+		if (remix) {
+			sm = _mm_sub_epi32(sm, s);
+			s = _mm_sub_epi32(zero, s);
+		} else {
+			sm = _mm_add_epi32(sm, s);
+		}
+		sm = dmix_sse2_select(z, s, sm);
+		_mm_storeu_si128((__m128i *)(sum + n), sm);
+		sm = dmix_sse2_select(_mm_cmpgt_epi32(sm, max), max, sm);
+		sm = dmix_sse2_select(_mm_cmpgt_epi32(min, sm), min, sm);
+		sm = _mm_shuffle_epi8(sm, compact);
+		_mm_storel_epi64((__m128i *)(dst + n * 3), sm);
+		tail = _mm_cvtsi128_si32(_mm_srli_si128(sm, 8));
+		memcpy(dst + n * 3 + 8, &tail, 4);
+	}
+	return n;
+}
+
+static inline __attribute__((always_inline)) DMIX_SIMD_TARGET("avx2")
+unsigned int dmix_avx2_16(unsigned int size, signed short *dst,
+			  const signed short *src, signed int *sum, int remix)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	unsigned int n;
+
+	for (n = 0; n + 16 <= size; n += 16) {
+		__m128i s0 = _mm_loadu_si128((const __m128i *)(src + n));
+		__m128i s1 = _mm_loadu_si128((const __m128i *)(src + n + 8));
+		__m128i d0 = _mm_loadu_si128((const __m128i *)(dst + n));
+		__m128i d1 = _mm_loadu_si128((const __m128i *)(dst + n + 8));
+		__m256i slo = _mm256_cvtepi16_epi32(s0);
+		__m256i shi = _mm256_cvtepi16_epi32(s1);
+		__m256i zlo = _mm256_cmpeq_epi32(_mm256_cvtepi16_epi32(d0), zero);
+		__m256i zhi = _mm256_cmpeq_epi32(_mm256_cvtepi16_epi32(d1), zero);
+		__m256i lo = _mm256_loadu_si256((const __m256i *)(sum + n));
+		__m256i hi = _mm256_loadu_si256((const __m256i *)(sum + n + 8));
+
+		if (remix) {
+			lo = _mm256_sub_epi32(lo, slo);
+			hi = _mm256_sub_epi32(hi, shi);
+			slo = _mm256_sub_epi32(zero, slo);
+			shi = _mm256_sub_epi32(zero, shi);
+		} else {
+			lo = _mm256_add_epi32(lo, slo);
+			hi = _mm256_add_epi32(hi, shi);
+		}
+		lo = _mm256_blendv_epi8(lo, slo, zlo);
+		hi = _mm256_blendv_epi8(hi, shi, zhi);
+		_mm256_storeu_si256((__m256i *)(sum + n), lo);
+		_mm256_storeu_si256((__m256i *)(sum + n + 8), hi);
+		/* packs works per 128-bit lane, restore the sample order */
+		_mm256_storeu_si256((__m256i *)(dst + n),
+				    _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xd8));
+	}
+	return n;
+}
+
+static inline __attribute__((always_inline)) DMIX_SIMD_TARGET("avx2")
+unsigned int dmix_avx2_32(unsigned int size, signed int *dst,
+			  const signed int *src, signed int *sum, int remix)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i max = _mm256_set1_epi32(0x7fffff);
+	const __m256i min = _mm256_set1_epi32(-0x800000);
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		__m256i s = _mm256_loadu_si256((const __m256i *)(src + n));
+		__m256i d = _mm256_loadu_si256((const __m256i *)(dst + n));
+		__m256i z = _mm256_cmpeq_epi32(d, zero);
+		__m256i v = _mm256_srai_epi32(s, 8);
+		__m256i sm = _mm256_loadu_si256((const __m256i *)(sum + n));
+		__m256i out;
+
+		if (remix) {
+			sm = _mm256_sub_epi32(sm, v);
+			v = _mm256_sub_epi32(zero, v);
+			s = _mm256_sub_epi32(zero, s);
+		} else {
+			sm = _mm256_add_epi32(sm, v);
+		}
+		sm = _mm256_blendv_epi8(sm, v, z);
+		_mm256_storeu_si256((__m256i *)(sum + n), sm);
+		out = _mm256_slli_epi32(_mm256_max_epi32(_mm256_min_epi32(sm, max), min), 8);
+		out = _mm256_blendv_epi8(out, _mm256_set1_epi32(0x7fffffff),
+					 _mm256_cmpgt_epi32(sm, max));
+		_mm256_storeu_si256((__m256i *)(dst + n),
+				    _mm256_blendv_epi8(out, s, z));
+	}
+	return n;
+}
+
+static DMIX_SIMD_TARGET("avx2")
+unsigned int dmix_avx2_add_16(unsigned int size, signed int *acc,
+			      const signed short *src)
+{
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		__m256i s = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(src + n)));
+		__m256i a = _mm256_loadu_si256((const __m256i *)(acc + n));
+
+		_mm256_storeu_si256((__m256i *)(acc + n), _mm256_add_epi32(a, s));
+	}
+	return n;
+}
+
+static DMIX_SIMD_TARGET("avx2")
+unsigned int dmix_avx2_add_32(unsigned int size, signed int *acc,
+			      const signed int *src)
+{
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		__m256i s = _mm256_loadu_si256((const __m256i *)(src + n));
+		__m256i a = _mm256_loadu_si256((const __m256i *)(acc + n));
+
+		_mm256_storeu_si256((__m256i *)(acc + n),
+				    _mm256_add_epi32(a, _mm256_srai_epi32(s, 8)));
+	}
+	return n;
+}
+
+static DMIX_SIMD_TARGET("avx2")
+unsigned int dmix_avx2_store_16(unsigned int size, signed short *dst,
+				const signed int *acc)
+{
+	unsigned int n;
+
+	for (n = 0; n + 16 <= size; n += 16) {
+		__m256i lo = _mm256_loadu_si256((const __m256i *)(acc + n));
+		__m256i hi = _mm256_loadu_si256((const __m256i *)(acc + n + 8));
+
+		_mm256_storeu_si256((__m256i *)(dst + n),
+				    _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xd8));
+	}
+	return n;
+}
+
+static DMIX_SIMD_TARGET("avx2")
+unsigned int dmix_avx2_store_32(unsigned int size, signed int *dst,
+				const signed int *acc)
+{
+	const __m256i max = _mm256_set1_epi32(0x7fffff);
+	const __m256i min = _mm256_set1_epi32(-0x800000);
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(acc + n));
+		__m256i out;
+
+		out = _mm256_slli_epi32(_mm256_max_epi32(_mm256_min_epi32(a, max), min), 8);
+		out = _mm256_blendv_epi8(out, _mm256_set1_epi32(0x7fffffff),
+					 _mm256_cmpgt_epi32(a, max));
+		_mm256_storeu_si256((__m256i *)(dst + n), out);
+	}
+	return n;
+}
+
+#define DMIX_SIMD_KERNEL(isa, name, width, type, remix)			\
+static DMIX_SIMD_TARGET(#isa)						\
+unsigned int dmix_##isa##_##name(unsigned int size, type *dst,		\
+				 const type *src, signed int *sum)	\
+{									\
+	return dmix_##isa##_##width(size, dst, src, sum, remix);	\
+}
+
+DMIX_SIMD_KERNEL(sse2, mix_16, 16, signed short, 0)
+DMIX_SIMD_KERNEL(sse2, remix_16, 16, signed short, 1)
+DMIX_SIMD_KERNEL(sse2, mix_32, 32, signed int, 0)
+DMIX_SIMD_KERNEL(sse2, remix_32, 32, signed int, 1)
+DMIX_SIMD_KERNEL(ssse3, mix_24, 24, unsigned char, 0)
+DMIX_SIMD_KERNEL(ssse3, remix_24, 24, unsigned char, 1)
+DMIX_SIMD_KERNEL(avx2, mix_16, 16, signed short, 0)
+DMIX_SIMD_KERNEL(avx2, remix_16, 16, signed short, 1)
+DMIX_SIMD_KERNEL(avx2, mix_32, 32, signed int, 0)
+DMIX_SIMD_KERNEL(avx2, remix_32, 32, signed int, 1)
+
+#undef DMIX_SIMD_KERNEL
+
+static int dmix_simd_have_sse2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+}
+
+static int dmix_simd_have_ssse3(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("ssse3");
+}
+
+static int dmix_simd_have_avx2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+#endif /* DMIX_SIMD_X86 */
+
+#ifdef DMIX_SIMD_NEON
+#include <arm_neon.h>
+
+static inline __attribute__((always_inline))
+unsigned int dmix_neon_16(unsigned int size, signed short *dst,
+			  const signed short *src, signed int *sum, int remix)
+{
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		int16x8_t s = vld1q_s16(src + n);
+		int16x8_t z = vreinterpretq_s16_u16(vceqq_s16(vld1q_s16(dst + n),
+							      vdupq_n_s16(0)));
+		uint32x4_t zlo = vreinterpretq_u32_s32(vmovl_s16(vget_low_s16(z)));
+		uint32x4_t zhi = vreinterpretq_u32_s32(vmovl_s16(vget_high_s16(z)));
+		int32x4_t slo = vmovl_s16(vget_low_s16(s));
+		int32x4_t shi = vmovl_s16(vget_high_s16(s));
+		int32x4_t lo = vld1q_s32(sum + n);
+		int32x4_t hi = vld1q_s32(sum + n + 4);
+
+		if (remix) {
+			lo = vsubq_s32(lo, slo);
+			hi = vsubq_s32(hi, shi);
+			slo = vnegq_s32(slo);
+			shi = vnegq_s32(shi);
+		} else {
+			lo = vaddq_s32(lo, slo);
+			hi = vaddq_s32(hi, shi);
+		}
+		lo = vbslq_s32(zlo, slo, lo);
+		hi = vbslq_s32(zhi, shi, hi);
+		vst1q_s32(sum + n, lo);
+		vst1q_s32(sum + n + 4, hi);
+		vst1q_s16(dst + n, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+	}
+	return n;
+}
+
+static inline __attribute__((always_inline))
+unsigned int dmix_neon_32(unsigned int size, signed int *dst,
+			  const signed int *src, signed int *sum, int remix)
+{
+	const int32x4_t max = vdupq_n_s32(0x7fffff);
+	const int32x4_t min = vdupq_n_s32(-0x800000);
+	unsigned int n;
+
+	for (n = 0; n + 4 <= size; n += 4) {
+		int32x4_t s = vld1q_s32(src + n);
+		uint32x4_t z = vceqq_s32(vld1q_s32(dst + n), vdupq_n_s32(0));
+		int32x4_t v = vshrq_n_s32(s, 8);
+		int32x4_t sm = vld1q_s32(sum + n);
+		int32x4_t out;
+
+		if (remix) {
+			sm = vsubq_s32(sm, v);
+			v = vnegq_s32(v);
+			s = vnegq_s32(s);
+		} else {
+			sm = vaddq_s32(sm, v);
+		}
+		sm = vbslq_s32(z, v, sm);
+		vst1q_s32(sum + n, sm);
+		out = vshlq_n_s32(vmaxq_s32(vminq_s32(sm, max), min), 8);
+		out = vbslq_s32(vcgtq_s32(sm, max), vdupq_n_s32(0x7fffffff), out);
+		vst1q_s32(dst + n, vbslq_s32(z, s, out));
+	}
+	return n;
+}
+
+static unsigned int dmix_neon_add_16(unsigned int size, signed int *acc,
+				     const signed short *src)
+{
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		int16x8_t s = vld1q_s16(src + n);
+
+		vst1q_s32(acc + n, vaddw_s16(vld1q_s32(acc + n), vget_low_s16(s)));
+		vst1q_s32(acc + n + 4, vaddw_s16(vld1q_s32(acc + n + 4),
+						 vget_high_s16(s)));
+	}
+	return n;
+}
+
+static unsigned int dmix_neon_add_32(unsigned int size, signed int *acc,
+				     const signed int *src)
+{
+	unsigned int n;
+
+	for (n = 0; n + 4 <= size; n += 4)
+		vst1q_s32(acc + n, vsraq_n_s32(vld1q_s32(acc + n),
+					       vld1q_s32(src + n), 8));
+	return n;
+}
+
+static unsigned int dmix_neon_store_16(unsigned int size, signed short *dst,
+				       const signed int *acc)
+{
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8)
+		vst1q_s16(dst + n, vcombine_s16(vqmovn_s32(vld1q_s32(acc + n)),
+						vqmovn_s32(vld1q_s32(acc + n + 4))));
+	return n;
+}
+
+static unsigned int dmix_neon_store_32(unsigned int size, signed int *dst,
+				       const signed int *acc)
+{
+	const int32x4_t max = vdupq_n_s32(0x7fffff);
+	const int32x4_t min = vdupq_n_s32(-0x800000);
+	unsigned int n;
+
+	for (n = 0; n + 4 <= size; n += 4) {
+		int32x4_t a = vld1q_s32(acc + n);
+		int32x4_t out = vshlq_n_s32(vmaxq_s32(vminq_s32(a, max), min), 8);
+
+		out = vbslq_s32(vcgtq_s32(a, max), vdupq_n_s32(0x7fffffff), out);
+		vst1q_s32(dst + n, out);
+	}
+	return n;
+}
+
+#define DMIX_SIMD_KERNEL(name, width, type, remix)			\
+static unsigned int dmix_neon_##name(unsigned int size, type *dst,	\
+				     const type *src, signed int *sum)	\
+{									\
+	return dmix_neon_##width(size, dst, src, sum, remix);		\
+}
+
+DMIX_SIMD_KERNEL(mix_16, 16, signed short, 0)
+DMIX_SIMD_KERNEL(remix_16, 16, signed short, 1)
+DMIX_SIMD_KERNEL(mix_32, 32, signed int, 0)
+DMIX_SIMD_KERNEL(remix_32, 32, signed int, 1)
+
+#undef DMIX_SIMD_KERNEL
+
+static int dmix_simd_have_neon(void)
+{
+	return 1;
+}
+
+#endif /* DMIX_SIMD_NEON */
+
+/*
+ * kernel table, ordered by preference
+ */
+typedef unsigned int (dmix_simd_16_t)(unsigned int size, signed short *dst,
+				      const signed short *src, signed int *sum);
+typedef unsigned int (dmix_simd_32_t)(unsigned int size, signed int *dst,
+				      const signed int *src, signed int *sum);
+typedef unsigned int (dmix_simd_24_t)(unsigned int size, unsigned char *dst,
+				      const unsigned char *src, signed int *sum);
+typedef unsigned int (dmix_simd_add_16_t)(unsigned int size, signed int *acc,
+					  const signed short *src);
+typedef unsigned int (dmix_simd_add_32_t)(unsigned int size, signed int *acc,
+					  const signed int *src);
+typedef unsigned int (dmix_simd_store_16_t)(unsigned int size, signed short *dst,
+					    const signed int *acc);
+typedef unsigned int (dmix_simd_store_32_t)(unsigned int size, signed int *dst,
+					    const signed int *acc);
+
+typedef struct {
+	const char *name;
+	int (*available)(void);
+	dmix_simd_16_t *mix_16, *remix_16;
+	dmix_simd_32_t *mix_32, *remix_32;
+	dmix_simd_24_t *mix_24, *remix_24;	/* S24_3LE only */
+	/* staged mixing */
+	dmix_simd_add_16_t *add_16;
+	dmix_simd_add_32_t *add_32;
+	dmix_simd_store_16_t *store_16;
+	dmix_simd_store_32_t *store_32;
+} dmix_simd_kernel_t;
+
+static const dmix_simd_kernel_t dmix_simd_kernels[] = {
+#ifdef DMIX_SIMD_X86
+	{ "avx2", dmix_simd_have_avx2,
+	  dmix_avx2_mix_16, dmix_avx2_remix_16,
+	  dmix_avx2_mix_32, dmix_avx2_remix_32,
+	  NULL, NULL,
+	  dmix_avx2_add_16, dmix_avx2_add_32,
+	  dmix_avx2_store_16, dmix_avx2_store_32 },
+	{ "ssse3", dmix_simd_have_ssse3,
+	  NULL, NULL,
+	  NULL, NULL,
+	  dmix_ssse3_mix_24, dmix_ssse3_remix_24,
+	  NULL, NULL, NULL, NULL },
+	{ "sse2", dmix_simd_have_sse2,
+	  dmix_sse2_mix_16, dmix_sse2_remix_16,
+	  dmix_sse2_mix_32, dmix_sse2_remix_32,
+	  NULL, NULL,
+	  dmix_sse2_add_16, dmix_sse2_add_32,
+	  dmix_sse2_store_16, dmix_sse2_store_32 },
+#endif
+#ifdef DMIX_SIMD_NEON
+	{ "neon", dmix_simd_have_neon,
+	  dmix_neon_mix_16, dmix_neon_remix_16,
+	  dmix_neon_mix_32, dmix_neon_remix_32,
+	  NULL, NULL,
+	  dmix_neon_add_16, dmix_neon_add_32,
+	  dmix_neon_store_16, dmix_neon_store_32 },
+#endif
+	{ NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+	  NULL, NULL, NULL, NULL }
+};
@@ -0,0 +1,614 @@
+/*
+ * staged mixing
+ *
+ * Instead of adding each sample into the shared sum buffer, every client
+ * copies its data into a private ring in a shared segment (ipc_key + 2,
+ * or behind the sum buffer in its memfd) without any locking.  A mixer pass, run by whichever client holds the
+ * streams lock (snd_pcm_direct_lock()), sums the rings of all clients over a slave buffer
+ * region and writes the saturated result to the slave buffer.
+ *
+ * The rings are as large as the slave buffer and are indexed by the
+ * slave position, so a ring frame maps 1:1 to a slave buffer frame.
+ * Each ring publishes the valid region [start, appl) in slave positions.
+ *
+ * A region is mixed once all running clients have written it (or when
+ * the hardware gets close to it, so one stalled client cannot starve the
+ * others); data which arrives for an already mixed region (late writers,
+ * rewind) triggers a recompute of that region only.
+ */
+
+#define DMIX_STAGE_SLOTS	32
+#define DMIX_STAGE_CHUNK	1024	/* frames per mixer step */
+
+/*
+ * A slot belongs to the client holding its owner lock, a robust mutex
+ * (pcm_direct_lock.h) taken in stage_open() and released in
+ * stage_close().  When the client dies the kernel marks the lock and
+ * the next client opening the instance takes the slot over; no pid is
+ * interpreted, so clients in other pid namespaces keep their slots.
+ * Like any robust mutex, the lock belongs to the thread which opened
+ * the stream: a slot is reclaimed when that thread exits, and a stream
+ * closed from another thread frees its slot when the opening thread
+ * exits.
+ */
+
+/* shared among clients - be careful to be 32/64bit compatible! */
+struct dmix_stage_slot {
+	direct_futex_t owner;		/* held by the client of the slot */
+	unsigned int used;		/* claimed, 0 = free */
+	unsigned int active;		/* [start, appl) holds valid data */
+	unsigned long long start;	/* first valid slave position */
+	unsigned long long appl;	/* end of valid data */
+};
+
+struct dmix_stage {
+	unsigned long long mix_ptr;	/* slave positions before are mixed */
+	unsigned int frames;		/* ring size (slave buffer size) */
+	unsigned int channels;		/* slave channels */
+	unsigned int sample_bytes;
+	unsigned int pad;
+	struct dmix_stage_slot slot[DMIX_STAGE_SLOTS];
+	/* followed by DMIX_STAGE_SLOTS rings */
+};
+
+static inline size_t stage_ring_bytes(struct dmix_stage *st)
+{
+	return (size_t)st->frames * st->channels * st->sample_bytes;
+}
+
+static inline char *stage_ring(struct dmix_stage *st, int slot)
+{
+	return (char *)(st + 1) + slot * stage_ring_bytes(st);
+}
+
+static int stage_supported(snd_pcm_direct_t *dmix)
+{
+	const snd_pcm_channel_area_t *areas = snd_pcm_mmap_areas(dmix->spcm);
+	snd_pcm_format_t format = dmix->shmptr->s.format;
+	unsigned int chn, bits;
+
+	switch (format) {
+	case SND_PCM_FORMAT_S16_LE:
+	case SND_PCM_FORMAT_S16_BE:
+	case SND_PCM_FORMAT_S32_LE:
+	case SND_PCM_FORMAT_S32_BE:
+		if (!snd_pcm_format_cpu_endian(format))
+			return 0;
+		break;
+	default:
+		return 0;
+	}
+	/* the mixer pass writes whole frames */
+	bits = snd_pcm_format_physical_width(format);
+	for (chn = 0; chn < dmix->shmptr->s.channels; chn++) {
+		if (areas[chn].addr != areas[0].addr ||
+		    areas[chn].first != chn * bits ||
+		    areas[chn].step != dmix->shmptr->s.channels * bits)
+			return 0;
+	}
+	return 1;
+}
+
+/* signed distance from a to b in slave positions */
+static inline snd_pcm_sframes_t stage_diff(snd_pcm_direct_t *dmix,
+					   snd_pcm_uframes_t a,
+					   snd_pcm_uframes_t b)
+{
+	snd_pcm_sframes_t diff = b - a;
+
+	if (diff > (snd_pcm_sframes_t)(dmix->slave_boundary / 2))
+		diff -= dmix->slave_boundary;
+	else if (diff < -(snd_pcm_sframes_t)(dmix->slave_boundary / 2))
+		diff += dmix->slave_boundary;
+	return diff;
+}
+
+static inline snd_pcm_uframes_t stage_add(snd_pcm_direct_t *dmix,
+					  snd_pcm_uframes_t a,
+					  snd_pcm_sframes_t frames)
+{
+	snd_pcm_sframes_t pos = a + frames;
+
+	if (pos < 0)
+		pos += dmix->slave_boundary;
+	return (snd_pcm_uframes_t)pos % dmix->slave_boundary;
+}
+
+static size_t shm_stage_size(snd_pcm_direct_t *dmix)
+{
+	unsigned int sample_bytes;
+
+	sample_bytes = snd_pcm_format_physical_width(dmix->shmptr->s.format) / 8;
+	return sizeof(struct dmix_stage) +
+	       (size_t)DMIX_STAGE_SLOTS * dmix->shmptr->s.channels *
+	       dmix->shmptr->s.buffer_size * sample_bytes;
+}
+
+/* set up the ring layout, unless it matches the current slave setup */
+static int stage_check_layout(snd_pcm_direct_t *dmix, int reset)
+{
+	struct dmix_stage *st = dmix->u.dmix.stage;
+	unsigned int sample_bytes;
+	int slot, err;
+
+	sample_bytes = snd_pcm_format_physical_width(dmix->shmptr->s.format) / 8;
+	if (st->frames == dmix->shmptr->s.buffer_size &&
+	    st->channels == dmix->shmptr->s.channels &&
+	    st->sample_bytes == sample_bytes && !reset)
+		return 0;
+	if (!reset)
+		return -EINVAL;
+	memset(st, 0, shm_stage_size(dmix));
+	st->frames = dmix->shmptr->s.buffer_size;
+	st->channels = dmix->shmptr->s.channels;
+	st->sample_bytes = sample_bytes;
+	for (slot = 0; slot < DMIX_STAGE_SLOTS; slot++) {
+		err = direct_futex_init(&st->slot[slot].owner);
+		/* without the robust lock a crashed client keeps its slot */
+		if (err < 0 && err != -ENOSYS)
+			return err;
+	}
+	return 0;
+}
+
+/* claim the slot, 1 if it is ours now */
+static int stage_slot_claim(struct dmix_stage_slot *s)
+{
+	int err = direct_futex_trylock(&s->owner);
+
+	if (err == -ENOSYS)
+		return !s->used;
+	/* a dead owner's lock is taken over */
+	return err == 0;
+}
+
+static int shm_stage_discard(snd_pcm_direct_t *dmix)
+{
+	struct shmid_ds buf;
+	int ret = 0;
+
+	if (dmix->shmptr->use_memfd) {
+		/* unmapped together with the sum buffer */
+		dmix->u.dmix.stage = NULL;
+		return 0;
+	}
+	if (dmix->u.dmix.shmid_stage < 0)
+		return -EINVAL;
+	if (dmix->u.dmix.stage && dmix->u.dmix.stage != (void *) -1 &&
+	    shmdt(dmix->u.dmix.stage) < 0)
+		return -errno;
+	dmix->u.dmix.stage = NULL;
+	if (shmctl(dmix->u.dmix.shmid_stage, IPC_STAT, &buf) < 0)
+		return -errno;
+	if (buf.shm_nattch == 0) {	/* we're the last user, destroy the segment */
+		if (shmctl(dmix->u.dmix.shmid_stage, IPC_RMID, NULL) < 0)
+			return -errno;
+		ret = 1;
+	}
+	dmix->u.dmix.shmid_stage = -1;
+	return ret;
+}
+
+static int shm_stage_create_or_connect(snd_pcm_direct_t *dmix)
+{
+	struct shmid_ds buf;
+	int tmpid, err;
+	size_t size;
+
+	if (dmix->shmptr->use_memfd) {
+		/* the memfd is sized for the rings by memfd_sum_size() */
+		dmix->u.dmix.stage = (struct dmix_stage *)
+			((char *)dmix->u.dmix.sum_buffer + memfd_stage_offset(dmix));
+		if (stage_check_layout(dmix, 0) < 0)
+			stage_check_layout(dmix, 1);
+		return 0;
+	}
+	size = shm_stage_size(dmix);
+retryshm:
+	dmix->u.dmix.shmid_stage = shmget(dmix->ipc_key + 2, size,
+					  IPC_CREAT | dmix->ipc_perm);
+	err = -errno;
+	if (dmix->u.dmix.shmid_stage < 0) {
+		if (errno == EINVAL)
+		if ((tmpid = shmget(dmix->ipc_key + 2, 0, dmix->ipc_perm)) != -1)
+		if (!shmctl(tmpid, IPC_STAT, &buf))
+		if (!buf.shm_nattch)
+		/* no users so destroy the segment */
+		if (!shmctl(tmpid, IPC_RMID, NULL))
+		    goto retryshm;
+		return err;
+	}
+	if (shmctl(dmix->u.dmix.shmid_stage, IPC_STAT, &buf) < 0) {
+		err = -errno;
+		shm_stage_discard(dmix);
+		return err;
+	}
+	/* left behind by crashed clients with another slave setup */
+	if (buf.shm_nattch == 0 && buf.shm_segsz != size) {
+		if (shmctl(dmix->u.dmix.shmid_stage, IPC_RMID, NULL) < 0) {
+			err = -errno;
+			dmix->u.dmix.shmid_stage = -1;
+			return err;
+		}
+		goto retryshm;
+	}
+	if (dmix->ipc_gid >= 0) {
+		buf.shm_perm.gid = dmix->ipc_gid;
+		shmctl(dmix->u.dmix.shmid_stage, IPC_SET, &buf);
+	}
+	dmix->u.dmix.stage = shmat(dmix->u.dmix.shmid_stage, 0, 0);
+	if (dmix->u.dmix.stage == (void *) -1) {
+		err = -errno;
+		shm_stage_discard(dmix);
+		return err;
+	}
+	mlock(dmix->u.dmix.stage, size);
+	/* a stale segment from a previous dmix instance is simply reset,
+	 * a segment in use must match our slave setup
+	 */
+	err = stage_check_layout(dmix, buf.shm_nattch == 0);
+	if (err < 0) {
+		SNDERR("dmix staging rings in use with another slave setup");
+		shm_stage_discard(dmix);
+		return err;
+	}
+	return 0;
+}
+
+/*
+ * attach to the staging rings and claim a slot
+ * called with the client semaphore held
+ */
+static int stage_open(snd_pcm_direct_t *dmix)
+{
+	struct dmix_stage *st;
+	unsigned int chn, dchn, bits;
+	int slot, err;
+
+#ifdef DMIX_SIMD_ENABLED
+	simd_mix_init();
+#endif
+	err = shm_stage_create_or_connect(dmix);
+	if (err < 0)
+		return err;
+	st = dmix->u.dmix.stage;
+	if (direct_futex_check(&st->slot[0].owner) == -EINVAL) {
+		SNDERR("dmix staging rings in use by clients of another ABI");
+		shm_stage_discard(dmix);
+		return -EINVAL;
+	}
+	/* the running clients mix under the futex, not the semaphore */
+	if (dmix->lock_futex)
+		snd_pcm_direct_lock(dmix);
+	for (slot = 0; slot < DMIX_STAGE_SLOTS; slot++) {
+		if (stage_slot_claim(&st->slot[slot]))
+			break;
+	}
+	if (slot >= DMIX_STAGE_SLOTS) {
+		if (dmix->lock_futex)
+			snd_pcm_direct_unlock(dmix);
+		SNDERR("no free dmix staging slot (max %d clients)",
+		       DMIX_STAGE_SLOTS);
+		return -EBUSY;
+	}
+	st->slot[slot].used = 1;
+	st->slot[slot].active = 0;
+	if (dmix->lock_futex)
+		snd_pcm_direct_unlock(dmix);
+	/* unbound slave channels must stay silent */
+	memset(stage_ring(st, slot), 0, stage_ring_bytes(st));
+	dmix->u.dmix.stage_slot = slot;
+
+	dmix->u.dmix.stage_acc = malloc(DMIX_STAGE_CHUNK * st->channels *
+					sizeof(signed int));
+	dmix->u.dmix.stage_areas = calloc(dmix->channels,
+					  sizeof(snd_pcm_channel_area_t));
+	if (!dmix->u.dmix.stage_acc || !dmix->u.dmix.stage_areas)
+		return -ENOMEM;
+	bits = st->sample_bytes * 8;
+	for (chn = 0; chn < dmix->channels; chn++) {
+		dchn = dmix->bindings ? dmix->bindings[chn] : chn;
+		if (dchn >= st->channels)
+			continue;
+		dmix->u.dmix.stage_areas[chn].addr = stage_ring(st, slot);
+		dmix->u.dmix.stage_areas[chn].first = dchn * bits;
+		dmix->u.dmix.stage_areas[chn].step = st->channels * bits;
+	}
+	return 0;
+}
+
+/* called with the client semaphore held */
+static void stage_close(snd_pcm_direct_t *dmix)
+{
+	struct dmix_stage *st = dmix->u.dmix.stage;
+
+	if (st && dmix->u.dmix.stage_slot >= 0) {
+		if (dmix->lock_futex)
+			snd_pcm_direct_lock(dmix);
+		st->slot[dmix->u.dmix.stage_slot].active = 0;
+		st->slot[dmix->u.dmix.stage_slot].used = 0;
+		if (dmix->lock_futex)
+			snd_pcm_direct_unlock(dmix);
+		direct_futex_unlock(&st->slot[dmix->u.dmix.stage_slot].owner);
+	}
+	dmix->u.dmix.stage_slot = -1;
+	shm_stage_discard(dmix);
+	free(dmix->u.dmix.stage_acc);
+	dmix->u.dmix.stage_acc = NULL;
+	free(dmix->u.dmix.stage_areas);
+	dmix->u.dmix.stage_areas = NULL;
+}
+
+static void stage_acc_add(struct dmix_stage *st, signed int *acc,
+			  const char *src, unsigned int size)
+{
+	unsigned int n = 0;
+
+	if (st->sample_bytes == 2) {
+		const signed short *s = (const signed short *)src;
+#ifdef DMIX_SIMD_ENABLED
+		if (simd_kernel_stage)
+			n = simd_kernel_stage->add_16(size, acc, s);
+#endif
+		for (; n < size; n++)
+			acc[n] += s[n];
+	} else {
+		const signed int *s = (const signed int *)src;
+#ifdef DMIX_SIMD_ENABLED
+		if (simd_kernel_stage)
+			n = simd_kernel_stage->add_32(size, acc, s);
+#endif
+		for (; n < size; n++)
+			acc[n] += s[n] >> 8;
+	}
+}
+
+static void stage_acc_store(struct dmix_stage *st, char *dst,
+			    const signed int *acc, unsigned int size)
+{
+	unsigned int n = 0;
+	signed int sample;
+
+	if (st->sample_bytes == 2) {
+		signed short *d = (signed short *)dst;
+#ifdef DMIX_SIMD_ENABLED
+		if (simd_kernel_stage)
+			n = simd_kernel_stage->store_16(size, d, acc);
+#endif
+		for (; n < size; n++) {
+			sample = acc[n];
+			if (sample > 0x7fff)
+				sample = 0x7fff;
+			else if (sample < -0x8000)
+				sample = -0x8000;
+			d[n] = sample;
+		}
+	} else {
+		signed int *d = (signed int *)dst;
+#ifdef DMIX_SIMD_ENABLED
+		if (simd_kernel_stage)
+			n = simd_kernel_stage->store_32(size, d, acc);
+#endif
+		for (; n < size; n++) {
+			sample = acc[n];
+			if (sample > 0x7fffff)
+				sample = 0x7fffffff;
+			else if (sample < -0x800000)
+				sample = -0x80000000;
+			else
+				sample *= 256;
+			d[n] = sample;
+		}
+	}
+}
+
+/*
+ * sum all rings over [pos, pos + frames) into the slave buffer
+ * called with the streams lock held
+ */
+static void stage_mix_region(snd_pcm_direct_t *dmix, snd_pcm_uframes_t pos,
+			     snd_pcm_uframes_t frames)
+{
+	struct dmix_stage *st = dmix->u.dmix.stage;
+	const snd_pcm_channel_area_t *dst_areas = snd_pcm_mmap_areas(dmix->spcm);
+	size_t frame_bytes = (size_t)st->channels * st->sample_bytes;
+	snd_pcm_uframes_t idx, transfer;
+	snd_pcm_sframes_t lo, hi;
+	int slot;
+
+	while (frames > 0) {
+		idx = pos % st->frames;
+		transfer = frames;
+		if (transfer > st->frames - idx)
+			transfer = st->frames - idx;
+		if (transfer > DMIX_STAGE_CHUNK)
+			transfer = DMIX_STAGE_CHUNK;
+		memset(dmix->u.dmix.stage_acc, 0,
+		       transfer * st->channels * sizeof(signed int));
+		for (slot = 0; slot < DMIX_STAGE_SLOTS; slot++) {
+			struct dmix_stage_slot *s = &st->slot[slot];
+
+			if (!s->used || !s->active)
+				continue;
+			lo = stage_diff(dmix, pos, s->start);
+			hi = stage_diff(dmix, pos, s->appl);
+			if (lo < 0)
+				lo = 0;
+			if (hi > (snd_pcm_sframes_t)transfer)
+				hi = transfer;
+			if (hi <= lo)
+				continue;
+			stage_acc_add(st, dmix->u.dmix.stage_acc + lo * st->channels,
+				      stage_ring(st, slot) + (idx + lo) * frame_bytes,
+				      (hi - lo) * st->channels);
+		}
+		stage_acc_store(st, (char *)dst_areas[0].addr + idx * frame_bytes,
+				dmix->u.dmix.stage_acc, transfer * st->channels);
+		pos = stage_add(dmix, pos, transfer);
+		frames -= transfer;
+	}
+}
+
+/*
+ * recompute an already mixed region after our ring changed there
+ * called with the streams lock held
+ */
+static void stage_remix(snd_pcm_direct_t *dmix, snd_pcm_uframes_t from,
+			snd_pcm_uframes_t to)
+{
+	struct dmix_stage *st = dmix->u.dmix.stage;
+	snd_pcm_sframes_t diff;
+
+	/* don't touch what the hardware is already playing */
+	if (stage_diff(dmix, from, dmix->slave_hw_ptr) > 0)
+		from = dmix->slave_hw_ptr;
+	if (stage_diff(dmix, st->mix_ptr, to) > 0)
+		to = st->mix_ptr;
+	diff = stage_diff(dmix, from, to);
+	if (diff > 0)
+		stage_mix_region(dmix, from, diff);
+}
+
+/*
+ * the mixer pass: mix forward from mix_ptr up to where all running
+ * clients have written, or at least up to the end of the next slave
+ * period if any client has data for it
+ * called with the streams lock held
+ */
+static void stage_mix(snd_pcm_direct_t *dmix)
+{
+	struct dmix_stage *st = dmix->u.dmix.stage;
+	snd_pcm_uframes_t hw_ptr = dmix->slave_hw_ptr;
+	snd_pcm_sframes_t ahead, lo = -1, hi = -1, deadline, target;
+	int slot;
+
+	ahead = stage_diff(dmix, hw_ptr, st->mix_ptr);
+	if (ahead < 0 || ahead > (snd_pcm_sframes_t)st->frames)
+		st->mix_ptr = hw_ptr;
+	for (slot = 0; slot < DMIX_STAGE_SLOTS; slot++) {
+		struct dmix_stage_slot *s = &st->slot[slot];
+		snd_pcm_sframes_t diff;
+
+		if (!s->used || !s->active)
+			continue;
+		diff = stage_diff(dmix, st->mix_ptr, s->appl);
+		if (diff <= 0)
+			continue;
+		if (lo < 0 || diff < lo)
+			lo = diff;
+		if (diff > hi)
+			hi = diff;
+	}
+	if (hi <= 0)
+		return;
+	deadline = stage_diff(dmix, st->mix_ptr,
+			      hw_ptr - hw_ptr % dmix->slave_period_size) +
+		   2 * dmix->slave_period_size;
+	target = lo;
+	if (target < deadline)
+		target = deadline < hi ? deadline : hi;
+	stage_mix_region(dmix, st->mix_ptr, target);
+	st->mix_ptr = stage_add(dmix, st->mix_ptr, target);
+}
+
+/*
+ * copy the client data to our ring, no locking needed
+ */
+static void stage_write(snd_pcm_direct_t *dmix,
+			const snd_pcm_channel_area_t *src_areas,
+			snd_pcm_uframes_t appl_ptr,
+			snd_pcm_uframes_t slave_appl_ptr,
+			snd_pcm_uframes_t size,
+			snd_pcm_uframes_t buffer_size)
+{
+	struct dmix_stage *st = dmix->u.dmix.stage;
+	snd_pcm_uframes_t transfer;
+	unsigned int chn, dchn;
+
+	slave_appl_ptr %= st->frames;
+	while (size > 0) {
+		transfer = size;
+		if (appl_ptr + transfer > buffer_size)
+			transfer = buffer_size - appl_ptr;
+		if (slave_appl_ptr + transfer > st->frames)
+			transfer = st->frames - slave_appl_ptr;
+		if (!dmix->bindings && dmix->channels == st->channels) {
+			snd_pcm_areas_copy(dmix->u.dmix.stage_areas, slave_appl_ptr,
+					   src_areas, appl_ptr, dmix->channels,
+					   transfer, dmix->shmptr->s.format);
+		} else {
+			for (chn = 0; chn < dmix->channels; chn++) {
+				dchn = dmix->bindings ? dmix->bindings[chn] : chn;
+				if (dchn >= st->channels)
+					continue;
+				snd_pcm_area_copy(&dmix->u.dmix.stage_areas[chn],
+						  slave_appl_ptr, &src_areas[chn],
+						  appl_ptr, transfer,
+						  dmix->shmptr->s.format);
+			}
+		}
+		size -= transfer;
+		appl_ptr = (appl_ptr + transfer) % buffer_size;
+		slave_appl_ptr = (slave_appl_ptr + transfer) % st->frames;
+	}
+}
+
+/*
+ * publish [from, to) of our ring and run the mixer pass
+ */
+static void stage_commit(snd_pcm_direct_t *dmix, snd_pcm_uframes_t from,
+			 snd_pcm_uframes_t to)
+{
+	struct dmix_stage *st = dmix->u.dmix.stage;
+	struct dmix_stage_slot *s = &st->slot[dmix->u.dmix.stage_slot];
+
+	snd_pcm_direct_lock(dmix);
+	if (!s->active || s->appl != from) {
+		s->start = from;
+		s->active = 1;
+	}
+	s->appl = to;
+	if (stage_diff(dmix, s->start, s->appl) > (snd_pcm_sframes_t)st->frames)
+		s->start = stage_add(dmix, s->appl, -(snd_pcm_sframes_t)st->frames);
+	stage_remix(dmix, from, to);
+	stage_mix(dmix);
+	snd_pcm_direct_unlock(dmix);
+}
+
+/*
+ * drop the tail [to, appl) of our ring (rewind)
+ */
+static void stage_rewind(snd_pcm_direct_t *dmix, snd_pcm_uframes_t to)
+{
+	struct dmix_stage *st = dmix->u.dmix.stage;
+	struct dmix_stage_slot *s = &st->slot[dmix->u.dmix.stage_slot];
+	snd_pcm_uframes_t old;
+
+	snd_pcm_direct_lock(dmix);
+	if (s->active) {
+		old = s->appl;
+		if (stage_diff(dmix, s->start, to) < 0)
+			s->start = to;
+		s->appl = to;
+		stage_remix(dmix, to, old);
+	}
+	snd_pcm_direct_unlock(dmix);
+}
+
+/* mixer pass without new data, e.g. on a poll wakeup */
+static void stage_flush(snd_pcm_direct_t *dmix)
+{
+	snd_pcm_direct_lock(dmix);
+	stage_mix(dmix);
+	snd_pcm_direct_unlock(dmix);
+}
+
+/* our ring no longer contributes (stop, xrun) */
+static void stage_deactivate(snd_pcm_direct_t *dmix)
+{
+	if (!dmix->u.dmix.stage || dmix->u.dmix.stage_slot < 0)
+		return;
+	snd_pcm_direct_lock(dmix);
+	dmix->u.dmix.stage->slot[dmix->u.dmix.stage_slot].active = 0;
+	snd_pcm_direct_unlock(dmix);
+}
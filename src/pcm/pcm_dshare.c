@@ -628,6 +628,7 @@ static const snd_pcm_ops_t snd_pcm_dshare_ops = {
 	.munmap = snd_pcm_direct_munmap,
 	.get_chmap = snd_pcm_direct_get_chmap,
 	.set_chmap = snd_pcm_direct_set_chmap,
+	.get_slave = snd_pcm_direct_get_slave,
 };
 
 static const snd_pcm_fast_ops_t snd_pcm_dshare_fast_ops = {
@@ -714,6 +715,7 @@ int snd_pcm_dshare_open(snd_pcm_t **pcmp, const char *name,
 	dshare->ipc_key = opts->ipc_key;
 	dshare->ipc_perm = opts->ipc_perm;
 	dshare->ipc_gid = opts->ipc_gid;
+	dshare->ipc_lock = opts->ipc_lock;
 	dshare->semid = -1;
 	dshare->shmid = -1;
 
@@ -905,6 +907,7 @@ pcm.name {
 	ipc_key INT		# unique IPC key
 	ipc_key_add_uid BOOL	# add current uid to unique IPC key
 	ipc_perm INT		# IPC permissions (octal, default 0600)
+	ipc_lock STR		# lock of the running streams, sem (default) or futex
 	slave STR
 	# or
 	slave {			# Slave definition
@@ -44,6 +44,8 @@
 #include <sys/un.h>
 #include <sys/mman.h>
 #include "pcm_direct.h"
+#include "pcm_plugin.h"
+#include "pcm_dsnoop_conv.h"
 
 #ifndef PIC
 /* entry for static linking */
@@ -81,6 +83,11 @@ static void snoop_areas(snd_pcm_direct_t *dsnoop,
 	unsigned int chn, schn, channels;
 	snd_pcm_format_t format;
 
+	if (dsnoop->u.dsnoop.format != SND_PCM_FORMAT_UNKNOWN) {
+		snoop_convert_areas(dsnoop, src_areas, dst_areas,
+				    src_ofs, dst_ofs, size);
+		return;
+	}
 	channels = dsnoop->channels;
 	format = dsnoop->shmptr->s.format;
 	if (dsnoop->interleaved) {
@@ -407,6 +414,8 @@ static int snd_pcm_dsnoop_close(snd_pcm_t *pcm)
 			snd_pcm_direct_semaphore_final(dsnoop, DIRECT_IPC_SEM_CLIENT);
 	} else
 		snd_pcm_direct_semaphore_final(dsnoop, DIRECT_IPC_SEM_CLIENT);
+	free(dsnoop->u.dsnoop.areas);
+	free(dsnoop->u.dsnoop.gather);
 	free(dsnoop->bindings);
 	pcm->private_data = NULL;
 	free(dsnoop);
@@ -487,6 +496,11 @@ static void snd_pcm_dsnoop_dump(snd_pcm_t *pcm, snd_output_t *out)
 	snd_pcm_direct_t *dsnoop = pcm->private_data;
 
 	snd_output_printf(out, "Direct Snoop PCM\n");
+	if (dsnoop->u.dsnoop.format != SND_PCM_FORMAT_UNKNOWN)
+		snd_output_printf(out, "Conversion: %s -> %s%s\n",
+				  snd_pcm_format_name(dsnoop->shmptr->s.format),
+				  snd_pcm_format_name(dsnoop->u.dsnoop.format),
+				  dsnoop->u.dsnoop.fast_idx >= 0 ? " (vectorized)" : "");
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -511,6 +525,7 @@ static const snd_pcm_ops_t snd_pcm_dsnoop_ops = {
 	.query_chmaps = snd_pcm_direct_query_chmaps,
 	.get_chmap = snd_pcm_direct_get_chmap,
 	.set_chmap = snd_pcm_direct_set_chmap,
+	.get_slave = snd_pcm_direct_get_slave,
 };
 
 static const snd_pcm_fast_ops_t snd_pcm_dsnoop_fast_ops = {
@@ -589,6 +604,7 @@ int snd_pcm_dsnoop_open(snd_pcm_t **pcmp, const char *name,
 	dsnoop->ipc_key = opts->ipc_key;
 	dsnoop->ipc_perm = opts->ipc_perm;
 	dsnoop->ipc_gid = opts->ipc_gid;
+	dsnoop->ipc_lock = opts->ipc_lock;
 	dsnoop->semid = -1;
 	dsnoop->shmid = -1;
 
@@ -724,6 +740,10 @@ int snd_pcm_dsnoop_open(snd_pcm_t **pcmp, const char *name,
 	
 	if (dsnoop->channels == UINT_MAX)
 		dsnoop->channels = dsnoop->shmptr->s.channels;
+
+	ret = snoop_conversion_init(dsnoop, opts->format);
+	if (ret < 0)
+		goto _err;
 	
 	snd_pcm_direct_semaphore_up(dsnoop, DIRECT_IPC_SEM_CLIENT);
 
@@ -747,6 +767,8 @@ int snd_pcm_dsnoop_open(snd_pcm_t **pcmp, const char *name,
 
  _err_nosem:
 	if (dsnoop) {
+		free(dsnoop->u.dsnoop.areas);
+		free(dsnoop->u.dsnoop.gather);
 		free(dsnoop->bindings);
 		free(dsnoop);
 	}
@@ -771,6 +793,7 @@ pcm.name {
 	ipc_key INT		# unique IPC key
 	ipc_key_add_uid BOOL	# add current uid to unique IPC key
 	ipc_perm INT		# IPC permissions (octal, default 0600)
+	ipc_lock STR		# lock of the running streams, sem (default) or futex
 	slave STR
 	# or
 	slave {			# Slave definition
@@ -791,10 +814,20 @@ pcm.name {
 	bindings {		# note: this is client independent!!!
 		N INT		# maps slave channel to client channel N
 	}
+	format STR		# client format (default: the slave format)
 	slowptr BOOL		# slow but more precise pointer updates
 }
 \endcode
 
+Each client can capture its own format and, with \c bindings, its own
+subset of the slave channels.  The samples are converted while they are
+copied from the slave buffer, so no plug or linear plugin has to be
+stacked on top.  Any pair of linear formats is supported, including the
+3 byte formats (S24_3LE, S20_3LE, ...) and the 20 bit formats, which
+are converted like the linear plugin does through S32 samples; FLOAT
+only from and to S16 and S32.  Conversions between S16, S32, S24_3LE
+and FLOAT use vector instructions where the CPU provides them.
+
 \subsection pcm_plugins_dsnoop_funcref Function reference
 
 <UL>
@@ -0,0 +1,130 @@
+/*
+ *  PCM - Capture Stream Snooping - conversion to the client format
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* included after pcm_direct.h and pcm_plugin.h */
+
+/*
+ * frames gathered per block for the vectorized conversion of a channel
+ * subset, small enough to stay in the cache until they are converted
+ */
+#define SNOOP_GATHER_FRAMES	256
+
+/*
+ *  copy the slave samples of the bound channels and convert them to
+ *  the client format in one pass
+ */
+static void snoop_convert_areas(snd_pcm_direct_t *dsnoop,
+				const snd_pcm_channel_area_t *src_areas,
+				const snd_pcm_channel_area_t *dst_areas,
+				snd_pcm_uframes_t src_ofs,
+				snd_pcm_uframes_t dst_ofs,
+				snd_pcm_uframes_t size)
+{
+	unsigned int chn, channels = dsnoop->channels;
+	snd_pcm_format_t sformat = dsnoop->shmptr->s.format;
+	snd_pcm_channel_area_t *bound = dsnoop->u.dsnoop.areas;
+	snd_pcm_channel_area_t *gather = bound + channels;
+	unsigned int width;
+	snd_pcm_uframes_t frames;
+	int planar;
+
+	for (chn = 0; chn < channels; chn++)
+		bound[chn] = src_areas[dsnoop->bindings ? dsnoop->bindings[chn] : chn];
+	if (dsnoop->u.dsnoop.fast_idx < 0) {
+		if (dsnoop->u.dsnoop.use_getput)
+			snd_pcm_linear_getput(dst_areas, dst_ofs, bound, src_ofs,
+					      channels, size,
+					      dsnoop->u.dsnoop.get_idx,
+					      dsnoop->u.dsnoop.put_idx);
+		else
+			snd_pcm_linear_convert(dst_areas, dst_ofs, bound, src_ofs,
+					       channels, size,
+					       dsnoop->u.dsnoop.conv_idx);
+		return;
+	}
+	if (snd_pcm_linear_fast_convert(dst_areas, dst_ofs, bound, src_ofs, channels,
+					size, dsnoop->u.dsnoop.fast_idx) == 0)
+		return;
+
+	/*
+	 * the bound channels aren't contiguous in the slave buffer, gather
+	 * them in the layout of the client buffer so that the fast path
+	 * accepts them
+	 */
+	width = snd_pcm_format_physical_width(sformat);
+	planar = dst_areas[0].step ==
+		 (unsigned int)snd_pcm_format_physical_width(dsnoop->u.dsnoop.format);
+	for (chn = 0; chn < channels; chn++) {
+		gather[chn].addr = dsnoop->u.dsnoop.gather;
+		gather[chn].first = planar ? chn * SNOOP_GATHER_FRAMES * width : chn * width;
+		gather[chn].step = planar ? width : channels * width;
+	}
+	while (size > 0) {
+		frames = size > SNOOP_GATHER_FRAMES ? SNOOP_GATHER_FRAMES : size;
+		snd_pcm_areas_copy(gather, 0, bound, src_ofs, channels, frames, sformat);
+		snd_pcm_linear_fast_convert(dst_areas, dst_ofs, gather, 0, channels,
+					    frames, dsnoop->u.dsnoop.fast_idx);
+		src_ofs += frames;
+		dst_ofs += frames;
+		size -= frames;
+	}
+}
+
+/*
+ *  set up the conversion of the slave samples to the client format
+ */
+static int snoop_conversion_init(snd_pcm_direct_t *dsnoop, snd_pcm_format_t format)
+{
+	snd_pcm_format_t sformat = dsnoop->shmptr->s.format;
+	int linear;
+
+	dsnoop->u.dsnoop.format = SND_PCM_FORMAT_UNKNOWN;
+	dsnoop->u.dsnoop.conv_idx = -1;
+	dsnoop->u.dsnoop.use_getput = 0;
+	dsnoop->u.dsnoop.fast_idx = -1;
+	if (format == SND_PCM_FORMAT_UNKNOWN || format == sformat)
+		return 0;
+	linear = snd_pcm_format_linear(sformat) && snd_pcm_format_linear(format);
+	dsnoop->u.dsnoop.fast_idx = snd_pcm_linear_fast_index(sformat, format);
+	if (dsnoop->u.dsnoop.fast_idx < 0 && !linear) {
+		SNDERR("dsnoop cannot convert %s to %s",
+		       snd_pcm_format_name(sformat), snd_pcm_format_name(format));
+		return -EINVAL;
+	}
+	/* as the linear plugin does */
+	if (linear && snd_pcm_linear_use_getput(sformat, format)) {
+		dsnoop->u.dsnoop.use_getput = 1;
+		dsnoop->u.dsnoop.get_idx = snd_pcm_linear_get_index(sformat, SND_PCM_FORMAT_S32);
+		dsnoop->u.dsnoop.put_idx = snd_pcm_linear_put_index(SND_PCM_FORMAT_S32, format);
+	} else if (linear)
+		dsnoop->u.dsnoop.conv_idx = snd_pcm_linear_convert_index(sformat, format);
+	dsnoop->u.dsnoop.areas = calloc(dsnoop->channels * 2,
+					sizeof(*dsnoop->u.dsnoop.areas));
+	if (!dsnoop->u.dsnoop.areas)
+		return -ENOMEM;
+	if (dsnoop->u.dsnoop.fast_idx >= 0) {
+		dsnoop->u.dsnoop.gather = malloc(dsnoop->channels * SNOOP_GATHER_FRAMES *
+						 snd_pcm_format_physical_width(sformat) / 8);
+		if (!dsnoop->u.dsnoop.gather)
+			return -ENOMEM;
+	}
+	dsnoop->u.dsnoop.format = format;
+	return 0;
+}
@@ -0,0 +1,500 @@
+/**
+ * \file pcm/pcm_eventloop.c
+ * \ingroup PCM_Eventloop
+ * \brief PCM Event Loop Interface
+ * \date 2026
+ *
+ * The event loop waits for many PCMs and other descriptors (of the
+ * control, sequencer or timer handles, for example) at once.  The
+ * descriptors are fetched once at the registration and kept in one
+ * epoll set, so a wakeup costs only the handles which are ready.
+ */
+/*
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include "pcm_local.h"
+
+#ifndef DOC_HIDDEN
+
+#define EVENTLOOP_MIN_EVENTS	16
+
+struct eventloop_entry;
+
+typedef struct {
+	struct eventloop_entry *entry;
+	unsigned int idx;		/* in entry->pfds */
+	int fd;				/* registered descriptor, a dup if shared */
+} eventloop_fd_t;
+
+typedef struct eventloop_entry {
+	struct list_head list;
+	snd_pcm_t *pcm;
+	void *private_data;
+	struct pollfd *pfds;
+	eventloop_fd_t *efds;
+	unsigned int nfds;
+	unsigned int serial;		/* last wait which saw it ready */
+} eventloop_entry_t;
+
+struct _snd_pcm_eventloop {
+	int epfd;
+	struct list_head entries;
+	unsigned int count;		/* entries */
+	unsigned int nfds;		/* registered descriptors */
+	unsigned int serial;
+	struct epoll_event *ready;
+	unsigned int ready_size;
+	eventloop_entry_t **ready_entries;
+	unsigned int ready_entries_size;
+};
+
+static uint32_t poll_to_epoll(short events)
+{
+	uint32_t res = 0;
+
+	if (events & POLLIN)
+		res |= EPOLLIN;
+	if (events & POLLOUT)
+		res |= EPOLLOUT;
+	if (events & POLLPRI)
+		res |= EPOLLPRI;
+	return res;
+}
+
+static short epoll_to_poll(uint32_t events)
+{
+	short res = 0;
+
+	if (events & EPOLLIN)
+		res |= POLLIN;
+	if (events & EPOLLOUT)
+		res |= POLLOUT;
+	if (events & EPOLLPRI)
+		res |= POLLPRI;
+	if (events & EPOLLERR)
+		res |= POLLERR;
+	if (events & EPOLLHUP)
+		res |= POLLHUP;
+	return res;
+}
+
+static void eventloop_unregister(snd_pcm_eventloop_t *loop,
+				 eventloop_entry_t *entry, unsigned int nfds)
+{
+	unsigned int i;
+
+	for (i = 0; i < nfds; i++) {
+		eventloop_fd_t *efd = &entry->efds[i];
+
+		epoll_ctl(loop->epfd, EPOLL_CTL_DEL, efd->fd, NULL);
+		if (efd->fd != entry->pfds[i].fd)
+			close(efd->fd);
+	}
+}
+
+/*
+ * a descriptor can be registered only once in an epoll set, a second
+ * handle sharing it gets a dup of it
+ */
+static int eventloop_register(snd_pcm_eventloop_t *loop, eventloop_entry_t *entry)
+{
+	struct epoll_event ev;
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < entry->nfds; i++) {
+		eventloop_fd_t *efd = &entry->efds[i];
+
+		efd->entry = entry;
+		efd->idx = i;
+		efd->fd = entry->pfds[i].fd;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = poll_to_epoll(entry->pfds[i].events);
+		ev.data.ptr = efd;
+		err = epoll_ctl(loop->epfd, EPOLL_CTL_ADD, efd->fd, &ev);
+		if (err < 0 && errno == EEXIST) {
+			efd->fd = fcntl(entry->pfds[i].fd, F_DUPFD_CLOEXEC, 0);
+			if (efd->fd >= 0) {
+				err = epoll_ctl(loop->epfd, EPOLL_CTL_ADD, efd->fd, &ev);
+				if (err < 0)
+					close(efd->fd);
+			}
+		}
+		if (err < 0 || efd->fd < 0) {
+			err = -errno;
+			SYSERR("cannot add a descriptor to the epoll set");
+			eventloop_unregister(loop, entry, i);
+			return err;
+		}
+	}
+	return 0;
+}
+
+static int eventloop_grow(snd_pcm_eventloop_t *loop, unsigned int nfds)
+{
+	if (loop->nfds + nfds > loop->ready_size) {
+		unsigned int size = (loop->nfds + nfds) * 2;
+		struct epoll_event *ready;
+
+		ready = realloc(loop->ready, size * sizeof(*ready));
+		if (!ready)
+			return -ENOMEM;
+		loop->ready = ready;
+		loop->ready_size = size;
+	}
+	if (loop->count + 1 > loop->ready_entries_size) {
+		unsigned int size = (loop->count + 1) * 2;
+		eventloop_entry_t **entries;
+
+		entries = realloc(loop->ready_entries, size * sizeof(*entries));
+		if (!entries)
+			return -ENOMEM;
+		loop->ready_entries = entries;
+		loop->ready_entries_size = size;
+	}
+	return 0;
+}
+
+static int eventloop_add(snd_pcm_eventloop_t *loop, snd_pcm_t *pcm,
+			 const struct pollfd *pfds, unsigned int nfds,
+			 void *private_data)
+{
+	eventloop_entry_t *entry;
+	int err;
+
+	err = eventloop_grow(loop, nfds);
+	if (err < 0)
+		return err;
+	entry = calloc(1, sizeof(*entry));
+	if (!entry)
+		return -ENOMEM;
+	entry->pfds = malloc(nfds * sizeof(*entry->pfds));
+	entry->efds = malloc(nfds * sizeof(*entry->efds));
+	if (!entry->pfds || !entry->efds) {
+		err = -ENOMEM;
+		goto _err;
+	}
+	memcpy(entry->pfds, pfds, nfds * sizeof(*pfds));
+	entry->nfds = nfds;
+	entry->pcm = pcm;
+	entry->private_data = private_data;
+	err = eventloop_register(loop, entry);
+	if (err < 0)
+		goto _err;
+	list_add_tail(&entry->list, &loop->entries);
+	loop->count++;
+	loop->nfds += nfds;
+	return 0;
+
+ _err:
+	free(entry->pfds);
+	free(entry->efds);
+	free(entry);
+	return err;
+}
+
+static void eventloop_remove(snd_pcm_eventloop_t *loop, eventloop_entry_t *entry)
+{
+	eventloop_unregister(loop, entry, entry->nfds);
+	list_del(&entry->list);
+	loop->count--;
+	loop->nfds -= entry->nfds;
+	free(entry->pfds);
+	free(entry->efds);
+	free(entry);
+}
+
+static eventloop_entry_t *eventloop_find_pcm(snd_pcm_eventloop_t *loop, snd_pcm_t *pcm)
+{
+	struct list_head *pos;
+
+	list_for_each(pos, &loop->entries) {
+		eventloop_entry_t *entry = list_entry(pos, eventloop_entry_t, list);
+
+		if (entry->pcm == pcm)
+			return entry;
+	}
+	return NULL;
+}
+
+/*
+ * fills the events of the ready handles from the result of epoll_wait(),
+ * the handles which don't fit are reported again by the next wait
+ */
+static int eventloop_dispatch(snd_pcm_eventloop_t *loop, int n,
+			      snd_pcm_eventloop_event_t *events,
+			      unsigned int space)
+{
+	eventloop_entry_t *entry;
+	unsigned int i, j, nready = 0, count = 0;
+
+	if (++loop->serial == 0)
+		loop->serial = 1;
+	for (i = 0; i < (unsigned int)n; i++) {
+		eventloop_fd_t *efd = loop->ready[i].data.ptr;
+
+		entry = efd->entry;
+		if (entry->serial != loop->serial) {
+			entry->serial = loop->serial;
+			for (j = 0; j < entry->nfds; j++)
+				entry->pfds[j].revents = 0;
+			loop->ready_entries[nready++] = entry;
+		}
+		entry->pfds[efd->idx].revents = epoll_to_poll(loop->ready[i].events);
+	}
+
+	for (i = 0; i < nready && count < space; i++) {
+		snd_pcm_eventloop_event_t *ev = &events[count];
+		unsigned short revents = 0;
+
+		entry = loop->ready_entries[i];
+		ev->pcm = entry->pcm;
+		ev->private_data = entry->private_data;
+		ev->pfds = entry->pfds;
+		ev->nfds = entry->nfds;
+		ev->avail = 0;
+		if (entry->pcm) {
+			int err = snd_pcm_poll_descriptors_revents(entry->pcm,
+								   entry->pfds,
+								   entry->nfds,
+								   &revents);
+			if (err < 0) {
+				ev->revents = POLLERR;
+				ev->avail = err;
+				count++;
+				continue;
+			}
+			/* a wakeup for the stack only, not for the application */
+			if (!revents)
+				continue;
+			ev->avail = snd_pcm_avail_update(entry->pcm);
+		} else {
+			for (j = 0; j < entry->nfds; j++)
+				revents |= entry->pfds[j].revents;
+		}
+		ev->revents = revents;
+		count++;
+	}
+	return count;
+}
+
+#endif /* DOC_HIDDEN */
+
+/**
+ * \brief Create an empty event loop
+ * \param loopp Returned event loop handle
+ * \return 0 on success otherwise a negative error code
+ */
+int snd_pcm_eventloop_open(snd_pcm_eventloop_t **loopp)
+{
+	snd_pcm_eventloop_t *loop;
+	int err;
+
+	assert(loopp);
+	loop = calloc(1, sizeof(*loop));
+	if (!loop)
+		return -ENOMEM;
+	INIT_LIST_HEAD(&loop->entries);
+	loop->ready = malloc(EVENTLOOP_MIN_EVENTS * sizeof(*loop->ready));
+	if (!loop->ready) {
+		free(loop);
+		return -ENOMEM;
+	}
+	loop->ready_size = EVENTLOOP_MIN_EVENTS;
+	loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epfd < 0) {
+		err = -errno;
+		SYSERR("epoll_create1 failed");
+		free(loop->ready);
+		free(loop);
+		return err;
+	}
+	*loopp = loop;
+	return 0;
+}
+
+/**
+ * \brief Free an event loop
+ * \param loop Event loop handle
+ * \return 0 on success otherwise a negative error code
+ *
+ * The registered handles are not closed.
+ */
+int snd_pcm_eventloop_close(snd_pcm_eventloop_t *loop)
+{
+	assert(loop);
+	while (!list_empty(&loop->entries))
+		eventloop_remove(loop, list_entry(loop->entries.next,
+						  eventloop_entry_t, list));
+	close(loop->epfd);
+	free(loop->ready);
+	free(loop->ready_entries);
+	free(loop);
+	return 0;
+}
+
+/**
+ * \brief Add a PCM to an event loop
+ * \param loop Event loop handle
+ * \param pcm PCM handle
+ * \param private_data Value returned in the events of the PCM
+ * \return 0 on success otherwise a negative error code
+ *
+ * The poll descriptors of the PCM are fetched once here.  When they
+ * may have changed (the period event of the hw plugin is switched on
+ * or off by snd_pcm_sw_params(), for example), add the PCM again to
+ * refresh them.  The PCM must be removed before it is closed.
+ */
+int snd_pcm_eventloop_add_pcm(snd_pcm_eventloop_t *loop, snd_pcm_t *pcm,
+			      void *private_data)
+{
+	eventloop_entry_t *entry;
+	struct pollfd *pfds;
+	int count, err;
+
+	assert(loop && pcm);
+	entry = eventloop_find_pcm(loop, pcm);
+	if (entry)
+		eventloop_remove(loop, entry);
+	count = snd_pcm_poll_descriptors_count(pcm);
+	if (count <= 0)
+		return count < 0 ? count : -EINVAL;
+	pfds = alloca(count * sizeof(*pfds));
+	err = snd_pcm_poll_descriptors(pcm, pfds, count);
+	if (err < 0)
+		return err;
+	return eventloop_add(loop, pcm, pfds, err, private_data);
+}
+
+/**
+ * \brief Remove a PCM from an event loop
+ * \param loop Event loop handle
+ * \param pcm PCM handle
+ * \return 0 on success, -ENOENT when the PCM is not in the loop
+ */
+int snd_pcm_eventloop_remove_pcm(snd_pcm_eventloop_t *loop, snd_pcm_t *pcm)
+{
+	eventloop_entry_t *entry;
+
+	assert(loop && pcm);
+	entry = eventloop_find_pcm(loop, pcm);
+	if (!entry)
+		return -ENOENT;
+	eventloop_remove(loop, entry);
+	return 0;
+}
+
+/**
+ * \brief Add other poll descriptors to an event loop
+ * \param loop Event loop handle
+ * \param pfds Poll descriptors, as returned by snd_ctl_poll_descriptors(),
+ *        for example
+ * \param nfds Count of the descriptors
+ * \param private_data Value returned in the events of the descriptors
+ * \return 0 on success otherwise a negative error code
+ *
+ * The descriptors are reported together in one event.  Its pfds carry
+ * the revents to pass to the matching revents function, like
+ * snd_ctl_poll_descriptors_revents().
+ */
+int snd_pcm_eventloop_add_poll(snd_pcm_eventloop_t *loop,
+			       const struct pollfd *pfds, unsigned int nfds,
+			       void *private_data)
+{
+	assert(loop && pfds);
+	if (!nfds)
+		return -EINVAL;
+	return eventloop_add(loop, NULL, pfds, nfds, private_data);
+}
+
+/**
+ * \brief Remove poll descriptors from an event loop
+ * \param loop Event loop handle
+ * \param private_data Value given to snd_pcm_eventloop_add_poll()
+ * \return 0 on success, -ENOENT when no descriptors match
+ */
+int snd_pcm_eventloop_remove_poll(snd_pcm_eventloop_t *loop, void *private_data)
+{
+	struct list_head *pos, *npos;
+	int err = -ENOENT;
+
+	assert(loop);
+	list_for_each_safe(pos, npos, &loop->entries) {
+		eventloop_entry_t *entry = list_entry(pos, eventloop_entry_t, list);
+
+		if (!entry->pcm && entry->private_data == private_data) {
+			eventloop_remove(loop, entry);
+			err = 0;
+		}
+	}
+	return err;
+}
+
+/**
+ * \brief Wait for the handles of an event loop
+ * \param loop Event loop handle
+ * \param events Returned events of the ready handles
+ * \param space Space in the events array
+ * \param timeout maximum time in milliseconds to wait,
+ *        a negative value means infinity
+ * \return count of the ready handles, 0 on timeout, otherwise a negative
+ *         error code
+ *
+ * Only the handles whose descriptors are ready are visited.  For a PCM
+ * the revents are translated by snd_pcm_poll_descriptors_revents() and
+ * the avail is updated, wakeups which don't concern the application
+ * (the internal timers of the plugins, for example) are not reported
+ * and the wait goes on.  When more handles are ready than fit into the
+ * events array, the rest is reported by the next call.
+ */
+int snd_pcm_eventloop_wait(snd_pcm_eventloop_t *loop,
+			   snd_pcm_eventloop_event_t *events,
+			   unsigned int space, int timeout)
+{
+	struct timespec start, now;
+	int n, count, elapsed;
+
+	assert(loop && events);
+	if (!space)
+		return -EINVAL;
+	if (timeout > 0)
+		clock_gettime(CLOCK_MONOTONIC, &start);
+	for (;;) {
+		elapsed = 0;
+		if (timeout > 0) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			elapsed = (now.tv_sec - start.tv_sec) * 1000 +
+				  (now.tv_nsec - start.tv_nsec) / 1000000;
+			if (elapsed >= timeout)
+				return 0;
+		}
+		n = epoll_wait(loop->epfd, loop->ready, loop->ready_size,
+			       timeout > 0 ? timeout - elapsed : timeout);
+		if (n < 0)
+			return -errno;
+		if (n == 0)
+			return 0;
+		count = eventloop_dispatch(loop, n, events, space);
+		if (count > 0 || timeout == 0)
+			return count;
+	}
+}
@@ -473,6 +473,7 @@ static const snd_pcm_ops_t snd_pcm_extplug_ops = {
 	.query_chmaps = snd_pcm_extplug_query_chmaps,
 	.get_chmap = snd_pcm_extplug_get_chmap,
 	.set_chmap = snd_pcm_extplug_set_chmap,
+	.get_slave = snd_pcm_generic_get_slave,
 };
 
 #endif /* !DOC_HIDDEN */
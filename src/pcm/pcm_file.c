@@ -29,8 +29,12 @@
 #include "bswap.h"
 #include <ctype.h>
 #include <string.h>
+#include <time.h>
 #include "pcm_local.h"
 #include "pcm_plugin.h"
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #ifndef PIC
 /* entry for static linking */
@@ -45,13 +49,19 @@ const char *_snd_module_pcm_file = "";
 #define CHANNELS_KEY	'c'
 #define BWIDTH_KEY	'b'
 #define FORMAT_KEY	'f'
+#define INDEX_KEY	'n'	/* index of the file when rotating */
 
 /* maximum length of a value */
 #define VALUE_MAXLEN	64
 
+/* defaults of the writer thread */
+#define ASYNC_BUFFER_TIME	2000	/* ms */
+#define ASYNC_SYNC_TIME		0	/* ms, no fdatasync */
+
 typedef enum _snd_pcm_file_format {
 	SND_PCM_FILE_FORMAT_RAW,
-	SND_PCM_FILE_FORMAT_WAV
+	SND_PCM_FILE_FORMAT_WAV,
+	SND_PCM_FILE_FORMAT_RF64
 } snd_pcm_file_format_t;
 
 /* WAV format chunk */
@@ -64,6 +74,30 @@ struct wav_fmt {
 	short bits;
 };
 
+/* WAV header with a JUNK chunk reserving the room for the RF64 ds64 chunk */
+#define WAV_HEADER_MAX	80
+
+#ifdef HAVE_LIBPTHREAD
+/*
+ * a helper thread moving data between the file and a single producer,
+ * single consumer ring; the audio path side never waits for it
+ */
+typedef struct {
+	pthread_t thread;
+	int running;
+	int quit;
+	int sleeping;
+	int err;			/* errno of the first failed call */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;		/* wakes up the thread */
+	pthread_cond_t idle_cond;	/* the thread went to sleep */
+	char *buf;
+	size_t size;
+	size_t head;			/* bytes taken by the consumer */
+	size_t tail;			/* bytes queued by the producer */
+} snd_pcm_file_thread_t;
+#endif
+
 typedef struct {
 	snd_pcm_generic_t gen;
 	char *fname;
@@ -86,13 +120,35 @@ typedef struct {
 	snd_pcm_channel_area_t *wbuf_areas;
 	size_t buffer_bytes;
 	struct wav_fmt wav_header;
-	size_t filelen;
+	unsigned long long filelen;	/* data bytes in the current file */
+	unsigned int header_update_time;	/* ms, 0 = only at close */
+	struct timespec header_updated;
+	unsigned int rotate_time;	/* seconds per file, 0 = no rotation */
+	unsigned long long rotate_bytes;
+	unsigned int rotate_index;
+	/* writer thread */
+	int async;
+	unsigned int async_buffer_time;	/* ring size in ms */
+	unsigned int async_sync_time;	/* fdatasync interval in ms */
+	/* infile reader thread */
+	unsigned int prefetch_time;	/* ring size in ms, 0 = no thread */
+#ifdef HAVE_LIBPTHREAD
+	snd_pcm_file_thread_t writer;
+	unsigned long overruns;
+	unsigned long long lost_bytes;
+	snd_pcm_file_thread_t reader;
+	int reader_eof;
+	unsigned long underruns;
+	unsigned long long silence_frames;
+#endif
 } snd_pcm_file_t;
 
 #if __BYTE_ORDER == __LITTLE_ENDIAN
+#define TO_LE64(x)	(x)
 #define TO_LE32(x)	(x)
 #define TO_LE16(x)	(x)
 #else
+#define TO_LE64(x)	bswap_64(x)
 #define TO_LE32(x)	bswap_32(x)
 #define TO_LE16(x)	bswap_16(x)
 #endif
@@ -186,6 +242,15 @@ static int snd_pcm_file_replace_fname(snd_pcm_file_t *file, char **new_fname_p)
 					return err;
 				break;
 
+			case INDEX_KEY:
+				snprintf(value, sizeof(value), "%04u",
+					file->rotate_index);
+				err = snd_pcm_file_append_value(&new_fname,
+					&new_index_ch, &new_len, value);
+				if (err < 0)
+					return err;
+				break;
+
 			default:
 				/* non-key char, just copying */
 				*(new_index_ch++) = *(old_index_ch);
@@ -279,27 +344,72 @@ static void setup_wav_header(snd_pcm_t *pcm, struct wav_fmt *fmt)
 	fmt->bits = TO_LE16(fmt->bits);
 }
 
+static char *put_chunk(char *p, const char *id, unsigned int len)
+{
+	memcpy(p, id, 4);
+	len = TO_LE32(len);
+	memcpy(p + 4, &len, 4);
+	return p + 8;
+}
+
+static char *put_le64(char *p, unsigned long long val)
+{
+	uint64_t v = TO_LE64(val);
+
+	memcpy(p, &v, 8);
+	return p + 8;
+}
+
+/*
+ * build the header for the data written so far into buf, returns its size;
+ * an RF64 file starts as a WAV file and switches to RF64 above 4 GiB
+ */
+static size_t build_wav_header(snd_pcm_t *pcm, char *buf)
+{
+	snd_pcm_file_t *file = pcm->private_data;
+	int rf64 = file->format == SND_PCM_FILE_FORMAT_RF64;
+	unsigned long long limit = rf64 ? 0xffffffffULL : 0x7fffffffULL;
+	unsigned long long riff_len = file->filelen + (rf64 ? 72 : 36);
+	int large = rf64 && riff_len > limit;
+	char *p = buf;
+
+	if (large)
+		p = put_chunk(p, "RF64", 0xffffffff);
+	else
+		p = put_chunk(p, "RIFF", riff_len > limit ? limit : riff_len);
+	memcpy(p, "WAVE", 4);
+	p += 4;
+	if (rf64) {
+		p = put_chunk(p, large ? "ds64" : "JUNK", 28);
+		memset(p, 0, 28);
+		if (large) {
+			put_le64(p, riff_len);
+			put_le64(p + 8, file->filelen);
+			/* sample count, followed by an empty chunk table */
+			put_le64(p + 16, file->filelen * 8 / pcm->frame_bits);
+		}
+		p += 28;
+	}
+	p = put_chunk(p, "fmt ", sizeof(file->wav_header));
+	memcpy(p, &file->wav_header, sizeof(file->wav_header));
+	p += sizeof(file->wav_header);
+	if (large)
+		p = put_chunk(p, "data", 0xffffffff);
+	else
+		p = put_chunk(p, "data", file->filelen > limit ?
+			      limit : file->filelen);
+	return p - buf;
+}
+
 static int write_wav_header(snd_pcm_t *pcm)
 {
 	snd_pcm_file_t *file = pcm->private_data;
-	static const char header[] = {
-		'R', 'I', 'F', 'F',
-		0x24, 0, 0, 0,
-		'W', 'A', 'V', 'E',
-		'f', 'm', 't', ' ',
-		0x10, 0, 0, 0,
-	};
-	static const char header2[] = {
-		'd', 'a', 't', 'a',
-		0, 0, 0, 0
-	};
-	
-	setup_wav_header(pcm, &file->wav_header);
+	char buf[WAV_HEADER_MAX];
+	ssize_t n;
 
-	if (write(file->fd, header, sizeof(header)) != sizeof(header) ||
-	    write(file->fd, &file->wav_header, sizeof(file->wav_header)) !=
-	    sizeof(file->wav_header) ||
-	    write(file->fd, header2, sizeof(header2)) != sizeof(header2)) {
+	setup_wav_header(pcm, &file->wav_header);
+	n = build_wav_header(pcm, buf);
+	if (write(file->fd, buf, n) != n) {
 		int err = errno;
 		SYSERR("Write error.\n");
 		return -err;
@@ -311,41 +421,500 @@ static int write_wav_header(snd_pcm_t *pcm)
 static void fixup_wav_header(snd_pcm_t *pcm)
 {
 	snd_pcm_file_t *file = pcm->private_data;
-	int len, ret;
+	char buf[WAV_HEADER_MAX];
+	ssize_t n, ret;
+
+	/* rewritten as a whole, without moving the file position */
+	n = build_wav_header(pcm, buf);
+	ret = pwrite(file->fd, buf, n, 0);
+	if (ret < 0)
+		return;
+}
 
-	/* RIFF length */
-	if (lseek(file->fd, 4, SEEK_SET) == 4) {
-		len = (file->filelen + 0x24) > 0x7fffffff ?
-			0x7fffffff : (int)(file->filelen + 0x24);
-		len = TO_LE32(len);
-		ret = write(file->fd, &len, 4);
-		if (ret < 0)
-			return;
+/* close the current file and continue in the next one */
+static int snd_pcm_file_rotate(snd_pcm_t *pcm)
+{
+	snd_pcm_file_t *file = pcm->private_data;
+	int err;
+
+	if (file->wav_header.fmt)
+		fixup_wav_header(pcm);
+	close(file->fd);
+	file->fd = -1;
+	free(file->final_fname);
+	file->final_fname = NULL;
+	file->filelen = 0;
+	file->wav_header.fmt = 0;
+	file->rotate_index++;
+	err = snd_pcm_file_open_output_file(file);
+	if (err < 0) {
+		SYSERR("failed opening output file %s", file->fname);
+		return err;
 	}
-	/* data length */
-	if (lseek(file->fd, 0x28, SEEK_SET) == 0x28) {
-		len = file->filelen > 0x7fffffff ?
-			0x7fffffff : (int)file->filelen;
-		len = TO_LE32(len);
-		ret = write(file->fd, &len, 4);
-		if (ret < 0)
-			return;
+	return 0;
+}
+
+/*
+ * write data to the output file like write(), returns -errno on error;
+ * writes the header before the first data of a file, switches files at
+ * the rotation boundary and updates the header periodically
+ */
+static ssize_t snd_pcm_file_write_data(snd_pcm_t *pcm, const char *buf,
+				       size_t n)
+{
+	snd_pcm_file_t *file = pcm->private_data;
+	struct timespec now;
+	ssize_t err;
+
+	if (file->rotate_bytes && file->filelen >= file->rotate_bytes) {
+		err = snd_pcm_file_rotate(pcm);
+		if (err < 0)
+			return err;
+	}
+	if (file->format != SND_PCM_FILE_FORMAT_RAW &&
+	    !file->wav_header.fmt) {
+		err = write_wav_header(pcm);
+		if (err < 0)
+			return err;
+	}
+	/* the rotation boundary is a multiple of frames */
+	if (file->rotate_bytes && n > file->rotate_bytes - file->filelen)
+		n = file->rotate_bytes - file->filelen;
+	err = write(file->fd, buf, n);
+	if (err < 0)
+		return -errno;
+	file->filelen += err;
+	if (file->header_update_time) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if ((now.tv_sec - file->header_updated.tv_sec) * 1000 +
+		    (now.tv_nsec - file->header_updated.tv_nsec) / 1000000 >=
+		    (long)file->header_update_time) {
+			fixup_wav_header(pcm);
+			file->header_updated = now;
+		}
 	}
+	return err;
 }
 #endif /* DOC_HIDDEN */
 
 
 
+#ifdef HAVE_LIBPTHREAD
+/*
+ * Helper threads
+ *
+ * The writer thread flushes the data due for the file from its ring, the
+ * reader thread fills its ring from the infile ahead of the capture.  The
+ * audio path copies from or into the ring and publishes its position
+ * without waiting; when the ring is full (writer) or empty (reader) the
+ * frames are dropped or replaced with silence and counted.  The mutex
+ * and the condition variables are only used to put the thread to sleep,
+ * to wake it up and to wait for it in drain.
+ */
+
+static int snd_pcm_file_thread_start(snd_pcm_file_thread_t *t, size_t size,
+				     void *(*func)(void *), snd_pcm_t *pcm)
+{
+	int err;
+
+	t->buf = malloc(size);
+	if (!t->buf)
+		return -ENOMEM;
+	t->size = size;
+	t->head = t->tail = 0;
+	t->quit = 0;
+	t->sleeping = 0;
+	t->err = 0;
+	pthread_mutex_init(&t->mutex, NULL);
+	pthread_cond_init(&t->cond, NULL);
+	pthread_cond_init(&t->idle_cond, NULL);
+	err = pthread_create(&t->thread, NULL, func, pcm);
+	if (err) {
+		SNDERR("cannot create the file thread");
+		pthread_cond_destroy(&t->idle_cond);
+		pthread_cond_destroy(&t->cond);
+		pthread_mutex_destroy(&t->mutex);
+		free(t->buf);
+		t->buf = NULL;
+		return -err;
+	}
+	t->running = 1;
+	return 0;
+}
+
+static void snd_pcm_file_thread_stop(snd_pcm_file_thread_t *t)
+{
+	pthread_mutex_lock(&t->mutex);
+	t->quit = 1;
+	pthread_cond_signal(&t->cond);
+	pthread_mutex_unlock(&t->mutex);
+	pthread_join(t->thread, NULL);
+	t->running = 0;
+	pthread_cond_destroy(&t->idle_cond);
+	pthread_cond_destroy(&t->cond);
+	pthread_mutex_destroy(&t->mutex);
+	free(t->buf);
+	t->buf = NULL;
+}
+
+/*
+ * called by the thread: sleep until the audio path moves *pos away from
+ * seen, for 100ms at most; returns non-zero when the thread should quit
+ */
+static int snd_pcm_file_thread_sleep(snd_pcm_file_thread_t *t,
+				     size_t *pos, size_t seen)
+{
+	struct timespec ts;
+	int quit;
+
+	pthread_mutex_lock(&t->mutex);
+	pthread_cond_broadcast(&t->idle_cond);
+	__atomic_store_n(&t->sleeping, 1, __ATOMIC_SEQ_CST);
+	/* re-check against an audio path which missed the flag */
+	if (__atomic_load_n(pos, __ATOMIC_SEQ_CST) == seen && !t->quit) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += 100000000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_nsec -= 1000000000;
+			ts.tv_sec++;
+		}
+		pthread_cond_timedwait(&t->cond, &t->mutex, &ts);
+	}
+	__atomic_store_n(&t->sleeping, 0, __ATOMIC_SEQ_CST);
+	quit = t->quit;
+	pthread_mutex_unlock(&t->mutex);
+	return quit;
+}
+
+/* called by the audio path after publishing its position */
+static void snd_pcm_file_thread_wake(snd_pcm_file_thread_t *t)
+{
+	if (__atomic_load_n(&t->sleeping, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&t->mutex);
+		pthread_cond_signal(&t->cond);
+		pthread_mutex_unlock(&t->mutex);
+	}
+}
+
+static void *snd_pcm_file_writer_thread(void *data)
+{
+	snd_pcm_t *pcm = data;
+	snd_pcm_file_t *file = pcm->private_data;
+	snd_pcm_file_thread_t *t = &file->writer;
+	struct timespec synced, now;
+	size_t head = t->head;
+
+	clock_gettime(CLOCK_MONOTONIC, &synced);
+	for (;;) {
+		size_t tail = __atomic_load_n(&t->tail, __ATOMIC_ACQUIRE);
+		size_t n, ofs;
+		ssize_t err;
+
+		if (head == tail) {
+			/* quit only once everything queued is written */
+			if (snd_pcm_file_thread_sleep(t, &t->tail, tail) &&
+			    __atomic_load_n(&t->tail, __ATOMIC_ACQUIRE) == head)
+				break;
+			continue;
+		}
+
+		ofs = head % t->size;
+		n = tail - head;
+		if (n > t->size - ofs)
+			n = t->size - ofs;
+		err = snd_pcm_file_write_data(pcm, t->buf + ofs, n);
+		if (err < 0) {
+			if (err == -EINTR)
+				continue;
+			/* keep consuming, the error is reported on stop */
+			if (!t->err)
+				t->err = -err;
+			err = n;
+		}
+		head += err;
+		__atomic_store_n(&t->head, head, __ATOMIC_RELEASE);
+
+		if (file->async_sync_time) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if ((now.tv_sec - synced.tv_sec) * 1000 +
+			    (now.tv_nsec - synced.tv_nsec) / 1000000 >=
+			    (long)file->async_sync_time) {
+				fdatasync(file->fd);
+				synced = now;
+			}
+		}
+	}
+	if (file->async_sync_time)
+		fdatasync(file->fd);
+	return NULL;
+}
+
+static int snd_pcm_file_writer_start(snd_pcm_t *pcm)
+{
+	snd_pcm_file_t *file = pcm->private_data;
+	snd_pcm_t *slave = file->gen.slave;
+	snd_pcm_uframes_t frames;
+	size_t size;
+
+	/* called from hw_params, before the setup of pcm is filled in */
+	frames = (snd_pcm_uframes_t)slave->rate * file->async_buffer_time / 1000;
+	size = snd_pcm_frames_to_bytes(slave, frames);
+	if (size < file->wbuf_size_bytes)
+		size = file->wbuf_size_bytes;
+	file->overruns = 0;
+	file->lost_bytes = 0;
+	return snd_pcm_file_thread_start(&file->writer, size,
+					 snd_pcm_file_writer_thread, pcm);
+}
+
+/* write out the queued data and stop the writer */
+static void snd_pcm_file_writer_stop(snd_pcm_t *pcm)
+{
+	snd_pcm_file_t *file = pcm->private_data;
+
+	if (!file->writer.running)
+		return;
+	snd_pcm_file_thread_stop(&file->writer);
+	if (file->writer.err) {
+		errno = file->writer.err;
+		SYSERR("write failed");
+	}
+	if (file->overruns)
+		SNDERR("%lu writer overruns, %llu bytes dropped",
+		       file->overruns, file->lost_bytes);
+}
+
+/* wait until the writer has taken everything queued so far */
+static void snd_pcm_file_writer_flush(snd_pcm_t *pcm)
+{
+	snd_pcm_file_t *file = pcm->private_data;
+	snd_pcm_file_thread_t *t = &file->writer;
+
+	if (!t->running)
+		return;
+	pthread_mutex_lock(&t->mutex);
+	while (__atomic_load_n(&t->head, __ATOMIC_ACQUIRE) != t->tail) {
+		pthread_cond_signal(&t->cond);
+		pthread_cond_wait(&t->idle_cond, &t->mutex);
+	}
+	pthread_mutex_unlock(&t->mutex);
+}
+
+/* hand bytes from wbuf over to the writer, called instead of write() */
+static void snd_pcm_file_queue_bytes(snd_pcm_t *pcm, size_t bytes)
+{
+	snd_pcm_file_t *file = pcm->private_data;
+	snd_pcm_file_thread_t *t = &file->writer;
+	size_t frame_bytes = pcm->frame_bits / 8;
+	size_t tail = t->tail;
+	size_t space, queued;
+
+	space = t->size - (tail - __atomic_load_n(&t->head, __ATOMIC_ACQUIRE));
+	queued = bytes;
+	if (queued > space) {
+		/* the file fell behind, drop the frames which do not fit */
+		queued = space - space % frame_bytes;
+		file->overruns++;
+		file->lost_bytes += bytes - queued;
+	}
+	while (bytes > 0) {
+		size_t n = bytes;
+		size_t cont = file->wbuf_size_bytes - file->file_ptr_bytes;
+		if (n > cont)
+			n = cont;
+		if (queued > 0) {
+			size_t m = n < queued ? n : queued;
+			const char *src = file->wbuf + file->file_ptr_bytes;
+
+			while (m > 0) {
+				size_t ofs = tail % t->size;
+				size_t c = t->size - ofs;
+				if (c > m)
+					c = m;
+				memcpy(t->buf + ofs, src, c);
+				src += c;
+				tail += c;
+				queued -= c;
+				m -= c;
+			}
+		}
+		bytes -= n;
+		file->wbuf_used_bytes -= n;
+		file->file_ptr_bytes += n;
+		if (file->file_ptr_bytes == file->wbuf_size_bytes)
+			file->file_ptr_bytes = 0;
+	}
+	__atomic_store_n(&t->tail, tail, __ATOMIC_SEQ_CST);
+	snd_pcm_file_thread_wake(t);
+}
+
+static void *snd_pcm_file_reader_thread(void *data)
+{
+	snd_pcm_t *pcm = data;
+	snd_pcm_file_t *file = pcm->private_data;
+	snd_pcm_file_thread_t *t = &file->reader;
+	/* read in quarters of the ring, not in every freed frame */
+	size_t chunk = t->size / 4;
+	size_t tail = t->tail;
+	int primed = 0;
+
+	for (;;) {
+		size_t head = __atomic_load_n(&t->head, __ATOMIC_ACQUIRE);
+		size_t space = t->size - (tail - head);
+		size_t n, ofs;
+		ssize_t err;
+
+		if (space < chunk || file->reader_eof) {
+			if (snd_pcm_file_thread_sleep(t, &t->head, head))
+				break;
+			continue;
+		}
+		ofs = tail % t->size;
+		n = space;
+		if (n > t->size - ofs)
+			n = t->size - ofs;
+		err = read(file->ifd, t->buf + ofs, n);
+		if (err < 0) {
+			if (errno == EINTR)
+				continue;
+			t->err = errno;
+			err = 0;
+		}
+		if (err == 0) {
+			__atomic_store_n(&file->reader_eof, 1, __ATOMIC_RELEASE);
+			continue;
+		}
+		tail += err;
+		__atomic_store_n(&t->tail, tail, __ATOMIC_RELEASE);
+		if (!primed) {
+			/* let snd_pcm_file_reader_start() return */
+			pthread_mutex_lock(&t->mutex);
+			pthread_cond_broadcast(&t->idle_cond);
+			pthread_mutex_unlock(&t->mutex);
+			primed = 1;
+		}
+	}
+	return NULL;
+}
+
+static int snd_pcm_file_reader_start(snd_pcm_t *pcm)
+{
+	snd_pcm_file_t *file = pcm->private_data;
+	snd_pcm_file_thread_t *t = &file->reader;
+	snd_pcm_t *slave = file->gen.slave;
+	snd_pcm_uframes_t frames;
+	size_t size;
+	int err;
+
+	/* called from hw_params, before the setup of pcm is filled in */
+	frames = (snd_pcm_uframes_t)slave->rate * file->prefetch_time / 1000;
+	if (frames < slave->buffer_size * 2)
+		frames = slave->buffer_size * 2;
+	size = snd_pcm_frames_to_bytes(slave, frames);
+	file->reader_eof = 0;
+	file->underruns = 0;
+	file->silence_frames = 0;
+	err = snd_pcm_file_thread_start(t, size, snd_pcm_file_reader_thread, pcm);
+	if (err < 0)
+		return err;
+	/* wait for the first read, the capture should not start with silence */
+	pthread_mutex_lock(&t->mutex);
+	while (!__atomic_load_n(&t->tail, __ATOMIC_ACQUIRE) &&
+	       !__atomic_load_n(&file->reader_eof, __ATOMIC_ACQUIRE))
+		pthread_cond_wait(&t->idle_cond, &t->mutex);
+	pthread_mutex_unlock(&t->mutex);
+	return 0;
+}
+
+static void snd_pcm_file_reader_stop(snd_pcm_t *pcm)
+{
+	snd_pcm_file_t *file = pcm->private_data;
+	snd_pcm_file_thread_t *t = &file->reader;
+
+	if (!t->running)
+		return;
+	snd_pcm_file_thread_stop(t);
+	/* give back what was read ahead for the next hw_params */
+	if (t->tail != t->head)
+		lseek(file->ifd, -(off_t)(t->tail - t->head), SEEK_CUR);
+	if (t->err) {
+		errno = t->err;
+		SYSERR("read failed");
+	}
+	if (file->underruns)
+		SNDERR("%lu infile underruns, %llu frames of silence inserted",
+		       file->underruns, file->silence_frames);
+}
+
+/*
+ * take frames from the reader ring into areas; when the reader is late,
+ * the missing frames are silenced, at the end of the file fewer frames
+ * are returned
+ */
+static snd_pcm_uframes_t snd_pcm_file_fetch_frames(snd_pcm_t *pcm,
+						   const snd_pcm_channel_area_t *areas,
+						   snd_pcm_uframes_t frames)
+{
+	snd_pcm_file_t *file = pcm->private_data;
+	snd_pcm_file_thread_t *t = &file->reader;
+	snd_pcm_channel_area_t ring_areas[pcm->channels];
+	size_t frame_bytes = pcm->frame_bits / 8;
+	snd_pcm_uframes_t ring_frames = t->size / frame_bytes;
+	snd_pcm_uframes_t avail, got = 0;
+	size_t head = t->head;
+	unsigned int channel;
+	int eof;
+
+	/* eof first, the data before it is then published */
+	eof = __atomic_load_n(&file->reader_eof, __ATOMIC_ACQUIRE);
+	avail = (__atomic_load_n(&t->tail, __ATOMIC_ACQUIRE) - head) / frame_bytes;
+	for (channel = 0; channel < pcm->channels; channel++) {
+		ring_areas[channel].addr = t->buf;
+		ring_areas[channel].first = channel * pcm->sample_bits;
+		ring_areas[channel].step = pcm->frame_bits;
+	}
+	/* the ring size is a multiple of frames, frames never wrap */
+	while (got < frames && avail > 0) {
+		snd_pcm_uframes_t ofs = (head / frame_bytes) % ring_frames;
+		snd_pcm_uframes_t n = frames - got;
+		if (n > avail)
+			n = avail;
+		if (n > ring_frames - ofs)
+			n = ring_frames - ofs;
+		snd_pcm_areas_copy(areas, got, ring_areas, ofs,
+				   pcm->channels, n, pcm->format);
+		got += n;
+		avail -= n;
+		head += n * frame_bytes;
+	}
+	__atomic_store_n(&t->head, head, __ATOMIC_SEQ_CST);
+	snd_pcm_file_thread_wake(t);
+	if (got < frames && !eof) {
+		snd_pcm_areas_silence(areas, got, pcm->channels,
+				      frames - got, pcm->format);
+		file->underruns++;
+		file->silence_frames += frames - got;
+		got = frames;
+	}
+	return got;
+}
+#else /* HAVE_LIBPTHREAD */
+static inline void snd_pcm_file_writer_stop(snd_pcm_t *pcm ATTRIBUTE_UNUSED) {}
+static inline void snd_pcm_file_writer_flush(snd_pcm_t *pcm ATTRIBUTE_UNUSED) {}
+static inline void snd_pcm_file_reader_stop(snd_pcm_t *pcm ATTRIBUTE_UNUSED) {}
+#endif /* HAVE_LIBPTHREAD */
+
 static void snd_pcm_file_write_bytes(snd_pcm_t *pcm, size_t bytes)
 {
 	snd_pcm_file_t *file = pcm->private_data;
 	assert(bytes <= file->wbuf_used_bytes);
 
-	if (file->format == SND_PCM_FILE_FORMAT_WAV &&
-	    !file->wav_header.fmt) {
-		if (write_wav_header(pcm) < 0)
-			return;
+#ifdef HAVE_LIBPTHREAD
+	if (file->writer.running) {
+		snd_pcm_file_queue_bytes(pcm, bytes);
+		return;
 	}
+#endif
 
 	while (bytes > 0) {
 		snd_pcm_sframes_t err;
@@ -353,7 +922,7 @@ static void snd_pcm_file_write_bytes(snd_pcm_t *pcm, size_t bytes)
 		size_t cont = file->wbuf_size_bytes - file->file_ptr_bytes;
 		if (n > cont)
 			n = cont;
-		err = write(file->fd, file->wbuf + file->file_ptr_bytes, n);
+		err = snd_pcm_file_write_data(pcm, file->wbuf + file->file_ptr_bytes, n);
 		if (err < 0) {
 			SYSERR("write failed");
 			break;
@@ -363,8 +932,9 @@ static void snd_pcm_file_write_bytes(snd_pcm_t *pcm, size_t bytes)
 		file->file_ptr_bytes += err;
 		if (file->file_ptr_bytes == file->wbuf_size_bytes)
 			file->file_ptr_bytes = 0;
-		file->filelen += err;
-		if ((snd_pcm_uframes_t)err != n)
+		/* a short write at the rotation boundary is not an error */
+		if ((snd_pcm_uframes_t)err != n &&
+		    !(file->rotate_bytes && file->filelen == file->rotate_bytes))
 			break;
 	}
 }
@@ -401,6 +971,8 @@ static void snd_pcm_file_add_frames(snd_pcm_t *pcm,
 static int snd_pcm_file_close(snd_pcm_t *pcm)
 {
 	snd_pcm_file_t *file = pcm->private_data;
+	snd_pcm_file_writer_stop(pcm);
+	snd_pcm_file_reader_stop(pcm);
 	if (file->fname) {
 		if (file->wav_header.fmt)
 			fixup_wav_header(pcm);
@@ -449,6 +1021,7 @@ static int snd_pcm_file_drain(snd_pcm_t *pcm)
 		__snd_pcm_lock(pcm);
 		snd_pcm_file_write_bytes(pcm, file->wbuf_used_bytes);
 		assert(file->wbuf_used_bytes == 0);
+		snd_pcm_file_writer_flush(pcm);
 		__snd_pcm_unlock(pcm);
 	}
 	return err;
@@ -550,6 +1123,14 @@ static snd_pcm_sframes_t snd_pcm_file_readi(snd_pcm_t *pcm, void *buffer, snd_pc
 	n = _snd_pcm_readi(file->gen.slave, buffer, size);
 	if (n <= 0)
 		return n;
+#ifdef HAVE_LIBPTHREAD
+	if (file->reader.running) {
+		snd_pcm_areas_from_buf(pcm, areas, buffer);
+		n = snd_pcm_file_fetch_frames(pcm, areas, n);
+		snd_pcm_file_add_frames(pcm, areas, 0, n);
+		return n;
+	}
+#endif
 	if (file->ifd >= 0) {
 		__snd_pcm_lock(pcm);
 		n = read(file->ifd, buffer, n * pcm->frame_bits / 8);
@@ -570,6 +1151,17 @@ static snd_pcm_sframes_t snd_pcm_file_readn(snd_pcm_t *pcm, void **bufs, snd_pcm
 	snd_pcm_channel_area_t areas[pcm->channels];
 	snd_pcm_sframes_t n;
 
+#ifdef HAVE_LIBPTHREAD
+	if (file->reader.running) {
+		n = _snd_pcm_readn(file->gen.slave, bufs, size);
+		if (n > 0) {
+			snd_pcm_areas_from_bufs(pcm, areas, bufs);
+			n = snd_pcm_file_fetch_frames(pcm, areas, n);
+			snd_pcm_file_add_frames(pcm, areas, 0, n);
+		}
+		return n;
+	}
+#endif
 	if (file->ifd >= 0) {
 		SNDERR("DEBUG: Noninterleaved read not yet implemented.\n");
 		return 0;	/* TODO: Noninterleaved read */
@@ -606,6 +1198,8 @@ static snd_pcm_sframes_t snd_pcm_file_mmap_commit(snd_pcm_t *pcm,
 static int snd_pcm_file_hw_free(snd_pcm_t *pcm)
 {
 	snd_pcm_file_t *file = pcm->private_data;
+	snd_pcm_file_writer_stop(pcm);
+	snd_pcm_file_reader_stop(pcm);
 	free(file->wbuf);
 	free(file->wbuf_areas);
 	free(file->final_fname);
@@ -645,6 +1239,8 @@ static int snd_pcm_file_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 		a->first = slave->sample_bits * channel;
 		a->step = slave->frame_bits;
 	}
+	file->rotate_bytes = (unsigned long long)slave->rate *
+			     file->rotate_time * (slave->frame_bits / 8);
 	if (file->fd < 0) {
 		err = snd_pcm_file_open_output_file(file);
 		if (err < 0) {
@@ -652,6 +1248,23 @@ static int snd_pcm_file_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 			return err;
 		}
 	}
+#ifdef HAVE_LIBPTHREAD
+	if (file->async) {
+		err = snd_pcm_file_writer_start(pcm);
+		if (err < 0) {
+			snd_pcm_file_hw_free(pcm);
+			return err;
+		}
+	}
+	if (file->prefetch_time && file->ifd >= 0 &&
+	    pcm->stream == SND_PCM_STREAM_CAPTURE) {
+		err = snd_pcm_file_reader_start(pcm);
+		if (err < 0) {
+			snd_pcm_file_hw_free(pcm);
+			return err;
+		}
+	}
+#endif
 
 	/* pointer may have changed - e.g if plug is used. */
 	snd_pcm_unlink_hw_ptr(pcm, file->gen.slave);
@@ -673,6 +1286,16 @@ static void snd_pcm_file_dump(snd_pcm_t *pcm, snd_output_t *out)
 	if (file->final_fname)
 		snd_output_printf(out, "Final file PCM (file=%s)\n",
 				file->final_fname);
+#ifdef HAVE_LIBPTHREAD
+	if (file->writer.running)
+		snd_output_printf(out, "Writer thread (ring=%zu bytes, overruns=%lu, dropped=%llu bytes)\n",
+				  file->writer.size, file->overruns,
+				  file->lost_bytes);
+	if (file->reader.running)
+		snd_output_printf(out, "Reader thread (ring=%zu bytes, underruns=%lu, silenced=%llu frames)\n",
+				  file->reader.size, file->underruns,
+				  file->silence_frames);
+#endif
 
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
@@ -698,6 +1321,7 @@ static const snd_pcm_ops_t snd_pcm_file_ops = {
 	.query_chmaps = snd_pcm_generic_query_chmaps,
 	.get_chmap = snd_pcm_generic_get_chmap,
 	.set_chmap = snd_pcm_generic_set_chmap,
+	.get_slave = snd_pcm_generic_get_slave,
 };
 
 static const snd_pcm_fast_ops_t snd_pcm_file_fast_ops = {
@@ -741,7 +1365,7 @@ static const snd_pcm_fast_ops_t snd_pcm_file_fast_ops = {
  * \param ifd Input file descriptor (if (ifd < 0) && (ifname == NULL), no input
  *            redirection will be performed)
  * \param trunc Truncate the file if it already exists
- * \param fmt File format ("raw" or "wav" are available)
+ * \param fmt File format ("raw", "wav" or "rf64" are available)
  * \param perm File permission
  * \param slave Slave PCM handle
  * \param close_slave When set, the slave PCM handle is closed with copy PCM
@@ -769,6 +1393,8 @@ int snd_pcm_file_open(snd_pcm_t **pcmp, const char *name,
 		format = SND_PCM_FILE_FORMAT_RAW;
 	else if (!strcmp(fmt, "wav"))
 		format = SND_PCM_FILE_FORMAT_WAV;
+	else if (!strcmp(fmt, "rf64"))
+		format = SND_PCM_FILE_FORMAT_RF64;
 	else {
 		SNDERR("file format %s is unknown", fmt);
 		return -EINVAL;
@@ -854,17 +1480,60 @@ pcm.name {
 				# %b	bits per sample (replaced with: 16)
 				# %f	sample format string
 				#			(replaced with: S16_LE)
+				# %n	index of the file when rotating
+				#			(replaced with: 0000)
 				# %%	replaced with %
 	or
 	file INT		# Output file descriptor number
 	infile STR		# Input filename - only raw format
 	or
 	infile INT		# Input file descriptor number
-	[format STR]		# File format ("raw" or "wav")
+	[infile_prefetch_time INT]	# Read the infile ahead from a separate
+				# thread, size of its ring in ms (def. 0,
+				# read on demand)
+	[format STR]		# File format ("raw", "wav" or "rf64")
 	[perm INT]		# Output file permission (octal, def. 0600)
+	[header_update_time INT]	# Update the WAV header every INT ms
+				# (def. 0, only when closing)
+	[rotate_time INT]	# Continue in a new file every INT seconds
+				# (def. 0, no rotation)
+	[async BOOL]		# Write the file from a separate thread
+	[async_buffer_time INT]	# Size of the writer ring in ms (def. 2000)
+	[async_sync_time INT]	# fdatasync() interval of the writer in ms
+				# (def. 0, no fdatasync)
 }
 \endcode
 
+The "rf64" format writes a WAV file with a reserved chunk which becomes
+the ds64 chunk of an RF64 file when the data grows above 4 GiB, so long
+recordings are not limited by the 32 bit sizes of RIFF.  The sizes in the
+header are only written when the file is closed, unless
+\c header_update_time is set; then they are also updated after the data
+writes at that interval, so the file stays readable when the recording
+is interrupted.
+
+With \c rotate_time, the recording continues in a new file after that many
+seconds of audio.  The files split at frame boundaries and no frame is lost
+or repeated.  The file name has to contain the %n key, which is replaced by
+the index of the file.  Rotation is not available for pipes and file
+descriptors.
+
+With \c async set, the plugin copies the data due for the file into a ring
+which a writer thread flushes to the file, so a slow disk or pipe does not
+stall the audio path.  The ring holds \c async_buffer_time of audio; when
+the writer falls behind by more than that, the frames which do not fit are
+dropped and counted as writer overruns, which are reported when the stream
+is freed.  drain waits until the writer has written everything queued.
+With \c async_sync_time, the writer also calls fdatasync() at most every
+that many milliseconds and once when it stops.
+
+With \c infile_prefetch_time set, a reader thread keeps that much of the
+infile read ahead, so the capture path only copies from memory.  This
+also allows non-interleaved reads.  Frames the reader could not provide
+in time are replaced with silence and counted as infile underruns, which
+are reported when the stream is freed.  At the end of the file, reads
+return fewer frames as without the thread.
+
 \subsection pcm_plugins_file_funcref Function reference
 
 <UL>
@@ -895,10 +1564,16 @@ int _snd_pcm_file_open(snd_pcm_t **pcmp, const char *name,
 	int err;
 	snd_pcm_t *spcm;
 	snd_config_t *slave = NULL, *sconf;
+	snd_pcm_file_t *file;
 	const char *fname = NULL, *ifname = NULL;
 	const char *format = NULL;
 	long fd = -1, ifd = -1, trunc = 1;
 	long perm = 0600;
+	int async = 0;
+	long async_buffer_time = ASYNC_BUFFER_TIME;
+	long async_sync_time = ASYNC_SYNC_TIME;
+	long prefetch_time = 0;
+	long header_update_time = 0, rotate_time = 0;
 	snd_config_for_each(i, next, conf) {
 		snd_config_t *n = snd_config_iterator_entry(i);
 		const char *id;
@@ -959,6 +1634,53 @@ int _snd_pcm_file_open(snd_pcm_t **pcmp, const char *name,
 			trunc = err;
 			continue;
 		}
+		if (strcmp(id, "async") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return -EINVAL;
+			async = err;
+			continue;
+		}
+		if (strcmp(id, "async_buffer_time") == 0) {
+			err = snd_config_get_integer(n, &async_buffer_time);
+			if (err < 0 || async_buffer_time <= 0) {
+				SNDERR("Invalid value for %s", id);
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (strcmp(id, "header_update_time") == 0) {
+			err = snd_config_get_integer(n, &header_update_time);
+			if (err < 0 || header_update_time < 0) {
+				SNDERR("Invalid value for %s", id);
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (strcmp(id, "rotate_time") == 0) {
+			err = snd_config_get_integer(n, &rotate_time);
+			if (err < 0 || rotate_time < 0) {
+				SNDERR("Invalid value for %s", id);
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (strcmp(id, "infile_prefetch_time") == 0) {
+			err = snd_config_get_integer(n, &prefetch_time);
+			if (err < 0 || prefetch_time < 0) {
+				SNDERR("Invalid value for %s", id);
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (strcmp(id, "async_sync_time") == 0) {
+			err = snd_config_get_integer(n, &async_sync_time);
+			if (err < 0 || async_sync_time < 0) {
+				SNDERR("Invalid value for %s", id);
+				return -EINVAL;
+			}
+			continue;
+		}
 		SNDERR("Unknown field %s", id);
 		return -EINVAL;
 	}
@@ -985,15 +1707,38 @@ int _snd_pcm_file_open(snd_pcm_t **pcmp, const char *name,
 		SNDERR("file is not defined");
 		return -EINVAL;
 	}
+	if (rotate_time && (!fname || fname[0] == '|' || !strstr(fname, "%n"))) {
+		snd_config_delete(sconf);
+		SNDERR("rotate_time needs a file name with the %%n key");
+		return -EINVAL;
+	}
+#ifndef HAVE_LIBPTHREAD
+	if (async || prefetch_time) {
+		snd_config_delete(sconf);
+		SNDERR("async and infile_prefetch_time need pthread support");
+		return -EINVAL;
+	}
+#endif
 	err = snd_pcm_open_slave(&spcm, root, sconf, stream, mode, conf);
 	snd_config_delete(sconf);
 	if (err < 0)
 		return err;
 	err = snd_pcm_file_open(pcmp, name, fname, fd, ifname, ifd,
 				trunc, format, perm, spcm, 1, stream);
-	if (err < 0)
+	if (err < 0) {
 		snd_pcm_close(spcm);
-	return err;
+		return err;
+	}
+	file = (*pcmp)->private_data;
+	if (async) {
+		file->async = 1;
+		file->async_buffer_time = async_buffer_time;
+		file->async_sync_time = async_sync_time;
+	}
+	file->prefetch_time = prefetch_time;
+	file->header_update_time = header_update_time;
+	file->rotate_time = rotate_time;
+	return 0;
 }
 #ifndef DOC_HIDDEN
 SND_DLSYM_BUILD_VERSION(_snd_pcm_file_open, SND_PCM_DLSYM_VERSION);
@@ -346,4 +346,10 @@ int snd_pcm_generic_may_wait_for_avail_min(snd_pcm_t *pcm, snd_pcm_uframes_t ava
 	return snd_pcm_may_wait_for_avail_min(generic->slave, snd_pcm_mmap_avail(generic->slave));
 }
 
+snd_pcm_t *snd_pcm_generic_get_slave(snd_pcm_t *pcm)
+{
+	snd_pcm_generic_t *generic = pcm->private_data;
+	return generic->slave;
+}
+
 #endif /* DOC_HIDDEN */
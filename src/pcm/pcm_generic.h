@@ -111,6 +111,8 @@ typedef struct {
 	snd1_pcm_generic_set_chmap
 #define snd_pcm_generic_may_wait_for_avail_min \
 	snd1_pcm_generic_may_wait_for_avail_min
+#define snd_pcm_generic_get_slave \
+	snd1_pcm_generic_get_slave
 
 int snd_pcm_generic_close(snd_pcm_t *pcm);
 int snd_pcm_generic_nonblock(snd_pcm_t *pcm, int nonblock);
@@ -161,4 +163,5 @@ snd_pcm_chmap_query_t **snd_pcm_generic_query_chmaps(snd_pcm_t *pcm);
 snd_pcm_chmap_t *snd_pcm_generic_get_chmap(snd_pcm_t *pcm);
 int snd_pcm_generic_set_chmap(snd_pcm_t *pcm, const snd_pcm_chmap_t *map);
 int snd_pcm_generic_may_wait_for_avail_min(snd_pcm_t *pcm, snd_pcm_uframes_t avail);
+snd_pcm_t *snd_pcm_generic_get_slave(snd_pcm_t *pcm);
 
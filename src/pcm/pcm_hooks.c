@@ -168,6 +168,7 @@ static const snd_pcm_ops_t snd_pcm_hooks_ops = {
 	.query_chmaps = snd_pcm_generic_query_chmaps,
 	.get_chmap = snd_pcm_generic_get_chmap,
 	.set_chmap = snd_pcm_generic_set_chmap,
+	.get_slave = snd_pcm_generic_get_slave,
 };
 
 static const snd_pcm_fast_ops_t snd_pcm_hooks_fast_ops = {
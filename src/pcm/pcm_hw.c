@@ -37,9 +37,11 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/timerfd.h>
 #include "pcm_local.h"
 #include "../control/control_local.h"
 #include "../timer/timer_local.h"
+#include "pcm_hw_tsched.h"
 
 //#define DEBUG_RW		/* use to debug readi/writei/readn/writen */
 //#define DEBUG_MMAP		/* debug mmap_commit */
@@ -102,6 +104,10 @@ typedef struct {
 	snd_timer_t *period_timer;
 	struct pollfd period_timer_pfd;
 	int period_timer_need_poll;
+	/* timer scheduling */
+	int tsched_fd;			/* timerfd, -1 = period wakeups only */
+	unsigned int tsched_time;	/* configured watermark in usec */
+	snd_pcm_tsched_t tsched;
 	/* restricted parameters */
 	snd_pcm_format_t format;
 	int rate;
@@ -219,35 +225,119 @@ static int snd_pcm_hw_clear_timer_queue(snd_pcm_hw_t *hw)
 	return 0;
 }
 
-static int snd_pcm_hw_poll_descriptors_count(snd_pcm_t *pcm ATTRIBUTE_UNUSED)
+/* timer scheduling, see pcm_hw_tsched.h */
+static unsigned long long snd_pcm_hw_tsched_now(void)
 {
-	return 2;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * programs the timer from the hw_ptr in the status data, returns 1 when
+ * the wakeup point is already reached; the timer then expires at once,
+ * so poll() keeps reporting it like the level triggered PCM descriptor
+ */
+static int snd_pcm_hw_tsched_arm(snd_pcm_t *pcm, int wakeup)
+{
+	snd_pcm_hw_t *hw = pcm->private_data;
+	struct itimerspec spec;
+	snd_pcm_uframes_t avail;
+	unsigned long long ns;
+	int ret;
+
+	memset(&spec, 0, sizeof(spec));
+	if (!pcm->setup || FAST_PCM_STATE(hw) != SNDRV_PCM_STATE_RUNNING) {
+		/* the state changes are reported by the PCM descriptor */
+		timerfd_settime(hw->tsched_fd, 0, &spec, NULL);
+		hw->tsched.deadline = 0;
+		hw->tsched.sync_ns = 0;
+		return 0;
+	}
+	avail = snd_pcm_mmap_avail(pcm) +
+		tsched_lag(&hw->tsched, *pcm->hw.ptr, pcm->boundary, pcm->rate,
+			   snd_pcm_hw_tsched_now());
+	ret = tsched_wait(&hw->tsched, avail, pcm->avail_min, pcm->buffer_size,
+			  pcm->rate, wakeup, &ns);
+	if (ret)
+		ns = 1;
+	spec.it_value.tv_sec = ns / 1000000000ULL;
+	spec.it_value.tv_nsec = ns % 1000000000ULL;
+	timerfd_settime(hw->tsched_fd, 0, &spec, NULL);
+	return ret;
+}
+
+static int snd_pcm_hw_hwsync(snd_pcm_t *pcm);
+
+/* the same with a fresh hw_ptr, for the wakeups and the state changes */
+static int snd_pcm_hw_tsched_update(snd_pcm_t *pcm, int wakeup)
+{
+	snd_pcm_hw_t *hw = pcm->private_data;
+
+	if (pcm->setup && snd_pcm_hw_hwsync(pcm) >= 0)
+		tsched_sync(&hw->tsched, *pcm->hw.ptr, snd_pcm_hw_tsched_now());
+	return snd_pcm_hw_tsched_arm(pcm, wakeup);
+}
+
+/*
+ * the period timer is opened by snd_pcm_sw_params() with period_event
+ * set, so the count may change then and the descriptors have to be
+ * queried again
+ */
+static int snd_pcm_hw_poll_descriptors_count(snd_pcm_t *pcm)
+{
+	snd_pcm_hw_t *hw = pcm->private_data;
+
+	return 1 + (hw->period_timer != NULL) + (hw->tsched_fd >= 0);
 }
 
 static int snd_pcm_hw_poll_descriptors(snd_pcm_t *pcm, struct pollfd *pfds, unsigned int space)
 {
 	snd_pcm_hw_t *hw = pcm->private_data;
+	int count = snd_pcm_hw_poll_descriptors_count(pcm);
+	int idx = 1;
 
-	if (space < 2)
+	if (space < (unsigned int)count)
 		return -ENOMEM;
 	pfds[0].fd = hw->fd;
 	pfds[0].events = pcm->poll_events | POLLERR | POLLNVAL;
-	pfds[1].fd = hw->period_timer_pfd.fd;
-	pfds[1].events = POLLIN | POLLERR | POLLNVAL;
-	return 2;
+	if (hw->period_timer) {
+		pfds[idx].fd = hw->period_timer_pfd.fd;
+		pfds[idx++].events = POLLIN | POLLERR | POLLNVAL;
+	}
+	if (hw->tsched_fd >= 0) {
+		snd_pcm_hw_tsched_arm(pcm, 0);
+		pfds[idx].fd = hw->tsched_fd;
+		pfds[idx++].events = POLLIN | POLLERR | POLLNVAL;
+	}
+	return count;
 }
 
 static int snd_pcm_hw_poll_revents(snd_pcm_t *pcm, struct pollfd *pfds, unsigned nfds, unsigned short *revents)
 {
 	snd_pcm_hw_t *hw = pcm->private_data;
-	unsigned int events;
+	unsigned int events, idx = 1;
 
-	if (nfds != 2 || pfds[0].fd != hw->fd || pfds[1].fd != hw->period_timer_pfd.fd)
+	if (nfds != (unsigned int)snd_pcm_hw_poll_descriptors_count(pcm) ||
+	    pfds[0].fd != hw->fd)
 		return -EINVAL;
 	events = pfds[0].revents;
-	if (pfds[1].revents & POLLIN) {
-		snd_pcm_hw_clear_timer_queue(hw);
-		events |= pcm->poll_events & ~(POLLERR|POLLNVAL);
+	if (hw->period_timer) {
+		if (pfds[idx].fd != hw->period_timer_pfd.fd)
+			return -EINVAL;
+		if (pfds[idx].revents & POLLIN) {
+			snd_pcm_hw_clear_timer_queue(hw);
+			events |= pcm->poll_events & ~(POLLERR|POLLNVAL);
+		}
+		idx++;
+	}
+	if (hw->tsched_fd >= 0) {
+		if (pfds[idx].fd != hw->tsched_fd)
+			return -EINVAL;
+		if ((pfds[idx].revents & POLLIN) &&
+		    snd_pcm_hw_tsched_update(pcm, 1) > 0)
+			events |= pcm->poll_events & ~(POLLERR|POLLNVAL);
 	}
 	*revents = events;
 	return 0;
@@ -474,7 +564,8 @@ static int snd_pcm_hw_change_timer(snd_pcm_t *pcm, int enable)
 		pcm->fast_ops = &snd_pcm_hw_fast_ops_timer;
 	} else {
 		snd_pcm_hw_close_timer(hw);
-		pcm->fast_ops = &snd_pcm_hw_fast_ops;
+		if (hw->tsched_fd < 0)
+			pcm->fast_ops = &snd_pcm_hw_fast_ops;
 		hw->period_event = 0;
 	}
 	return 0;
@@ -498,6 +589,12 @@ static int snd_pcm_hw_sw_params(snd_pcm_t *pcm, snd_pcm_sw_params_t * params)
 	snd_pcm_hw_t *hw = pcm->private_data;
 	int fd = hw->fd, err;
 	int old_period_event = sw_get_period_event(params);
+
+	if (hw->tsched_fd >= 0) {
+		/* the hw parameters are known here, fix the watermark */
+		tsched_setup(&hw->tsched, hw->tsched_time, pcm->rate,
+			     pcm->buffer_size);
+	}
 	sw_set_period_event(params, 0);
 	if ((snd_pcm_tstamp_t) params->tstamp_mode == pcm->tstamp_mode &&
 	    (snd_pcm_tstamp_type_t) params->tstamp_type == pcm->tstamp_type &&
@@ -688,6 +785,8 @@ static int snd_pcm_hw_start(snd_pcm_t *pcm)
 #endif
 		return err;
 	}
+	if (hw->tsched_fd >= 0)
+		snd_pcm_hw_tsched_update(pcm, 0);
 	return 0;
 }
 
@@ -701,6 +800,8 @@ static int snd_pcm_hw_drop(snd_pcm_t *pcm)
 		return err;
 	} else {
 	}
+	if (hw->tsched_fd >= 0)
+		snd_pcm_hw_tsched_arm(pcm, 0);
 	return 0;
 }
 
@@ -725,6 +826,8 @@ static int snd_pcm_hw_pause(snd_pcm_t *pcm, int enable)
 		SYSMSG("SNDRV_PCM_IOCTL_PAUSE failed (%i)", err);
 		return err;
 	}
+	if (hw->tsched_fd >= 0)
+		snd_pcm_hw_tsched_update(pcm, 0);
 	return 0;
 }
 
@@ -862,6 +965,8 @@ static snd_pcm_sframes_t snd_pcm_hw_writei(snd_pcm_t *pcm, const void *buffer, s
 #endif
 	if (err < 0)
 		return snd_pcm_check_error(pcm, err);
+	if (hw->tsched_fd >= 0)
+		snd_pcm_hw_tsched_arm(pcm, 0);
 	return xferi.result;
 }
 
@@ -883,6 +988,8 @@ static snd_pcm_sframes_t snd_pcm_hw_writen(snd_pcm_t *pcm, void **bufs, snd_pcm_
 #endif
 	if (err < 0)
 		return snd_pcm_check_error(pcm, err);
+	if (hw->tsched_fd >= 0)
+		snd_pcm_hw_tsched_arm(pcm, 0);
 	return xfern.result;
 }
 
@@ -904,6 +1011,8 @@ static snd_pcm_sframes_t snd_pcm_hw_readi(snd_pcm_t *pcm, void *buffer, snd_pcm_
 #endif
 	if (err < 0)
 		return snd_pcm_check_error(pcm, err);
+	if (hw->tsched_fd >= 0)
+		snd_pcm_hw_tsched_arm(pcm, 0);
 	return xferi.result;
 }
 
@@ -925,6 +1034,8 @@ static snd_pcm_sframes_t snd_pcm_hw_readn(snd_pcm_t *pcm, void **bufs, snd_pcm_u
 #endif
 	if (err < 0)
 		return snd_pcm_check_error(pcm, err);
+	if (hw->tsched_fd >= 0)
+		snd_pcm_hw_tsched_arm(pcm, 0);
 	return xfern.result;
 }
 
@@ -1075,6 +1186,8 @@ static int snd_pcm_hw_close(snd_pcm_t *pcm)
 
 	unmap_status_and_control_data(hw);
 
+	if (hw->tsched_fd >= 0)
+		close(hw->tsched_fd);
 	free(hw);
 	return err;
 }
@@ -1087,6 +1200,8 @@ static snd_pcm_sframes_t snd_pcm_hw_mmap_commit(snd_pcm_t *pcm,
 
 	snd_pcm_mmap_appl_forward(pcm, size);
 	issue_applptr(hw);
+	if (hw->tsched_fd >= 0)
+		snd_pcm_hw_tsched_arm(pcm, 0);
 #ifdef DEBUG_MMAP
 	fprintf(stderr, "appl_forward: hw_ptr = %li, appl_ptr = %li, size = %li\n", *pcm->hw.ptr, *pcm->appl.ptr, size);
 #endif
@@ -1413,6 +1528,8 @@ static void snd_pcm_hw_dump(snd_pcm_t *pcm, snd_output_t *out)
 		snd_pcm_dump_setup(pcm, out);
 		snd_output_printf(out, "  appl_ptr     : %li\n", hw->mmap_control->appl_ptr);
 		snd_output_printf(out, "  hw_ptr       : %li\n", hw->mmap_status->hw_ptr);
+		if (hw->tsched_fd >= 0)
+			snd_output_printf(out, "  tsched_wm    : %lu\n", hw->tsched.watermark);
 	}
 }
 
@@ -1593,6 +1710,7 @@ int snd_pcm_hw_open_fd(snd_pcm_t **pcmp, const char *name, int fd,
 	hw->device = info.device;
 	hw->subdevice = info.subdevice;
 	hw->fd = fd;
+	hw->tsched_fd = -1;
 	/* no restriction */
 	hw->format = SND_PCM_FORMAT_UNKNOWN;
 	hw->rate = 0;
@@ -1714,6 +1832,23 @@ int snd_pcm_hw_open(snd_pcm_t **pcmp, const char *name,
 	return ret;
 }
 
+/* switch to the timer scheduling, the watermark is given in usec */
+static int snd_pcm_hw_set_tsched(snd_pcm_t *pcm, unsigned int watermark_time)
+{
+	snd_pcm_hw_t *hw = pcm->private_data;
+	int fd;
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0) {
+		SYSERR("Cannot create timerfd");
+		return -errno;
+	}
+	hw->tsched_fd = fd;
+	hw->tsched_time = watermark_time;
+	pcm->fast_ops = &snd_pcm_hw_fast_ops_timer;
+	return 0;
+}
+
 /*! \page pcm_plugins
 
 \section pcm_plugins_hw Plugin: hw
@@ -1740,9 +1875,24 @@ pcm.name {
 	[channels INT]		# Restrict only to the given channels
 	[rate INT]		# Restrict only to the given rate
 	[chmap MAP]		# Override channel maps; MAP is a string array
+	[tsched BOOL]		# Timer scheduled wakeups (default false)
+	[tsched_watermark INT]	# Wakeup watermark in usec (default 20000)
 }
 \endcode
 
+With \c tsched, the poll descriptors include a timer which is programmed
+from the current hardware position and the rate, so that poll() returns
+when the avail reaches avail_min, but at the latest when only the
+watermark is left in the buffer (in playback) or free (in capture).
+The wakeups don't depend on the period interrupts then: large buffers
+with few periods, or even with period wakeups disabled by
+snd_pcm_hw_params_set_period_wakeup(), can be used with poll().  When a
+wakeup comes too late, the watermark is raised, up to a half of the
+buffer, and it slowly returns to the configured value afterwards.
+Since the period event of the sw params adds a timer of its own, the
+number of the poll descriptors changes with it: query them again after
+snd_pcm_sw_params().
+
 \subsection pcm_plugins_hw_funcref Function reference
 
 <UL>
@@ -1778,6 +1928,8 @@ int _snd_pcm_hw_open(snd_pcm_t **pcmp, const char *name,
 	int nonblock = 1; /* non-block per default */
 	snd_pcm_chmap_query_t **chmap = NULL;
 	snd_pcm_hw_t *hw;
+	int tsched = 0;
+	long tsched_time = TSCHED_DEFAULT_TIME;
 
 	/* look for defaults.pcm.nonblock definition */
 	if (snd_config_search(root, "defaults.pcm.nonblock", &n) >= 0) {
@@ -1869,6 +2021,22 @@ int _snd_pcm_hw_open(snd_pcm_t **pcmp, const char *name,
 			channels = val;
 			continue;
 		}
+		if (strcmp(id, "tsched") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				continue;
+			tsched = err;
+			continue;
+		}
+		if (strcmp(id, "tsched_watermark") == 0) {
+			err = snd_config_get_integer(n, &tsched_time);
+			if (err < 0 || tsched_time <= 0) {
+				SNDERR("Invalid value for %s", id);
+				err = -EINVAL;
+				goto fail;
+			}
+			continue;
+		}
 		if (strcmp(id, "chmap") == 0) {
 			snd_pcm_free_chmaps(chmap);
 			chmap = _snd_pcm_parse_config_chmaps(n);
@@ -1914,6 +2082,13 @@ int _snd_pcm_hw_open(snd_pcm_t **pcmp, const char *name,
 		hw->rate = rate;
 	if (chmap)
 		hw->chmap_override = chmap;
+	if (tsched) {
+		err = snd_pcm_hw_set_tsched(*pcmp, tsched_time);
+		if (err < 0) {
+			snd_pcm_close(*pcmp);
+			return err;
+		}
+	}
 
 	return 0;
 
@@ -0,0 +1,138 @@
+/*
+ *  PCM - Hardware - timer scheduling arithmetic
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* included after pcm_local.h or asoundlib.h */
+
+/*
+ * The timer is programmed for the moment the avail reaches the wakeup
+ * point, the smaller of avail_min and the buffer size minus the
+ * watermark, computed from the hw_ptr and the rate.  When a wakeup comes
+ * so late that less than half of the watermark was left, the watermark
+ * grows by half; after a run of wakeups in time it shrinks back towards
+ * the configured value.
+ *
+ * The hw_ptr in the status data is refreshed by the kernel only at the
+ * period interrupts, unless it is synced.  Between the syncs the frames
+ * played or captured since the last sync are estimated from the time.
+ */
+#define TSCHED_DEFAULT_TIME	20000	/* usec */
+#define TSCHED_SHRINK_WAKEUPS	64
+
+typedef struct {
+	snd_pcm_uframes_t min_watermark;
+	snd_pcm_uframes_t watermark;	/* current watermark in frames */
+	unsigned int on_time;		/* wakeups in time since the last change */
+	int deadline;			/* the timer waits for the wakeup point */
+	snd_pcm_uframes_t sync_ptr;	/* hw_ptr at the last sync */
+	unsigned long long sync_ns;	/* time of the last sync, 0 = none */
+} snd_pcm_tsched_t;
+
+/* fix the watermarks for the configured time in usec */
+static inline void tsched_setup(snd_pcm_tsched_t *ts, unsigned int time,
+				unsigned int rate, snd_pcm_uframes_t buffer_size)
+{
+	ts->min_watermark = (unsigned long long)time * rate / 1000000;
+	if (ts->min_watermark > buffer_size / 2)
+		ts->min_watermark = buffer_size / 2;
+	if (ts->watermark < ts->min_watermark ||
+	    ts->watermark > buffer_size / 2)
+		ts->watermark = ts->min_watermark;
+}
+
+static inline void tsched_adapt(snd_pcm_tsched_t *ts,
+				snd_pcm_uframes_t buffer_size,
+				snd_pcm_uframes_t late)
+{
+	snd_pcm_uframes_t wm = ts->watermark;
+
+	if (late > wm / 2) {
+		wm += wm / 2;
+		if (wm > buffer_size / 2)
+			wm = buffer_size / 2;
+		ts->on_time = 0;
+	} else if (++ts->on_time >= TSCHED_SHRINK_WAKEUPS) {
+		wm -= wm / 8;
+		if (wm < ts->min_watermark)
+			wm = ts->min_watermark;
+		ts->on_time = 0;
+	}
+	ts->watermark = wm;
+}
+
+static inline void tsched_sync(snd_pcm_tsched_t *ts, snd_pcm_uframes_t hw_ptr,
+			       unsigned long long now_ns)
+{
+	ts->sync_ptr = hw_ptr;
+	ts->sync_ns = now_ns;
+}
+
+/*
+ * frames the hw_ptr is behind the time elapsed since the last sync; the
+ * part the kernel already moved it by itself is subtracted
+ */
+static inline snd_pcm_uframes_t tsched_lag(const snd_pcm_tsched_t *ts,
+					   snd_pcm_uframes_t hw_ptr,
+					   snd_pcm_uframes_t boundary,
+					   unsigned int rate,
+					   unsigned long long now_ns)
+{
+	unsigned long long ns, elapsed;
+	snd_pcm_uframes_t moved;
+
+	if (!ts->sync_ns || now_ns <= ts->sync_ns)
+		return 0;
+	ns = now_ns - ts->sync_ns;
+	elapsed = ns / 1000000000ULL * rate +
+		  ns % 1000000000ULL * rate / 1000000000ULL;
+	moved = hw_ptr >= ts->sync_ptr ? hw_ptr - ts->sync_ptr :
+		hw_ptr + (boundary - ts->sync_ptr);
+	if (elapsed <= moved)
+		return 0;
+	elapsed -= moved;
+	return elapsed > boundary ? boundary : elapsed;
+}
+
+/*
+ * returns 1 when the avail has reached the wakeup point, otherwise 0 and
+ * the time until then in ns; a wakeup of the timer adapts the watermark
+ */
+static inline int tsched_wait(snd_pcm_tsched_t *ts, snd_pcm_uframes_t avail,
+			      snd_pcm_uframes_t avail_min,
+			      snd_pcm_uframes_t buffer_size,
+			      unsigned int rate, int wakeup,
+			      unsigned long long *ns)
+{
+	snd_pcm_uframes_t target;
+
+	target = buffer_size - ts->watermark;
+	if (target > avail_min)
+		target = avail_min;
+	if (avail >= target) {
+		/* only a deadline tells how late the wakeup was */
+		if (wakeup && ts->deadline)
+			tsched_adapt(ts, buffer_size, avail - target);
+		ts->deadline = 0;
+		*ns = 0;
+		return 1;
+	}
+	*ns = (unsigned long long)(target - avail) * 1000000000ULL / rate;
+	ts->deadline = 1;
+	return 0;
+}
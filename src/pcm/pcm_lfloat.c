@@ -51,6 +51,7 @@ typedef struct {
 	snd_pcm_plugin_t plug;
 	unsigned int int32_idx;
 	unsigned int float32_idx;
+	int fast_idx;
 	snd_pcm_format_t sformat;
 	void (*func)(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
 		     const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
@@ -294,6 +295,7 @@ static int snd_pcm_lfloat_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 		lfloat->float32_idx = snd_pcm_lfloat_get_s32_index(src_format);
 		lfloat->func = snd_pcm_lfloat_convert_float_integer;
 	}
+	lfloat->fast_idx = snd_pcm_linear_fast_index(src_format, dst_format);
 	return 0;
 }
 
@@ -309,10 +311,13 @@ snd_pcm_lfloat_write_areas(snd_pcm_t *pcm,
 	snd_pcm_lfloat_t *lfloat = pcm->private_data;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	lfloat->func(slave_areas, slave_offset,
-		     areas, offset, 
-		     pcm->channels, size,
-		     lfloat->int32_idx, lfloat->float32_idx);
+	if (snd_pcm_linear_fast_convert(slave_areas, slave_offset,
+					areas, offset,
+					pcm->channels, size, lfloat->fast_idx) < 0)
+		lfloat->func(slave_areas, slave_offset,
+			     areas, offset, 
+			     pcm->channels, size,
+			     lfloat->int32_idx, lfloat->float32_idx);
 	*slave_sizep = size;
 	return size;
 }
@@ -329,10 +334,13 @@ snd_pcm_lfloat_read_areas(snd_pcm_t *pcm,
 	snd_pcm_lfloat_t *lfloat = pcm->private_data;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	lfloat->func(areas, offset, 
-		     slave_areas, slave_offset,
-		     pcm->channels, size,
-		     lfloat->int32_idx, lfloat->float32_idx);
+	if (snd_pcm_linear_fast_convert(areas, offset,
+					slave_areas, slave_offset,
+					pcm->channels, size, lfloat->fast_idx) < 0)
+		lfloat->func(areas, offset, 
+			     slave_areas, slave_offset,
+			     pcm->channels, size,
+			     lfloat->int32_idx, lfloat->float32_idx);
 	*slave_sizep = size;
 	return size;
 }
@@ -366,6 +374,7 @@ static const snd_pcm_ops_t snd_pcm_lfloat_ops = {
 	.query_chmaps = snd_pcm_generic_query_chmaps,
 	.get_chmap = snd_pcm_generic_get_chmap,
 	.set_chmap = snd_pcm_generic_set_chmap,
+	.get_slave = snd_pcm_generic_get_slave,
 };
 
 /**
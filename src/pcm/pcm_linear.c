@@ -26,12 +26,9 @@
  *
  */
   
-#include "bswap.h"
 #include "pcm_local.h"
 #include "pcm_plugin.h"
 
-#include "plugin_ops.h"
-
 #ifndef PIC
 /* entry for static linking */
 const char *_snd_module_pcm_linear = "";
@@ -44,178 +41,11 @@ typedef struct {
 	unsigned int use_getput;
 	unsigned int conv_idx;
 	unsigned int get_idx, put_idx;
+	int fast_idx;
 	snd_pcm_format_t sformat;
 } snd_pcm_linear_t;
 #endif
 
-#ifndef DOC_HIDDEN
-
-int snd_pcm_linear_convert_index(snd_pcm_format_t src_format,
-				 snd_pcm_format_t dst_format)
-{
-	int src_endian, dst_endian, sign, src_width, dst_width;
-
-	sign = (snd_pcm_format_signed(src_format) !=
-		snd_pcm_format_signed(dst_format));
-#ifdef SND_LITTLE_ENDIAN
-	src_endian = snd_pcm_format_big_endian(src_format);
-	dst_endian = snd_pcm_format_big_endian(dst_format);
-#else
-	src_endian = snd_pcm_format_little_endian(src_format);
-	dst_endian = snd_pcm_format_little_endian(dst_format);
-#endif
-
-	if (src_endian < 0)
-		src_endian = 0;
-	if (dst_endian < 0)
-		dst_endian = 0;
-
-	src_width = snd_pcm_format_width(src_format) / 8 - 1;
-	dst_width = snd_pcm_format_width(dst_format) / 8 - 1;
-
-	return src_width * 32 + src_endian * 16 + sign * 8 + dst_width * 2 + dst_endian;
-}
-
-int snd_pcm_linear_get_index(snd_pcm_format_t src_format, snd_pcm_format_t dst_format)
-{
-	int sign, width, pwidth, endian;
-	sign = (snd_pcm_format_signed(src_format) != 
-		snd_pcm_format_signed(dst_format));
-#ifdef SND_LITTLE_ENDIAN
-	endian = snd_pcm_format_big_endian(src_format);
-#else
-	endian = snd_pcm_format_little_endian(src_format);
-#endif
-	if (endian < 0)
-		endian = 0;
-	pwidth = snd_pcm_format_physical_width(src_format);
-	width = snd_pcm_format_width(src_format);
-	if (pwidth == 24) {
-		switch (width) {
-		case 24:
-			width = 0; break;
-		case 20:
-			width = 1; break;
-		case 18:
-		default:
-			width = 2; break;
-		}
-		return width * 4 + endian * 2 + sign + 20;
-	} else {
-		if (width == 20)
-			width = 40;
-
-		width = width / 8 - 1;
-		return width * 4 + endian * 2 + sign;
-	}
-}
-
-int snd_pcm_linear_put_index(snd_pcm_format_t src_format, snd_pcm_format_t dst_format)
-{
-	int sign, width, pwidth, endian;
-	sign = (snd_pcm_format_signed(src_format) != 
-		snd_pcm_format_signed(dst_format));
-#ifdef SND_LITTLE_ENDIAN
-	endian = snd_pcm_format_big_endian(dst_format);
-#else
-	endian = snd_pcm_format_little_endian(dst_format);
-#endif
-	if (endian < 0)
-		endian = 0;
-	pwidth = snd_pcm_format_physical_width(dst_format);
-	width = snd_pcm_format_width(dst_format);
-	if (pwidth == 24) {
-		switch (width) {
-		case 24:
-			width = 0; break;
-		case 20:
-			width = 1; break;
-		case 18:
-		default:
-			width = 2; break;
-		}
-		return width * 4 + endian * 2 + sign + 20;
-	} else {
-		if (width == 20)
-			width = 40;
-
-		width = width / 8 - 1;
-		return width * 4 + endian * 2 + sign;
-	}
-}
-
-void snd_pcm_linear_convert(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
-			    const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
-			    unsigned int channels, snd_pcm_uframes_t frames,
-			    unsigned int convidx)
-{
-#define CONV_LABELS
-#include "plugin_ops.h"
-#undef CONV_LABELS
-	void *conv = conv_labels[convidx];
-	unsigned int channel;
-	for (channel = 0; channel < channels; ++channel) {
-		const char *src;
-		char *dst;
-		int src_step, dst_step;
-		snd_pcm_uframes_t frames1;
-		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
-		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
-		src = snd_pcm_channel_area_addr(src_area, src_offset);
-		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
-		src_step = snd_pcm_channel_area_step(src_area);
-		dst_step = snd_pcm_channel_area_step(dst_area);
-		frames1 = frames;
-		while (frames1-- > 0) {
-			goto *conv;
-#define CONV_END after
-#include "plugin_ops.h"
-#undef CONV_END
-		after:
-			src += src_step;
-			dst += dst_step;
-		}
-	}
-}
-
-void snd_pcm_linear_getput(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
-			   const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
-			   unsigned int channels, snd_pcm_uframes_t frames,
-			   unsigned int get_idx, unsigned int put_idx)
-{
-#define CONV24_LABELS
-#include "plugin_ops.h"
-#undef CONV24_LABELS
-	void *get = get32_labels[get_idx];
-	void *put = put32_labels[put_idx];
-	unsigned int channel;
-	uint32_t sample = 0;
-	for (channel = 0; channel < channels; ++channel) {
-		const char *src;
-		char *dst;
-		int src_step, dst_step;
-		snd_pcm_uframes_t frames1;
-		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
-		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
-		src = snd_pcm_channel_area_addr(src_area, src_offset);
-		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
-		src_step = snd_pcm_channel_area_step(src_area);
-		dst_step = snd_pcm_channel_area_step(dst_area);
-		frames1 = frames;
-		while (frames1-- > 0) {
-			goto *get;
-#define CONV24_END after
-#include "plugin_ops.h"
-#undef CONV24_END
-		after:
-			src += src_step;
-			dst += dst_step;
-		}
-	}
-}
-
-#endif /* DOC_HIDDEN */
-
 static int snd_pcm_linear_hw_refine_cprepare(snd_pcm_t *pcm ATTRIBUTE_UNUSED, snd_pcm_hw_params_t *params)
 {
 	int err;
@@ -308,10 +138,11 @@ static int snd_pcm_linear_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 	err = INTERNAL(snd_pcm_hw_params_get_format)(params, &format);
 	if (err < 0)
 		return err;
-	linear->use_getput = (snd_pcm_format_physical_width(format) == 24 ||
-			      snd_pcm_format_physical_width(linear->sformat) == 24 ||
-			      snd_pcm_format_width(format) == 20 ||
-			      snd_pcm_format_width(linear->sformat) == 20);
+	if (pcm->stream == SND_PCM_STREAM_PLAYBACK)
+		linear->fast_idx = snd_pcm_linear_fast_index(format, linear->sformat);
+	else
+		linear->fast_idx = snd_pcm_linear_fast_index(linear->sformat, format);
+	linear->use_getput = snd_pcm_linear_use_getput(format, linear->sformat);
 	if (linear->use_getput) {
 		if (pcm->stream == SND_PCM_STREAM_PLAYBACK) {
 			linear->get_idx = snd_pcm_linear_get_index(format, SND_PCM_FORMAT_S32);
@@ -331,6 +162,30 @@ static int snd_pcm_linear_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 	return 0;
 }
 
+static void snd_pcm_linear_do_convert(snd_pcm_t *pcm,
+				      const snd_pcm_channel_area_t *dst_areas,
+				      snd_pcm_uframes_t dst_offset,
+				      const snd_pcm_channel_area_t *src_areas,
+				      snd_pcm_uframes_t src_offset,
+				      snd_pcm_uframes_t size)
+{
+	snd_pcm_linear_t *linear = pcm->private_data;
+
+	if (snd_pcm_linear_fast_convert(dst_areas, dst_offset,
+					src_areas, src_offset,
+					pcm->channels, size, linear->fast_idx) == 0)
+		return;
+	if (linear->use_getput)
+		snd_pcm_linear_getput(dst_areas, dst_offset,
+				      src_areas, src_offset,
+				      pcm->channels, size,
+				      linear->get_idx, linear->put_idx);
+	else
+		snd_pcm_linear_convert(dst_areas, dst_offset,
+				       src_areas, src_offset,
+				       pcm->channels, size, linear->conv_idx);
+}
+
 static snd_pcm_uframes_t
 snd_pcm_linear_write_areas(snd_pcm_t *pcm,
 			   const snd_pcm_channel_area_t *areas,
@@ -340,18 +195,10 @@ snd_pcm_linear_write_areas(snd_pcm_t *pcm,
 			   snd_pcm_uframes_t slave_offset,
 			   snd_pcm_uframes_t *slave_sizep)
 {
-	snd_pcm_linear_t *linear = pcm->private_data;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	if (linear->use_getput)
-		snd_pcm_linear_getput(slave_areas, slave_offset,
-				      areas, offset, 
-				      pcm->channels, size,
-				      linear->get_idx, linear->put_idx);
-	else
-		snd_pcm_linear_convert(slave_areas, slave_offset,
-				       areas, offset, 
-				       pcm->channels, size, linear->conv_idx);
+	snd_pcm_linear_do_convert(pcm, slave_areas, slave_offset,
+				  areas, offset, size);
 	*slave_sizep = size;
 	return size;
 }
@@ -365,18 +212,10 @@ snd_pcm_linear_read_areas(snd_pcm_t *pcm,
 			  snd_pcm_uframes_t slave_offset,
 			  snd_pcm_uframes_t *slave_sizep)
 {
-	snd_pcm_linear_t *linear = pcm->private_data;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	if (linear->use_getput)
-		snd_pcm_linear_getput(areas, offset, 
-				      slave_areas, slave_offset,
-				      pcm->channels, size,
-				      linear->get_idx, linear->put_idx);
-	else
-		snd_pcm_linear_convert(areas, offset, 
-				       slave_areas, slave_offset,
-				       pcm->channels, size, linear->conv_idx);
+	snd_pcm_linear_do_convert(pcm, areas, offset,
+				  slave_areas, slave_offset, size);
 	*slave_sizep = size;
 	return size;
 }
@@ -410,6 +249,7 @@ static const snd_pcm_ops_t snd_pcm_linear_ops = {
 	.query_chmaps = snd_pcm_generic_query_chmaps,
 	.get_chmap = snd_pcm_generic_get_chmap,
 	.set_chmap = snd_pcm_generic_set_chmap,
+	.get_slave = snd_pcm_generic_get_slave,
 };
 
 
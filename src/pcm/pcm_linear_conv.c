@@ -0,0 +1,342 @@
+/*
+ *  PCM - Linear conversion kernels
+ *  Copyright (c) 2000 by Abramo Bagnara <abramo@alsa-project.org>
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * The sample conversions of the linear plugin, shared with the plugins
+ * converting on their own (dsnoop, rate).  They use the public area and
+ * format helpers only, so test programs can build them in.
+ */
+
+#include "bswap.h"
+#include "pcm_local.h"
+#include "pcm_plugin.h"
+
+#include "plugin_ops.h"
+#include "plugin_ops_simd.h"
+
+#ifndef DOC_HIDDEN
+
+int snd_pcm_linear_convert_index(snd_pcm_format_t src_format,
+				 snd_pcm_format_t dst_format)
+{
+	int src_endian, dst_endian, sign, src_width, dst_width;
+
+	sign = (snd_pcm_format_signed(src_format) !=
+		snd_pcm_format_signed(dst_format));
+#ifdef SND_LITTLE_ENDIAN
+	src_endian = snd_pcm_format_big_endian(src_format);
+	dst_endian = snd_pcm_format_big_endian(dst_format);
+#else
+	src_endian = snd_pcm_format_little_endian(src_format);
+	dst_endian = snd_pcm_format_little_endian(dst_format);
+#endif
+
+	if (src_endian < 0)
+		src_endian = 0;
+	if (dst_endian < 0)
+		dst_endian = 0;
+
+	src_width = snd_pcm_format_width(src_format) / 8 - 1;
+	dst_width = snd_pcm_format_width(dst_format) / 8 - 1;
+
+	return src_width * 32 + src_endian * 16 + sign * 8 + dst_width * 2 + dst_endian;
+}
+
+int snd_pcm_linear_get_index(snd_pcm_format_t src_format, snd_pcm_format_t dst_format)
+{
+	int sign, width, pwidth, endian;
+	sign = (snd_pcm_format_signed(src_format) != 
+		snd_pcm_format_signed(dst_format));
+#ifdef SND_LITTLE_ENDIAN
+	endian = snd_pcm_format_big_endian(src_format);
+#else
+	endian = snd_pcm_format_little_endian(src_format);
+#endif
+	if (endian < 0)
+		endian = 0;
+	pwidth = snd_pcm_format_physical_width(src_format);
+	width = snd_pcm_format_width(src_format);
+	if (pwidth == 24) {
+		switch (width) {
+		case 24:
+			width = 0; break;
+		case 20:
+			width = 1; break;
+		case 18:
+		default:
+			width = 2; break;
+		}
+		return width * 4 + endian * 2 + sign + 20;
+	} else {
+		if (width == 20)
+			width = 40;
+
+		width = width / 8 - 1;
+		return width * 4 + endian * 2 + sign;
+	}
+}
+
+int snd_pcm_linear_put_index(snd_pcm_format_t src_format, snd_pcm_format_t dst_format)
+{
+	int sign, width, pwidth, endian;
+	sign = (snd_pcm_format_signed(src_format) != 
+		snd_pcm_format_signed(dst_format));
+#ifdef SND_LITTLE_ENDIAN
+	endian = snd_pcm_format_big_endian(dst_format);
+#else
+	endian = snd_pcm_format_little_endian(dst_format);
+#endif
+	if (endian < 0)
+		endian = 0;
+	pwidth = snd_pcm_format_physical_width(dst_format);
+	width = snd_pcm_format_width(dst_format);
+	if (pwidth == 24) {
+		switch (width) {
+		case 24:
+			width = 0; break;
+		case 20:
+			width = 1; break;
+		case 18:
+		default:
+			width = 2; break;
+		}
+		return width * 4 + endian * 2 + sign + 20;
+	} else {
+		if (width == 20)
+			width = 40;
+
+		width = width / 8 - 1;
+		return width * 4 + endian * 2 + sign;
+	}
+}
+
+void snd_pcm_linear_convert(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
+			    const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
+			    unsigned int channels, snd_pcm_uframes_t frames,
+			    unsigned int convidx)
+{
+#define CONV_LABELS
+#include "plugin_ops.h"
+#undef CONV_LABELS
+	void *conv = conv_labels[convidx];
+	unsigned int channel;
+	for (channel = 0; channel < channels; ++channel) {
+		const char *src;
+		char *dst;
+		int src_step, dst_step;
+		snd_pcm_uframes_t frames1;
+		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
+		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+		src = snd_pcm_channel_area_addr(src_area, src_offset);
+		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+		src_step = snd_pcm_channel_area_step(src_area);
+		dst_step = snd_pcm_channel_area_step(dst_area);
+		frames1 = frames;
+		while (frames1-- > 0) {
+			goto *conv;
+#define CONV_END after
+#include "plugin_ops.h"
+#undef CONV_END
+		after:
+			src += src_step;
+			dst += dst_step;
+		}
+	}
+}
+
+void snd_pcm_linear_getput(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
+			   const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
+			   unsigned int channels, snd_pcm_uframes_t frames,
+			   unsigned int get_idx, unsigned int put_idx)
+{
+#define CONV24_LABELS
+#include "plugin_ops.h"
+#undef CONV24_LABELS
+	void *get = get32_labels[get_idx];
+	void *put = put32_labels[put_idx];
+	unsigned int channel;
+	uint32_t sample = 0;
+	for (channel = 0; channel < channels; ++channel) {
+		const char *src;
+		char *dst;
+		int src_step, dst_step;
+		snd_pcm_uframes_t frames1;
+		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
+		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+		src = snd_pcm_channel_area_addr(src_area, src_offset);
+		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+		src_step = snd_pcm_channel_area_step(src_area);
+		dst_step = snd_pcm_channel_area_step(dst_area);
+		frames1 = frames;
+		while (frames1-- > 0) {
+			goto *get;
+#define CONV24_END after
+#include "plugin_ops.h"
+#undef CONV24_END
+		after:
+			src += src_step;
+			dst += dst_step;
+		}
+	}
+}
+
+/*
+ * fast path for contiguous areas
+ */
+static const struct {
+	snd_pcm_format_t src, dst;
+} fast_formats[CONV_SIMD_OPS] = {
+	[CONV_SIMD_S16_S32] = { SND_PCM_FORMAT_S16, SND_PCM_FORMAT_S32 },
+	[CONV_SIMD_S32_S16] = { SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S16 },
+	[CONV_SIMD_S24_3LE_S32] = { SND_PCM_FORMAT_S24_3LE, SND_PCM_FORMAT_S32 },
+	[CONV_SIMD_S32_S24_3LE] = { SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S24_3LE },
+	[CONV_SIMD_S16_FLOAT] = { SND_PCM_FORMAT_S16, SND_PCM_FORMAT_FLOAT },
+	[CONV_SIMD_FLOAT_S16] = { SND_PCM_FORMAT_FLOAT, SND_PCM_FORMAT_S16 },
+	[CONV_SIMD_S32_FLOAT] = { SND_PCM_FORMAT_S32, SND_PCM_FORMAT_FLOAT },
+	[CONV_SIMD_FLOAT_S32] = { SND_PCM_FORMAT_FLOAT, SND_PCM_FORMAT_S32 },
+};
+
+static conv_simd_func_t *fast_kernels[CONV_SIMD_OPS];
+
+static void fast_kernels_init(void)
+{
+	static int probed = 0;
+	const conv_simd_kernel_t *k;
+	unsigned int op;
+
+	if (probed)
+		return;
+	for (k = conv_simd_kernels; k->name; k++) {
+		if (!k->available())
+			continue;
+		for (op = 0; op < CONV_SIMD_OPS; op++) {
+			if (!fast_kernels[op])
+				fast_kernels[op] = k->op[op];
+		}
+	}
+	probed = 1;
+}
+
+/* returns the fast path for the given pair of formats, or -1 */
+/*
+ * the convert index is built from the format width, so it cannot
+ * describe 3 byte containers and 20 bit samples; these are converted
+ * through a get/put pair via S32 instead
+ */
+int snd_pcm_linear_use_getput(snd_pcm_format_t src_format, snd_pcm_format_t dst_format)
+{
+	return snd_pcm_format_physical_width(src_format) == 24 ||
+	       snd_pcm_format_physical_width(dst_format) == 24 ||
+	       snd_pcm_format_width(src_format) == 20 ||
+	       snd_pcm_format_width(dst_format) == 20;
+}
+
+int snd_pcm_linear_fast_index(snd_pcm_format_t src_format, snd_pcm_format_t dst_format)
+{
+	int op;
+
+	for (op = 0; op < CONV_SIMD_OPS; op++) {
+		if (fast_formats[op].src == src_format &&
+		    fast_formats[op].dst == dst_format) {
+			fast_kernels_init();
+			return op;
+		}
+	}
+	return -1;
+}
+
+/*
+ * returns the start of the samples if all channels follow each other
+ * in memory, *per_channel is set if each channel is contiguous on its own
+ */
+static char *fast_areas(const snd_pcm_channel_area_t *areas,
+			snd_pcm_uframes_t offset, unsigned int channels,
+			unsigned int width, int *per_channel)
+{
+	unsigned int chn;
+
+	for (chn = 0; chn < channels; chn++) {
+		if (areas[chn].addr != areas[0].addr ||
+		    areas[chn].first != areas[0].first + chn * width ||
+		    areas[chn].step != channels * width)
+			break;
+	}
+	if (chn == channels && areas[0].first % 8 == 0) {
+		*per_channel = 0;
+		return snd_pcm_channel_area_addr(areas, offset);
+	}
+	for (chn = 0; chn < channels; chn++) {
+		if (areas[chn].step != width || areas[chn].first % 8)
+			return NULL;
+	}
+	*per_channel = 1;
+	return snd_pcm_channel_area_addr(areas, offset);
+}
+
+static void fast_run(int op, unsigned int size, char *dst, const char *src)
+{
+	unsigned int done = 0;
+
+	if (fast_kernels[op])
+		done = fast_kernels[op](size, dst, src);
+	if (done < size)
+		conv_simd_scalar[op](size - done,
+				     dst + done * snd_pcm_format_physical_width(fast_formats[op].dst) / 8,
+				     src + done * snd_pcm_format_physical_width(fast_formats[op].src) / 8);
+}
+
+/*
+ * converts interleaved or non-interleaved areas in one go, returns
+ * -EINVAL when the layout doesn't fit and the caller has to use the
+ * generic conversion
+ */
+int snd_pcm_linear_fast_convert(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
+				const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
+				unsigned int channels, snd_pcm_uframes_t frames,
+				int fast_idx)
+{
+	unsigned int src_width, dst_width, chn;
+	int src_split, dst_split;
+	char *dst;
+	const char *src;
+
+	if (fast_idx < 0 || frames > UINT_MAX / channels)
+		return -EINVAL;
+	src_width = snd_pcm_format_physical_width(fast_formats[fast_idx].src);
+	dst_width = snd_pcm_format_physical_width(fast_formats[fast_idx].dst);
+	src = fast_areas(src_areas, src_offset, channels, src_width, &src_split);
+	dst = fast_areas(dst_areas, dst_offset, channels, dst_width, &dst_split);
+	if (!src || !dst)
+		return -EINVAL;
+	if (src_split != dst_split)
+		return -EINVAL;
+	if (!src_split) {
+		fast_run(fast_idx, frames * channels, dst, src);
+		return 0;
+	}
+	for (chn = 0; chn < channels; chn++)
+		fast_run(fast_idx, frames,
+			 snd_pcm_channel_area_addr(&dst_areas[chn], dst_offset),
+			 snd_pcm_channel_area_addr(&src_areas[chn], src_offset));
+	return 0;
+}
+
+#endif /* DOC_HIDDEN */
@@ -152,6 +152,7 @@ typedef struct {
 	snd_pcm_chmap_query_t **(*query_chmaps)(snd_pcm_t *pcm);
 	snd_pcm_chmap_t *(*get_chmap)(snd_pcm_t *pcm);
 	int (*set_chmap)(snd_pcm_t *pcm, const snd_pcm_chmap_t *map);
+	snd_pcm_t *(*get_slave)(snd_pcm_t *pcm); /* next PCM of the chain */
 } snd_pcm_ops_t;
 
 typedef struct {
@@ -186,6 +187,36 @@ typedef struct {
 	int (*may_wait_for_avail_min)(snd_pcm_t *pcm, snd_pcm_uframes_t avail);
 } snd_pcm_fast_ops_t;
 
+/* the counters of one PCM, see pcm_stats.c */
+typedef struct {
+	unsigned long long calls;
+	unsigned long long time;	/* in ns */
+	unsigned long long max_time;	/* in ns */
+} snd_pcm_stats_counter_t;
+
+struct _snd_pcm_stats {
+	snd_pcm_type_t type;
+	const char *name;
+	snd_pcm_stats_counter_t op[SND_PCM_STATS_LAST + 1];
+	unsigned long long frames;	/* converted by the PCM itself */
+	unsigned long long bytes;	/* read and written by the conversion */
+	long latency;			/* in us, set in the snapshots */
+};
+
+/* the positions seen under the lock for the lock-free readers, see pcm.c */
+#define SND_PCM_SNAPSHOT_AVAIL		(1 << 0)
+#define SND_PCM_SNAPSHOT_DELAY		(1 << 1)
+#define SND_PCM_SNAPSHOT_TSTAMP		(1 << 2)
+
+typedef struct {
+	unsigned int seq;		/* odd while being written */
+	unsigned int valid;		/* SND_PCM_SNAPSHOT_* */
+	snd_pcm_sframes_t avail;
+	snd_pcm_sframes_t delay;	/* minus the queued frames */
+	snd_pcm_uframes_t tstamp_avail;
+	snd_htimestamp_t tstamp;
+} snd_pcm_snapshot_t;
+
 struct _snd_pcm {
 	void *open_func;
 	char *name;
@@ -245,6 +276,9 @@ struct _snd_pcm {
 	snd_pcm_t *fast_op_arg;
 	void *private_data;
 	struct list_head async_handlers;
+	snd_pcm_stats_t *stats;		/* NULL unless accounting is enabled */
+	unsigned long long refine_key;	/* 0 unless refinements are cached */
+	int refine_memory;		/* hw chain, not kept in the cache file */
 #ifdef THREAD_SAFE_API
 	int need_lock;		/* true = this PCM (plugin) is thread-unsafe,
 				 * thus it needs a lock.
@@ -253,6 +287,10 @@ struct _snd_pcm {
 				 * it's set depending on $LIBASOUND_THREAD_SAFE.
 				 */
 	pthread_mutex_t lock;
+	int use_snapshot;	/* lock-free position reads are enabled;
+				 * it's set depending on $LIBASOUND_PCM_SNAPSHOT.
+				 */
+	snd_pcm_snapshot_t snapshot;
 #endif
 };
 
@@ -424,9 +462,68 @@ snd_pcm_sframes_t __snd_pcm_mmap_commit(snd_pcm_t *pcm,
 					snd_pcm_uframes_t frames);
 int __snd_pcm_wait_in_lock(snd_pcm_t *pcm, int timeout);
 
+#define snd_pcm_stats_now \
+	snd1_pcm_stats_now
+#define snd_pcm_stats_add \
+	snd1_pcm_stats_add
+#define snd_pcm_stats_inherit \
+	snd1_pcm_stats_inherit
+
+void snd_pcm_stats_now(snd_htimestamp_t *tstamp);
+void snd_pcm_stats_add(snd_pcm_t *pcm, snd_pcm_stats_op_t op,
+		       const snd_htimestamp_t *start,
+		       snd_pcm_uframes_t frames, size_t bytes);
+int snd_pcm_stats_inherit(snd_pcm_t *pcm, snd_pcm_t *slave);
+
+#define snd_pcm_refine_cache_setup \
+	snd1_pcm_refine_cache_setup
+#define snd_pcm_refine_cache_lookup \
+	snd1_pcm_refine_cache_lookup
+#define snd_pcm_refine_cache_store \
+	snd1_pcm_refine_cache_store
+#define snd_pcm_refine_cache_drop \
+	snd1_pcm_refine_cache_drop
+#define snd_pcm_refine_cache_sync \
+	snd1_pcm_refine_cache_sync
+
+/* see pcm_refine_cache.c */
+int snd_pcm_refine_cache_setup(snd_pcm_t *pcm, const char *name,
+			       snd_config_t *root, snd_config_t *conf,
+			       int external);
+int snd_pcm_refine_cache_lookup(snd_pcm_t *pcm, snd_pcm_hw_params_t *params,
+				int *result);
+void snd_pcm_refine_cache_store(snd_pcm_t *pcm,
+				const snd_pcm_hw_params_t *in,
+				const snd_pcm_hw_params_t *out, int result);
+void snd_pcm_refine_cache_drop(snd_pcm_t *pcm);
+int snd_pcm_refine_cache_sync(void);
+
+/* accounting of an operation, cheap when it is disabled */
+static inline void snd_pcm_stats_begin(snd_pcm_t *pcm, snd_htimestamp_t *start)
+{
+	if (pcm->stats)
+		snd_pcm_stats_now(start);
+	else
+		start->tv_sec = start->tv_nsec = 0;
+}
+
+static inline void snd_pcm_stats_end(snd_pcm_t *pcm, snd_pcm_stats_op_t op,
+				     const snd_htimestamp_t *start,
+				     snd_pcm_uframes_t frames, size_t bytes)
+{
+	if (pcm->stats)
+		snd_pcm_stats_add(pcm, op, start, frames, bytes);
+}
+
 static inline snd_pcm_sframes_t __snd_pcm_avail_update(snd_pcm_t *pcm)
 {
-	return pcm->fast_ops->avail_update(pcm->fast_op_arg);
+	snd_htimestamp_t start;
+	snd_pcm_sframes_t avail;
+
+	snd_pcm_stats_begin(pcm, &start);
+	avail = pcm->fast_ops->avail_update(pcm->fast_op_arg);
+	snd_pcm_stats_end(pcm, SND_PCM_STATS_AVAIL_UPDATE, &start, 0, 0);
+	return avail;
 }
 
 static inline int __snd_pcm_start(snd_pcm_t *pcm)
@@ -441,7 +538,13 @@ static inline snd_pcm_state_t __snd_pcm_state(snd_pcm_t *pcm)
 
 static inline int __snd_pcm_hwsync(snd_pcm_t *pcm)
 {
-	return pcm->fast_ops->hwsync(pcm->fast_op_arg);
+	snd_htimestamp_t start;
+	int err;
+
+	snd_pcm_stats_begin(pcm, &start);
+	err = pcm->fast_ops->hwsync(pcm->fast_op_arg);
+	snd_pcm_stats_end(pcm, SND_PCM_STATS_HWSYNC, &start, 0, 0);
+	return err;
 }
 
 static inline int __snd_pcm_delay(snd_pcm_t *pcm, snd_pcm_sframes_t *delayp)
@@ -28,15 +28,19 @@
   
 
 #include "bswap.h"
+#include <math.h>
 #include <time.h>
 #include <pthread.h>
 #include <dlfcn.h>
 #include "pcm_local.h"
 #include "pcm_plugin.h"
+#include "pcm_meter_simd.h"
 
 #define atomic_read(ptr)    __atomic_load_n(ptr, __ATOMIC_SEQ_CST )
 #define atomic_add(ptr, n)  __atomic_add_fetch(ptr, n, __ATOMIC_SEQ_CST)
 #define atomic_dec(ptr)     __atomic_sub_fetch(ptr, 1, __ATOMIC_SEQ_CST)
+#define atomic_publish(ptr, v)	__atomic_store_n(ptr, v, __ATOMIC_RELEASE)
+#define atomic_acquire(ptr)	__atomic_load_n(ptr, __ATOMIC_ACQUIRE)
 
 #ifndef PIC
 /* entry for static linking */
@@ -54,9 +58,18 @@ struct _snd_pcm_scope {
 	struct list_head list;
 };
 
+/*
+ * The meter buffer is a single producer ring: only the thread calling
+ * into the PCM copies frames into it (mmap_commit for playback,
+ * avail_update for capture) and publishes the position it filled up to
+ * in written.  The meter thread and the scopes only read frames before
+ * written; a thread which fell behind by a whole buffer resets the
+ * scopes instead of reading overwritten frames.
+ */
 typedef struct _snd_pcm_meter {
 	snd_pcm_generic_t gen;
 	snd_pcm_uframes_t rptr;
+	snd_pcm_uframes_t written;
 	snd_pcm_uframes_t buf_size;
 	snd_pcm_channel_area_t *buf_areas;
 	snd_pcm_uframes_t now;
@@ -66,7 +79,6 @@ typedef struct _snd_pcm_meter {
 	int running;
 	int reset;
 	pthread_t thread;
-	pthread_mutex_t update_mutex;
 	pthread_mutex_t running_mutex;
 	pthread_cond_t running_cond;
 	struct timespec delay;
@@ -99,59 +111,39 @@ static void snd_pcm_meter_add_frames(snd_pcm_t *pcm,
 	}
 }
 
-static void snd_pcm_meter_update_main(snd_pcm_t *pcm)
+/* frames from ptr2 up to ptr1 */
+static snd_pcm_uframes_t snd_pcm_meter_distance(snd_pcm_t *pcm,
+						snd_pcm_uframes_t ptr1,
+						snd_pcm_uframes_t ptr2)
+{
+	snd_pcm_sframes_t d = ptr1 - ptr2;
+	if (d < 0)
+		d += pcm->boundary;
+	return d;
+}
+
+/* restart the ring at ptr, the thread resets the scopes */
+static void snd_pcm_meter_restart(snd_pcm_t *pcm, snd_pcm_uframes_t ptr)
 {
 	snd_pcm_meter_t *meter = pcm->private_data;
-	snd_pcm_sframes_t frames;
-	snd_pcm_uframes_t rptr, old_rptr;
-	const snd_pcm_channel_area_t *areas;
-	int locked;
-	locked = (pthread_mutex_trylock(&meter->update_mutex) >= 0);
-	areas = snd_pcm_mmap_areas(pcm);
-	rptr = *pcm->hw.ptr;
-	old_rptr = meter->rptr;
-	meter->rptr = rptr;
-	frames = rptr - old_rptr;
-	if (frames < 0)
-		frames += pcm->boundary;
-	if (frames > 0) {
-		assert((snd_pcm_uframes_t) frames <= pcm->buffer_size);
-		snd_pcm_meter_add_frames(pcm, areas, old_rptr,
-					 (snd_pcm_uframes_t) frames);
-	}
-	if (locked)
-		pthread_mutex_unlock(&meter->update_mutex);
+	meter->rptr = ptr;
+	atomic_publish(&meter->written, ptr);
 }
 
-static int snd_pcm_meter_update_scope(snd_pcm_t *pcm)
+static void snd_pcm_meter_update_main(snd_pcm_t *pcm)
 {
 	snd_pcm_meter_t *meter = pcm->private_data;
-	snd_pcm_sframes_t frames;
-	snd_pcm_uframes_t rptr, old_rptr;
-	const snd_pcm_channel_area_t *areas;
-	int reset = 0;
-	/* Wait main thread */
-	pthread_mutex_lock(&meter->update_mutex);
-	areas = snd_pcm_mmap_areas(pcm);
- _again:
+	snd_pcm_uframes_t frames, rptr, old_rptr;
 	rptr = *pcm->hw.ptr;
 	old_rptr = meter->rptr;
-	if (atomic_read(&meter->reset)) {
-		reset = 1;
-		atomic_dec(&meter->reset);
-		goto _again;
-	}
-	meter->rptr = rptr;
-	frames = rptr - old_rptr;
-	if (frames < 0)
-		frames += pcm->boundary;
+	frames = snd_pcm_meter_distance(pcm, rptr, old_rptr);
 	if (frames > 0) {
-		assert((snd_pcm_uframes_t) frames <= pcm->buffer_size);
-		snd_pcm_meter_add_frames(pcm, areas, old_rptr,
-					 (snd_pcm_uframes_t) frames);
+		assert(frames <= pcm->buffer_size);
+		snd_pcm_meter_add_frames(pcm, snd_pcm_mmap_areas(pcm),
+					 old_rptr, frames);
 	}
-	pthread_mutex_unlock(&meter->update_mutex);
-	return reset;
+	meter->rptr = rptr;
+	atomic_publish(&meter->written, rptr);
 }
 
 static int snd_pcm_scope_remove(snd_pcm_scope_t *scope)
@@ -194,6 +186,7 @@ static void *snd_pcm_meter_thread(void *data)
 	}
 	while (!meter->closed) {
 		snd_pcm_sframes_t now;
+		snd_pcm_uframes_t written;
 		snd_pcm_status_t status;
 		int err;
 		pthread_mutex_lock(&meter->running_mutex);
@@ -224,16 +217,20 @@ static void *snd_pcm_meter_thread(void *data)
 			if ((snd_pcm_uframes_t) now >= pcm->boundary)
 				now -= pcm->boundary;
 		}
-		meter->now = now;
-		if (pcm->stream == SND_PCM_STREAM_CAPTURE)
-			reset = snd_pcm_meter_update_scope(pcm);
-		else {
-			reset = 0;
-			while (atomic_read(&meter->reset)) {
-				reset = 1;
-				atomic_dec(&meter->reset);
-			}
+		reset = 0;
+		while (atomic_read(&meter->reset)) {
+			reset = 1;
+			atomic_dec(&meter->reset);
 		}
+		/* don't run ahead of the producer */
+		written = atomic_acquire(&meter->written);
+		if (snd_pcm_meter_distance(pcm, written, now) > pcm->buffer_size)
+			now = written;
+		/* the producer may be overwriting frames after meter->now */
+		if (snd_pcm_meter_distance(pcm, written, meter->now) >
+		    meter->buf_size - pcm->buffer_size)
+			reset = 1;
+		meter->now = now;
 		if (reset) {
 			list_for_each(pos, &meter->scopes) {
 				scope = list_entry(pos, snd_pcm_scope_t, list);
@@ -270,7 +267,6 @@ static int snd_pcm_meter_close(snd_pcm_t *pcm)
 	snd_pcm_meter_t *meter = pcm->private_data;
 	struct list_head *pos, *npos;
 	int err = 0;
-	pthread_mutex_destroy(&meter->update_mutex);
 	pthread_mutex_destroy(&meter->running_mutex);
 	pthread_cond_destroy(&meter->running_cond);
 	if (meter->gen.close_slave)
@@ -294,9 +290,9 @@ static int snd_pcm_meter_prepare(snd_pcm_t *pcm)
 	err = snd_pcm_prepare(meter->gen.slave);
 	if (err >= 0) {
 		if (pcm->stream == SND_PCM_STREAM_PLAYBACK)
-			meter->rptr = *pcm->appl.ptr;
+			snd_pcm_meter_restart(pcm, *pcm->appl.ptr);
 		else
-			meter->rptr = *pcm->hw.ptr;
+			snd_pcm_meter_restart(pcm, *pcm->hw.ptr);
 	}
 	return err;
 }
@@ -307,7 +303,7 @@ static int snd_pcm_meter_reset(snd_pcm_t *pcm)
 	int err = snd_pcm_reset(meter->gen.slave);
 	if (err >= 0) {
 		if (pcm->stream == SND_PCM_STREAM_PLAYBACK)
-			meter->rptr = *pcm->appl.ptr;
+			snd_pcm_meter_restart(pcm, *pcm->appl.ptr);
 	}
 	return err;
 }
@@ -329,7 +325,7 @@ static snd_pcm_sframes_t snd_pcm_meter_rewind(snd_pcm_t *pcm, snd_pcm_uframes_t
 	snd_pcm_meter_t *meter = pcm->private_data;
 	snd_pcm_sframes_t err = snd_pcm_rewind(meter->gen.slave, frames);
 	if (err > 0 && pcm->stream == SND_PCM_STREAM_PLAYBACK)
-		meter->rptr = *pcm->appl.ptr;
+		snd_pcm_meter_restart(pcm, *pcm->appl.ptr);
 	return err;
 }
 
@@ -338,7 +334,7 @@ static snd_pcm_sframes_t snd_pcm_meter_forward(snd_pcm_t *pcm, snd_pcm_uframes_t
 	snd_pcm_meter_t *meter = pcm->private_data;
 	snd_pcm_sframes_t err = INTERNAL(snd_pcm_forward)(meter->gen.slave, frames);
 	if (err > 0 && pcm->stream == SND_PCM_STREAM_PLAYBACK)
-		meter->rptr = *pcm->appl.ptr;
+		snd_pcm_meter_restart(pcm, *pcm->appl.ptr);
 	return err;
 }
 
@@ -354,6 +350,7 @@ static snd_pcm_sframes_t snd_pcm_meter_mmap_commit(snd_pcm_t *pcm,
 	if (pcm->stream == SND_PCM_STREAM_PLAYBACK) {
 		snd_pcm_meter_add_frames(pcm, snd_pcm_mmap_areas(pcm), old_rptr, result);
 		meter->rptr = *pcm->appl.ptr;
+		atomic_publish(&meter->written, meter->rptr);
 	}
 	return result;
 }
@@ -448,8 +445,9 @@ static int snd_pcm_meter_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 				      snd_pcm_meter_hw_params_slave);
 	if (err < 0)
 		return err;
-	/* more than 1 second of buffer */
-	meter->buf_size = slave->buffer_size;
+	/* more than 1 second of buffer, the scopes trail the producer by
+	 * up to a slave buffer and may lag some more before a reset */
+	meter->buf_size = slave->buffer_size * 4;
 	while (meter->buf_size < slave->rate)
 		meter->buf_size *= 2;
 	buf_size_bytes = snd_pcm_frames_to_bytes(slave, meter->buf_size);
@@ -519,6 +517,7 @@ static const snd_pcm_ops_t snd_pcm_meter_ops = {
 	.query_chmaps = snd_pcm_generic_query_chmaps,
 	.get_chmap = snd_pcm_generic_get_chmap,
 	.set_chmap = snd_pcm_generic_set_chmap,
+	.get_slave = snd_pcm_generic_get_slave,
 };
 
 static const snd_pcm_fast_ops_t snd_pcm_meter_fast_ops = {
@@ -595,7 +594,6 @@ int snd_pcm_meter_open(snd_pcm_t **pcmp, const char *name, unsigned int frequenc
 	snd_pcm_link_appl_ptr(pcm, slave);
 	*pcmp = pcm;
 
-	pthread_mutex_init(&meter->update_mutex, NULL);
 	pthread_mutex_init(&meter->running_mutex, NULL);
 	pthread_cond_init(&meter->running_cond, NULL);
 	return 0;
@@ -1159,6 +1157,137 @@ static const snd_pcm_scope_ops_t s16_ops = {
 	.reset = s16_reset,
 };
 
+typedef struct _snd_pcm_scope_peak {
+	snd_pcm_t *pcm;
+	meter_simd_func_t *kernel;
+	meter_simd_func_t *scalar;
+	snd_pcm_uframes_t old;
+	float *peak;
+	float *rms;
+} snd_pcm_scope_peak_t;
+
+static int peak_enable(snd_pcm_scope_t *scope)
+{
+	snd_pcm_scope_peak_t *peak = scope->private_data;
+	snd_pcm_meter_t *meter = peak->pcm->private_data;
+	snd_pcm_t *spcm = meter->gen.slave;
+	const meter_simd_kernel_t *k;
+	for (k = meter_simd_kernels; k->name; k++)
+		if (k->available())
+			break;
+	switch (spcm->format) {
+	case SND_PCM_FORMAT_S16:
+		peak->scalar = meter_peak_s16;
+		peak->kernel = k->peak_s16;
+		break;
+	case SND_PCM_FORMAT_S32:
+		peak->scalar = meter_peak_s32;
+		peak->kernel = k->peak_s32;
+		break;
+	case SND_PCM_FORMAT_FLOAT:
+		peak->scalar = meter_peak_float;
+		peak->kernel = k->peak_float;
+		break;
+	default:
+		return -EINVAL;
+	}
+	peak->peak = calloc(spcm->channels * 2, sizeof(float));
+	if (!peak->peak)
+		return -ENOMEM;
+	peak->rms = peak->peak + spcm->channels;
+	return 0;
+}
+
+static void peak_disable(snd_pcm_scope_t *scope)
+{
+	snd_pcm_scope_peak_t *peak = scope->private_data;
+	free(peak->peak);
+	peak->peak = NULL;
+	peak->rms = NULL;
+}
+
+static void peak_close(snd_pcm_scope_t *scope)
+{
+	snd_pcm_scope_peak_t *peak = scope->private_data;
+	free(peak);
+}
+
+static void peak_start(snd_pcm_scope_t *scope ATTRIBUTE_UNUSED)
+{
+}
+
+static void peak_clear(snd_pcm_scope_peak_t *peak, unsigned int channels)
+{
+	static const float zero;
+	unsigned int c;
+	for (c = 0; c < channels * 2; c++)
+		__atomic_store(&peak->peak[c], &zero, __ATOMIC_RELAXED);
+}
+
+static void peak_stop(snd_pcm_scope_t *scope)
+{
+	snd_pcm_scope_peak_t *peak = scope->private_data;
+	snd_pcm_meter_t *meter = peak->pcm->private_data;
+	peak_clear(peak, meter->gen.slave->channels);
+}
+
+/* peak and RMS of each channel over the frames since the last update */
+static void peak_update(snd_pcm_scope_t *scope)
+{
+	snd_pcm_scope_peak_t *peak = scope->private_data;
+	snd_pcm_meter_t *meter = peak->pcm->private_data;
+	snd_pcm_t *spcm = meter->gen.slave;
+	unsigned int bytes = spcm->sample_bits / 8;
+	snd_pcm_uframes_t size, offset;
+	unsigned int c;
+	size = snd_pcm_meter_distance(spcm, meter->now, peak->old);
+	if (!size)
+		return;
+	offset = peak->old % meter->buf_size;
+	for (c = 0; c < spcm->channels; c++) {
+		const char *src = meter->buf_areas[c].addr;
+		snd_pcm_uframes_t pos = offset, left = size;
+		float p = 0, rms;
+		double sum = 0;
+		while (left > 0) {
+			unsigned int frames = left, n = 0;
+			if (frames > meter->buf_size - pos)
+				frames = meter->buf_size - pos;
+			if (peak->kernel)
+				n = peak->kernel(src + pos * bytes, frames, &p, &sum);
+			if (n < frames)
+				peak->scalar(src + (pos + n) * bytes, frames - n,
+					     &p, &sum);
+			left -= frames;
+			pos += frames;
+			if (pos == meter->buf_size)
+				pos = 0;
+		}
+		rms = sqrt(sum / size);
+		__atomic_store(&peak->peak[c], &p, __ATOMIC_RELAXED);
+		__atomic_store(&peak->rms[c], &rms, __ATOMIC_RELAXED);
+	}
+	peak->old = meter->now;
+}
+
+static void peak_reset(snd_pcm_scope_t *scope)
+{
+	snd_pcm_scope_peak_t *peak = scope->private_data;
+	snd_pcm_meter_t *meter = peak->pcm->private_data;
+	peak->old = meter->now;
+	peak_clear(peak, meter->gen.slave->channels);
+}
+
+static const snd_pcm_scope_ops_t peak_ops = {
+	.enable = peak_enable,
+	.disable = peak_disable,
+	.close = peak_close,
+	.start = peak_start,
+	.stop = peak_stop,
+	.update = peak_update,
+	.reset = peak_reset,
+};
+
 #endif
 
 /**
@@ -1218,6 +1347,83 @@ int16_t *snd_pcm_scope_s16_get_channel_buffer(snd_pcm_scope_t *scope,
 	return s16->buf_areas[channel].addr;
 }
 
+/**
+ * \brief Add a peak pseudo scope to a #SND_PCM_TYPE_METER PCM
+ * \param pcm The pcm handle
+ * \param name Scope name
+ * \param scopep Pointer to newly created and added scope
+ * \return 0 on success otherwise a negative error code
+ *
+ * peak pseudo scope measures the peak and RMS level of each channel of
+ * #SND_PCM_TYPE_METER PCM frames at every update, directly on CPU endian
+ * S16, S32 and FLOAT samples.  Other formats leave the scope disabled.
+ */
+int snd_pcm_scope_peak_open(snd_pcm_t *pcm, const char *name,
+			    snd_pcm_scope_t **scopep)
+{
+	snd_pcm_meter_t *meter;
+	snd_pcm_scope_t *scope;
+	snd_pcm_scope_peak_t *peak;
+	assert(pcm->type == SND_PCM_TYPE_METER);
+	meter = pcm->private_data;
+	scope = calloc(1, sizeof(*scope));
+	if (!scope)
+		return -ENOMEM;
+	peak = calloc(1, sizeof(*peak));
+	if (!peak) {
+		free(scope);
+		return -ENOMEM;
+	}
+	if (name)
+		scope->name = strdup(name);
+	peak->pcm = pcm;
+	scope->ops = &peak_ops;
+	scope->private_data = peak;
+	list_add_tail(&scope->list, &meter->scopes);
+	*scopep = scope;
+	return 0;
+}
+
+/**
+ * \brief Get the peak level of a channel from a peak pseudo scope
+ * \param scope peak pseudo scope handle
+ * \param channel Channel
+ * \return largest absolute sample value of the last update (0.0 ... 1.0)
+ */
+float snd_pcm_scope_peak_get_peak(snd_pcm_scope_t *scope, unsigned int channel)
+{
+	snd_pcm_scope_peak_t *peak;
+	float val = 0;
+	assert(scope->ops == &peak_ops);
+	peak = scope->private_data;
+	if (scope->enabled && peak->peak) {
+		snd_pcm_meter_t *meter = peak->pcm->private_data;
+		assert(channel < meter->gen.slave->channels);
+		__atomic_load(&peak->peak[channel], &val, __ATOMIC_RELAXED);
+	}
+	return val;
+}
+
+/**
+ * \brief Get the RMS level of a channel from a peak pseudo scope
+ * \param scope peak pseudo scope handle
+ * \param channel Channel
+ * \return RMS of the samples of the last update (0.0 ... 1.0)
+ */
+float snd_pcm_scope_peak_get_rms(snd_pcm_scope_t *scope, unsigned int channel)
+{
+	snd_pcm_scope_peak_t *peak;
+	float val = 0;
+	assert(scope->ops == &peak_ops);
+	peak = scope->private_data;
+	if (scope->enabled && peak->rms) {
+		snd_pcm_meter_t *meter = peak->pcm->private_data;
+		assert(channel < meter->gen.slave->channels);
+		__atomic_load(&peak->rms[channel], &val, __ATOMIC_RELAXED);
+	}
+	return val;
+}
+
 /**
  * \brief allocate an invalid #snd_pcm_scope_t using standard malloc
  * \param ptr returned pointer
@@ -0,0 +1,267 @@
+/*
+ *  PCM Meter Plugin - peak and RMS kernels
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * The kernels scan a run of samples of one channel in CPU endian S16, S32
+ * or FLOAT, scaled to -1.0 .. 1.0.  They raise *peak to the largest
+ * absolute value and add the sum of the squares to *sum.  The squares are
+ * summed in float lanes for blocks of METER_SIMD_BLOCK samples and the
+ * blocks in double, so long runs don't lose precision.
+ *
+ * The vector kernels return the number of samples they processed, the
+ * caller finishes the tail with the scalar version.
+ */
+
+#include <stdint.h>
+
+#define METER_SIMD_BLOCK	4096
+
+typedef unsigned int (meter_simd_func_t)(const void *src, unsigned int n,
+					 float *peak, double *sum);
+
+/*
+ * scalar versions
+ */
+#define METER_SCALAR(name, type, scale) \
+static unsigned int name(const void *src, unsigned int n, \
+			 float *peak, double *sum) \
+{ \
+	const type *s = src; \
+	float p = *peak; \
+	double acc = 0; \
+	unsigned int i; \
+	for (i = 0; i < n; i++) { \
+		float v = s[i] * (scale); \
+		float a = v < 0 ? -v : v; \
+		if (a > p) \
+			p = a; \
+		acc += v * v; \
+	} \
+	*peak = p; \
+	*sum += acc; \
+	return n; \
+}
+
+METER_SCALAR(meter_peak_s16, int16_t, 1.0f / 32768)
+METER_SCALAR(meter_peak_s32, int32_t, 1.0f / 2147483648.0f)
+METER_SCALAR(meter_peak_float, float, 1.0f)
+
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+#if defined(__x86_64__) || defined(__i386__)
+#define METER_SIMD_X86
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#define METER_SIMD_NEON
+#endif
+#endif
+
+#ifdef METER_SIMD_X86
+#include <immintrin.h>
+
+#define METER_SIMD_TARGET(isa)	__attribute__((target(isa)))
+
+/* horizontal reductions */
+static METER_SIMD_TARGET("sse2")
+float meter_sse2_hmax(__m128 v)
+{
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(v);
+}
+
+static METER_SIMD_TARGET("sse2")
+float meter_sse2_hsum(__m128 v)
+{
+	v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(v);
+}
+
+/*
+ * LOAD(i) sets the __m128 x to the scaled samples i .. i + 3; the
+ * sign bit is cleared for the peak
+ */
+#define METER_SSE2_KERNEL(name, type, LOAD) \
+static METER_SIMD_TARGET("sse2") \
+unsigned int name(const void *src, unsigned int n, float *peak, double *sum) \
+{ \
+	const type *s = src; \
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)); \
+	__m128 vpeak = _mm_set1_ps(*peak); \
+	unsigned int i = 0, end; \
+	n &= ~3U; \
+	while (i < n) { \
+		__m128 acc = _mm_setzero_ps(); \
+		end = n - i > METER_SIMD_BLOCK ? i + METER_SIMD_BLOCK : n; \
+		for (; i < end; i += 4) { \
+			__m128 x; \
+			LOAD(i); \
+			vpeak = _mm_max_ps(vpeak, _mm_and_ps(x, abs_mask)); \
+			acc = _mm_add_ps(acc, _mm_mul_ps(x, x)); \
+		} \
+		*sum += meter_sse2_hsum(acc); \
+	} \
+	*peak = meter_sse2_hmax(vpeak); \
+	return n; \
+}
+
+#define METER_SSE2_LOAD_S16(i) \
+	x = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(\
+		_mm_loadl_epi64((const __m128i *)(s + (i))), \
+		_mm_loadl_epi64((const __m128i *)(s + (i)))), 16)), \
+		_mm_set1_ps(1.0f / 32768))
+#define METER_SSE2_LOAD_S32(i) \
+	x = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(s + (i)))), \
+		       _mm_set1_ps(1.0f / 2147483648.0f))
+#define METER_SSE2_LOAD_FLOAT(i) \
+	x = _mm_loadu_ps(s + (i))
+
+METER_SSE2_KERNEL(meter_sse2_peak_s16, int16_t, METER_SSE2_LOAD_S16)
+METER_SSE2_KERNEL(meter_sse2_peak_s32, int32_t, METER_SSE2_LOAD_S32)
+METER_SSE2_KERNEL(meter_sse2_peak_float, float, METER_SSE2_LOAD_FLOAT)
+
+/* the same with eight lanes */
+#define METER_AVX2_KERNEL(name, type, LOAD) \
+static METER_SIMD_TARGET("avx2") \
+unsigned int name(const void *src, unsigned int n, float *peak, double *sum) \
+{ \
+	const type *s = src; \
+	const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff)); \
+	__m256 vpeak = _mm256_set1_ps(*peak); \
+	unsigned int i = 0, end; \
+	n &= ~7U; \
+	while (i < n) { \
+		__m256 acc = _mm256_setzero_ps(); \
+		end = n - i > METER_SIMD_BLOCK ? i + METER_SIMD_BLOCK : n; \
+		for (; i < end; i += 8) { \
+			__m256 x; \
+			LOAD(i); \
+			vpeak = _mm256_max_ps(vpeak, _mm256_and_ps(x, abs_mask)); \
+			acc = _mm256_add_ps(acc, _mm256_mul_ps(x, x)); \
+		} \
+		*sum += meter_sse2_hsum(_mm_add_ps(_mm256_castps256_ps128(acc), \
+						   _mm256_extractf128_ps(acc, 1))); \
+	} \
+	*peak = meter_sse2_hmax(_mm_max_ps(_mm256_castps256_ps128(vpeak), \
+					   _mm256_extractf128_ps(vpeak, 1))); \
+	return n; \
+}
+
+#define METER_AVX2_LOAD_S16(i) \
+	x = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(\
+		_mm_loadu_si128((const __m128i *)(s + (i))))), \
+		_mm256_set1_ps(1.0f / 32768))
+#define METER_AVX2_LOAD_S32(i) \
+	x = _mm256_mul_ps(_mm256_cvtepi32_ps(\
+		_mm256_loadu_si256((const __m256i *)(s + (i)))), \
+		_mm256_set1_ps(1.0f / 2147483648.0f))
+#define METER_AVX2_LOAD_FLOAT(i) \
+	x = _mm256_loadu_ps(s + (i))
+
+METER_AVX2_KERNEL(meter_avx2_peak_s16, int16_t, METER_AVX2_LOAD_S16)
+METER_AVX2_KERNEL(meter_avx2_peak_s32, int32_t, METER_AVX2_LOAD_S32)
+METER_AVX2_KERNEL(meter_avx2_peak_float, float, METER_AVX2_LOAD_FLOAT)
+
+static int meter_simd_have_sse2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+}
+
+static int meter_simd_have_avx2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+#endif /* METER_SIMD_X86 */
+
+#ifdef METER_SIMD_NEON
+#include <arm_neon.h>
+
+#define METER_NEON_KERNEL(name, type, LOAD) \
+static unsigned int name(const void *src, unsigned int n, \
+			 float *peak, double *sum) \
+{ \
+	const type *s = src; \
+	float32x4_t vpeak = vdupq_n_f32(*peak); \
+	float32x2_t r; \
+	unsigned int i = 0, end; \
+	n &= ~3U; \
+	while (i < n) { \
+		float32x4_t acc = vdupq_n_f32(0); \
+		end = n - i > METER_SIMD_BLOCK ? i + METER_SIMD_BLOCK : n; \
+		for (; i < end; i += 4) { \
+			float32x4_t x; \
+			LOAD(i); \
+			vpeak = vmaxq_f32(vpeak, vabsq_f32(x)); \
+			acc = vmlaq_f32(acc, x, x); \
+		} \
+		r = vadd_f32(vget_low_f32(acc), vget_high_f32(acc)); \
+		*sum += vget_lane_f32(vpadd_f32(r, r), 0); \
+	} \
+	r = vmax_f32(vget_low_f32(vpeak), vget_high_f32(vpeak)); \
+	*peak = vget_lane_f32(vpmax_f32(r, r), 0); \
+	return n; \
+}
+
+#define METER_NEON_LOAD_S16(i) \
+	x = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vld1_s16(s + (i)))), \
+			1.0f / 32768)
+#define METER_NEON_LOAD_S32(i) \
+	x = vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(s + (i))), \
+			1.0f / 2147483648.0f)
+#define METER_NEON_LOAD_FLOAT(i) \
+	x = vld1q_f32(s + (i))
+
+METER_NEON_KERNEL(meter_neon_peak_s16, int16_t, METER_NEON_LOAD_S16)
+METER_NEON_KERNEL(meter_neon_peak_s32, int32_t, METER_NEON_LOAD_S32)
+METER_NEON_KERNEL(meter_neon_peak_float, float, METER_NEON_LOAD_FLOAT)
+
+static int meter_simd_have_neon(void)
+{
+	return 1;
+}
+
+#endif /* METER_SIMD_NEON */
+
+/*
+ * kernel table, ordered by preference
+ */
+typedef struct {
+	const char *name;
+	int (*available)(void);
+	meter_simd_func_t *peak_s16;
+	meter_simd_func_t *peak_s32;
+	meter_simd_func_t *peak_float;
+} meter_simd_kernel_t;
+
+static const meter_simd_kernel_t meter_simd_kernels[] = {
+#ifdef METER_SIMD_X86
+	{ "avx2", meter_simd_have_avx2,
+	  meter_avx2_peak_s16, meter_avx2_peak_s32, meter_avx2_peak_float },
+	{ "sse2", meter_simd_have_sse2,
+	  meter_sse2_peak_s16, meter_sse2_peak_s32, meter_sse2_peak_float },
+#endif
+#ifdef METER_SIMD_NEON
+	{ "neon", meter_simd_have_neon,
+	  meter_neon_peak_s16, meter_neon_peak_s32, meter_neon_peak_float },
+#endif
+	{ NULL, NULL, NULL, NULL, NULL }
+};
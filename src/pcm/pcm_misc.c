@@ -597,6 +597,63 @@ uint8_t snd_pcm_format_silence(snd_pcm_format_t format)
 	return (uint8_t)snd_pcm_format_silence_64(format);
 }
 
+/*
+ * Fill with a non-zero silence sample: write the first SILENCE_PATTERN
+ * bytes (a multiple of all sample sizes) sample by sample, then repeat
+ * them with memcpy, which uses the widest stores of the CPU.  The copies
+ * are limited to a chunk so that the source stays in the cache.
+ */
+#define SILENCE_PATTERN	48
+#define SILENCE_CHUNK	(SILENCE_PATTERN * 64)
+
+static void silence_fill(void *data, unsigned int samples, uint64_t silence,
+			 unsigned int bytes)
+{
+	uint8_t *p = data;
+	uint8_t sample[8];
+	size_t size = (size_t)samples * bytes;
+	size_t done, n;
+
+	switch (bytes) {
+	case 2: {
+		uint16_t s = silence;
+		memcpy(sample, &s, 2);
+		break;
+	}
+	case 3:
+#ifdef SNDRV_LITTLE_ENDIAN
+		sample[0] = silence >> 0;
+		sample[1] = silence >> 8;
+		sample[2] = silence >> 16;
+#else
+		sample[0] = silence >> 16;
+		sample[1] = silence >> 8;
+		sample[2] = silence >> 0;
+#endif
+		break;
+	case 4: {
+		uint32_t s = silence;
+		memcpy(sample, &s, 4);
+		break;
+	}
+	default:
+		memcpy(sample, &silence, 8);
+		break;
+	}
+	n = size < SILENCE_PATTERN ? size : SILENCE_PATTERN;
+	for (done = 0; done < n; done += bytes)
+		memcpy(p + done, sample, bytes);
+	while (done < size) {
+		n = size - done;
+		if (n > done)
+			n = done;
+		if (n > SILENCE_CHUNK)
+			n = SILENCE_CHUNK;
+		memcpy(p + done, p, n);
+		done += n;
+	}
+}
+
 /**
  * \brief Silence a PCM samples buffer
  * \param format Sample format
@@ -606,76 +663,34 @@ uint8_t snd_pcm_format_silence(snd_pcm_format_t format)
  */
 int snd_pcm_format_set_silence(snd_pcm_format_t format, void *data, unsigned int samples)
 {
+	uint64_t silence;
+	int width;
+
 	if (samples == 0)
 		return 0;
-	switch (snd_pcm_format_physical_width(format)) {
+	width = snd_pcm_format_physical_width(format);
+	silence = snd_pcm_format_silence_64(format);
+	switch (width) {
 	case 4: {
-		uint8_t silence = snd_pcm_format_silence_64(format);
 		unsigned int samples1;
 		if (samples % 2 != 0)
 			return -EINVAL;
 		samples1 = samples / 2;
-		memset(data, silence, samples1);
-		break;
-	}
-	case 8: {
-		uint8_t silence = snd_pcm_format_silence_64(format);
-		memset(data, silence, samples);
-		break;
-	}
-	case 16: {
-		uint16_t silence = snd_pcm_format_silence_64(format);
-		uint16_t *pdata = (uint16_t *)data;
-		if (! silence)
-			memset(data, 0, samples * 2);
-		else {
-			while (samples-- > 0)
-				*pdata++ = silence;
-		}
-		break;
-	}
-	case 24: {
-		uint32_t silence = snd_pcm_format_silence_64(format);
-		uint8_t *pdata = (uint8_t *)data;
-		if (! silence)
-			memset(data, 0, samples * 3);
-		else {
-			while (samples-- > 0) {
-#ifdef SNDRV_LITTLE_ENDIAN
-				*pdata++ = silence >> 0;
-				*pdata++ = silence >> 8;
-				*pdata++ = silence >> 16;
-#else
-				*pdata++ = silence >> 16;
-				*pdata++ = silence >> 8;
-				*pdata++ = silence >> 0;
-#endif
-			}
-		}
+		memset(data, (uint8_t)silence, samples1);
 		break;
 	}
-	case 32: {
-		uint32_t silence = snd_pcm_format_silence_64(format);
-		uint32_t *pdata = (uint32_t *)data;
-		if (! silence)
-			memset(data, 0, samples * 4);
-		else {
-			while (samples-- > 0)
-				*pdata++ = silence;
-		}
+	case 8:
+		memset(data, (uint8_t)silence, samples);
 		break;
-	}
-	case 64: {
-		uint64_t silence = snd_pcm_format_silence_64(format);
-		uint64_t *pdata = (uint64_t *)data;
+	case 16:
+	case 24:
+	case 32:
+	case 64:
 		if (! silence)
-			memset(data, 0, samples * 8);
-		else {
-			while (samples-- > 0)
-				*pdata++ = silence;
-		}
+			memset(data, 0, samples * (width / 8));
+		else
+			silence_fill(data, samples, silence, width / 8);
 		break;
-	}
 	default:
 		assert(0);
 		return -EINVAL;
@@ -158,6 +158,59 @@ static int ulaw_to_s16(unsigned char u_val)
 
 #ifndef DOC_HIDDEN
 
+/* native S16 on the linear side, without the per-sample jumps */
+static void ulaw_decode_s16(const snd_pcm_channel_area_t *dst_areas,
+			    snd_pcm_uframes_t dst_offset,
+			    const snd_pcm_channel_area_t *src_areas,
+			    snd_pcm_uframes_t src_offset,
+			    unsigned int channels, snd_pcm_uframes_t frames)
+{
+	unsigned int channel;
+	for (channel = 0; channel < channels; ++channel) {
+		const unsigned char *src;
+		char *dst;
+		int src_step, dst_step;
+		snd_pcm_uframes_t frames1;
+		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
+		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+		src = snd_pcm_channel_area_addr(src_area, src_offset);
+		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+		src_step = snd_pcm_channel_area_step(src_area);
+		dst_step = snd_pcm_channel_area_step(dst_area);
+		for (frames1 = frames; frames1 > 0; frames1--) {
+			*(int16_t *)dst = ulaw_to_s16(*src);
+			src += src_step;
+			dst += dst_step;
+		}
+	}
+}
+
+static void ulaw_encode_s16(const snd_pcm_channel_area_t *dst_areas,
+			    snd_pcm_uframes_t dst_offset,
+			    const snd_pcm_channel_area_t *src_areas,
+			    snd_pcm_uframes_t src_offset,
+			    unsigned int channels, snd_pcm_uframes_t frames)
+{
+	unsigned int channel;
+	for (channel = 0; channel < channels; ++channel) {
+		const char *src;
+		unsigned char *dst;
+		int src_step, dst_step;
+		snd_pcm_uframes_t frames1;
+		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
+		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+		src = snd_pcm_channel_area_addr(src_area, src_offset);
+		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+		src_step = snd_pcm_channel_area_step(src_area);
+		dst_step = snd_pcm_channel_area_step(dst_area);
+		for (frames1 = frames; frames1 > 0; frames1--) {
+			*dst = s16_to_ulaw(*(const int16_t *)src);
+			src += src_step;
+			dst += dst_step;
+		}
+	}
+}
+
 void snd_pcm_mulaw_decode(const snd_pcm_channel_area_t *dst_areas,
 			  snd_pcm_uframes_t dst_offset,
 			  const snd_pcm_channel_area_t *src_areas,
@@ -170,6 +223,12 @@ void snd_pcm_mulaw_decode(const snd_pcm_channel_area_t *dst_areas,
 #undef PUT16_LABELS
 	void *put = put16_labels[putidx];
 	unsigned int channel;
+	if (putidx == (unsigned int)snd_pcm_linear_put_index(SND_PCM_FORMAT_S16,
+						       SND_PCM_FORMAT_S16)) {
+		ulaw_decode_s16(dst_areas, dst_offset, src_areas, src_offset,
+				channels, frames);
+		return;
+	}
 	for (channel = 0; channel < channels; ++channel) {
 		const unsigned char *src;
 		char *dst;
@@ -208,6 +267,12 @@ void snd_pcm_mulaw_encode(const snd_pcm_channel_area_t *dst_areas,
 	void *get = get16_labels[getidx];
 	unsigned int channel;
 	int16_t sample = 0;
+	if (getidx == (unsigned int)snd_pcm_linear_get_index(SND_PCM_FORMAT_S16,
+						       SND_PCM_FORMAT_S16)) {
+		ulaw_encode_s16(dst_areas, dst_offset, src_areas, src_offset,
+				channels, frames);
+		return;
+	}
 	for (channel = 0; channel < channels; ++channel) {
 		const char *src;
 		char *dst;
@@ -421,6 +486,7 @@ static const snd_pcm_ops_t snd_pcm_mulaw_ops = {
 	.munmap = snd_pcm_generic_munmap,
 	.get_chmap = snd_pcm_generic_get_chmap,
 	.set_chmap = snd_pcm_generic_set_chmap,
+	.get_slave = snd_pcm_generic_get_slave,
 };
 
 /**
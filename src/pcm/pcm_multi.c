@@ -33,6 +33,9 @@
 #include <math.h>
 #include "pcm_local.h"
 #include "pcm_generic.h"
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #ifndef PIC
 /* entry for static linking */
@@ -46,6 +49,16 @@ typedef struct {
 	unsigned int channels_count;
 	int close_slave;
 	snd_pcm_t *linked;
+	snd_pcm_sframes_t result;	/* of the last dispatched operation */
+	snd_htimestamp_t tstamp;	/* of hw_ptr at the last avail update */
+	int tstamp_valid;
+	/* drift monitoring */
+	int skew_valid;
+	int drift_valid;
+	snd_pcm_sframes_t skew;		/* frames played ahead of the master */
+	snd_pcm_uframes_t window_ptr;	/* master hw_ptr at the window start */
+	double n, sx, sy, sxx, sxy;	/* weighted sums of the skew regression */
+	double drift;			/* ppm */
 } snd_pcm_multi_slave_t;
 
 typedef struct {
@@ -53,21 +66,239 @@ typedef struct {
 	unsigned int slave_channel;
 } snd_pcm_multi_channel_t;
 
+typedef enum {
+	SND_PCM_MULTI_OP_MMAP_COMMIT,
+	SND_PCM_MULTI_OP_AVAIL_UPDATE,
+	SND_PCM_MULTI_OP_START,
+} snd_pcm_multi_op_t;
+
+#ifdef HAVE_LIBPTHREAD
+/*
+ * worker threads for the slaves but the first one, which is serviced
+ * by the caller
+ */
+typedef struct {
+	pthread_t *threads;
+	unsigned int count;
+	unsigned int started;		/* hands out the slave indices */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;		/* new operation or quit */
+	pthread_cond_t done_cond;	/* all workers are done */
+	unsigned int generation;	/* bumped for each operation */
+	unsigned int pending;		/* workers not done yet */
+	unsigned int sleeping;		/* workers waiting on cond */
+	int waiting;			/* caller waiting on done_cond */
+	int quit;
+	snd_pcm_multi_op_t op;
+	snd_pcm_uframes_t offset;
+	snd_pcm_uframes_t size;
+} snd_pcm_multi_workers_t;
+#endif
+
 typedef struct {
 	unsigned int slaves_count;
 	unsigned int master_slave;
 	snd_pcm_multi_slave_t *slaves;
 	unsigned int channels_count;
 	snd_pcm_multi_channel_t *channels;
+#ifdef HAVE_LIBPTHREAD
+	snd_pcm_multi_workers_t workers;
+#endif
 } snd_pcm_multi_t;
 
+/* spins before sleeping, for back to back operations */
+#define MULTI_SPIN	2000
+
+#endif
+
+static snd_pcm_sframes_t snd_pcm_multi_slave_op(snd_pcm_multi_t *multi,
+						unsigned int idx,
+						snd_pcm_multi_op_t op,
+						snd_pcm_uframes_t offset,
+						snd_pcm_uframes_t size)
+{
+	snd_pcm_multi_slave_t *slave = &multi->slaves[idx];
+	switch (op) {
+	case SND_PCM_MULTI_OP_MMAP_COMMIT:
+		return snd_pcm_mmap_commit(slave->pcm, offset, size);
+	case SND_PCM_MULTI_OP_AVAIL_UPDATE: {
+		snd_pcm_sframes_t avail = snd_pcm_avail_update(slave->pcm);
+		snd_pcm_uframes_t tavail;
+		/* the slaves are sampled at different times, remember when */
+		slave->tstamp_valid = avail >= 0 &&
+			snd_pcm_htimestamp(slave->pcm, &tavail, &slave->tstamp) >= 0;
+		return slave->tstamp_valid ? (snd_pcm_sframes_t)tavail : avail;
+	}
+	case SND_PCM_MULTI_OP_START:
+		if (slave->linked)
+			return 0;
+		return snd_pcm_start(slave->pcm);
+	}
+	return -EINVAL;
+}
+
+#ifdef HAVE_LIBPTHREAD
+/*
+ * Parallel servicing of the slaves
+ *
+ * The caller publishes the operation by bumping the generation, services
+ * the first slave itself and waits until each worker has stored the
+ * result for its slave.  Both sides spin shortly before they sleep, so
+ * the operations of one transfer don't go through the scheduler each.
+ */
+static void *snd_pcm_multi_worker(void *data)
+{
+	snd_pcm_multi_t *multi = data;
+	snd_pcm_multi_workers_t *w = &multi->workers;
+	unsigned int idx = __atomic_add_fetch(&w->started, 1, __ATOMIC_SEQ_CST);
+	unsigned int seen = 0, gen = 0;
+	int spin;
+
+	for (;;) {
+		for (spin = 0; spin < MULTI_SPIN; spin++) {
+			gen = __atomic_load_n(&w->generation, __ATOMIC_ACQUIRE);
+			if (gen != seen)
+				break;
+		}
+		if (gen == seen) {
+			pthread_mutex_lock(&w->mutex);
+			__atomic_add_fetch(&w->sleeping, 1, __ATOMIC_SEQ_CST);
+			while ((gen = __atomic_load_n(&w->generation, __ATOMIC_SEQ_CST)) == seen)
+				pthread_cond_wait(&w->cond, &w->mutex);
+			__atomic_sub_fetch(&w->sleeping, 1, __ATOMIC_SEQ_CST);
+			pthread_mutex_unlock(&w->mutex);
+		}
+		if (__atomic_load_n(&w->quit, __ATOMIC_ACQUIRE))
+			break;
+		seen = gen;
+		multi->slaves[idx].result =
+			snd_pcm_multi_slave_op(multi, idx, w->op, w->offset, w->size);
+		if (__atomic_sub_fetch(&w->pending, 1, __ATOMIC_SEQ_CST) == 0 &&
+		    __atomic_load_n(&w->waiting, __ATOMIC_SEQ_CST)) {
+			pthread_mutex_lock(&w->mutex);
+			pthread_cond_signal(&w->done_cond);
+			pthread_mutex_unlock(&w->mutex);
+		}
+	}
+	return NULL;
+}
+
+/* bump the generation and wake up the sleeping workers */
+static void snd_pcm_multi_workers_kick(snd_pcm_multi_workers_t *w)
+{
+	__atomic_add_fetch(&w->generation, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&w->sleeping, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&w->mutex);
+		pthread_cond_broadcast(&w->cond);
+		pthread_mutex_unlock(&w->mutex);
+	}
+}
+
+static void snd_pcm_multi_workers_wait(snd_pcm_multi_workers_t *w)
+{
+	int spin;
+
+	for (spin = 0; spin < MULTI_SPIN; spin++) {
+		if (!__atomic_load_n(&w->pending, __ATOMIC_ACQUIRE))
+			return;
+	}
+	pthread_mutex_lock(&w->mutex);
+	__atomic_store_n(&w->waiting, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&w->pending, __ATOMIC_SEQ_CST))
+		pthread_cond_wait(&w->done_cond, &w->mutex);
+	__atomic_store_n(&w->waiting, 0, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&w->mutex);
+}
+
+static void snd_pcm_multi_workers_stop(snd_pcm_multi_t *multi)
+{
+	snd_pcm_multi_workers_t *w = &multi->workers;
+	unsigned int i;
+
+	if (!w->threads)
+		return;
+	__atomic_store_n(&w->quit, 1, __ATOMIC_RELEASE);
+	snd_pcm_multi_workers_kick(w);
+	for (i = 0; i < w->count; i++)
+		pthread_join(w->threads[i], NULL);
+	pthread_cond_destroy(&w->done_cond);
+	pthread_cond_destroy(&w->cond);
+	pthread_mutex_destroy(&w->mutex);
+	free(w->threads);
+	w->threads = NULL;
+	w->count = 0;
+}
+
+static int snd_pcm_multi_workers_start(snd_pcm_multi_t *multi)
+{
+	snd_pcm_multi_workers_t *w = &multi->workers;
+	unsigned int i;
+	int err;
+
+	if (multi->slaves_count < 2)
+		return 0;
+	w->threads = calloc(multi->slaves_count - 1, sizeof(*w->threads));
+	if (!w->threads)
+		return -ENOMEM;
+	pthread_mutex_init(&w->mutex, NULL);
+	pthread_cond_init(&w->cond, NULL);
+	pthread_cond_init(&w->done_cond, NULL);
+	for (i = 0; i < multi->slaves_count - 1; i++) {
+		err = pthread_create(&w->threads[i], NULL,
+				     snd_pcm_multi_worker, multi);
+		if (err) {
+			SNDERR("cannot create the multi worker threads");
+			snd_pcm_multi_workers_stop(multi);
+			return -err;
+		}
+		w->count++;
+	}
+	return 0;
+}
+#else /* HAVE_LIBPTHREAD */
+static inline void snd_pcm_multi_workers_stop(snd_pcm_multi_t *multi ATTRIBUTE_UNUSED) {}
+static inline int snd_pcm_multi_workers_start(snd_pcm_multi_t *multi ATTRIBUTE_UNUSED)
+{
+	return 0;
+}
+#endif /* HAVE_LIBPTHREAD */
+
+/* run op on all slaves, the results are left in slaves[].result */
+static void snd_pcm_multi_dispatch(snd_pcm_multi_t *multi,
+				   snd_pcm_multi_op_t op,
+				   snd_pcm_uframes_t offset,
+				   snd_pcm_uframes_t size)
+{
+	unsigned int i;
+
+#ifdef HAVE_LIBPTHREAD
+	snd_pcm_multi_workers_t *w = &multi->workers;
+	if (w->count) {
+		w->op = op;
+		w->offset = offset;
+		w->size = size;
+		__atomic_store_n(&w->pending, w->count, __ATOMIC_RELAXED);
+		snd_pcm_multi_workers_kick(w);
+		multi->slaves[0].result =
+			snd_pcm_multi_slave_op(multi, 0, op, offset, size);
+		snd_pcm_multi_workers_wait(w);
+		return;
+	}
 #endif
+	for (i = 0; i < multi->slaves_count; ++i) {
+		multi->slaves[i].result =
+			snd_pcm_multi_slave_op(multi, i, op, offset, size);
+		if (multi->slaves[i].result < 0)
+			break;
+	}
+}
 
 static int snd_pcm_multi_close(snd_pcm_t *pcm)
 {
 	snd_pcm_multi_t *multi = pcm->private_data;
 	unsigned int i;
 	int ret = 0;
+	snd_pcm_multi_workers_stop(multi);
 	for (i = 0; i < multi->slaves_count; ++i) {
 		snd_pcm_multi_slave_t *slave = &multi->slaves[i];
 		if (slave->close_slave) {
@@ -415,19 +646,117 @@ static int snd_pcm_multi_delay(snd_pcm_t *pcm, snd_pcm_sframes_t *delayp)
 	return snd_pcm_delay(slave, delayp);
 }
 
+static void snd_pcm_multi_reset_skew(snd_pcm_multi_t *multi)
+{
+	unsigned int i;
+	for (i = 0; i < multi->slaves_count; ++i) {
+		multi->slaves[i].tstamp_valid = 0;
+		multi->slaves[i].skew_valid = 0;
+		multi->slaves[i].drift_valid = 0;
+		multi->slaves[i].skew = 0;
+		multi->slaves[i].drift = 0;
+	}
+}
+
+/* weight of the samples of the previous windows in the skew regression */
+#define MULTI_SKEW_DECAY	0.75
+
+/*
+ * start a new window at master_ptr, x frames after the current one:
+ * move the origin of the sums there and let the older samples weigh less
+ */
+static void snd_pcm_multi_window_shift(snd_pcm_multi_slave_t *slave,
+				       snd_pcm_uframes_t master_ptr, double x)
+{
+	slave->sxx += x * (slave->n * x - 2 * slave->sx);
+	slave->sxy -= x * slave->sy;
+	slave->sx -= slave->n * x;
+	slave->n *= MULTI_SKEW_DECAY;
+	slave->sx *= MULTI_SKEW_DECAY;
+	slave->sy *= MULTI_SKEW_DECAY;
+	slave->sxx *= MULTI_SKEW_DECAY;
+	slave->sxy *= MULTI_SKEW_DECAY;
+	slave->window_ptr = master_ptr;
+}
+
+/*
+ * sample the hw_ptr distance of each slave to the master after an
+ * update of all of them.  Each hw_ptr is moved to the time of the
+ * master's by its own timestamp, since the slaves are read one after
+ * the other or from different threads.  The drift is the slope of the
+ * skew fitted to all samples, updated each second of the master with
+ * the older seconds weighing less: the difference of two samples can be
+ * off by a frame, i.e. 20 ppm over a second at 48 kHz.
+ */
+static void snd_pcm_multi_update_skew(snd_pcm_t *pcm)
+{
+	snd_pcm_multi_t *multi = pcm->private_data;
+	snd_pcm_multi_slave_t *mslave = &multi->slaves[multi->master_slave];
+	snd_pcm_t *master = mslave->pcm;
+	snd_pcm_uframes_t master_ptr = *master->hw.ptr;
+	snd_pcm_sframes_t boundary = master->boundary;
+	unsigned int i;
+
+	if (snd_pcm_state(master) != SND_PCM_STATE_RUNNING)
+		return;
+	for (i = 0; i < multi->slaves_count; ++i) {
+		snd_pcm_multi_slave_t *slave = &multi->slaves[i];
+		snd_pcm_sframes_t frames;
+		double skew, x, d;
+
+		frames = *slave->pcm->hw.ptr - master_ptr;
+		if (frames > boundary / 2)
+			frames -= boundary;
+		else if (frames < -boundary / 2)
+			frames += boundary;
+		skew = frames;
+		if (slave != mslave && slave->tstamp_valid &&
+		    mslave->tstamp_valid)
+			skew += ((mslave->tstamp.tv_sec - slave->tstamp.tv_sec) +
+				 (mslave->tstamp.tv_nsec - slave->tstamp.tv_nsec) / 1e9) *
+				slave->pcm->rate;
+		slave->skew = skew < 0 ? skew - 0.5 : skew + 0.5;
+		if (!slave->skew_valid) {
+			slave->skew_valid = 1;
+			slave->window_ptr = master_ptr;
+			slave->n = slave->sx = slave->sy = 0;
+			slave->sxx = slave->sxy = 0;
+		}
+		frames = master_ptr - slave->window_ptr;
+		if (frames < 0)
+			frames += boundary;
+		x = frames;
+		slave->n += 1;
+		slave->sx += x;
+		slave->sy += skew;
+		slave->sxx += x * x;
+		slave->sxy += x * skew;
+		if (frames < (snd_pcm_sframes_t)pcm->rate)
+			continue;
+		d = slave->n * slave->sxx - slave->sx * slave->sx;
+		if (d > 0) {
+			slave->drift = (slave->n * slave->sxy -
+					slave->sx * slave->sy) / d * 1000000;
+			slave->drift_valid = 1;
+		}
+		snd_pcm_multi_window_shift(slave, master_ptr, x);
+	}
+}
+
 static snd_pcm_sframes_t snd_pcm_multi_avail_update(snd_pcm_t *pcm)
 {
 	snd_pcm_multi_t *multi = pcm->private_data;
 	snd_pcm_sframes_t ret = LONG_MAX;
 	unsigned int i;
+	snd_pcm_multi_dispatch(multi, SND_PCM_MULTI_OP_AVAIL_UPDATE, 0, 0);
 	for (i = 0; i < multi->slaves_count; ++i) {
-		snd_pcm_sframes_t avail;
-		avail = snd_pcm_avail_update(multi->slaves[i].pcm);
+		snd_pcm_sframes_t avail = multi->slaves[i].result;
 		if (avail < 0)
 			return avail;
 		if (ret > avail)
 			ret = avail;
 	}
+	snd_pcm_multi_update_skew(pcm);
 	return ret;
 }
 
@@ -444,6 +773,7 @@ static int snd_pcm_multi_prepare(snd_pcm_t *pcm)
 	snd_pcm_multi_t *multi = pcm->private_data;
 	int result = 0, err;
 	unsigned int i;
+	snd_pcm_multi_reset_skew(multi);
 	for (i = 0; i < multi->slaves_count; ++i) {
 		/* We call prepare to each slave even if it's linked.
 		 * This is to make sure to sync non-mmaped control/status.
@@ -476,18 +806,17 @@ static int snd_pcm_multi_reset(snd_pcm_t *pcm)
 static int snd_pcm_multi_start(snd_pcm_t *pcm)
 {
 	snd_pcm_multi_t *multi = pcm->private_data;
-	int err = 0;
 	unsigned int i;
+	snd_pcm_multi_reset_skew(multi);
 	if (multi->slaves[0].linked)
 		return snd_pcm_start(multi->slaves[0].linked);
+	/* with the workers the unlinked slaves start at about the same time */
+	snd_pcm_multi_dispatch(multi, SND_PCM_MULTI_OP_START, 0, 0);
 	for (i = 0; i < multi->slaves_count; ++i) {
-		if (multi->slaves[i].linked)
-			continue;
-		err = snd_pcm_start(multi->slaves[i].pcm);
-		if (err < 0)
-			return err;
+		if (multi->slaves[i].result < 0)
+			return multi->slaves[i].result;
 	}
-	return err;
+	return 0;
 }
 
 static int snd_pcm_multi_drop(snd_pcm_t *pcm)
@@ -719,13 +1048,12 @@ static snd_pcm_sframes_t snd_pcm_multi_mmap_commit(snd_pcm_t *pcm,
 						   snd_pcm_uframes_t size)
 {
 	snd_pcm_multi_t *multi = pcm->private_data;
-	snd_pcm_t *slave;
 	unsigned int i;
 	snd_pcm_sframes_t result;
 
+	snd_pcm_multi_dispatch(multi, SND_PCM_MULTI_OP_MMAP_COMMIT, offset, size);
 	for (i = 0; i < multi->slaves_count; ++i) {
-		slave = multi->slaves[i].pcm;
-		result = snd_pcm_mmap_commit(slave, offset, size);
+		result = multi->slaves[i].result;
 		if (result < 0)
 			return result;
 		if ((snd_pcm_uframes_t)result != size)
@@ -927,6 +1255,11 @@ static void snd_pcm_multi_dump(snd_pcm_t *pcm, snd_output_t *out)
 		snd_output_printf(out, "    %d: slave %d, channel %d\n", 
 			k, c->slave_idx, c->slave_channel);
 	}
+#ifdef HAVE_LIBPTHREAD
+	if (multi->workers.count)
+		snd_output_printf(out, "  Worker threads: %u\n",
+				  multi->workers.count);
+#endif
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -987,6 +1320,44 @@ static const snd_pcm_fast_ops_t snd_pcm_multi_fast_ops = {
 	.may_wait_for_avail_min = snd_pcm_multi_may_wait_for_avail_min,
 };
 
+/**
+ * \brief Get the position skew and drift of a slave of a multi PCM
+ * \param pcm Multi PCM handle
+ * \param slave Slave index
+ * \param skew Returns the frames the slave has played ahead of the master
+ * \param drift Returns the drift against the master in ppm, may be NULL
+ * \retval zero on success otherwise a negative error code
+ *
+ * The hw_ptr of each slave is sampled in #snd_pcm_avail_update() of the
+ * running PCM and moved to the time of the master's by the slave's
+ * #snd_pcm_htimestamp(); the drift is fitted over the last seconds of the
+ * master.  While no sample was taken since the start, -EAGAIN is
+ * returned; the drift is zero until the first second has passed.
+ */
+int snd_pcm_multi_get_skew(snd_pcm_t *pcm, unsigned int slave,
+			   snd_pcm_sframes_t *skew, double *drift)
+{
+	snd_pcm_multi_t *multi;
+	int err = 0;
+
+	assert(pcm && skew);
+	if (pcm->type != SND_PCM_TYPE_MULTI)
+		return -EINVAL;
+	multi = pcm->private_data;
+	if (slave >= multi->slaves_count)
+		return -EINVAL;
+	snd_pcm_lock(pcm);
+	if (multi->slaves[slave].skew_valid) {
+		*skew = multi->slaves[slave].skew;
+		if (drift)
+			*drift = multi->slaves[slave].drift;
+	} else {
+		err = -EAGAIN;
+	}
+	snd_pcm_unlock(pcm);
+	return err;
+}
+
 /**
  * \brief Creates a new Multi PCM
  * \param pcmp Returns created PCM handle
@@ -1109,9 +1480,19 @@ pcm.name {
 		}
 	}
 	[master INT]		# Define the master slave
+	[parallel BOOL]		# Service the slaves from worker threads
 }
 \endcode
 
+With \c parallel, #snd_pcm_mmap_commit(), #snd_pcm_avail_update() and
+#snd_pcm_start() reach the slaves from one worker thread each instead of
+one after the other, which pays off with several slaves behind slow
+transports such as USB.  Unlinked slaves are started at about the same
+time then, too.
+
+The distance of the slaves to the master and their drift can be read with
+snd_pcm_multi_get_skew().
+
 For example, to bind two PCM streams with two-channel stereo (hw:0,0 and
 hw:0,1) as one 4-channel stereo PCM stream, define like this:
 \code
@@ -1154,6 +1535,7 @@ pcm.quad2 {
 <UL>
   <LI>snd_pcm_multi_open()
   <LI>_snd_pcm_multi_open()
+  <LI>snd_pcm_multi_get_skew()
 </UL>
 
 */
@@ -1188,6 +1570,7 @@ int _snd_pcm_multi_open(snd_pcm_t **pcmp, const char *name,
 	unsigned int *channels_schannel = NULL;
 	unsigned int slaves_count = 0;
 	long master_slave = 0;
+	int parallel = 0;
 	unsigned int channels_count = 0;
 	snd_config_for_each(i, inext, conf) {
 		snd_config_t *n = snd_config_iterator_entry(i);
@@ -1219,6 +1602,13 @@ int _snd_pcm_multi_open(snd_pcm_t **pcmp, const char *name,
 			}
 			continue;
 		}
+		if (strcmp(id, "parallel") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return -EINVAL;
+			parallel = err;
+			continue;
+		}
 		SNDERR("Unknown field %s", id);
 		return -EINVAL;
 	}
@@ -1368,6 +1758,14 @@ int _snd_pcm_multi_open(snd_pcm_t **pcmp, const char *name,
 				 channels_count,
 				 channels_sidx, channels_schannel,
 				 1);
+	if (err >= 0 && parallel) {
+		err = snd_pcm_multi_workers_start((*pcmp)->private_data);
+		if (err < 0) {
+			snd_pcm_close(*pcmp);
+			/* the slaves went with it */
+			memset(slaves_pcm, 0, slaves_count * sizeof(*slaves_pcm));
+		}
+	}
 _free:
 	if (err < 0) {
 		for (idx = 0; idx < slaves_count; ++idx) {
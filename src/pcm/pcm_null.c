@@ -28,6 +28,7 @@
   
 #include "bswap.h"
 #include <limits.h>
+#include <sys/timerfd.h>
 #include "pcm_local.h"
 #include "pcm_plugin.h"
 
@@ -44,9 +45,76 @@ typedef struct {
 	snd_pcm_uframes_t hw_ptr;
 	int poll_fd;
 	snd_pcm_chmap_query_t **chmap;
+	int paced;			/* hw_ptr follows the monotonic clock */
+	struct timespec start_time;	/* time of the start or pause release */
+	snd_pcm_uframes_t start_ptr;	/* hw_ptr at start_time */
 } snd_pcm_null_t;
 #endif
 
+/*
+ * paced mode: hw_ptr moves at the nominal rate since the start, and
+ * the poll descriptor is a timer firing once per period
+ */
+static int snd_pcm_null_paced_update(snd_pcm_t *pcm)
+{
+	snd_pcm_null_t *null = pcm->private_data;
+	struct timespec now;
+	snd_pcm_uframes_t frames;
+	long nsec;
+
+	if (null->state == SND_PCM_STATE_XRUN)
+		return -EPIPE;
+	if (null->state != SND_PCM_STATE_RUNNING)
+		return 0;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	nsec = now.tv_nsec - null->start_time.tv_nsec;
+	frames = (now.tv_sec - null->start_time.tv_sec) * pcm->rate;
+	if (nsec < 0) {
+		nsec += 1000000000;
+		frames -= pcm->rate;
+	}
+	frames += (uint64_t)nsec * pcm->rate / 1000000000;
+	*pcm->hw.ptr = (null->start_ptr + frames) % pcm->boundary;
+	if ((snd_pcm_uframes_t)snd_pcm_mmap_avail(pcm) >= pcm->stop_threshold) {
+		null->state = SND_PCM_STATE_XRUN;
+		return -EPIPE;
+	}
+	return 0;
+}
+
+/* rounded up, so that the frames are complete when the timer fires */
+static void frames_to_timespec(struct timespec *ts, snd_pcm_uframes_t frames,
+			       unsigned int rate)
+{
+	uint64_t nsec = ((uint64_t)frames * 1000000000ULL + rate - 1) / rate;
+
+	ts->tv_sec = nsec / 1000000000ULL;
+	ts->tv_nsec = nsec % 1000000000ULL;
+}
+
+/* fire once per period, or disarm */
+static void snd_pcm_null_paced_timer(snd_pcm_t *pcm, int enable)
+{
+	snd_pcm_null_t *null = pcm->private_data;
+	struct itimerspec spec;
+
+	memset(&spec, 0, sizeof(spec));
+	if (enable) {
+		frames_to_timespec(&spec.it_interval, pcm->period_size, pcm->rate);
+		spec.it_value = spec.it_interval;
+	}
+	timerfd_settime(null->poll_fd, 0, &spec, NULL);
+}
+
+static void snd_pcm_null_paced_start(snd_pcm_t *pcm)
+{
+	snd_pcm_null_t *null = pcm->private_data;
+
+	clock_gettime(CLOCK_MONOTONIC, &null->start_time);
+	null->start_ptr = *pcm->hw.ptr;
+	snd_pcm_null_paced_timer(pcm, 1);
+}
+
 static int snd_pcm_null_close(snd_pcm_t *pcm)
 {
 	snd_pcm_null_t *null = pcm->private_data;
@@ -87,6 +155,12 @@ static snd_pcm_sframes_t snd_pcm_null_avail_update(snd_pcm_t *pcm)
                 /* the prepared stream, otherwise the start is not called */
                 return snd_pcm_mmap_avail(pcm);
         }
+	if (null->paced) {
+		int err = snd_pcm_null_paced_update(pcm);
+		if (err < 0)
+			return err;
+		return snd_pcm_mmap_avail(pcm);
+	}
 	return pcm->buffer_size;
 }
 
@@ -94,10 +168,17 @@ static int snd_pcm_null_status(snd_pcm_t *pcm, snd_pcm_status_t * status)
 {
 	snd_pcm_null_t *null = pcm->private_data;
 	memset(status, 0, sizeof(*status));
+	if (null->paced) {
+		snd_pcm_null_paced_update(pcm);
+		status->hw_ptr = *pcm->hw.ptr;
+		status->appl_ptr = *pcm->appl.ptr;
+		status->delay = snd_pcm_mmap_delay(pcm);
+	}
 	status->state = null->state;
 	status->trigger_tstamp = null->trigger_tstamp;
 	gettimestamp(&status->tstamp, pcm->tstamp_type);
-	status->avail = snd_pcm_null_avail_update(pcm);
+	status->avail = null->paced ? (snd_pcm_uframes_t)snd_pcm_mmap_avail(pcm) :
+		(snd_pcm_uframes_t)snd_pcm_null_avail_update(pcm);
 	status->avail_max = pcm->buffer_size;
 	return 0;
 }
@@ -108,13 +189,24 @@ static snd_pcm_state_t snd_pcm_null_state(snd_pcm_t *pcm)
 	return null->state;
 }
 
-static int snd_pcm_null_hwsync(snd_pcm_t *pcm ATTRIBUTE_UNUSED)
+static int snd_pcm_null_hwsync(snd_pcm_t *pcm)
 {
+	snd_pcm_null_t *null = pcm->private_data;
+	if (null->paced)
+		return snd_pcm_null_paced_update(pcm);
 	return 0;
 }
 
-static int snd_pcm_null_delay(snd_pcm_t *pcm ATTRIBUTE_UNUSED, snd_pcm_sframes_t *delayp)
+static int snd_pcm_null_delay(snd_pcm_t *pcm, snd_pcm_sframes_t *delayp)
 {
+	snd_pcm_null_t *null = pcm->private_data;
+	if (null->paced) {
+		int err = snd_pcm_null_paced_update(pcm);
+		if (err < 0)
+			return err;
+		*delayp = snd_pcm_mmap_delay(pcm);
+		return 0;
+	}
 	*delayp = 0;
 	return 0;
 }
@@ -138,7 +230,9 @@ static int snd_pcm_null_start(snd_pcm_t *pcm)
 	snd_pcm_null_t *null = pcm->private_data;
 	assert(null->state == SND_PCM_STATE_PREPARED);
 	null->state = SND_PCM_STATE_RUNNING;
-	if (pcm->stream == SND_PCM_STREAM_CAPTURE)
+	if (null->paced)
+		snd_pcm_null_paced_start(pcm);
+	else if (pcm->stream == SND_PCM_STREAM_CAPTURE)
 		*pcm->hw.ptr = *pcm->appl.ptr + pcm->buffer_size;
 	else
 		*pcm->hw.ptr = *pcm->appl.ptr;
@@ -150,6 +244,8 @@ static int snd_pcm_null_drop(snd_pcm_t *pcm)
 	snd_pcm_null_t *null = pcm->private_data;
 	assert(null->state != SND_PCM_STATE_OPEN);
 	null->state = SND_PCM_STATE_SETUP;
+	if (null->paced)
+		snd_pcm_null_paced_timer(pcm, 0);
 	return 0;
 }
 
@@ -158,6 +254,8 @@ static int snd_pcm_null_drain(snd_pcm_t *pcm)
 	snd_pcm_null_t *null = pcm->private_data;
 	assert(null->state != SND_PCM_STATE_OPEN);
 	null->state = SND_PCM_STATE_SETUP;
+	if (null->paced)
+		snd_pcm_null_paced_timer(pcm, 0);
 	return 0;
 }
 
@@ -167,11 +265,17 @@ static int snd_pcm_null_pause(snd_pcm_t *pcm, int enable)
 	if (enable) {
 		if (null->state != SND_PCM_STATE_RUNNING)
 			return -EBADFD;
+		if (null->paced) {
+			snd_pcm_null_paced_update(pcm);
+			snd_pcm_null_paced_timer(pcm, 0);
+		}
 		null->state = SND_PCM_STATE_PAUSED;
 	} else {
 		if (null->state != SND_PCM_STATE_PAUSED)
 			return -EBADFD;
 		null->state = SND_PCM_STATE_RUNNING;
+		if (null->paced)
+			snd_pcm_null_paced_start(pcm);
 	}
 	return 0;
 }
@@ -192,7 +296,8 @@ static snd_pcm_sframes_t snd_pcm_null_rewind(snd_pcm_t *pcm, snd_pcm_uframes_t f
 	snd_pcm_null_t *null = pcm->private_data;
 	switch (null->state) {
 	case SND_PCM_STATE_RUNNING:
-		snd_pcm_mmap_hw_backward(pcm, frames);
+		if (! null->paced)
+			snd_pcm_mmap_hw_backward(pcm, frames);
 		/* Fall through */
 	case SND_PCM_STATE_PREPARED:
 		snd_pcm_mmap_appl_backward(pcm, frames);
@@ -207,7 +312,8 @@ static snd_pcm_sframes_t snd_pcm_null_forward(snd_pcm_t *pcm, snd_pcm_uframes_t
 	snd_pcm_null_t *null = pcm->private_data;
 	switch (null->state) {
 	case SND_PCM_STATE_RUNNING:
-		snd_pcm_mmap_hw_forward(pcm, frames);
+		if (! null->paced)
+			snd_pcm_mmap_hw_forward(pcm, frames);
 		/* Fall through */
 	case SND_PCM_STATE_PREPARED:
 		snd_pcm_mmap_appl_forward(pcm, frames);
@@ -227,8 +333,10 @@ static snd_pcm_sframes_t snd_pcm_null_xfer_areas(snd_pcm_t *pcm,
 						 snd_pcm_uframes_t offset ATTRIBUTE_UNUSED,
 						 snd_pcm_uframes_t size)
 {
+	snd_pcm_null_t *null = pcm->private_data;
 	snd_pcm_mmap_appl_forward(pcm, size);
-	snd_pcm_mmap_hw_forward(pcm, size);
+	if (! null->paced)
+		snd_pcm_mmap_hw_forward(pcm, size);
 	return size;
 }
 
@@ -259,6 +367,37 @@ static snd_pcm_sframes_t snd_pcm_null_mmap_commit(snd_pcm_t *pcm,
 	return snd_pcm_null_forward(pcm, size);
 }
 
+static int snd_pcm_null_poll_revents(snd_pcm_t *pcm, struct pollfd *pfds,
+				     unsigned int nfds, unsigned short *revents)
+{
+	snd_pcm_null_t *null = pcm->private_data;
+	snd_pcm_sframes_t avail;
+	uint64_t expired = 0;
+
+	if (nfds != 1)
+		return -EINVAL;
+	if (! null->paced) {
+		*revents = pfds->revents;
+		return 0;
+	}
+	if (pfds->revents & POLLIN) {
+		if (read(null->poll_fd, &expired, sizeof(expired)) < 0) {
+			if (errno != EAGAIN)
+				return -errno;
+			expired = 0;
+		}
+	}
+	*revents = 0;
+	avail = snd_pcm_null_avail_update(pcm);
+	if (avail < 0)
+		*revents = POLLERR;
+	else if ((snd_pcm_uframes_t)avail >= pcm->avail_min ||
+		 (expired && avail > 0))
+		/* like a period interrupt, also when not period aligned */
+		*revents = pcm->stream == SND_PCM_STREAM_PLAYBACK ? POLLOUT : POLLIN;
+	return 0;
+}
+
 static int snd_pcm_null_hw_refine(snd_pcm_t *pcm ATTRIBUTE_UNUSED, snd_pcm_hw_params_t *params)
 {
 	int err = snd_pcm_hw_refine_soft(pcm, params);
@@ -303,7 +442,8 @@ static snd_pcm_chmap_t *snd_pcm_null_get_chmap(snd_pcm_t *pcm)
 
 static void snd_pcm_null_dump(snd_pcm_t *pcm, snd_output_t *out)
 {
-	snd_output_printf(out, "Null PCM\n");
+	snd_pcm_null_t *null = pcm->private_data;
+	snd_output_printf(out, "Null PCM%s\n", null->paced ? " (paced)" : "");
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -351,6 +491,7 @@ static const snd_pcm_fast_ops_t snd_pcm_null_fast_ops = {
 	.avail_update = snd_pcm_null_avail_update,
 	.mmap_commit = snd_pcm_null_mmap_commit,
 	.htimestamp = snd_pcm_generic_real_htimestamp,
+	.poll_revents = snd_pcm_null_poll_revents,
 };
 
 /**
@@ -410,6 +551,25 @@ int snd_pcm_null_open(snd_pcm_t **pcmp, const char *name, snd_pcm_stream_t strea
 	return 0;
 }
 
+/* switch to the paced mode, replacing the poll descriptor by a timer */
+static int snd_pcm_null_set_paced(snd_pcm_t *pcm)
+{
+	snd_pcm_null_t *null = pcm->private_data;
+	int fd;
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0) {
+		SYSERR("Cannot create timerfd");
+		return -errno;
+	}
+	close(null->poll_fd);
+	null->poll_fd = fd;
+	null->paced = 1;
+	pcm->poll_fd = fd;
+	pcm->poll_events = POLLIN;
+	return 0;
+}
+
 /*! \page pcm_plugins
 
 \section pcm_plugins_null Plugin: Null
@@ -417,6 +577,13 @@ int snd_pcm_null_open(snd_pcm_t **pcmp, const char *name, snd_pcm_stream_t strea
 This plugin discards contents of a PCM stream or creates a stream with zero
 samples.
 
+By default the stream is not timed: the written samples are consumed
+and the captured samples are available immediately.  With \c paced,
+the stream position moves at the configured rate after the start like
+with a sound card running on the system clock, including the wakeups
+and xruns, which is useful to test the timing of plugins and
+applications without hardware.
+
 Note: This implementation uses devices /dev/null (playback, must be writable)
 and /dev/full (capture, must be readable).
 
@@ -424,6 +591,7 @@ and /dev/full (capture, must be readable).
 pcm.name {
         type null               # Null PCM
 	[chmap MAP]		# Provide channel maps; MAP is a string array
+	[paced BOOL]		# Move the position in real time (default false)
 }
 \endcode
 
@@ -456,6 +624,7 @@ int _snd_pcm_null_open(snd_pcm_t **pcmp, const char *name,
 	snd_config_iterator_t i, next;
 	snd_pcm_null_t *null;
 	snd_pcm_chmap_query_t **chmap = NULL;
+	int paced = 0;
 	int err;
 
 	snd_config_for_each(i, next, conf) {
@@ -474,6 +643,15 @@ int _snd_pcm_null_open(snd_pcm_t **pcmp, const char *name,
 			}
 			continue;
 		}
+		if (strcmp(id, "paced") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0) {
+				snd_pcm_free_chmaps(chmap);
+				return err;
+			}
+			paced = err;
+			continue;
+		}
 		SNDERR("Unknown field %s", id);
 		snd_pcm_free_chmaps(chmap);
 		return -EINVAL;
@@ -486,6 +664,13 @@ int _snd_pcm_null_open(snd_pcm_t **pcmp, const char *name,
 
 	null = (*pcmp)->private_data;
 	null->chmap = chmap;
+	if (paced) {
+		err = snd_pcm_null_set_paced(*pcmp);
+		if (err < 0) {
+			snd_pcm_close(*pcmp);
+			return err;
+		}
+	}
 	return 0;
 }
 #ifndef DOC_HIDDEN
@@ -2282,7 +2282,8 @@ static int snd_pcm_sw_params_default(snd_pcm_t *pcm, snd_pcm_sw_params_t *params
 
 int snd_pcm_hw_refine(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 {
-	int res;
+	snd_pcm_hw_params_t in;
+	int res, cache;
 #ifdef REFINE_DEBUG
 	snd_output_t *log;
 	snd_output_stdio_attach(&log, stderr, 0);
@@ -2292,7 +2293,15 @@ int snd_pcm_hw_refine(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 	snd_output_printf(log, "REFINE called:\n");
 	snd_pcm_hw_params_dump(params, log);
 #endif
-	res = pcm->ops->hw_refine(pcm->op_arg, params);
+	/* a plug PCM refines through its converters while set up */
+	cache = pcm->refine_key && !pcm->setup;
+	if (!cache || !snd_pcm_refine_cache_lookup(pcm, params, &res)) {
+		if (cache)
+			in = *params;
+		res = pcm->ops->hw_refine(pcm->op_arg, params);
+		if (cache)
+			snd_pcm_refine_cache_store(pcm, &in, params, res);
+	}
 #ifdef REFINE_DEBUG
 	snd_output_printf(log, "refine done - result = %i\n", res);
 	snd_pcm_hw_params_dump(params, log);
@@ -2317,10 +2326,17 @@ int _snd_pcm_hw_params_internal(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 {
 	int err;
 	snd_pcm_sw_params_t sw;
-	int fb, min_align;
+	snd_pcm_hw_params_t saved;
+	int fb, min_align, retry;
+
+	/* a cached space may be stale, retry once without the cache */
+	retry = pcm->refine_key != 0;
+	if (retry)
+		saved = *params;
+ _again:
 	err = snd_pcm_hw_refine(pcm, params);
 	if (err < 0)
-		return err;
+		goto _fail;
 	snd_pcm_hw_params_choose(pcm, params);
 	if (pcm->setup) {
 		err = snd_pcm_hw_free(pcm);
@@ -2329,7 +2345,7 @@ int _snd_pcm_hw_params_internal(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 	}
 	err = pcm->ops->hw_params(pcm->op_arg, params);
 	if (err < 0)
-		return err;
+		goto _fail;
 
 	pcm->setup = 1;
 	INTERNAL(snd_pcm_hw_params_get_access)(params, &pcm->access);
@@ -2373,5 +2389,14 @@ int _snd_pcm_hw_params_internal(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 	if (err < 0)
 		return err;
 	return 0;
+
+ _fail:
+	if (retry) {
+		snd_pcm_refine_cache_drop(pcm);
+		*params = saved;
+		retry = 0;
+		goto _again;
+	}
+	return err;
 }
 
@@ -400,7 +400,12 @@ static int snd_pcm_plug_change_channels(snd_pcm_t *pcm, snd_pcm_t **new, snd_pcm
 	if (clt->rate != slv->rate &&
 	    clt->channels > slv->channels)
 		return 0;
+#ifdef SND_PCM_ROUTE_FLOAT_FORMATS
+	assert(snd_pcm_format_linear(slv->format) ||
+	       snd_pcm_format_float(slv->format));
+#else
 	assert(snd_pcm_format_linear(slv->format));
+#endif
 	tt_ssize = slv->channels;
 	tt_cused = clt->channels;
 	tt_sused = slv->channels;
@@ -486,6 +491,11 @@ static int snd_pcm_plug_change_channels(snd_pcm_t *pcm, snd_pcm_t **new, snd_pcm
 	slv->access = clt->access;
 	if (snd_pcm_format_linear(clt->format))
 		slv->format = clt->format;
+#ifdef SND_PCM_ROUTE_FLOAT_FORMATS
+	/* float too, unless the rate plugin still comes on top */
+	else if (snd_pcm_format_float(clt->format) && clt->rate == slv->rate)
+		slv->format = clt->format;
+#endif
 	return 1;
 }
 #endif
@@ -539,6 +549,15 @@ static int snd_pcm_plug_change_format(snd_pcm_t *pcm, snd_pcm_t **new, snd_pcm_p
 		}
 #ifdef BUILD_PCM_PLUGIN_LFLOAT
 	} else if (snd_pcm_format_float(slv->format)) {
+#ifdef SND_PCM_ROUTE_FLOAT_FORMATS
+		/* the route plugin converts the format with the channels */
+		if (clt->rate == slv->rate &&
+		    (clt->channels != slv->channels ||
+		     (plug->ttable && !plug->ttable_ok)) &&
+		    (snd_pcm_format_linear(clt->format) ||
+		     snd_pcm_format_float(clt->format)))
+			return 0;
+#endif
 		if (snd_pcm_format_linear(clt->format)) {
 			cfmt = clt->format;
 			f = snd_pcm_lfloat_open;
@@ -1039,6 +1058,7 @@ static int snd_pcm_plug_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 		err = snd_pcm_plug_insert_plugins(pcm, &clt_params, &slv_params);
 		if (err < 0)
 			return err;
+		snd_pcm_stats_inherit(pcm, plug->gen.slave);
 	}
 	slave = plug->gen.slave;
 	err = _snd_pcm_hw_params_internal(slave, params);
@@ -1088,6 +1108,7 @@ static const snd_pcm_ops_t snd_pcm_plug_ops = {
 	.query_chmaps = snd_pcm_generic_query_chmaps,
 	.get_chmap = snd_pcm_generic_get_chmap,
 	.set_chmap = snd_pcm_generic_set_chmap,
+	.get_slave = snd_pcm_generic_get_slave,
 };
 
 /**
@@ -234,6 +234,20 @@ snd_pcm_sframes_t snd_pcm_plugin_forward(snd_pcm_t *pcm, snd_pcm_uframes_t frame
 	return (snd_pcm_sframes_t) frames;
 }
 
+/* account the conversion of one chunk, both sides touched once */
+static inline void plugin_stats_end(snd_pcm_t *pcm,
+				    const snd_htimestamp_t *start,
+				    snd_pcm_uframes_t frames,
+				    snd_pcm_uframes_t slave_frames)
+{
+	snd_pcm_plugin_t *plugin = pcm->private_data;
+
+	if (pcm->stats)
+		snd_pcm_stats_add(pcm, SND_PCM_STATS_TRANSFER, start, frames,
+				  (frames * pcm->frame_bits +
+				   slave_frames * plugin->gen.slave->frame_bits) / 8);
+}
+
 static snd_pcm_sframes_t snd_pcm_plugin_write_areas(snd_pcm_t *pcm,
 						    const snd_pcm_channel_area_t *areas,
 						    snd_pcm_uframes_t offset,
@@ -243,6 +257,7 @@ static snd_pcm_sframes_t snd_pcm_plugin_write_areas(snd_pcm_t *pcm,
 	snd_pcm_t *slave = plugin->gen.slave;
 	snd_pcm_uframes_t xfer = 0;
 	snd_pcm_sframes_t result;
+	snd_htimestamp_t start;
 	int err;
 
 	while (size > 0) {
@@ -258,8 +273,10 @@ static snd_pcm_sframes_t snd_pcm_plugin_write_areas(snd_pcm_t *pcm,
 		}
 		if (slave_frames == 0)
 			break;
+		snd_pcm_stats_begin(pcm, &start);
 		frames = plugin->write(pcm, areas, offset, frames,
 				       slave_areas, slave_offset, &slave_frames);
+		plugin_stats_end(pcm, &start, frames, slave_frames);
 		if (CHECK_SANITY(slave_frames > snd_pcm_mmap_playback_avail(slave))) {
 			SNDMSG("write overflow %ld > %ld", slave_frames,
 			       snd_pcm_mmap_playback_avail(slave));
@@ -300,6 +317,7 @@ static snd_pcm_sframes_t snd_pcm_plugin_read_areas(snd_pcm_t *pcm,
 	snd_pcm_t *slave = plugin->gen.slave;
 	snd_pcm_uframes_t xfer = 0;
 	snd_pcm_sframes_t result;
+	snd_htimestamp_t start;
 	int err;
 	
 	while (size > 0) {
@@ -315,8 +333,10 @@ static snd_pcm_sframes_t snd_pcm_plugin_read_areas(snd_pcm_t *pcm,
 		}
 		if (slave_frames == 0)
 			break;
+		snd_pcm_stats_begin(pcm, &start);
 		frames = (plugin->read)(pcm, areas, offset, frames,
 				      slave_areas, slave_offset, &slave_frames);
+		plugin_stats_end(pcm, &start, frames, slave_frames);
 		if (CHECK_SANITY(slave_frames > snd_pcm_mmap_capture_avail(slave))) {
 			SNDMSG("read overflow %ld > %ld", slave_frames,
 			       snd_pcm_mmap_playback_avail(slave));
@@ -397,6 +417,7 @@ snd_pcm_plugin_mmap_commit(snd_pcm_t *pcm,
 	snd_pcm_uframes_t appl_offset;
 	snd_pcm_sframes_t slave_size;
 	snd_pcm_sframes_t xfer;
+	snd_htimestamp_t start;
 	int err;
 
 	if (pcm->stream == SND_PCM_STREAM_CAPTURE) {
@@ -424,8 +445,10 @@ snd_pcm_plugin_mmap_commit(snd_pcm_t *pcm,
 		}
 		if (frames > cont)
 			frames = cont;
+		snd_pcm_stats_begin(pcm, &start);
 		frames = plugin->write(pcm, areas, appl_offset, frames,
 				       slave_areas, slave_offset, &slave_frames);
+		plugin_stats_end(pcm, &start, frames, slave_frames);
 		result = snd_pcm_mmap_commit(slave, slave_offset, slave_frames);
 		if (result > 0 && (snd_pcm_uframes_t)result != slave_frames) {
 			snd_pcm_sframes_t res;
@@ -465,6 +488,7 @@ static snd_pcm_sframes_t snd_pcm_plugin_avail_update(snd_pcm_t *pcm)
 	snd_pcm_plugin_t *plugin = pcm->private_data;
 	snd_pcm_t *slave = plugin->gen.slave;
 	snd_pcm_sframes_t slave_size;
+	snd_htimestamp_t start;
 	int err;
 
 	slave_size = snd_pcm_avail_update(slave);
@@ -505,8 +529,10 @@ static snd_pcm_sframes_t snd_pcm_plugin_avail_update(snd_pcm_t *pcm)
 			}
 			if (frames > cont)
 				frames = cont;
+			snd_pcm_stats_begin(pcm, &start);
 			frames = (plugin->read)(pcm, areas, hw_offset, frames,
 					      slave_areas, slave_offset, &slave_frames);
+			plugin_stats_end(pcm, &start, frames, slave_frames);
 			result = snd_pcm_mmap_commit(slave, slave_offset, slave_frames);
 			if (result > 0 && (snd_pcm_uframes_t)result != slave_frames) {
 				snd_pcm_sframes_t res;
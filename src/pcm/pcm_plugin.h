@@ -90,6 +90,9 @@ snd_pcm_sframes_t snd_pcm_plugin_undo_write_generic
 #define snd_pcm_linear_convert_index	snd1_pcm_linear_convert_index
 #define snd_pcm_linear_convert	snd1_pcm_linear_convert
 #define snd_pcm_linear_getput	snd1_pcm_linear_getput
+#define snd_pcm_linear_use_getput	snd1_pcm_linear_use_getput
+#define snd_pcm_linear_fast_index	snd1_pcm_linear_fast_index
+#define snd_pcm_linear_fast_convert	snd1_pcm_linear_fast_convert
 #define snd_pcm_alaw_decode	snd1_pcm_alaw_decode
 #define snd_pcm_alaw_encode	snd1_pcm_alaw_encode
 #define snd_pcm_mulaw_decode	snd1_pcm_mulaw_decode
@@ -100,6 +103,14 @@ snd_pcm_sframes_t snd_pcm_plugin_undo_write_generic
 int snd_pcm_linear_get_index(snd_pcm_format_t src_format, snd_pcm_format_t dst_format);
 int snd_pcm_linear_put_index(snd_pcm_format_t src_format, snd_pcm_format_t dst_format);
 int snd_pcm_linear_convert_index(snd_pcm_format_t src_format, snd_pcm_format_t dst_format);
+int snd_pcm_lfloat_get_s32_index(snd_pcm_format_t format);
+int snd_pcm_lfloat_put_s32_index(snd_pcm_format_t format);
+
+/* the route plugin converts float samples itself, see pcm_route.c */
+#if SND_PCM_PLUGIN_ROUTE_FLOAT && defined(BUILD_PCM_PLUGIN_ROUTE) && \
+    defined(BUILD_PCM_PLUGIN_LFLOAT)
+#define SND_PCM_ROUTE_FLOAT_FORMATS
+#endif
 
 void snd_pcm_linear_convert(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
 			    const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
@@ -109,6 +120,12 @@ void snd_pcm_linear_getput(const snd_pcm_channel_area_t *dst_areas, snd_pcm_ufra
 			   const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
 			   unsigned int channels, snd_pcm_uframes_t frames,
 			   unsigned int get_idx, unsigned int put_idx);
+int snd_pcm_linear_use_getput(snd_pcm_format_t src_format, snd_pcm_format_t dst_format);
+int snd_pcm_linear_fast_index(snd_pcm_format_t src_format, snd_pcm_format_t dst_format);
+int snd_pcm_linear_fast_convert(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
+				const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
+				unsigned int channels, snd_pcm_uframes_t frames,
+				int fast_idx);
 void snd_pcm_alaw_decode(const snd_pcm_channel_area_t *dst_areas,
 			 snd_pcm_uframes_t dst_offset,
 			 const snd_pcm_channel_area_t *src_areas,
@@ -64,15 +64,40 @@ struct _snd_pcm_rate {
 	snd_pcm_rate_ops_t ops;
 	unsigned int get_idx;
 	unsigned int put_idx;
-	int16_t *src_buf;
-	int16_t *dst_buf;
+	void *src_buf;
+	void *dst_buf;
+	snd_pcm_channel_area_t *bufareas;	/* areas for src_buf and dst_buf */
+	uint64_t in_formats;		/* formats accepted by convert */
+	uint64_t out_formats;
+	unsigned int format_flags;
+	snd_pcm_format_t orig_in_format;	/* formats before/after convert */
+	snd_pcm_format_t orig_out_format;
 	int start_pending; /* start is triggered but not commited to slave */
 	snd_htimestamp_t trigger_tstamp;
 	unsigned int plugin_version;
 	unsigned int rate_min, rate_max;
+	int adaptive;		/* trim the ratio to the slave fill level */
+	double adapt_max;	/* max. relative trim */
+	struct {
+		double target;		/* fill level to keep (seconds) */
+		double err;		/* smoothed fill level error (seconds) */
+		double integ;		/* integral term */
+		double trim;		/* current relative trim */
+		double frac;		/* fraction of the slave frames */
+		snd_pcm_uframes_t played;	/* slave frames since last update */
+		snd_pcm_uframes_t warmup;	/* slave frames played for target */
+	} adapt;
 };
 
 #define SND_PCM_RATE_PLUGIN_VERSION_OLD	0x010001	/* old rate plugin */
+#define SND_PCM_RATE_PLUGIN_VERSION_NOFMT	0x010002	/* no get_supported_formats */
+
+/* PI controller of the adaptive mode, all in seconds */
+#define ADAPT_WARMUP	1.0	/* time to average the target fill level */
+#define ADAPT_TAU	1.0	/* smoothing of the fill level */
+#define ADAPT_KP	0.4
+#define ADAPT_KI	0.04
+#define ADAPT_DEFAULT_PPM	1000	/* default max. trim */
 
 #endif /* DOC_HIDDEN */
 
@@ -82,10 +107,22 @@ static int snd_pcm_rate_hw_refine_cprepare(snd_pcm_t *pcm ATTRIBUTE_UNUSED, snd_
 	int err;
 	snd_pcm_access_mask_t access_mask = { SND_PCM_ACCBIT_SHM };
 	snd_pcm_format_mask_t format_mask = { SND_PCM_FMTBIT_LINEAR };
+	snd_pcm_format_t format;
 	err = _snd_pcm_hw_param_set_mask(params, SND_PCM_HW_PARAM_ACCESS,
 					 &access_mask);
 	if (err < 0)
 		return err;
+	/*
+	 * float formats can't be converted here, so they are passed only
+	 * to a converter accepting them on both sides and only when the
+	 * slave format follows the client format
+	 */
+	if (rate->sformat == SND_PCM_FORMAT_UNKNOWN) {
+		for (format = SND_PCM_FORMAT_FLOAT_LE; format <= SND_PCM_FORMAT_FLOAT64_BE; format++) {
+			if ((rate->in_formats & rate->out_formats) & (1ULL << format))
+				snd_pcm_format_mask_set(&format_mask, format);
+		}
+	}
 	err = _snd_pcm_hw_param_set_mask(params, SND_PCM_HW_PARAM_FORMAT,
 					 &format_mask);
 	if (err < 0)
@@ -235,11 +272,82 @@ static int snd_pcm_rate_hw_refine(snd_pcm_t *pcm,
 				       snd_pcm_generic_hw_refine);
 }
 
+/* pick a format accepted by the converter, preferring the given one */
+static snd_pcm_format_t convert_format(snd_pcm_format_t format, uint64_t formats)
+{
+	static const snd_pcm_format_t preferred[] = {
+		SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S16
+	};
+	snd_pcm_format_t f;
+	unsigned int i;
+
+	if (formats & (1ULL << format))
+		return format;
+	for (i = 0; i < ARRAY_SIZE(preferred); i++)
+		if (formats & (1ULL << preferred[i]))
+			return preferred[i];
+	for (f = 0; f <= SND_PCM_FORMAT_LAST; f++)
+		if ((formats & (1ULL << f)) && snd_pcm_format_linear(f) == 1)
+			return f;
+	return SND_PCM_FORMAT_UNKNOWN;
+}
+
+/*
+ * set the formats passed to the converter; when they differ from the
+ * client and slave formats, the data is converted in do_convert()
+ */
+static int choose_convert_formats(snd_pcm_rate_t *rate)
+{
+	snd_pcm_format_t in, out;
+
+	in = convert_format(rate->info.in.format, rate->in_formats);
+	out = convert_format(rate->info.out.format, rate->out_formats);
+	if ((rate->format_flags & SND_PCM_RATE_FLAG_SYNC_FORMATS) && in != out) {
+		if (rate->out_formats & (1ULL << in))
+			out = in;
+		else if (rate->in_formats & (1ULL << out))
+			in = out;
+		else
+			in = out = convert_format(rate->info.in.format,
+						  rate->in_formats & rate->out_formats);
+	}
+	if (in == SND_PCM_FORMAT_UNKNOWN || out == SND_PCM_FORMAT_UNKNOWN) {
+		SNDERR("rate converter doesn't support %s -> %s",
+		       snd_pcm_format_name(rate->info.in.format),
+		       snd_pcm_format_name(rate->info.out.format));
+		return -EINVAL;
+	}
+	rate->info.in.format = in;
+	rate->info.out.format = out;
+	return 0;
+}
+
+/* allocate an interleaved buffer for a period and set up its areas */
+static void *alloc_buf_areas(snd_pcm_channel_area_t *areas,
+			     snd_pcm_format_t format, unsigned int channels,
+			     snd_pcm_uframes_t frames)
+{
+	unsigned int width = snd_pcm_format_physical_width(format);
+	unsigned int chn;
+	void *buf;
+
+	buf = malloc(frames * channels * width / 8);
+	if (! buf)
+		return NULL;
+	for (chn = 0; chn < channels; chn++) {
+		areas[chn].addr = buf;
+		areas[chn].first = chn * width;
+		areas[chn].step = channels * width;
+	}
+	return buf;
+}
+
 static int snd_pcm_rate_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 {
 	snd_pcm_rate_t *rate = pcm->private_data;
 	snd_pcm_t *slave = rate->gen.slave;
 	snd_pcm_rate_side_info_t *sinfo, *cinfo;
+	snd_pcm_uframes_t speriod;
 	unsigned int channels, cwidth, swidth, chn;
 	int err = snd_pcm_hw_params_slave(pcm, params,
 					  snd_pcm_rate_hw_refine_cchange,
@@ -282,18 +390,31 @@ static int snd_pcm_rate_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 		SNDMSG("rate plugin already in use");
 		return -EBUSY;
 	}
+	rate->orig_in_format = rate->info.in.format;
+	rate->orig_out_format = rate->info.out.format;
+	if (!rate->ops.convert_s16) {
+		err = choose_convert_formats(rate);
+		if (err < 0)
+			return err;
+	}
 	err = rate->ops.init(rate->obj, &rate->info);
 	if (err < 0)
 		return err;
 
-	rate->pareas = malloc(2 * channels * sizeof(*rate->pareas));
+	rate->pareas = malloc(4 * channels * sizeof(*rate->pareas));
 	if (rate->pareas == NULL)
 		goto error;
+	rate->bufareas = rate->pareas + 2 * channels;
+
+	/* room for the longest trimmed slave period in the adaptive mode */
+	speriod = sinfo->period_size;
+	if (rate->adaptive)
+		speriod += sinfo->period_size * rate->adapt_max + 2;
 
 	cwidth = snd_pcm_format_physical_width(cinfo->format);
 	swidth = snd_pcm_format_physical_width(sinfo->format);
 	rate->pareas[0].addr = malloc(((cwidth * channels * cinfo->period_size) / 8) +
-				      ((swidth * channels * sinfo->period_size) / 8));
+				      ((swidth * channels * speriod) / 8));
 	if (rate->pareas[0].addr == NULL)
 		goto error;
 
@@ -303,7 +424,7 @@ static int snd_pcm_rate_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 		rate->pareas[chn].addr = rate->pareas[0].addr + (cwidth * chn * cinfo->period_size) / 8;
 		rate->pareas[chn].first = 0;
 		rate->pareas[chn].step = cwidth;
-		rate->sareas[chn].addr = rate->sareas[0].addr + (swidth * chn * sinfo->period_size) / 8;
+		rate->sareas[chn].addr = rate->sareas[0].addr + (swidth * chn * speriod) / 8;
 		rate->sareas[chn].first = 0;
 		rate->sareas[chn].step = swidth;
 	}
@@ -317,6 +438,28 @@ static int snd_pcm_rate_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 		rate->dst_buf = malloc(channels * rate->info.out.period_size * 2);
 		if (! rate->src_buf || ! rate->dst_buf)
 			goto error;
+	} else {
+		int interleaved = rate->format_flags & SND_PCM_RATE_FLAG_INTERLEAVED;
+		free(rate->src_buf);
+		free(rate->dst_buf);
+		rate->src_buf = rate->dst_buf = NULL;
+		if (interleaved || rate->info.in.format != rate->orig_in_format) {
+			rate->src_buf = alloc_buf_areas(rate->bufareas,
+							rate->info.in.format,
+							channels,
+							rate->info.in.period_size);
+			if (! rate->src_buf)
+				goto error;
+		}
+		if (interleaved || rate->info.out.format != rate->orig_out_format) {
+			rate->dst_buf = alloc_buf_areas(rate->bufareas + channels,
+							rate->info.out.format,
+							channels,
+							rate->adaptive ? speriod :
+							rate->info.out.period_size);
+			if (! rate->dst_buf)
+				goto error;
+		}
 	}
 
 	return 0;
@@ -327,6 +470,9 @@ static int snd_pcm_rate_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 		free(rate->pareas);
 		rate->pareas = NULL;
 	}
+	free(rate->src_buf);
+	free(rate->dst_buf);
+	rate->src_buf = rate->dst_buf = NULL;
 	if (rate->ops.free)
 		rate->ops.free(rate->obj);
 	return -ENOMEM;
@@ -423,6 +569,7 @@ static int snd_pcm_rate_init(snd_pcm_t *pcm)
 		rate->ops.reset(rate->obj);
 	rate->last_commit_ptr = 0;
 	rate->start_pending = 0;
+	memset(&rate->adapt, 0, sizeof(rate->adapt));
 	return 0;
 }
 
@@ -502,6 +649,49 @@ static void convert_from_s16(snd_pcm_rate_t *rate, const int16_t *buf,
 	}
 }
 
+static int areas_interleaved(const snd_pcm_channel_area_t *areas,
+			     unsigned int channels, snd_pcm_format_t format)
+{
+	unsigned int width = snd_pcm_format_physical_width(format);
+	unsigned int chn;
+
+	for (chn = 0; chn < channels; chn++) {
+		if (areas[chn].addr != areas[0].addr ||
+		    areas[chn].first != chn * width ||
+		    areas[chn].step != channels * width)
+			return 0;
+	}
+	return 1;
+}
+
+static void convert_areas(const snd_pcm_channel_area_t *dst_areas,
+			  snd_pcm_uframes_t dst_offset,
+			  snd_pcm_format_t dst_format,
+			  const snd_pcm_channel_area_t *src_areas,
+			  snd_pcm_uframes_t src_offset,
+			  snd_pcm_format_t src_format,
+			  unsigned int channels, snd_pcm_uframes_t frames)
+{
+	if (src_format == dst_format) {
+		snd_pcm_areas_copy(dst_areas, dst_offset, src_areas, src_offset,
+				   channels, frames, src_format);
+		return;
+	}
+	if (snd_pcm_linear_fast_convert(dst_areas, dst_offset,
+					src_areas, src_offset, channels, frames,
+					snd_pcm_linear_fast_index(src_format, dst_format)) == 0)
+		return;
+	if (snd_pcm_linear_use_getput(src_format, dst_format))
+		snd_pcm_linear_getput(dst_areas, dst_offset, src_areas, src_offset,
+				      channels, frames,
+				      snd_pcm_linear_get_index(src_format, SND_PCM_FORMAT_S32),
+				      snd_pcm_linear_put_index(SND_PCM_FORMAT_S32, dst_format));
+	else
+		snd_pcm_linear_convert(dst_areas, dst_offset, src_areas, src_offset,
+				       channels, frames,
+				       snd_pcm_linear_convert_index(src_format, dst_format));
+}
+
 static void do_convert(const snd_pcm_channel_area_t *dst_areas,
 		       snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
 		       const snd_pcm_channel_area_t *src_areas,
@@ -528,22 +718,69 @@ static void do_convert(const snd_pcm_channel_area_t *dst_areas,
 			convert_from_s16(rate, rate->dst_buf, dst_areas, dst_offset,
 					 dst_frames, channels);
 	} else {
-		rate->ops.convert(rate->obj, dst_areas, dst_offset, dst_frames,
-				   src_areas, src_offset, src_frames);
+		const snd_pcm_channel_area_t *sareas = src_areas;
+		const snd_pcm_channel_area_t *dareas = dst_areas;
+		snd_pcm_uframes_t soffset = src_offset;
+		snd_pcm_uframes_t doffset = dst_offset;
+
+		/* bounce only if the format differs or interleaving is needed */
+		if (rate->src_buf &&
+		    (rate->info.in.format != rate->orig_in_format ||
+		     ! areas_interleaved(src_areas, channels, rate->orig_in_format))) {
+			sareas = rate->bufareas;
+			soffset = 0;
+			convert_areas(sareas, 0, rate->info.in.format,
+				      src_areas, src_offset, rate->orig_in_format,
+				      channels, src_frames);
+		}
+		if (rate->dst_buf &&
+		    (rate->info.out.format != rate->orig_out_format ||
+		     ! areas_interleaved(dst_areas, channels, rate->orig_out_format))) {
+			dareas = rate->bufareas + channels;
+			doffset = 0;
+		}
+		rate->ops.convert(rate->obj, dareas, doffset, dst_frames,
+				  sareas, soffset, src_frames);
+		if (dareas != dst_areas)
+			convert_areas(dst_areas, dst_offset, rate->orig_out_format,
+				      dareas, 0, rate->info.out.format,
+				      channels, dst_frames);
 	}
 }
 
+static inline void
+snd_pcm_rate_stats_end(snd_pcm_t *pcm, const snd_htimestamp_t *start,
+		       snd_pcm_uframes_t size, snd_pcm_uframes_t slave_size)
+{
+	snd_pcm_rate_t *rate = pcm->private_data;
+
+	if (pcm->stats)
+		snd_pcm_stats_add(pcm, SND_PCM_STATS_TRANSFER, start, size,
+				  (size * pcm->frame_bits +
+				   slave_size * rate->gen.slave->frame_bits) / 8);
+}
+
 static inline void
 snd_pcm_rate_write_areas1(snd_pcm_t *pcm,
 			 const snd_pcm_channel_area_t *areas,
-			 snd_pcm_uframes_t offset,
+			 snd_pcm_uframes_t offset, snd_pcm_uframes_t size,
 			 const snd_pcm_channel_area_t *slave_areas,
-			 snd_pcm_uframes_t slave_offset)
+			 snd_pcm_uframes_t slave_offset,
+			 snd_pcm_uframes_t slave_size)
 {
 	snd_pcm_rate_t *rate = pcm->private_data;
-	do_convert(slave_areas, slave_offset, rate->gen.slave->period_size,
-		   areas, offset, pcm->period_size,
+	snd_htimestamp_t start;
+
+	/* the converter gets whole periods unless the ratio is trimmed */
+	if (! rate->adaptive) {
+		size = pcm->period_size;
+		slave_size = rate->gen.slave->period_size;
+	}
+	snd_pcm_stats_begin(pcm, &start);
+	do_convert(slave_areas, slave_offset, slave_size,
+		   areas, offset, size,
 		   pcm->channels, rate);
+	snd_pcm_rate_stats_end(pcm, &start, size, slave_size);
 }
 
 static inline void
@@ -554,9 +791,103 @@ snd_pcm_rate_read_areas1(snd_pcm_t *pcm,
 			 snd_pcm_uframes_t slave_offset)
 {
 	snd_pcm_rate_t *rate = pcm->private_data;
+	snd_htimestamp_t start;
+
+	snd_pcm_stats_begin(pcm, &start);
 	do_convert(areas, offset, pcm->period_size,
 		   slave_areas, slave_offset, rate->gen.slave->period_size,
 		   pcm->channels, rate);
+	snd_pcm_rate_stats_end(pcm, &start, pcm->period_size,
+			       rate->gen.slave->period_size);
+}
+
+/*
+ * adaptive mode: a PI controller keeps the frames queued in the slave
+ * (plus the client frames not converted yet) at the level seen after
+ * the start by trimming the number of slave frames per period
+ */
+static void snd_pcm_rate_adapt_update(snd_pcm_rate_t *rate,
+				      snd_pcm_uframes_t queued,
+				      snd_pcm_uframes_t played)
+{
+	double srate = rate->gen.slave->rate;
+	double level = queued / srate;
+	double dt = played / srate;
+	double alpha = dt < ADAPT_TAU ? dt / ADAPT_TAU : 1.0;
+
+	if (rate->adapt.warmup < ADAPT_WARMUP * srate) {
+		rate->adapt.warmup += played;
+		rate->adapt.target += (level - rate->adapt.target) *
+			played / rate->adapt.warmup;
+		return;
+	}
+	rate->adapt.err += (level - rate->adapt.target - rate->adapt.err) * alpha;
+	rate->adapt.integ += ADAPT_KI * rate->adapt.err * dt;
+	if (rate->adapt.integ > rate->adapt_max)
+		rate->adapt.integ = rate->adapt_max;
+	else if (rate->adapt.integ < -rate->adapt_max)
+		rate->adapt.integ = -rate->adapt_max;
+	/* more queued than wanted: less slave frames per period */
+	rate->adapt.trim = -(ADAPT_KP * rate->adapt.err + rate->adapt.integ);
+	if (rate->adapt.trim > rate->adapt_max)
+		rate->adapt.trim = rate->adapt_max;
+	else if (rate->adapt.trim < -rate->adapt_max)
+		rate->adapt.trim = -rate->adapt_max;
+}
+
+/* number of slave frames for the next client period */
+static inline snd_pcm_uframes_t snd_pcm_rate_slave_size(snd_pcm_rate_t *rate)
+{
+	if (! rate->adaptive)
+		return rate->gen.slave->period_size;
+	return rate->gen.slave->period_size * (1.0 + rate->adapt.trim) +
+		rate->adapt.frac;
+}
+
+/* frames written to the slave and not played yet */
+static snd_pcm_uframes_t snd_pcm_rate_slave_pending(snd_pcm_t *pcm)
+{
+	snd_pcm_rate_t *rate = pcm->private_data;
+	snd_pcm_t *slave = rate->gen.slave;
+	snd_pcm_sframes_t pending;
+
+	pending = *slave->appl.ptr - rate->last_slave_hw_ptr;
+	if (pending < 0)
+		pending += slave->boundary;
+	if ((snd_pcm_uframes_t)pending > slave->buffer_size)
+		pending = 0;	/* underrun */
+	return pending;
+}
+
+/*
+ * the slave periods don't match the client periods in the adaptive
+ * mode, so the client position is taken from the frames still queued
+ * in the slave, and it's never moved backwards
+ */
+static void snd_pcm_rate_adapt_sync_hwptr(snd_pcm_t *pcm, snd_pcm_uframes_t slave_hw_ptr)
+{
+	snd_pcm_rate_t *rate = pcm->private_data;
+	snd_pcm_t *slave = rate->gen.slave;
+	snd_pcm_sframes_t played, diff;
+	snd_pcm_uframes_t hw_ptr;
+
+	played = slave_hw_ptr - rate->last_slave_hw_ptr;
+	if (played < 0)
+		played += slave->boundary;
+	if (played == 0)
+		return;
+	rate->last_slave_hw_ptr = slave_hw_ptr;
+	rate->adapt.played += played;
+
+	hw_ptr = rate->last_commit_ptr + pcm->boundary -
+		muldiv_near(snd_pcm_rate_slave_pending(pcm),
+			    pcm->period_size, slave->period_size);
+	hw_ptr %= pcm->boundary;
+	diff = hw_ptr - rate->hw_ptr;
+	if (diff < 0)
+		diff += pcm->boundary;
+	if ((snd_pcm_uframes_t)diff <= pcm->buffer_size)
+		rate->hw_ptr = hw_ptr;
 }
 
 static inline void snd_pcm_rate_sync_hwptr0(snd_pcm_t *pcm, snd_pcm_uframes_t slave_hw_ptr)
@@ -568,6 +899,10 @@ static inline void snd_pcm_rate_sync_hwptr0(snd_pcm_t *pcm, snd_pcm_uframes_t sl
 
 	if (pcm->stream != SND_PCM_STREAM_PLAYBACK)
 		return;
+	if (rate->adaptive) {
+		snd_pcm_rate_adapt_sync_hwptr(pcm, slave_hw_ptr);
+		return;
+	}
 
 	if (slave_hw_ptr_diff < 0)
 		slave_hw_ptr_diff += rate->gen.slave->boundary; /* slave boundary wraparound */
@@ -715,11 +1050,12 @@ static int snd_pcm_rate_commit_area(snd_pcm_t *pcm, snd_pcm_rate_t *rate,
 		if (result < 0)
 			return result;
 		if (slave_frames < slave_size) {
-			snd_pcm_rate_write_areas1(pcm, areas, appl_offset, rate->sareas, 0);
+			snd_pcm_rate_write_areas1(pcm, areas, appl_offset, size,
+						  rate->sareas, 0, slave_size);
 			goto __partial;
 		}
-		snd_pcm_rate_write_areas1(pcm, areas, appl_offset,
-					  slave_areas, slave_offset);
+		snd_pcm_rate_write_areas1(pcm, areas, appl_offset, size,
+					  slave_areas, slave_offset, slave_size);
 		result = snd_pcm_mmap_commit(rate->gen.slave, slave_offset, slave_size);
 		if (result < (snd_pcm_sframes_t)slave_size) {
 			if (result < 0)
@@ -739,7 +1075,8 @@ static int snd_pcm_rate_commit_area(snd_pcm_t *pcm, snd_pcm_rate_t *rate,
 				   pcm->channels, size - cont,
 				   pcm->format);
 
-		snd_pcm_rate_write_areas1(pcm, rate->pareas, 0, rate->sareas, 0);
+		snd_pcm_rate_write_areas1(pcm, rate->pareas, 0, size,
+					  rate->sareas, 0, slave_size);
 
 		/* ok, commit first fragment */
 		result = snd_pcm_mmap_begin(rate->gen.slave, &slave_areas, &slave_offset, &slave_frames);
@@ -804,12 +1141,18 @@ static int snd_pcm_rate_commit_area(snd_pcm_t *pcm, snd_pcm_rate_t *rate,
 	return 1;
 }
 
-static int snd_pcm_rate_commit_next_period(snd_pcm_t *pcm, snd_pcm_uframes_t appl_offset)
+static int snd_pcm_rate_commit_next_period(snd_pcm_t *pcm, snd_pcm_uframes_t appl_offset,
+					   snd_pcm_uframes_t slave_size)
 {
 	snd_pcm_rate_t *rate = pcm->private_data;
+	int err;
 
-	return snd_pcm_rate_commit_area(pcm, rate, appl_offset, pcm->period_size,
-					rate->gen.slave->period_size);
+	err = snd_pcm_rate_commit_area(pcm, rate, appl_offset, pcm->period_size,
+				       slave_size);
+	if (err > 0 && rate->adaptive)
+		rate->adapt.frac += rate->gen.slave->period_size *
+			(1.0 + rate->adapt.trim) - slave_size;
+	return err;
 }
 
 static int snd_pcm_rate_grab_next_period(snd_pcm_t *pcm, snd_pcm_uframes_t hw_offset)
@@ -920,7 +1263,7 @@ static int snd_pcm_rate_sync_playback_area(snd_pcm_t *pcm, snd_pcm_uframes_t app
 {
 	snd_pcm_rate_t *rate = pcm->private_data;
 	snd_pcm_t *slave = rate->gen.slave;
-	snd_pcm_uframes_t xfer;
+	snd_pcm_uframes_t xfer, ssize;
 	snd_pcm_sframes_t slave_size;
 	int err;
 
@@ -932,15 +1275,18 @@ static int snd_pcm_rate_sync_playback_area(snd_pcm_t *pcm, snd_pcm_uframes_t app
 		xfer = appl_ptr - rate->last_commit_ptr + pcm->boundary;
 	else
 		xfer = appl_ptr - rate->last_commit_ptr;
-	while (xfer >= pcm->period_size &&
-	       (snd_pcm_uframes_t)slave_size >= rate->gen.slave->period_size) {
-		err = snd_pcm_rate_commit_next_period(pcm, rate->last_commit_ptr % pcm->buffer_size);
+	while (xfer >= pcm->period_size) {
+		ssize = snd_pcm_rate_slave_size(rate);
+		if ((snd_pcm_uframes_t)slave_size < ssize)
+			break;
+		err = snd_pcm_rate_commit_next_period(pcm, rate->last_commit_ptr % pcm->buffer_size,
+						      ssize);
 		if (err == 0)
 			break;
 		if (err < 0)
 			return err;
 		xfer -= pcm->period_size;
-		slave_size -= rate->gen.slave->period_size;
+		slave_size -= ssize;
 		rate->last_commit_ptr += pcm->period_size;
 		if (rate->last_commit_ptr >= pcm->boundary)
 			rate->last_commit_ptr = 0;
@@ -948,6 +1294,25 @@ static int snd_pcm_rate_sync_playback_area(snd_pcm_t *pcm, snd_pcm_uframes_t app
 	return 0;
 }
 
+/*
+ * the level is measured right after the application wrote, so that the
+ * size of its writes doesn't show up as a changing level
+ */
+static void snd_pcm_rate_adapt_measure(snd_pcm_t *pcm)
+{
+	snd_pcm_rate_t *rate = pcm->private_data;
+	snd_pcm_t *slave = rate->gen.slave;
+	snd_pcm_uframes_t queued;
+
+	if (! rate->adapt.played)
+		return;
+	queued = snd_pcm_rate_slave_pending(pcm) +
+		muldiv_near(snd_pcm_rate_playback_internal_delay(pcm),
+			    slave->period_size, pcm->period_size);
+	snd_pcm_rate_adapt_update(rate, queued, rate->adapt.played);
+	rate->adapt.played = 0;
+}
+
 static snd_pcm_sframes_t snd_pcm_rate_mmap_commit(snd_pcm_t *pcm,
 						  snd_pcm_uframes_t offset ATTRIBUTE_UNUSED,
 						  snd_pcm_uframes_t size)
@@ -963,6 +1328,8 @@ static snd_pcm_sframes_t snd_pcm_rate_mmap_commit(snd_pcm_t *pcm,
 			return err;
 	}
 	snd_pcm_mmap_appl_forward(pcm, size);
+	if (rate->adaptive)
+		snd_pcm_rate_adapt_measure(pcm);
 	return size;
 }
 
@@ -1168,6 +1535,9 @@ static void snd_pcm_rate_dump(snd_pcm_t *pcm, snd_output_t *out)
 	if (rate->ops.dump)
 		rate->ops.dump(rate->obj, out);
 	snd_output_printf(out, "Protocol version: %x\n", rate->plugin_version);
+	if (rate->adaptive)
+		snd_output_printf(out, "Adaptive: max %.0f ppm, trim %+.1f ppm\n",
+				  rate->adapt_max * 1e6, rate->adapt.trim * 1e6);
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -1232,6 +1602,7 @@ static const snd_pcm_ops_t snd_pcm_rate_ops = {
 	.query_chmaps = snd_pcm_generic_query_chmaps,
 	.get_chmap = snd_pcm_generic_get_chmap,
 	.set_chmap = snd_pcm_generic_set_chmap,
+	.get_slave = snd_pcm_generic_get_slave,
 };
 
 /**
@@ -1248,10 +1619,17 @@ const snd_config_t *snd_pcm_rate_get_default_converter(snd_config_t *root)
 	return NULL;
 }
 
+static uint64_t linear_format_bits(void)
+{
+	snd_pcm_format_mask_t mask = { SND_PCM_FMTBIT_LINEAR };
+
+	return mask.bits[0] | ((uint64_t)mask.bits[1] << 32);
+}
+
 #ifdef PIC
 static int is_builtin_plugin(const char *type)
 {
-	return strcmp(type, "linear") == 0;
+	return strcmp(type, "linear") == 0 || strcmp(type, "polyphase") == 0;
 }
 
 static const char *const default_rate_plugins[] = {
@@ -1311,6 +1689,18 @@ static int rate_open_func(snd_pcm_rate_t *rate, const char *type, const snd_conf
 		return 0;
 	}
 
+	/* plugins checking for the exact version know only 0x010002 */
+	err = open_func(SND_PCM_RATE_PLUGIN_VERSION_NOFMT,
+			&rate->obj, &rate->ops);
+	if (!err) {
+		rate->plugin_version = SND_PCM_RATE_PLUGIN_VERSION_NOFMT;
+		if (rate->ops.get_supported_rates)
+			rate->ops.get_supported_rates(rate->obj,
+						      &rate->rate_min,
+						      &rate->rate_max);
+		return 0;
+	}
+
 	/* try to open with the old protocol version */
 	rate->plugin_version = SND_PCM_RATE_PLUGIN_VERSION_OLD;
 	err = open_func(SND_PCM_RATE_PLUGIN_VERSION_OLD,
@@ -1374,6 +1764,7 @@ int snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 #ifndef PIC
 	snd_pcm_rate_open_func_t open_func;
 	extern int SND_PCM_RATE_PLUGIN_ENTRY(linear) (unsigned int version, void **objp, snd_pcm_rate_ops_t *ops);
+	extern int SND_PCM_RATE_PLUGIN_ENTRY(polyphase) (unsigned int version, void **objp, snd_pcm_rate_ops_t *ops);
 #endif
 
 	assert(pcmp && slave);
@@ -1450,14 +1841,20 @@ int snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 		return -ENOENT;
 	}
 #else
-	type = "linear";
-	open_func = SND_PCM_RATE_PLUGIN_ENTRY(linear);
+	if (converter && !snd_config_get_string(converter, &type) &&
+	    strcmp(type, "polyphase") == 0) {
+		open_func = SND_PCM_RATE_PLUGIN_ENTRY(polyphase);
+	} else {
+		type = "linear";
+		open_func = SND_PCM_RATE_PLUGIN_ENTRY(linear);
+	}
 	err = open_func(SND_PCM_RATE_PLUGIN_VERSION, &rate->obj, &rate->ops);
 	if (err < 0) {
 		snd_pcm_free(pcm);
 		free(rate);
 		return err;
 	}
+	rate->plugin_version = rate->ops.version;
 #endif
 
 	if (! rate->ops.init || ! (rate->ops.convert || rate->ops.convert_s16) ||
@@ -1468,6 +1865,24 @@ int snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 		return err;
 	}
 
+	/* converters without format info take any linear format */
+	rate->in_formats = linear_format_bits();
+	rate->out_formats = rate->in_formats;
+	rate->format_flags = 0;
+	if (rate->plugin_version >= SND_PCM_RATE_PLUGIN_VERSION &&
+	    ! rate->ops.convert_s16 && rate->ops.get_supported_formats) {
+		err = rate->ops.get_supported_formats(rate->obj,
+						      &rate->in_formats,
+						      &rate->out_formats,
+						      &rate->format_flags);
+		if (err < 0) {
+			SNDERR("Cannot get formats of rate plugin %s", type);
+			snd_pcm_free(pcm);
+			free(rate);
+			return err;
+		}
+	}
+
 	pcm->ops = &snd_pcm_rate_ops;
 	pcm->fast_ops = &snd_pcm_rate_fast_ops;
 	pcm->private_data = rate;
@@ -1487,6 +1902,8 @@ int snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 \section pcm_plugins_rate Plugin: Rate
 
 This plugin converts a stream rate. The input and output formats must be linear.
+Float formats are accepted as well when the converter supports them
+and no slave format is given.
 
 \code
 pcm.name {
@@ -1510,9 +1927,27 @@ pcm.name {
 		name STR	# Convertor type
 		xxx yyy		# optional convertor-specific configuration
 	}
+	[adaptive BOOL]		# Trim the ratio to the slave clock (playback)
+	[adaptive_ppm INT]	# Max. trim in ppm, default 1000
 }
 \endcode
 
+Two converters are built into the library: \c linear (linear
+interpolation, lowest latency and CPU usage) and \c polyphase
+(windowed-sinc polyphase FIR filter working on float samples, so it
+keeps the full resolution of 24 and 32 bit formats).  The filter of
+\c polyphase adds a fixed delay of 32 input samples when upsampling
+(more when downsampling).  Other converters such as \c speexrate or
+\c samplerate are loaded from external plugins.
+
+With \c adaptive, the plugin bridges streams on unrelated clocks, e.g.
+a capture device feeding a playback device.  It watches the number of
+frames queued in the slave, and a PI controller trims the ratio (by at
+most \c adaptive_ppm) so that the level seen after the start is kept,
+and the slave neither underruns nor needs a deep buffer.  This mode is
+available only for playback and needs a converter accepting any number
+of frames per call, such as \c linear.
+
 \subsection pcm_plugins_rate_funcref Function reference
 
 <UL>
@@ -1522,6 +1957,23 @@ pcm.name {
 
 */
 
+static int rate_set_adaptive(snd_pcm_t *pcm, long ppm)
+{
+	snd_pcm_rate_t *rate = pcm->private_data;
+
+	if (pcm->stream != SND_PCM_STREAM_PLAYBACK) {
+		SNDERR("adaptive rate is supported only for playback");
+		return -EINVAL;
+	}
+	if (! (rate->format_flags & SND_PCM_RATE_FLAG_VARIABLE_FRAMES)) {
+		SNDERR("rate converter doesn't support adaptive rate");
+		return -EINVAL;
+	}
+	rate->adaptive = 1;
+	rate->adapt_max = ppm / 1e6;
+	return 0;
+}
+
 /**
  * \brief Creates a new rate PCM
  * \param pcmp Returns created PCM handle
@@ -1546,6 +1998,8 @@ int _snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 	snd_pcm_format_t sformat = SND_PCM_FORMAT_UNKNOWN;
 	int srate = -1;
 	const snd_config_t *converter = NULL;
+	int adaptive = 0;
+	long adaptive_ppm = ADAPT_DEFAULT_PPM;
 
 	snd_config_for_each(i, next, conf) {
 		snd_config_t *n = snd_config_iterator_entry(i);
@@ -1562,6 +2016,25 @@ int _snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 			converter = n;
 			continue;
 		}
+		if (strcmp(id, "adaptive") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return err;
+			adaptive = err;
+			continue;
+		}
+		if (strcmp(id, "adaptive_ppm") == 0) {
+			err = snd_config_get_integer(n, &adaptive_ppm);
+			if (err < 0) {
+				SNDERR("Invalid type for %s", id);
+				return err;
+			}
+			if (adaptive_ppm <= 0 || adaptive_ppm > 100000) {
+				SNDERR("Invalid value for %s", id);
+				return -EINVAL;
+			}
+			continue;
+		}
 		SNDERR("Unknown field %s", id);
 		return -EINVAL;
 	}
@@ -1587,8 +2060,15 @@ int _snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 		return err;
 	err = snd_pcm_rate_open(pcmp, name, sformat, (unsigned int) srate,
 				converter, spcm, 1);
-	if (err < 0)
+	if (err < 0) {
 		snd_pcm_close(spcm);
+		return err;
+	}
+	if (adaptive) {
+		err = rate_set_adaptive(*pcmp, adaptive_ppm);
+		if (err < 0)
+			snd_pcm_close(*pcmp);
+	}
 	return err;
 }
 #ifndef DOC_HIDDEN
@@ -33,18 +33,26 @@
 #define LINEAR_DIV_SHIFT 19
 #define LINEAR_DIV (1<<LINEAR_DIV_SHIFT)
 
+struct rate_linear;
+
+typedef void (*linear_func_t)(struct rate_linear *rate,
+			      const snd_pcm_channel_area_t *dst_areas,
+			      snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
+			      const snd_pcm_channel_area_t *src_areas,
+			      snd_pcm_uframes_t src_offset, unsigned int src_frames);
+
 struct rate_linear {
 	unsigned int get_idx;
 	unsigned int put_idx;
 	unsigned int pitch;
 	unsigned int pitch_shift;	/* for expand interpolation */
 	unsigned int channels;
-	int16_t *old_sample;
-	void (*func)(struct rate_linear *rate,
-		     const snd_pcm_channel_area_t *dst_areas,
-		     snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
-		     const snd_pcm_channel_area_t *src_areas,
-		     snd_pcm_uframes_t src_offset, unsigned int src_frames);
+	int32_t *old_sample;		/* last input sample (float for FLOAT) */
+	unsigned int in_frames;		/* frame counts the pitch is set for */
+	unsigned int out_frames;
+	linear_func_t func;
+	linear_func_t expand;
+	linear_func_t shrink;
 };
 
 static snd_pcm_uframes_t input_frames(void *obj, snd_pcm_uframes_t frames)
@@ -253,6 +261,7 @@ static void linear_shrink(struct rate_linear *rate,
 			}
 			old_sample = new_sample;
 		}
+		rate->old_sample[channel] = new_sample;
 	}
 }
 
@@ -305,9 +314,311 @@ static void linear_shrink_s16(struct rate_linear *rate,
 			}
 			old_sample = new_sample;
 		}
+		rate->old_sample[channel] = new_sample;
+	}
+}
+
+/* version for formats wider than 16 bits, interpolated in 32 bit */
+static void linear_expand32(struct rate_linear *rate,
+			    const snd_pcm_channel_area_t *dst_areas,
+			    snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
+			    const snd_pcm_channel_area_t *src_areas,
+			    snd_pcm_uframes_t src_offset, unsigned int src_frames)
+{
+#define GET32_LABELS
+#define PUT32_LABELS
+#include "plugin_ops.h"
+#undef GET32_LABELS
+#undef PUT32_LABELS
+	void *get = get32_labels[rate->get_idx];
+	void *put = put32_labels[rate->put_idx];
+	unsigned int get_threshold = rate->pitch;
+	unsigned int channel;
+	unsigned int src_frames1;
+	unsigned int dst_frames1;
+	int32_t sample = 0;
+	unsigned int pos;
+
+	for (channel = 0; channel < rate->channels; ++channel) {
+		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
+		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+		const char *src;
+		char *dst;
+		int src_step, dst_step;
+		int32_t old_sample = 0;
+		int32_t new_sample;
+		int old_weight, new_weight;
+		src = snd_pcm_channel_area_addr(src_area, src_offset);
+		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+		src_step = snd_pcm_channel_area_step(src_area);
+		dst_step = snd_pcm_channel_area_step(dst_area);
+		src_frames1 = 0;
+		dst_frames1 = 0;
+		new_sample = rate->old_sample[channel];
+		pos = get_threshold;
+		while (dst_frames1 < dst_frames) {
+			if (pos >= get_threshold) {
+				pos -= get_threshold;
+				old_sample = new_sample;
+				if (src_frames1 < src_frames) {
+					goto *get;
+#define GET32_END after_get
+#include "plugin_ops.h"
+#undef GET32_END
+				after_get:
+					new_sample = sample;
+				}
+			}
+			new_weight = (pos << (16 - rate->pitch_shift)) / (get_threshold >> rate->pitch_shift);
+			old_weight = 0x10000 - new_weight;
+			sample = ((int64_t)old_sample * old_weight + (int64_t)new_sample * new_weight) >> 16;
+			goto *put;
+#define PUT32_END after_put
+#include "plugin_ops.h"
+#undef PUT32_END
+		after_put:
+			dst += dst_step;
+			dst_frames1++;
+			pos += LINEAR_DIV;
+			if (pos >= get_threshold) {
+				src += src_step;
+				src_frames1++;
+			}
+		}
+		rate->old_sample[channel] = new_sample;
+	}
+}
+
+static void linear_shrink32(struct rate_linear *rate,
+			    const snd_pcm_channel_area_t *dst_areas,
+			    snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
+			    const snd_pcm_channel_area_t *src_areas,
+			    snd_pcm_uframes_t src_offset, unsigned int src_frames)
+{
+#define GET32_LABELS
+#define PUT32_LABELS
+#include "plugin_ops.h"
+#undef GET32_LABELS
+#undef PUT32_LABELS
+	void *get = get32_labels[rate->get_idx];
+	void *put = put32_labels[rate->put_idx];
+	unsigned int get_increment = rate->pitch;
+	unsigned int channel;
+	unsigned int src_frames1;
+	unsigned int dst_frames1;
+	int32_t sample = 0;
+	unsigned int pos;
+
+	for (channel = 0; channel < rate->channels; ++channel) {
+		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
+		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+		const char *src;
+		char *dst;
+		int src_step, dst_step;
+		int32_t old_sample = 0;
+		int32_t new_sample = 0;
+		int old_weight, new_weight;
+		pos = LINEAR_DIV - get_increment; /* Force first sample to be copied */
+		src = snd_pcm_channel_area_addr(src_area, src_offset);
+		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+		src_step = snd_pcm_channel_area_step(src_area);
+		dst_step = snd_pcm_channel_area_step(dst_area);
+		src_frames1 = 0;
+		dst_frames1 = 0;
+		while (src_frames1 < src_frames) {
+			goto *get;
+#define GET32_END after_get
+#include "plugin_ops.h"
+#undef GET32_END
+		after_get:
+			new_sample = sample;
+			src += src_step;
+			src_frames1++;
+			pos += get_increment;
+			if (pos >= LINEAR_DIV) {
+				pos -= LINEAR_DIV;
+				old_weight = (pos << (32 - LINEAR_DIV_SHIFT)) / (get_increment >> (LINEAR_DIV_SHIFT - 16));
+				new_weight = 0x10000 - old_weight;
+				sample = ((int64_t)old_sample * old_weight + (int64_t)new_sample * new_weight) >> 16;
+				goto *put;
+#define PUT32_END after_put
+#include "plugin_ops.h"
+#undef PUT32_END
+			after_put:
+				dst += dst_step;
+				dst_frames1++;
+				if (CHECK_SANITY(dst_frames1 > dst_frames)) {
+					SNDERR("dst_frames overflow");
+					break;
+				}
+			}
+			old_sample = new_sample;
+		}
+		rate->old_sample[channel] = new_sample;
 	}
 }
 
+/*
+ * optimized versions for native S32 and FLOAT formats, following the
+ * S16 ones above
+ */
+#define LINEAR_NATIVE_FUNCS(fmt, type, interp)				\
+static void linear_expand_##fmt(struct rate_linear *rate,		\
+				const snd_pcm_channel_area_t *dst_areas, \
+				snd_pcm_uframes_t dst_offset,		\
+				unsigned int dst_frames,		\
+				const snd_pcm_channel_area_t *src_areas, \
+				snd_pcm_uframes_t src_offset,		\
+				unsigned int src_frames)		\
+{									\
+	type *last = (type *)rate->old_sample;				\
+	unsigned int get_threshold = rate->pitch;			\
+	unsigned int channel;						\
+	unsigned int src_frames1;					\
+	unsigned int dst_frames1;					\
+	unsigned int pos;						\
+									\
+	for (channel = 0; channel < rate->channels; ++channel) {	\
+		const type *src;					\
+		type *dst;						\
+		int src_step, dst_step;					\
+		type old_sample = 0;					\
+		type new_sample;					\
+		int old_weight, new_weight;				\
+		src = snd_pcm_channel_area_addr(&src_areas[channel], src_offset); \
+		dst = snd_pcm_channel_area_addr(&dst_areas[channel], dst_offset); \
+		src_step = snd_pcm_channel_area_step(&src_areas[channel]) / sizeof(type); \
+		dst_step = snd_pcm_channel_area_step(&dst_areas[channel]) / sizeof(type); \
+		src_frames1 = 0;					\
+		dst_frames1 = 0;					\
+		new_sample = last[channel];				\
+		pos = get_threshold;					\
+		while (dst_frames1 < dst_frames) {			\
+			if (pos >= get_threshold) {			\
+				pos -= get_threshold;			\
+				old_sample = new_sample;		\
+				if (src_frames1 < src_frames)		\
+					new_sample = *src;		\
+			}						\
+			new_weight = (pos << (16 - rate->pitch_shift)) / (get_threshold >> rate->pitch_shift); \
+			old_weight = 0x10000 - new_weight;		\
+			*dst = interp(old_sample, old_weight, new_sample, new_weight); \
+			dst += dst_step;				\
+			dst_frames1++;					\
+			pos += LINEAR_DIV;				\
+			if (pos >= get_threshold) {			\
+				src += src_step;			\
+				src_frames1++;				\
+			}						\
+		}							\
+		last[channel] = new_sample;				\
+	}								\
+}									\
+									\
+static void linear_shrink_##fmt(struct rate_linear *rate,		\
+				const snd_pcm_channel_area_t *dst_areas, \
+				snd_pcm_uframes_t dst_offset,		\
+				unsigned int dst_frames,		\
+				const snd_pcm_channel_area_t *src_areas, \
+				snd_pcm_uframes_t src_offset,		\
+				unsigned int src_frames)		\
+{									\
+	type *last = (type *)rate->old_sample;				\
+	unsigned int get_increment = rate->pitch;			\
+	unsigned int channel;						\
+	unsigned int src_frames1;					\
+	unsigned int dst_frames1;					\
+	unsigned int pos;						\
+									\
+	for (channel = 0; channel < rate->channels; ++channel) {	\
+		const type *src;					\
+		type *dst;						\
+		int src_step, dst_step;					\
+		type old_sample = 0;					\
+		type new_sample = 0;					\
+		int old_weight, new_weight;				\
+		pos = LINEAR_DIV - get_increment; /* Force first sample to be copied */ \
+		src = snd_pcm_channel_area_addr(&src_areas[channel], src_offset); \
+		dst = snd_pcm_channel_area_addr(&dst_areas[channel], dst_offset); \
+		src_step = snd_pcm_channel_area_step(&src_areas[channel]) / sizeof(type); \
+		dst_step = snd_pcm_channel_area_step(&dst_areas[channel]) / sizeof(type); \
+		src_frames1 = 0;					\
+		dst_frames1 = 0;					\
+		while (src_frames1 < src_frames) {			\
+			new_sample = *src;				\
+			src += src_step;				\
+			src_frames1++;					\
+			pos += get_increment;				\
+			if (pos >= LINEAR_DIV) {			\
+				pos -= LINEAR_DIV;			\
+				old_weight = (pos << (32 - LINEAR_DIV_SHIFT)) / (get_increment >> (LINEAR_DIV_SHIFT - 16)); \
+				new_weight = 0x10000 - old_weight;	\
+				*dst = interp(old_sample, old_weight, new_sample, new_weight); \
+				dst += dst_step;			\
+				dst_frames1++;				\
+				if (CHECK_SANITY(dst_frames1 > dst_frames)) { \
+					SNDERR("dst_frames overflow");	\
+					break;				\
+				}					\
+			}						\
+			old_sample = new_sample;			\
+		}							\
+		last[channel] = new_sample;				\
+	}								\
+}
+
+#define INTERP_S32(o, ow, n, nw) \
+	(int32_t)(((int64_t)(o) * (ow) + (int64_t)(n) * (nw)) >> 16)
+#define INTERP_FLOAT(o, ow, n, nw) \
+	(((o) * (ow) + (n) * (nw)) * (1.0f / 0x10000))
+
+LINEAR_NATIVE_FUNCS(s32, int32_t, INTERP_S32)
+LINEAR_NATIVE_FUNCS(float, float, INTERP_FLOAT)
+
+#undef LINEAR_NATIVE_FUNCS
+#undef INTERP_S32
+#undef INTERP_FLOAT
+
+static void linear_set_shift(struct rate_linear *rate)
+{
+	if (rate->pitch >= LINEAR_DIV) {
+		/* shift for expand linear interpolation */
+		rate->pitch_shift = 0;
+		while ((rate->pitch >> rate->pitch_shift) >= (1 << 16))
+			rate->pitch_shift++;
+	}
+}
+
+/*
+ * set up the pitch for converting exactly in_frames to out_frames
+ * (used when the rate PCM changes the frame counts per call, e.g. in
+ * the adaptive mode); the expand loop reads 1 + (out - 1) * DIV / pitch
+ * input frames and the shrink loop writes 1 + (in - 1) * pitch / DIV
+ * output frames, so the pitch is taken from the middle of the range
+ * giving the requested count
+ */
+static void linear_set_frames(struct rate_linear *rate,
+			      unsigned int in_frames, unsigned int out_frames)
+{
+	rate->in_frames = in_frames;
+	rate->out_frames = out_frames;
+	if (in_frames < 2 || out_frames < 2)
+		return;
+	if (out_frames > in_frames) {
+		rate->func = rate->expand;
+		rate->pitch = ((uint64_t)(out_frames - 1) * 2 * LINEAR_DIV) /
+			(2 * in_frames - 1);
+	} else if (out_frames < in_frames) {
+		rate->func = rate->shrink;
+		rate->pitch = ((uint64_t)(2 * out_frames - 1) * LINEAR_DIV) /
+			(2 * (in_frames - 1));
+	} else {
+		rate->func = rate->shrink;
+		rate->pitch = LINEAR_DIV;
+	}
+	linear_set_shift(rate);
+}
+
 static void linear_convert(void *obj, 
 			   const snd_pcm_channel_area_t *dst_areas,
 			   snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
@@ -315,6 +626,9 @@ static void linear_convert(void *obj,
 			   snd_pcm_uframes_t src_offset, unsigned int src_frames)
 {
 	struct rate_linear *rate = obj;
+
+	if (src_frames != rate->in_frames || dst_frames != rate->out_frames)
+		linear_set_frames(rate, src_frames, dst_frames);
 	rate->func(rate, dst_areas, dst_offset, dst_frames,
 		   src_areas, src_offset, src_frames);
 }
@@ -331,24 +645,38 @@ static int linear_init(void *obj, snd_pcm_rate_info_t *info)
 {
 	struct rate_linear *rate = obj;
 
-	rate->get_idx = snd_pcm_linear_get_index(info->in.format, SND_PCM_FORMAT_S16);
-	rate->put_idx = snd_pcm_linear_put_index(SND_PCM_FORMAT_S16, info->out.format);
-	if (info->in.rate < info->out.rate) {
-		if (info->in.format == info->out.format && info->in.format == SND_PCM_FORMAT_S16)
-			rate->func = linear_expand_s16;
-		else
-			rate->func = linear_expand;
-		/* pitch is get_threshold */
+	snd_pcm_format_t format = info->in.format;
+	int same = format == info->out.format;
+	int is_float = snd_pcm_format_float(format) == 1;
+	int wide = snd_pcm_format_width(format) > 16 ||
+		   snd_pcm_format_width(info->out.format) > 16;
+
+	/* float is accepted only as native FLOAT on both sides */
+	if ((is_float || snd_pcm_format_float(info->out.format) == 1) &&
+	    (format != SND_PCM_FORMAT_FLOAT || ! same))
+		return -EINVAL;
+	rate->get_idx = snd_pcm_linear_get_index(format, wide ? SND_PCM_FORMAT_S32 : SND_PCM_FORMAT_S16);
+	rate->put_idx = snd_pcm_linear_put_index(wide ? SND_PCM_FORMAT_S32 : SND_PCM_FORMAT_S16, info->out.format);
+	if (same && format == SND_PCM_FORMAT_S16) {
+		rate->expand = linear_expand_s16;
+		rate->shrink = linear_shrink_s16;
+	} else if (same && format == SND_PCM_FORMAT_S32) {
+		rate->expand = linear_expand_s32;
+		rate->shrink = linear_shrink_s32;
+	} else if (is_float) {
+		rate->expand = linear_expand_float;
+		rate->shrink = linear_shrink_float;
 	} else {
-		if (info->in.format == info->out.format && info->in.format == SND_PCM_FORMAT_S16)
-			rate->func = linear_shrink_s16;
-		else
-			rate->func = linear_shrink;
-		/* pitch is get_increment */
+		rate->expand = wide ? linear_expand32 : linear_expand;
+		rate->shrink = wide ? linear_shrink32 : linear_shrink;
 	}
+	/* pitch is get_threshold for expand, get_increment for shrink */
+	rate->func = info->in.rate < info->out.rate ? rate->expand : rate->shrink;
 	rate->pitch = (((uint64_t)info->out.rate * LINEAR_DIV) +
 		       (info->in.rate / 2)) / info->in.rate;
 	rate->channels = info->channels;
+	rate->in_frames = info->in.period_size;
+	rate->out_frames = info->out.period_size;
 
 	free(rate->old_sample);
 	rate->old_sample = malloc(sizeof(*rate->old_sample) * rate->channels);
@@ -382,12 +710,9 @@ static int linear_adjust_pitch(void *obj, snd_pcm_rate_info_t *info)
 		}
 		cframes = cframes_new;
 	}
-	if (rate->pitch >= LINEAR_DIV) {
-		/* shift for expand linear interpolation */
-		rate->pitch_shift = 0;
-		while ((rate->pitch >> rate->pitch_shift) >= (1 << 16))
-			rate->pitch_shift++;
-	}
+	linear_set_shift(rate);
+	rate->in_frames = info->in.period_size;
+	rate->out_frames = info->out.period_size;
 	return 0;
 }
 
@@ -413,6 +738,19 @@ static int get_supported_rates(ATTRIBUTE_UNUSED void *rate,
 	return 0;
 }
 
+static int get_supported_formats(ATTRIBUTE_UNUSED void *rate,
+				 uint64_t *in_formats, uint64_t *out_formats,
+				 unsigned int *flags)
+{
+	snd_pcm_format_mask_t mask = { SND_PCM_FMTBIT_LINEAR };
+
+	*in_formats = mask.bits[0] | ((uint64_t)mask.bits[1] << 32) |
+		      (1ULL << SND_PCM_FORMAT_FLOAT);
+	*out_formats = *in_formats;
+	*flags = SND_PCM_RATE_FLAG_VARIABLE_FRAMES;
+	return 0;
+}
+
 static void linear_dump(ATTRIBUTE_UNUSED void *rate, snd_output_t *out)
 {
 	snd_output_printf(out, "Converter: linear-interpolation\n");
@@ -430,6 +768,7 @@ static const snd_pcm_rate_ops_t linear_ops = {
 	.version = SND_PCM_RATE_PLUGIN_VERSION,
 	.get_supported_rates = get_supported_rates,
 	.dump = linear_dump,
+	.get_supported_formats = get_supported_formats,
 };
 
 int SND_PCM_RATE_PLUGIN_ENTRY(linear) (ATTRIBUTE_UNUSED unsigned int version,
@@ -0,0 +1,400 @@
+/*
+ *  Polyphase windowed-sinc rate converter plugin
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include "bswap.h"
+#include "pcm_local.h"
+#include "pcm_plugin.h"
+#include "pcm_rate.h"
+
+#include "plugin_ops.h"
+
+/*
+ * The converter works on float samples: the input is read as S32 via
+ * the get32 conversion table and the filtered output is written back
+ * via put32, so any linear format keeps its full resolution; native
+ * FLOAT is processed directly.
+ *
+ * Since pcm_rate always converts whole periods, the ratio is taken from
+ * the period sizes (out_period / in_period reduced to L / M) and each
+ * period starts at phase zero.  When L is small (e.g. 160/147 for
+ * 44.1 kHz -> 48 kHz or 2/1 for 48 kHz -> 96 kHz with matching
+ * periods) every phase gets its own filter; otherwise the fractional
+ * position is interpolated linearly between POLYPHASE_PHASES filters.
+ */
+
+#define POLYPHASE_PHASES	256	/* max. exact phases, interpolated otherwise */
+#define POLYPHASE_TAPS		64	/* filter length when upsampling */
+#define POLYPHASE_MAX_TAPS	512	/* limit for large downsampling ratios */
+#define POLYPHASE_CUTOFF	0.91	/* passband edge relative to Nyquist */
+#define POLYPHASE_BETA		8.0	/* Kaiser window, ~80dB stopband */
+
+#include "pcm_rate_polyphase_simd.h"
+
+struct rate_polyphase {
+	unsigned int get_idx;
+	unsigned int put_idx;
+	unsigned int channels;
+	int is_float;			/* native FLOAT on both sides */
+	unsigned int taps;		/* multiple of 8 */
+	unsigned int phases;		/* number of filter phases */
+	int interp;			/* interpolate between two phases */
+	float *coeffs;			/* (phases + interp) * taps */
+	unsigned int in_period;
+	unsigned int out_period;
+	/* per output frame: input index, phase and interpolation weight */
+	unsigned int *step_idx;
+	unsigned int *step_phase;
+	float *step_frac;
+	float *hist;			/* per channel: taps - 1 + in_period */
+	unsigned int hist_len;
+	dot_func_t dot;
+};
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+	while (b) {
+		unsigned int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/* zeroth order modified Bessel function of the first kind */
+static double bessel_i0(double x)
+{
+	double sum = 1.0, term = 1.0, q = x * x / 4.0;
+	unsigned int k;
+
+	for (k = 1; k < 64 && term > sum * 1e-12; k++) {
+		term *= q / ((double)k * k);
+		sum += term;
+	}
+	return sum;
+}
+
+/*
+ * compute the filter for each phase; phase p interpolates at the
+ * fractional position p / phases between the two center taps
+ */
+static void make_coeffs(struct rate_polyphase *rate, double cutoff)
+{
+	unsigned int p, k, half = rate->taps / 2;
+	double i0_beta = bessel_i0(POLYPHASE_BETA);
+
+	for (p = 0; p < rate->phases + rate->interp; p++) {
+		float *h = rate->coeffs + p * rate->taps;
+		double frac = (double)p / rate->phases;
+		double sum = 0;
+
+		for (k = 0; k < rate->taps; k++) {
+			double d = (double)half - 1 - k + frac;
+			double x = d / half;
+			double w, s;
+
+			w = 1.0 - x * x;
+			w = w > 0 ? bessel_i0(POLYPHASE_BETA * sqrt(w)) / i0_beta : 0;
+			s = M_PI * cutoff * d;
+			s = fabs(s) < 1e-9 ? cutoff : cutoff * sin(s) / s;
+			h[k] = s * w;
+			sum += h[k];
+		}
+		/* unity gain at DC for every phase */
+		for (k = 0; k < rate->taps; k++)
+			h[k] /= sum;
+	}
+}
+
+static snd_pcm_uframes_t input_frames(void *obj, snd_pcm_uframes_t frames)
+{
+	struct rate_polyphase *rate = obj;
+	if (frames == 0)
+		return 0;
+	return muldiv_near(frames, rate->in_period, rate->out_period);
+}
+
+static snd_pcm_uframes_t output_frames(void *obj, snd_pcm_uframes_t frames)
+{
+	struct rate_polyphase *rate = obj;
+	if (frames == 0)
+		return 0;
+	return muldiv_near(frames, rate->out_period, rate->in_period);
+}
+
+static void polyphase_convert(void *obj,
+			      const snd_pcm_channel_area_t *dst_areas,
+			      snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
+			      const snd_pcm_channel_area_t *src_areas,
+			      snd_pcm_uframes_t src_offset, unsigned int src_frames)
+{
+#define GET32_LABELS
+#define PUT32_LABELS
+#include "plugin_ops.h"
+#undef GET32_LABELS
+#undef PUT32_LABELS
+	struct rate_polyphase *rate = obj;
+	void *get = get32_labels[rate->get_idx];
+	void *put = put32_labels[rate->put_idx];
+	unsigned int keep = rate->taps - 1;
+	unsigned int channel, n;
+	int32_t sample = 0;
+
+	if (src_frames > rate->in_period)
+		src_frames = rate->in_period;
+	if (dst_frames > rate->out_period)
+		dst_frames = rate->out_period;
+
+	for (channel = 0; channel < rate->channels; ++channel) {
+		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
+		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+		float *hist = rate->hist + channel * rate->hist_len;
+		float *buf = hist + keep;
+		const char *src;
+		char *dst;
+		int src_step, dst_step;
+
+		src = snd_pcm_channel_area_addr(src_area, src_offset);
+		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+		src_step = snd_pcm_channel_area_step(src_area);
+		dst_step = snd_pcm_channel_area_step(dst_area);
+		if (rate->is_float) {
+			for (n = 0; n < src_frames; n++) {
+				buf[n] = *(const float *)src;
+				src += src_step;
+			}
+		}
+		for (n = rate->is_float ? src_frames : 0; n < src_frames; n++) {
+			goto *get;
+#define GET32_END after_get
+#include "plugin_ops.h"
+#undef GET32_END
+		after_get:
+			buf[n] = (float)sample * (1.0f / 2147483648.0f);
+			src += src_step;
+		}
+		for (; n < rate->in_period; n++)
+			buf[n] = 0;
+
+		for (n = 0; n < dst_frames; n++) {
+			const float *x = hist + rate->step_idx[n];
+			const float *h = rate->coeffs + rate->step_phase[n] * rate->taps;
+			float y = rate->dot(h, x, rate->taps);
+
+			if (rate->interp) {
+				float y1 = rate->dot(h + rate->taps, x, rate->taps);
+				y += (y1 - y) * rate->step_frac[n];
+			}
+			if (rate->is_float) {
+				*(float *)dst = y;
+				dst += dst_step;
+				continue;
+			}
+			y *= 2147483648.0f;
+			if (y >= 2147483647.0f)
+				sample = 0x7fffffff;
+			else if (y <= -2147483648.0f)
+				sample = -0x7fffffff - 1;
+			else
+				sample = (int32_t)lrintf(y);
+			goto *put;
+#define PUT32_END after_put
+#include "plugin_ops.h"
+#undef PUT32_END
+		after_put:
+			dst += dst_step;
+		}
+
+		memmove(hist, hist + src_frames, keep * sizeof(*hist));
+	}
+}
+
+static void polyphase_free(void *obj)
+{
+	struct rate_polyphase *rate = obj;
+
+	free(rate->coeffs);
+	free(rate->step_idx);
+	free(rate->step_phase);
+	free(rate->step_frac);
+	free(rate->hist);
+	rate->coeffs = NULL;
+	rate->step_idx = rate->step_phase = NULL;
+	rate->step_frac = NULL;
+	rate->hist = NULL;
+}
+
+static int polyphase_init(void *obj, snd_pcm_rate_info_t *info)
+{
+	struct rate_polyphase *rate = obj;
+	unsigned int n, g, l;
+	double cutoff;
+	void *ptr;
+
+	if (!info->in.period_size || !info->out.period_size)
+		return -EINVAL;
+	if ((snd_pcm_format_float(info->in.format) == 1 ||
+	     snd_pcm_format_float(info->out.format) == 1) &&
+	    (info->in.format != SND_PCM_FORMAT_FLOAT ||
+	     info->out.format != SND_PCM_FORMAT_FLOAT))
+		return -EINVAL;
+	polyphase_free(rate);
+	rate->is_float = info->in.format == SND_PCM_FORMAT_FLOAT;
+	rate->get_idx = snd_pcm_linear_get_index(info->in.format, SND_PCM_FORMAT_S32);
+	rate->put_idx = snd_pcm_linear_put_index(SND_PCM_FORMAT_S32, info->out.format);
+	rate->channels = info->channels;
+	rate->in_period = info->in.period_size;
+	rate->out_period = info->out.period_size;
+
+	/* widen the filter by the decimation factor when downsampling */
+	cutoff = POLYPHASE_CUTOFF;
+	rate->taps = POLYPHASE_TAPS;
+	if (info->out.rate < info->in.rate) {
+		cutoff = cutoff * info->out.rate / info->in.rate;
+		rate->taps = (unsigned int)ceil((double)POLYPHASE_TAPS *
+						info->in.rate / info->out.rate);
+		rate->taps = (rate->taps + 7) & ~7;
+		if (rate->taps > POLYPHASE_MAX_TAPS)
+			rate->taps = POLYPHASE_MAX_TAPS;
+	}
+
+	g = gcd(rate->in_period, rate->out_period);
+	l = rate->out_period / g;
+	if (l <= POLYPHASE_PHASES) {
+		rate->phases = l;
+		rate->interp = 0;
+	} else {
+		rate->phases = POLYPHASE_PHASES;
+		rate->interp = 1;
+	}
+
+	if (posix_memalign(&ptr, 32, (rate->phases + rate->interp) *
+			   rate->taps * sizeof(float)))
+		goto error;
+	rate->coeffs = ptr;
+	make_coeffs(rate, cutoff);
+
+	rate->step_idx = malloc(rate->out_period * sizeof(*rate->step_idx));
+	rate->step_phase = malloc(rate->out_period * sizeof(*rate->step_phase));
+	rate->step_frac = malloc(rate->out_period * sizeof(*rate->step_frac));
+	if (!rate->step_idx || !rate->step_phase || !rate->step_frac)
+		goto error;
+	for (n = 0; n < rate->out_period; n++) {
+		uint64_t pos = (uint64_t)n * rate->in_period;
+		unsigned int rem = pos % rate->out_period;
+
+		/* the filter of output n ends at input sample idx */
+		rate->step_idx[n] = pos / rate->out_period;
+		if (!rate->interp) {
+			rate->step_phase[n] = rem / g;
+			rate->step_frac[n] = 0;
+		} else {
+			uint64_t fp = (uint64_t)rem * rate->phases;
+			rate->step_phase[n] = fp / rate->out_period;
+			rate->step_frac[n] = (float)(fp % rate->out_period) /
+					     rate->out_period;
+		}
+	}
+
+	rate->hist_len = rate->taps - 1 + rate->in_period;
+	rate->hist = calloc(rate->channels * rate->hist_len, sizeof(float));
+	if (!rate->hist)
+		goto error;
+	return 0;
+
+ error:
+	polyphase_free(rate);
+	return -ENOMEM;
+}
+
+static void polyphase_reset(void *obj)
+{
+	struct rate_polyphase *rate = obj;
+
+	if (rate->hist)
+		memset(rate->hist, 0, rate->channels * rate->hist_len * sizeof(float));
+}
+
+static void polyphase_close(void *obj)
+{
+	polyphase_free(obj);
+	free(obj);
+}
+
+static int get_supported_rates(ATTRIBUTE_UNUSED void *rate,
+			       unsigned int *rate_min, unsigned int *rate_max)
+{
+	*rate_min = SND_PCM_PLUGIN_RATE_MIN;
+	*rate_max = SND_PCM_PLUGIN_RATE_MAX;
+	return 0;
+}
+
+static int get_supported_formats(ATTRIBUTE_UNUSED void *rate,
+				 uint64_t *in_formats, uint64_t *out_formats,
+				 unsigned int *flags)
+{
+	snd_pcm_format_mask_t mask = { SND_PCM_FMTBIT_LINEAR };
+
+	*in_formats = mask.bits[0] | ((uint64_t)mask.bits[1] << 32) |
+		      (1ULL << SND_PCM_FORMAT_FLOAT);
+	*out_formats = *in_formats;
+	*flags = 0;
+	return 0;
+}
+
+static void polyphase_dump(void *obj, snd_output_t *out)
+{
+	struct rate_polyphase *rate = obj;
+
+	snd_output_printf(out, "Converter: polyphase-sinc\n");
+	if (rate->coeffs)
+		snd_output_printf(out, "  taps %u, phases %u%s\n",
+				  rate->taps, rate->phases,
+				  rate->interp ? " (interpolated)" : "");
+}
+
+static const snd_pcm_rate_ops_t polyphase_ops = {
+	.close = polyphase_close,
+	.init = polyphase_init,
+	.free = polyphase_free,
+	.reset = polyphase_reset,
+	.convert = polyphase_convert,
+	.input_frames = input_frames,
+	.output_frames = output_frames,
+	.version = SND_PCM_RATE_PLUGIN_VERSION,
+	.get_supported_rates = get_supported_rates,
+	.dump = polyphase_dump,
+	.get_supported_formats = get_supported_formats,
+};
+
+int SND_PCM_RATE_PLUGIN_ENTRY(polyphase) (ATTRIBUTE_UNUSED unsigned int version,
+					  void **objp, snd_pcm_rate_ops_t *ops)
+{
+	struct rate_polyphase *rate;
+
+	rate = calloc(1, sizeof(*rate));
+	if (! rate)
+		return -ENOMEM;
+
+	rate->dot = select_dot();
+	*objp = rate;
+	*ops = polyphase_ops;
+	return 0;
+}
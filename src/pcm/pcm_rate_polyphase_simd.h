@@ -0,0 +1,123 @@
+/*
+ *  Polyphase windowed-sinc rate converter - vectorized kernels
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+#if defined(__x86_64__) || defined(__i386__)
+#define POLYPHASE_SIMD_X86
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#define POLYPHASE_SIMD_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+typedef float (*dot_func_t)(const float *a, const float *b, unsigned int n);
+
+/*
+ * dot product kernels; n is a multiple of 8, the coefficients are
+ * 32 byte aligned, the samples may be unaligned
+ */
+static float dot_generic(const float *a, const float *b, unsigned int n)
+{
+	float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	unsigned int i;
+
+	for (i = 0; i < n; i += 4) {
+		s0 += a[i] * b[i];
+		s1 += a[i + 1] * b[i + 1];
+		s2 += a[i + 2] * b[i + 2];
+		s3 += a[i + 3] * b[i + 3];
+	}
+	return (s0 + s1) + (s2 + s3);
+}
+
+#ifdef POLYPHASE_SIMD_X86
+static __attribute__((target("sse")))
+float dot_sse(const float *a, const float *b, unsigned int n)
+{
+	__m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+	float r[4];
+	unsigned int i;
+
+	for (i = 0; i < n; i += 8) {
+		s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_load_ps(a + i),
+					       _mm_loadu_ps(b + i)));
+		s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_load_ps(a + i + 4),
+					       _mm_loadu_ps(b + i + 4)));
+	}
+	_mm_storeu_ps(r, _mm_add_ps(s0, s1));
+	return (r[0] + r[1]) + (r[2] + r[3]);
+}
+
+static __attribute__((target("avx2,fma")))
+float dot_avx2(const float *a, const float *b, unsigned int n)
+{
+	__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+	__m128 s;
+	float r[4];
+	unsigned int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		s0 = _mm256_fmadd_ps(_mm256_load_ps(a + i),
+				     _mm256_loadu_ps(b + i), s0);
+		s1 = _mm256_fmadd_ps(_mm256_load_ps(a + i + 8),
+				     _mm256_loadu_ps(b + i + 8), s1);
+	}
+	if (i < n)
+		s0 = _mm256_fmadd_ps(_mm256_load_ps(a + i),
+				     _mm256_loadu_ps(b + i), s0);
+	s0 = _mm256_add_ps(s0, s1);
+	s = _mm_add_ps(_mm256_castps256_ps128(s0),
+		       _mm256_extractf128_ps(s0, 1));
+	_mm_storeu_ps(r, s);
+	return (r[0] + r[1]) + (r[2] + r[3]);
+}
+#endif /* POLYPHASE_SIMD_X86 */
+
+#ifdef POLYPHASE_SIMD_NEON
+static float dot_neon(const float *a, const float *b, unsigned int n)
+{
+	float32x4_t s0 = vdupq_n_f32(0), s1 = vdupq_n_f32(0);
+	float r[4];
+	unsigned int i;
+
+	for (i = 0; i < n; i += 8) {
+		s0 = vmlaq_f32(s0, vld1q_f32(a + i), vld1q_f32(b + i));
+		s1 = vmlaq_f32(s1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+	}
+	vst1q_f32(r, vaddq_f32(s0, s1));
+	return (r[0] + r[1]) + (r[2] + r[3]);
+}
+#endif /* POLYPHASE_SIMD_NEON */
+
+static dot_func_t select_dot(void)
+{
+#ifdef POLYPHASE_SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return dot_avx2;
+	if (__builtin_cpu_supports("sse"))
+		return dot_sse;
+#endif
+#ifdef POLYPHASE_SIMD_NEON
+	return dot_neon;
+#endif
+	return dot_generic;
+}
@@ -0,0 +1,502 @@
+/**
+ * \file pcm/pcm_refine_cache.c
+ * \ingroup PCM
+ * \brief PCM Refinement Cache
+ * \date 2026
+ *
+ * Process wide cache of the configuration spaces refined by the PCMs,
+ * optionally kept in a file between the runs.
+ */
+/*
+ *  PCM Interface - refinement cache
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+#include "pcm_local.h"
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
+#ifndef DOC_HIDDEN
+
+#define REFINE_CACHE_SIZE	256	/* entries */
+#define REFINE_CACHE_HASH	64	/* buckets */
+#define REFINE_CACHE_MAGIC	"ALSARFC"
+#define REFINE_CACHE_VERSION	2
+
+#define REFINE_REC_MEMORY	(1<<0)	/* refined by a hw PCM, not saved */
+
+#define FNV_BASIS		0xcbf29ce484222325ULL
+#define FNV_PRIME		0x100000001b3ULL
+
+/* one refinement, also the record of the cache file */
+struct refine_record {
+	unsigned long long key;		/* of the refining PCM */
+	int result;
+	unsigned int flags;		/* REFINE_REC_* */
+	snd_pcm_hw_params_t in;
+	snd_pcm_hw_params_t out;
+};
+
+struct refine_file_header {
+	char magic[8];
+	unsigned int version;
+	unsigned int params_size;	/* the layout must match */
+	unsigned int count;
+	unsigned int reserved;
+};
+
+typedef struct {
+	struct list_head hash;		/* in the bucket */
+	struct list_head lru;		/* most recently used first */
+	unsigned long long hval;
+	struct refine_record rec;
+} refine_entry_t;
+
+static struct list_head refine_hash[REFINE_CACHE_HASH];
+static LIST_HEAD(refine_lru);
+static unsigned int refine_count;
+static char *refine_file;		/* NULL = kept in memory only */
+static int refine_dirty;
+
+#ifdef HAVE_LIBPTHREAD
+static pthread_mutex_t refine_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static inline void refine_lock(void)
+{
+	pthread_mutex_lock(&refine_mutex);
+}
+
+static inline void refine_unlock(void)
+{
+	pthread_mutex_unlock(&refine_mutex);
+}
+#else
+static inline void refine_lock(void) {}
+static inline void refine_unlock(void) {}
+#endif
+
+static unsigned long long fnv(unsigned long long h, const void *data,
+			      size_t size)
+{
+	const unsigned char *p = data;
+
+	while (size--) {
+		h ^= *p++;
+		h *= FNV_PRIME;
+	}
+	return h;
+}
+
+static unsigned long long entry_hash(unsigned long long key,
+				     const snd_pcm_hw_params_t *params)
+{
+	return fnv(fnv(FNV_BASIS, &key, sizeof(key)), params, sizeof(*params));
+}
+
+/* called locked */
+static void refine_init(void)
+{
+	unsigned int i;
+
+	if (refine_hash[0].next)
+		return;
+	for (i = 0; i < REFINE_CACHE_HASH; i++)
+		INIT_LIST_HEAD(&refine_hash[i]);
+}
+
+static void refine_remove(refine_entry_t *e)
+{
+	list_del(&e->hash);
+	list_del(&e->lru);
+	refine_count--;
+	free(e);
+}
+
+static refine_entry_t *refine_find(unsigned long long key,
+				   const snd_pcm_hw_params_t *params,
+				   unsigned long long hval)
+{
+	struct list_head *pos;
+	refine_entry_t *e;
+
+	list_for_each(pos, &refine_hash[hval % REFINE_CACHE_HASH]) {
+		e = list_entry(pos, refine_entry_t, hash);
+		if (e->hval == hval && e->rec.key == key &&
+		    !memcmp(&e->rec.in, params, sizeof(*params)))
+			return e;
+	}
+	return NULL;
+}
+
+/* add as the least recently used entry when tail is set */
+static void refine_insert(refine_entry_t *e, int tail)
+{
+	e->hval = entry_hash(e->rec.key, &e->rec.in);
+	list_add(&e->hash, &refine_hash[e->hval % REFINE_CACHE_HASH]);
+	if (tail)
+		list_add_tail(&e->lru, &refine_lru);
+	else
+		list_add(&e->lru, &refine_lru);
+	refine_count++;
+	while (refine_count > REFINE_CACHE_SIZE)
+		refine_remove(list_entry(refine_lru.prev, refine_entry_t, lru));
+}
+
+static void refine_load(void)
+{
+	struct refine_file_header hdr;
+	refine_entry_t *e;
+	unsigned int i;
+	FILE *f;
+
+	f = fopen(refine_file, "r");
+	if (!f)
+		return;
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    memcmp(hdr.magic, REFINE_CACHE_MAGIC, sizeof(hdr.magic)) ||
+	    hdr.version != REFINE_CACHE_VERSION ||
+	    hdr.params_size != sizeof(snd_pcm_hw_params_t) ||
+	    hdr.count > REFINE_CACHE_SIZE)
+		goto _close;
+	for (i = 0; i < hdr.count; i++) {
+		e = malloc(sizeof(*e));
+		if (!e)
+			break;
+		if (fread(&e->rec, sizeof(e->rec), 1, f) != 1 ||
+		    (e->rec.flags & REFINE_REC_MEMORY) ||
+		    refine_find(e->rec.key, &e->rec.in,
+				entry_hash(e->rec.key, &e->rec.in))) {
+			free(e);
+			break;
+		}
+		refine_insert(e, 1);
+	}
+ _close:
+	fclose(f);
+}
+
+/* the defaults from $LIBASOUND_PCM_REFINE_CACHE, called locked */
+static int refine_default(const char **file)
+{
+	static int enable = -1;
+	static const char *path;
+
+	if (enable < 0) {
+		char *p = getenv("LIBASOUND_PCM_REFINE_CACHE");
+
+		enable = p && *p && *p != '0';
+		if (enable && *p == '/')
+			path = p;
+	}
+	*file = path;
+	return enable;
+}
+
+static unsigned long long file_hash(unsigned long long h, const char *file)
+{
+	char buf[512];
+	size_t len;
+	FILE *f;
+
+	f = fopen(file, "r");
+	if (!f)
+		return h;
+	while ((len = fread(buf, 1, sizeof(buf), f)) > 0)
+		h = fnv(h, buf, len);
+	fclose(f);
+	return h;
+}
+
+static unsigned long long str_hash(unsigned long long h, const char *str)
+{
+	return fnv(h, str, strlen(str) + 1);
+}
+
+/*
+ * the state a hw PCM refines against, as far as it is known at open:
+ * the cards present, the kernel and driver version and the device
+ */
+static unsigned long long hw_hash(snd_pcm_t *pcm)
+{
+	unsigned long long h = FNV_BASIS;
+	snd_pcm_info_t info;
+	struct utsname uts;
+	int val;
+
+	h = file_hash(h, "/proc/asound/cards");
+	h = file_hash(h, "/proc/asound/version");
+	if (uname(&uts) == 0) {
+		h = str_hash(h, uts.release);
+		h = str_hash(h, uts.version);
+	}
+	memset(&info, 0, sizeof(info));
+	if (snd_pcm_info(pcm, &info) >= 0) {
+		val = snd_pcm_info_get_card(&info);
+		h = fnv(h, &val, sizeof(val));
+		val = snd_pcm_info_get_device(&info);
+		h = fnv(h, &val, sizeof(val));
+		val = snd_pcm_info_get_subdevice(&info);
+		h = fnv(h, &val, sizeof(val));
+		h = str_hash(h, snd_pcm_info_get_id(&info));
+		h = str_hash(h, snd_pcm_info_get_name(&info));
+		h = str_hash(h, snd_pcm_info_get_subdevice_name(&info));
+	}
+	return h;
+}
+
+/*
+ * Sets the key of a newly opened PCM.  It identifies everything the
+ * refinement depends on: the PCM name, stream and mode, the expanded
+ * definition and the key of the slave, down to the cards, the kernel
+ * and the device for the hw PCMs.  PCMs from external modules and PCMs
+ * with several slaves are not cached, nor are the PCMs on top of them.
+ *
+ * A hw PCM also depends on state which no key covers (HDMI ELD, USB
+ * altsettings, the other open streams of the card), so the refinements
+ * of chains ending in a hw PCM are kept in memory only, and a setup
+ * which fails after a cache hit is retried without the cache.
+ */
+int snd_pcm_refine_cache_setup(snd_pcm_t *pcm, const char *name,
+			       snd_config_t *root, snd_config_t *conf,
+			       int external)
+{
+	unsigned long long key = FNV_BASIS;
+	const char *file, *str;
+	snd_pcm_t *slave;
+	snd_output_t *out;
+	snd_config_t *n;
+	size_t size;
+	char *buf;
+	int enable, err;
+
+	pcm->refine_key = 0;
+	pcm->refine_memory = 0;
+	refine_lock();
+	enable = refine_default(&file);
+	refine_unlock();
+	if (!enable && snd_config_search(root, "defaults.pcm.refine_cache", &n) >= 0)
+		enable = snd_config_get_bool(n) > 0;
+	if (!enable || external)
+		return 0;
+	if (snd_config_search(root, "defaults.pcm.refine_cache_file", &n) >= 0 &&
+	    snd_config_get_string(n, &str) >= 0 && *str)
+		file = str;
+
+	if (pcm->ops->get_slave) {
+		slave = pcm->ops->get_slave(pcm->op_arg);
+		if (!slave || !slave->refine_key)
+			return 0;
+		key = fnv(key, &slave->refine_key, sizeof(slave->refine_key));
+		pcm->refine_memory = slave->refine_memory;
+	} else if (pcm->type == SND_PCM_TYPE_HW) {
+		unsigned long long hw = hw_hash(pcm);
+
+		key = fnv(key, &hw, sizeof(hw));
+		pcm->refine_memory = 1;
+	} else if (pcm->type != SND_PCM_TYPE_NULL) {
+		return 0;
+	}
+	if (name)
+		key = fnv(key, name, strlen(name) + 1);
+	key = fnv(key, &pcm->type, sizeof(pcm->type));
+	key = fnv(key, &pcm->stream, sizeof(pcm->stream));
+	key = fnv(key, &pcm->mode, sizeof(pcm->mode));
+	err = snd_output_buffer_open(&out);
+	if (err < 0)
+		return err;
+	err = snd_config_save(conf, out);
+	if (err >= 0) {
+		size = snd_output_buffer_string(out, &buf);
+		key = fnv(key, buf, size);
+	}
+	snd_output_close(out);
+	if (err < 0)
+		return err;
+
+	refine_lock();
+	refine_init();
+	if (file && !refine_file) {
+		refine_file = strdup(file);
+		if (refine_file)
+			refine_load();
+	}
+	refine_unlock();
+	pcm->refine_key = key ? key : 1;
+	return 0;
+}
+
+/* returns 1 and the refined params when the refinement is known */
+int snd_pcm_refine_cache_lookup(snd_pcm_t *pcm, snd_pcm_hw_params_t *params,
+				int *result)
+{
+	unsigned long long hval = entry_hash(pcm->refine_key, params);
+	refine_entry_t *e;
+
+	refine_lock();
+	e = refine_find(pcm->refine_key, params, hval);
+	if (e) {
+		list_del(&e->lru);
+		list_add(&e->lru, &refine_lru);
+		*params = e->rec.out;
+		*result = e->rec.result;
+	}
+	refine_unlock();
+	return e != NULL;
+}
+
+void snd_pcm_refine_cache_store(snd_pcm_t *pcm,
+				const snd_pcm_hw_params_t *in,
+				const snd_pcm_hw_params_t *out, int result)
+{
+	refine_entry_t *e, *old;
+
+	/* a busy or vanished device tells nothing about the next time */
+	if (result < 0 && result != -EINVAL)
+		return;
+	e = malloc(sizeof(*e));
+	if (!e)
+		return;
+	memset(&e->rec, 0, sizeof(e->rec));
+	e->rec.key = pcm->refine_key;
+	e->rec.result = result;
+	e->rec.flags = pcm->refine_memory ? REFINE_REC_MEMORY : 0;
+	e->rec.in = *in;
+	e->rec.out = *out;
+	refine_lock();
+	old = refine_find(e->rec.key, in, entry_hash(e->rec.key, in));
+	if (old)
+		refine_remove(old);
+	refine_insert(e, 0);
+	if (!pcm->refine_memory)
+		refine_dirty = 1;
+	refine_unlock();
+}
+
+/* called locked */
+static void refine_drop_key(unsigned long long key)
+{
+	struct list_head *pos, *npos;
+	refine_entry_t *e;
+
+	list_for_each_safe(pos, npos, &refine_lru) {
+		e = list_entry(pos, refine_entry_t, lru);
+		if (e->rec.key == key) {
+			if (!(e->rec.flags & REFINE_REC_MEMORY))
+				refine_dirty = 1;
+			refine_remove(e);
+		}
+	}
+}
+
+/*
+ * forget the refinements of a PCM and of its slaves, its setup did not
+ * work out
+ */
+void snd_pcm_refine_cache_drop(snd_pcm_t *pcm)
+{
+	refine_lock();
+	while (pcm && pcm->refine_key) {
+		refine_drop_key(pcm->refine_key);
+		pcm = pcm->ops->get_slave ? pcm->ops->get_slave(pcm->op_arg) : NULL;
+	}
+	refine_unlock();
+}
+
+/* write the cache file when it has changed */
+int snd_pcm_refine_cache_sync(void)
+{
+	struct refine_file_header *hdr;
+	struct refine_record *rec;
+	struct list_head *pos;
+	char *path = NULL, *tmp;
+	unsigned int count;
+	size_t size;
+	ssize_t len;
+	int fd, err;
+
+	refine_lock();
+	if (!refine_dirty || !refine_file) {
+		refine_unlock();
+		return 0;
+	}
+	/* the hw refinements are not saved */
+	count = 0;
+	list_for_each(pos, &refine_lru) {
+		if (!(list_entry(pos, refine_entry_t, lru)->rec.flags & REFINE_REC_MEMORY))
+			count++;
+	}
+	size = sizeof(*hdr) + count * sizeof(*rec);
+	hdr = calloc(1, size);
+	tmp = malloc(strlen(refine_file) + 8);
+	if (!hdr || !tmp) {
+		refine_unlock();
+		free(hdr);
+		free(tmp);
+		return -ENOMEM;
+	}
+	memcpy(hdr->magic, REFINE_CACHE_MAGIC, sizeof(hdr->magic));
+	hdr->version = REFINE_CACHE_VERSION;
+	hdr->params_size = sizeof(snd_pcm_hw_params_t);
+	hdr->count = count;
+	rec = (struct refine_record *)(hdr + 1);
+	list_for_each(pos, &refine_lru) {
+		refine_entry_t *e = list_entry(pos, refine_entry_t, lru);
+
+		if (!(e->rec.flags & REFINE_REC_MEMORY))
+			*rec++ = e->rec;
+	}
+	sprintf(tmp, "%s.XXXXXX", refine_file);
+	path = refine_file;
+	refine_dirty = 0;
+	refine_unlock();
+
+	/* refine_file is never freed once set */
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		err = -errno;
+		SYSERR("cannot create %s", tmp);
+		goto _free;
+	}
+	len = write(fd, hdr, size);
+	if (len != (ssize_t)size) {
+		err = len < 0 ? -errno : -EIO;
+		SYSERR("cannot write %s", tmp);
+		close(fd);
+		unlink(tmp);
+		goto _free;
+	}
+	close(fd);
+	err = 0;
+	if (rename(tmp, path) < 0) {
+		err = -errno;
+		SYSERR("cannot rename %s to %s", tmp, path);
+		unlink(tmp);
+	}
+ _free:
+	free(hdr);
+	free(tmp);
+	return err;
+}
+
+#endif /* DOC_HIDDEN */
@@ -32,6 +32,7 @@
 #include "pcm_plugin.h"
 
 #include "plugin_ops.h"
+#include "pcm_route_simd.h"
 
 #ifndef PIC
 /* entry for static linking */
@@ -63,6 +64,8 @@ typedef struct {
 	enum {UINT64, FLOAT} sum_idx;
 	unsigned int get_idx;
 	unsigned int put_idx;
+	int get_float;		/* get_idx is an index of the float ops */
+	int put_float;		/* put_idx is an index of the float ops */
 	unsigned int conv_idx;
 	int use_getput;
 	unsigned int src_size;
@@ -70,6 +73,12 @@ typedef struct {
 	unsigned int nsrcs;
 	unsigned int ndsts;
 	snd_pcm_route_ttable_dst_t *dsts;
+	/* blocked mixing of the destinations with several sources */
+	unsigned int mix_nsrcs;		/* source channels loaded per block */
+	unsigned int *mix_chans;	/* their channel numbers */
+	unsigned int mix_block;		/* frames per block */
+	float *mix_buf;			/* mix_nsrcs source blocks */
+	int32_t *mix_out;		/* mixed block of one destination */
 } snd_pcm_route_params_t;
 
 
@@ -87,6 +96,10 @@ struct snd_pcm_route_ttable_dst {
 	unsigned int nsrcs;
 	snd_pcm_route_ttable_src_t* srcs;
 	route_f func;
+	/* blocked mixing, mix_srcs is NULL when not used */
+	unsigned int mix_nsrcs;
+	const float **mix_srcs;
+	float *mix_coefs;
 };
 
 typedef union {
@@ -397,6 +410,273 @@ static void snd_pcm_route_convert1_many(const snd_pcm_channel_area_t *dst_area,
 
 #endif /* DOC_HIDDEN */
 
+#if SND_PCM_PLUGIN_ROUTE_FLOAT
+
+/*
+ * blocked mixing: the ttable is compiled at hw_params time into a
+ * gather list per destination; each source channel is loaded once per
+ * block of frames and the destinations are mixed from the loaded
+ * blocks, instead of reading every source again for each destination
+ * and frame in snd_pcm_route_convert1_many()
+ */
+
+#define ROUTE_MIX_BYTES		(32 * 1024)	/* size of the source blocks */
+#define ROUTE_MIX_MAX_BLOCK	1024
+
+static route_simd_func_t *route_mix_kernel;
+
+static void route_mix_kernel_init(void)
+{
+	static int probed = 0;
+	const route_simd_kernel_t *k;
+
+	if (probed)
+		return;
+	for (k = route_simd_kernels; k->name; k++) {
+		if (k->available()) {
+			route_mix_kernel = k->mix;
+			break;
+		}
+	}
+	probed = 1;
+}
+
+static void route_mix_free(snd_pcm_route_params_t *params)
+{
+	unsigned int dst_channel;
+
+	for (dst_channel = 0; dst_channel < params->ndsts; ++dst_channel) {
+		snd_pcm_route_ttable_dst_t *d = &params->dsts[dst_channel];
+		free(d->mix_srcs);
+		free(d->mix_coefs);
+		d->mix_srcs = NULL;
+		d->mix_coefs = NULL;
+		d->mix_nsrcs = 0;
+	}
+	free(params->mix_chans);
+	free(params->mix_buf);
+	free(params->mix_out);
+	params->mix_chans = NULL;
+	params->mix_buf = NULL;
+	params->mix_out = NULL;
+	params->mix_nsrcs = 0;
+}
+
+/*
+ * the destinations which snd_pcm_route_convert1_many() has to mix; with
+ * float samples on either side all the destinations are mixed, as the
+ * other conversion functions take only linear formats
+ */
+static unsigned int route_mix_count(const snd_pcm_route_params_t *params,
+				    const snd_pcm_route_ttable_dst_t *d,
+				    unsigned int src_channels)
+{
+	unsigned int srcidx, n = 0, first = 0;
+
+	for (srcidx = 0; srcidx < d->nsrcs; srcidx++) {
+		if (d->srcs[srcidx].channel >= (int)src_channels)
+			continue;
+		if (!n)
+			first = srcidx;
+		n++;
+	}
+	if (n == 1 && d->srcs[first].as_int == SND_PCM_PLUGIN_ROUTE_RESOLUTION &&
+	    !params->get_float && !params->put_float)
+		return 0;
+	return n;
+}
+
+static int route_mix_init(snd_pcm_route_params_t *params,
+			  unsigned int src_channels)
+{
+	unsigned int dst_channel, srcidx, block;
+	int *map;
+
+	route_mix_free(params);
+	map = malloc(src_channels * sizeof(*map));
+	params->mix_chans = malloc(src_channels * sizeof(*params->mix_chans));
+	if (!map || !params->mix_chans)
+		goto _nomem;
+	memset(map, 0xff, src_channels * sizeof(*map));
+	for (dst_channel = 0; dst_channel < params->ndsts; ++dst_channel) {
+		snd_pcm_route_ttable_dst_t *d = &params->dsts[dst_channel];
+		if (!route_mix_count(params, d, src_channels))
+			continue;
+		for (srcidx = 0; srcidx < d->nsrcs; srcidx++) {
+			unsigned int channel = d->srcs[srcidx].channel;
+			if (channel < src_channels && map[channel] < 0) {
+				map[channel] = params->mix_nsrcs;
+				params->mix_chans[params->mix_nsrcs++] = channel;
+			}
+		}
+	}
+	if (!params->mix_nsrcs) {
+		free(map);
+		route_mix_free(params);
+		return 0;
+	}
+
+	block = ROUTE_MIX_BYTES / (params->mix_nsrcs * sizeof(float));
+	block -= block % ROUTE_SIMD_PAD;
+	if (block < 4 * ROUTE_SIMD_PAD)
+		block = 4 * ROUTE_SIMD_PAD;
+	else if (block > ROUTE_MIX_MAX_BLOCK)
+		block = ROUTE_MIX_MAX_BLOCK;
+	params->mix_block = block;
+	params->mix_buf = calloc(params->mix_nsrcs * block, sizeof(float));
+	params->mix_out = malloc(block * sizeof(int32_t));
+	if (!params->mix_buf || !params->mix_out)
+		goto _nomem;
+
+	for (dst_channel = 0; dst_channel < params->ndsts; ++dst_channel) {
+		snd_pcm_route_ttable_dst_t *d = &params->dsts[dst_channel];
+		unsigned int n = route_mix_count(params, d, src_channels);
+		if (!n)
+			continue;
+		d->mix_srcs = malloc(n * sizeof(*d->mix_srcs));
+		d->mix_coefs = malloc(n * sizeof(*d->mix_coefs));
+		if (!d->mix_srcs || !d->mix_coefs)
+			goto _nomem;
+		for (srcidx = 0; srcidx < d->nsrcs; srcidx++) {
+			unsigned int channel = d->srcs[srcidx].channel;
+			if (channel >= src_channels)
+				continue;
+			d->mix_srcs[d->mix_nsrcs] = params->mix_buf +
+				map[channel] * block;
+			/* the non attenuated sum adds the plain samples */
+			d->mix_coefs[d->mix_nsrcs] = d->att ?
+				d->srcs[srcidx].as_float : 1.0f;
+			d->mix_nsrcs++;
+		}
+	}
+	free(map);
+	route_mix_kernel_init();
+	return 0;
+
+ _nomem:
+	free(map);
+	route_mix_free(params);
+	return -ENOMEM;
+}
+
+static void route_mix_load(const snd_pcm_route_params_t *params, float *buf,
+			   const snd_pcm_channel_area_t *src_area,
+			   snd_pcm_uframes_t src_offset, unsigned int frames)
+{
+#define GET32_LABELS
+#ifdef SND_PCM_ROUTE_FLOAT_FORMATS
+#define GET32F_LABELS
+#endif
+#include "plugin_ops.h"
+#undef GET32_LABELS
+#undef GET32F_LABELS
+	void *get32 = get32_labels[params->get_idx];
+	const char *src = snd_pcm_channel_area_addr(src_area, src_offset);
+	int src_step = snd_pcm_channel_area_step(src_area);
+	int32_t sample = 0;
+	unsigned int n;
+#ifdef SND_PCM_ROUTE_FLOAT_FORMATS
+	snd_tmp_float_t tmp_float;
+	snd_tmp_double_t tmp_double;
+
+	if (params->get_float)
+		get32 = get32float_labels[params->get_idx];
+#endif
+	for (n = 0; n < frames; n++) {
+		goto *get32;
+#define GET32_END after_get
+#ifdef SND_PCM_ROUTE_FLOAT_FORMATS
+#define GET32F_END after_get
+#endif
+#include "plugin_ops.h"
+#undef GET32_END
+#undef GET32F_END
+	after_get:
+		buf[n] = sample;
+		src += src_step;
+	}
+}
+
+static void route_mix_store(const snd_pcm_route_params_t *params,
+			    const snd_pcm_channel_area_t *dst_area,
+			    snd_pcm_uframes_t dst_offset, const int32_t *buf,
+			    unsigned int frames)
+{
+#define PUT32_LABELS
+#ifdef SND_PCM_ROUTE_FLOAT_FORMATS
+#define PUT32F_LABELS
+#endif
+#include "plugin_ops.h"
+#undef PUT32_LABELS
+#undef PUT32F_LABELS
+	void *put32 = put32_labels[params->put_idx];
+	char *dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+	int dst_step = snd_pcm_channel_area_step(dst_area);
+	int32_t sample;
+	unsigned int n;
+#ifdef SND_PCM_ROUTE_FLOAT_FORMATS
+	snd_tmp_float_t tmp_float;
+	snd_tmp_double_t tmp_double;
+
+	if (params->put_float)
+		put32 = put32float_labels[params->put_idx];
+#endif
+	for (n = 0; n < frames; n++) {
+		sample = buf[n];
+		goto *put32;
+#define PUT32_END after_put32
+#ifdef SND_PCM_ROUTE_FLOAT_FORMATS
+#define PUT32F_END after_put32
+#endif
+#include "plugin_ops.h"
+#undef PUT32_END
+#undef PUT32F_END
+	after_put32:
+		dst += dst_step;
+	}
+}
+
+static void route_mix_convert(const snd_pcm_channel_area_t *dst_areas,
+			      snd_pcm_uframes_t dst_offset,
+			      const snd_pcm_channel_area_t *src_areas,
+			      snd_pcm_uframes_t src_offset,
+			      unsigned int dst_channels,
+			      snd_pcm_uframes_t frames,
+			      const snd_pcm_route_params_t *params)
+{
+	unsigned int block = params->mix_block;
+	unsigned int dst_channel, srcidx, n;
+	snd_pcm_uframes_t done;
+
+	if (dst_channels > params->ndsts)
+		dst_channels = params->ndsts;
+	for (done = 0; done < frames; done += n) {
+		n = frames - done;
+		if (n > block)
+			n = block;
+		for (srcidx = 0; srcidx < params->mix_nsrcs; srcidx++)
+			route_mix_load(params, params->mix_buf + srcidx * block,
+				       &src_areas[params->mix_chans[srcidx]],
+				       src_offset + done, n);
+		for (dst_channel = 0; dst_channel < dst_channels; dst_channel++) {
+			const snd_pcm_route_ttable_dst_t *d = &params->dsts[dst_channel];
+			if (!d->mix_srcs)
+				continue;
+			if (route_mix_kernel)
+				route_mix_kernel((n + ROUTE_SIMD_PAD - 1) & ~(ROUTE_SIMD_PAD - 1),
+						 params->mix_out, d->mix_srcs,
+						 d->mix_coefs, d->mix_nsrcs);
+			else
+				route_c_mix(n, params->mix_out, d->mix_srcs,
+					    d->mix_coefs, d->mix_nsrcs);
+			route_mix_store(params, &dst_areas[dst_channel],
+					dst_offset + done, params->mix_out, n);
+		}
+	}
+}
+
+#endif /* SND_PCM_PLUGIN_ROUTE_FLOAT */
+
 static void snd_pcm_route_convert(const snd_pcm_channel_area_t *dst_areas,
 				  snd_pcm_uframes_t dst_offset,
 				  const snd_pcm_channel_area_t *src_areas,
@@ -410,6 +690,12 @@ static void snd_pcm_route_convert(const snd_pcm_channel_area_t *dst_areas,
 	snd_pcm_route_ttable_dst_t *dstp;
 	const snd_pcm_channel_area_t *dst_area;
 
+#if SND_PCM_PLUGIN_ROUTE_FLOAT
+	if (params->mix_nsrcs)
+		route_mix_convert(dst_areas, dst_offset,
+				  src_areas, src_offset,
+				  dst_channels, frames, params);
+#endif
 	dstp = params->dsts;
 	dst_area = dst_areas;
 	for (dst_channel = 0; dst_channel < dst_channels; ++dst_channel) {
@@ -418,6 +704,10 @@ static void snd_pcm_route_convert(const snd_pcm_channel_area_t *dst_areas,
 						    src_areas, src_offset,
 						    src_channels,
 						    frames, dstp, params);
+#if SND_PCM_PLUGIN_ROUTE_FLOAT
+		else if (dstp->mix_srcs)
+			; /* done by route_mix_convert() */
+#endif
 		else
 			dstp->func(dst_area, dst_offset,
 				   src_areas, src_offset,
@@ -434,6 +724,9 @@ static int snd_pcm_route_close(snd_pcm_t *pcm)
 	snd_pcm_route_params_t *params = &route->params;
 	unsigned int dst_channel;
 
+#if SND_PCM_PLUGIN_ROUTE_FLOAT
+	route_mix_free(params);
+#endif
 	if (params->dsts) {
 		for (dst_channel = 0; dst_channel < params->ndsts; ++dst_channel) {
 			free(params->dsts[dst_channel].srcs);
@@ -449,6 +742,11 @@ static int snd_pcm_route_hw_refine_cprepare(snd_pcm_t *pcm ATTRIBUTE_UNUSED, snd
 	int err;
 	snd_pcm_access_mask_t access_mask = { SND_PCM_ACCBIT_SHM };
 	snd_pcm_format_mask_t format_mask = { SND_PCM_FMTBIT_LINEAR };
+#ifdef SND_PCM_ROUTE_FLOAT_FORMATS
+	snd_pcm_format_mask_t float_mask = { SND_PCM_FMTBIT_FLOAT };
+
+	snd_mask_union((snd_mask_t *)&format_mask, (const snd_mask_t *)&float_mask);
+#endif
 	err = _snd_pcm_hw_param_set_mask(params, SND_PCM_HW_PARAM_ACCESS,
 					 &access_mask);
 	if (err < 0)
@@ -548,6 +846,9 @@ static int snd_pcm_route_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 	snd_pcm_route_t *route = pcm->private_data;
 	snd_pcm_t *slave = route->plug.gen.slave;
 	snd_pcm_format_t src_format, dst_format;
+#if SND_PCM_PLUGIN_ROUTE_FLOAT
+	unsigned int src_channels;
+#endif
 	int err = snd_pcm_hw_params_slave(pcm, params,
 					  snd_pcm_route_hw_refine_cchange,
 					  snd_pcm_route_hw_refine_sprepare,
@@ -565,25 +866,60 @@ static int snd_pcm_route_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 	}
 	if (err < 0)
 		return err;
-	/* 3 bytes or 20-bit formats? */
-	route->params.use_getput =
-		(snd_pcm_format_physical_width(src_format) + 7) / 8 == 3 ||
-		(snd_pcm_format_physical_width(dst_format) + 7) / 8 == 3 ||
-		snd_pcm_format_width(src_format) == 20 ||
-		snd_pcm_format_width(dst_format) == 20;
-	route->params.get_idx = snd_pcm_linear_get_index(src_format, SND_PCM_FORMAT_S32);
-	route->params.put_idx = snd_pcm_linear_put_index(SND_PCM_FORMAT_S32, dst_format);
-	route->params.conv_idx = snd_pcm_linear_convert_index(src_format, dst_format);
+#ifdef SND_PCM_ROUTE_FLOAT_FORMATS
+	/* float samples are converted from and to S32 by the mixing code */
+	route->params.get_float = snd_pcm_format_float(src_format) == 1;
+	route->params.put_float = snd_pcm_format_float(dst_format) == 1;
+	if (route->params.get_float || route->params.put_float) {
+		route->params.use_getput = 0;
+		route->params.conv_idx = 0;
+		route->params.get_idx = route->params.get_float ?
+			snd_pcm_lfloat_get_s32_index(src_format) :
+			snd_pcm_linear_get_index(src_format, SND_PCM_FORMAT_S32);
+		route->params.put_idx = route->params.put_float ?
+			snd_pcm_lfloat_put_s32_index(dst_format) :
+			snd_pcm_linear_put_index(SND_PCM_FORMAT_S32, dst_format);
+	} else
+#endif
+	{
+		/* 3 bytes or 20-bit formats? */
+		route->params.use_getput =
+			(snd_pcm_format_physical_width(src_format) + 7) / 8 == 3 ||
+			(snd_pcm_format_physical_width(dst_format) + 7) / 8 == 3 ||
+			snd_pcm_format_width(src_format) == 20 ||
+			snd_pcm_format_width(dst_format) == 20;
+		route->params.get_idx = snd_pcm_linear_get_index(src_format, SND_PCM_FORMAT_S32);
+		route->params.put_idx = snd_pcm_linear_put_index(SND_PCM_FORMAT_S32, dst_format);
+		route->params.conv_idx = snd_pcm_linear_convert_index(src_format, dst_format);
+	}
 	route->params.src_size = snd_pcm_format_width(src_format) / 8;
 	route->params.dst_sfmt = dst_format;
 #if SND_PCM_PLUGIN_ROUTE_FLOAT
 	route->params.sum_idx = FLOAT;
+	if (pcm->stream == SND_PCM_STREAM_PLAYBACK)
+		err = INTERNAL(snd_pcm_hw_params_get_channels)(params, &src_channels);
+	else
+		src_channels = slave->channels;
+	if (err >= 0)
+		err = route_mix_init(&route->params, src_channels);
+	if (err < 0)
+		return err;
 #else
 	route->params.sum_idx = UINT64;
 #endif
 	return 0;
 }
 
+static int snd_pcm_route_hw_free(snd_pcm_t *pcm)
+{
+#if SND_PCM_PLUGIN_ROUTE_FLOAT
+	snd_pcm_route_t *route = pcm->private_data;
+
+	route_mix_free(&route->params);
+#endif
+	return snd_pcm_generic_hw_free(pcm);
+}
+
 static snd_pcm_uframes_t
 snd_pcm_route_write_areas(snd_pcm_t *pcm,
 			  const snd_pcm_channel_area_t *areas,
@@ -905,7 +1241,7 @@ static const snd_pcm_ops_t snd_pcm_route_ops = {
 	.info = snd_pcm_generic_info,
 	.hw_refine = snd_pcm_route_hw_refine,
 	.hw_params = snd_pcm_route_hw_params,
-	.hw_free = snd_pcm_generic_hw_free,
+	.hw_free = snd_pcm_route_hw_free,
 	.sw_params = snd_pcm_generic_sw_params,
 	.channel_info = snd_pcm_generic_channel_info,
 	.dump = snd_pcm_route_dump,
@@ -916,6 +1252,7 @@ static const snd_pcm_ops_t snd_pcm_route_ops = {
 	.query_chmaps = snd_pcm_route_query_chmaps,
 	.get_chmap = snd_pcm_route_get_chmap,
 	.set_chmap = NULL, /* NYI */
+	.get_slave = snd_pcm_generic_get_slave,
 };
 
 static int route_load_ttable(snd_pcm_route_params_t *params, snd_pcm_stream_t stream,
@@ -988,6 +1325,16 @@ static int route_load_ttable(snd_pcm_route_params_t *params, snd_pcm_stream_t st
 	return 0;
 }
 
+/* the slave formats the plugin converts to */
+static int route_format_supported(snd_pcm_format_t format)
+{
+#ifdef SND_PCM_ROUTE_FLOAT_FORMATS
+	if (snd_pcm_format_float(format) == 1)
+		return 1;
+#endif
+	return snd_pcm_format_linear(format) == 1;
+}
+
 /**
  * \brief Creates a new Route & Volume PCM
  * \param pcmp Returns created PCM handle
@@ -1017,7 +1364,7 @@ int snd_pcm_route_open(snd_pcm_t **pcmp, const char *name,
 	int err;
 	assert(pcmp && slave && ttable);
 	if (sformat != SND_PCM_FORMAT_UNKNOWN && 
-	    snd_pcm_format_linear(sformat) != 1)
+	    !route_format_supported(sformat))
 		return -EINVAL;
 	route = calloc(1, sizeof(snd_pcm_route_t));
 	if (!route) {
@@ -1230,11 +1577,19 @@ int snd_pcm_route_load_ttable(snd_config_t *tt, snd_pcm_route_ttable_entry_t *tt
 \section pcm_plugins_route Plugin: Route & Volume
 
 This plugin converts channels and applies volume during the conversion.
-The format and rate must match for both of them.
+The rate must match for both of them.  The sample format is converted
+in the same pass, between any linear formats and, when the library is
+built with float routing, float formats as well.
 
 SCHANNEL can be a channel name instead of a number (e g FL, LFE).
 If so, a matching channel map will be selected for the slave.
 
+The destination channels which mix several sources (or take one source
+with a volume below 1.0) are computed block-wise: each used source channel
+is read once per block of frames and the destinations are summed from
+these blocks with the vectorized kernels the CPU supports.  The result is
+the same as summing frame by frame.
+
 \code
 pcm.name {
         type route              # Route & Volume conversion PCM
@@ -1328,9 +1683,9 @@ int _snd_pcm_route_open(snd_pcm_t **pcmp, const char *name,
 	if (err < 0)
 		return err;
 	if (sformat != SND_PCM_FORMAT_UNKNOWN &&
-	    snd_pcm_format_linear(sformat) != 1) {
+	    !route_format_supported(sformat)) {
 	    	snd_config_delete(sconf);
-		SNDERR("slave format is not linear");
+		SNDERR("slave format is not supported");
 		return -EINVAL;
 	}
 
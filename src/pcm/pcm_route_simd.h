@@ -0,0 +1,167 @@
+/*
+ *  Route & Volume Plugin - vectorized mixing kernels
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * One destination channel of the route plugin for a block of frames:
+ * the source channels were loaded into float blocks (the S32 sample
+ * value), each output sample is the sum of src[k][i] * coef[k] added
+ * in the order of k, rounded to the nearest integer and saturated to
+ * S32.  This is the float sum of snd_pcm_route_convert1_many().
+ *
+ * The vector kernels take a multiple of ROUTE_SIMD_PAD frames, the
+ * caller pads its blocks accordingly; the scalar version takes any
+ * number of frames.  The kernels multiply and add separately like the
+ * scalar code built for the x86 baseline, which has no fma, so all of
+ * them give the same result.  Other architectures use the scalar
+ * version, whatever the compiler makes of it there.
+ */
+
+#include <stdint.h>
+#include <math.h>
+
+#define ROUTE_SIMD_PAD		8
+
+typedef void (route_simd_func_t)(unsigned int frames, int32_t *dst,
+				 const float *const *src, const float *coef,
+				 unsigned int nsrcs);
+
+/*
+ * scalar version
+ */
+static inline int32_t route_float_to_s32(float sum)
+{
+	if (sum >= 2147483648.0f)
+		return 0x7fffffff;
+	if (sum < -2147483648.0f)
+		return (int32_t)0x80000000;
+	return (int32_t)rintf(sum);
+}
+
+static void route_c_mix(unsigned int frames, int32_t *dst,
+			const float *const *src, const float *coef,
+			unsigned int nsrcs)
+{
+	unsigned int i, k;
+
+	for (i = 0; i < frames; i++) {
+		float sum = 0.0f;
+
+		for (k = 0; k < nsrcs; k++)
+			sum += src[k][i] * coef[k];
+		dst[i] = route_float_to_s32(sum);
+	}
+}
+
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+#if defined(__x86_64__) || defined(__i386__)
+#define ROUTE_SIMD_X86
+#endif
+#endif
+
+#ifdef ROUTE_SIMD_X86
+#include <immintrin.h>
+
+#define ROUTE_SIMD_TARGET(isa)	__attribute__((target(isa)))
+
+/* the current rounding mode is round to nearest, as for rintf() */
+static inline __attribute__((always_inline)) ROUTE_SIMD_TARGET("sse2")
+__m128i route_sse2_float_to_s32(__m128 sum)
+{
+	__m128i over = _mm_castps_si128(_mm_cmpge_ps(sum, _mm_set1_ps(2147483648.0f)));
+
+	/* cvtps gives 0x80000000 for anything out of range */
+	return _mm_or_si128(_mm_andnot_si128(over, _mm_cvtps_epi32(sum)),
+			    _mm_and_si128(over, _mm_set1_epi32(0x7fffffff)));
+}
+
+static ROUTE_SIMD_TARGET("sse2")
+void route_sse2_mix(unsigned int frames, int32_t *dst, const float *const *src,
+		    const float *coef, unsigned int nsrcs)
+{
+	unsigned int i, k;
+
+	for (i = 0; i < frames; i += 8) {
+		__m128 c = _mm_set1_ps(coef[0]);
+		__m128 s0 = _mm_mul_ps(_mm_loadu_ps(src[0] + i), c);
+		__m128 s1 = _mm_mul_ps(_mm_loadu_ps(src[0] + i + 4), c);
+
+		for (k = 1; k < nsrcs; k++) {
+			c = _mm_set1_ps(coef[k]);
+			s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(src[k] + i), c));
+			s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(src[k] + i + 4), c));
+		}
+		_mm_storeu_si128((__m128i *)(dst + i), route_sse2_float_to_s32(s0));
+		_mm_storeu_si128((__m128i *)(dst + i + 4), route_sse2_float_to_s32(s1));
+	}
+}
+
+static ROUTE_SIMD_TARGET("avx2")
+void route_avx2_mix(unsigned int frames, int32_t *dst, const float *const *src,
+		    const float *coef, unsigned int nsrcs)
+{
+	const __m256 limit = _mm256_set1_ps(2147483648.0f);
+	unsigned int i, k;
+
+	for (i = 0; i < frames; i += 8) {
+		__m256 sum = _mm256_mul_ps(_mm256_loadu_ps(src[0] + i),
+					   _mm256_set1_ps(coef[0]));
+		__m256i over;
+
+		for (k = 1; k < nsrcs; k++)
+			sum = _mm256_add_ps(sum,
+				_mm256_mul_ps(_mm256_loadu_ps(src[k] + i),
+					      _mm256_set1_ps(coef[k])));
+		over = _mm256_castps_si256(_mm256_cmp_ps(sum, limit, _CMP_GE_OQ));
+		_mm256_storeu_si256((__m256i *)(dst + i),
+			_mm256_blendv_epi8(_mm256_cvtps_epi32(sum),
+					   _mm256_set1_epi32(0x7fffffff), over));
+	}
+}
+
+static int route_simd_have_sse2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+}
+
+static int route_simd_have_avx2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+#endif /* ROUTE_SIMD_X86 */
+
+/*
+ * kernel table, ordered by preference
+ */
+typedef struct {
+	const char *name;
+	int (*available)(void);
+	route_simd_func_t *mix;
+} route_simd_kernel_t;
+
+static const route_simd_kernel_t route_simd_kernels[] = {
+#ifdef ROUTE_SIMD_X86
+	{ "avx2", route_simd_have_avx2, route_avx2_mix },
+	{ "sse2", route_simd_have_sse2, route_sse2_mix },
+#endif
+	{ NULL, NULL, NULL }
+};
@@ -34,6 +34,8 @@
 #include <signal.h>
 #include <math.h>
 #include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <poll.h>
 #include <pthread.h>
 #include "pcm_local.h"
@@ -86,16 +88,19 @@ typedef struct {
 	unsigned int running_count;
 	snd_pcm_uframes_t safety_threshold;
 	snd_pcm_uframes_t silence_frames;
-	snd_pcm_sw_params_t sw_params;
 	snd_pcm_uframes_t hw_ptr;
-	int poll[2];
-	int polling;
+	int wake_fd;			/* eventfd kicking the thread */
+	int timer_fd;			/* fires at the next client event */
+	int timer_armed;
+	snd_pcm_uframes_t wakeup_ptr;	/* slave hw_ptr the timer is armed for */
+	snd_pcm_uframes_t armed_hw_ptr;	/* slave hw_ptr when the timer was armed */
+	int stepped;			/* slave hw_ptr moves in period steps */
+	int dirty;			/* clients published positions to commit */
 	pthread_t thread;
 	pthread_mutex_t mutex;
 #ifdef MUTEX_DEBUG
 	char *mutex_holder;
 #endif
-	pthread_cond_t poll_cond;
 } snd_pcm_share_slave_t;
 
 typedef struct {
@@ -109,6 +114,7 @@ typedef struct {
 	snd_pcm_state_t state;
 	snd_pcm_uframes_t hw_ptr;
 	snd_pcm_uframes_t appl_ptr;
+	snd_pcm_uframes_t committed_ptr;	/* appl_ptr seen by the slave */
 	int ready;
 	int client_socket;
 	int slave_socket;
@@ -117,6 +123,7 @@ typedef struct {
 #endif /* DOC_HIDDEN */
 
 static void _snd_pcm_share_stop(snd_pcm_t *pcm, snd_pcm_state_t state);
+static void _snd_pcm_share_update(snd_pcm_t *pcm);
 
 static snd_pcm_uframes_t snd_pcm_share_slave_avail(snd_pcm_share_slave_t *slave)
 {
@@ -338,6 +345,8 @@ static snd_pcm_uframes_t _snd_pcm_share_slave_missing(snd_pcm_share_slave_t *sla
 {
 	snd_pcm_uframes_t missing = INT_MAX;
 	struct list_head *i;
+	if (!slave->running_count)
+		return INT_MAX;
 	/* snd_pcm_sframes_t avail = */ snd_pcm_avail_update(slave->pcm);
 	slave->hw_ptr = *slave->pcm->hw.ptr;
 	list_for_each(i, &slave->clients) {
@@ -350,108 +359,208 @@ static snd_pcm_uframes_t _snd_pcm_share_slave_missing(snd_pcm_share_slave_t *sla
 	return missing;
 }
 
+/*
+ * slave hw_ptr missing frames away, rounded up to the period boundary
+ * when the slave hw_ptr only moves at the period interrupts
+ */
+static snd_pcm_uframes_t snd_pcm_share_wakeup_ptr(snd_pcm_share_slave_t *slave,
+						  snd_pcm_uframes_t missing)
+{
+	snd_pcm_t *spcm = slave->pcm;
+	snd_pcm_uframes_t hw_ptr;
+	hw_ptr = slave->hw_ptr + missing;
+	if (slave->stepped)
+		hw_ptr += spcm->period_size - 1;
+	if (hw_ptr >= spcm->boundary)
+		hw_ptr -= spcm->boundary;
+	if (slave->stepped)
+		hw_ptr -= hw_ptr % spcm->period_size;
+	return hw_ptr;
+}
+
+static snd_pcm_uframes_t snd_pcm_share_frames_to(snd_pcm_share_slave_t *slave,
+						 snd_pcm_uframes_t hw_ptr)
+{
+	snd_pcm_sframes_t frames = hw_ptr - slave->hw_ptr;
+	if (frames < 0)
+		frames += slave->pcm->boundary;
+	return frames;
+}
+
+/* Warning: take the mutex before to call this */
+/* arm the timer for the next event, or disarm it when there is none */
+static void _snd_pcm_share_slave_arm(snd_pcm_share_slave_t *slave,
+				     snd_pcm_uframes_t missing)
+{
+	snd_pcm_t *spcm = slave->pcm;
+	struct itimerspec spec;
+	memset(&spec, 0, sizeof(spec));
+	slave->timer_armed = missing < INT_MAX;
+	slave->armed_hw_ptr = slave->hw_ptr;
+	if (slave->timer_armed) {
+		unsigned long long nsec, min_nsec;
+		slave->wakeup_ptr = snd_pcm_share_wakeup_ptr(slave, missing);
+		nsec = (unsigned long long)snd_pcm_share_frames_to(slave, slave->wakeup_ptr) *
+			1000000000ULL / spcm->rate;
+		/* not sooner than an eighth of a period, so that the events
+		 * a few frames away don't make it spin; this also bounds
+		 * the wakeups until a stepping slave is detected */
+		min_nsec = (unsigned long long)spcm->period_size *
+			1000000000ULL / spcm->rate / 8;
+		if (nsec < min_nsec)
+			nsec = min_nsec;
+		spec.it_value.tv_sec = nsec / 1000000000ULL;
+		spec.it_value.tv_nsec = nsec % 1000000000ULL;
+	}
+	timerfd_settime(slave->timer_fd, 0, &spec, NULL);
+}
+
+static void snd_pcm_share_slave_kick(snd_pcm_share_slave_t *slave)
+{
+	uint64_t one = 1;
+	if (write(slave->wake_fd, &one, sizeof(one)) < 0)
+		SYSMSG("cannot wake up the share thread");
+}
+
+/* Warning: take the mutex before to call this */
+/* pass the positions published by the clients on to the slave */
+static int _snd_pcm_share_slave_commit(snd_pcm_share_slave_t *slave)
+{
+	snd_pcm_t *spcm = slave->pcm;
+	struct list_head *i;
+	snd_pcm_sframes_t frames;
+	int changed = 0, res = 0;
+	list_for_each(i, &slave->clients) {
+		snd_pcm_share_t *share = list_entry(i, snd_pcm_share_t, list);
+		snd_pcm_uframes_t appl_ptr;
+		if (share->state != SND_PCM_STATE_RUNNING)
+			continue;
+		appl_ptr = __atomic_load_n(&share->appl_ptr, __ATOMIC_ACQUIRE);
+		if (appl_ptr == share->committed_ptr)
+			continue;
+		if (share->pcm->stream == SND_PCM_STREAM_PLAYBACK) {
+			frames = *spcm->appl.ptr - share->committed_ptr;
+			if (frames > (snd_pcm_sframes_t)spcm->buffer_size)
+				frames -= spcm->boundary;
+			else if (frames < -(snd_pcm_sframes_t)spcm->buffer_size)
+				frames += spcm->boundary;
+			if (frames > 0) {
+				/* Latecomer PCM, the slave may have played
+				 * part of it already; the others still count */
+				frames = snd_pcm_rewind(spcm, frames);
+				if (frames < 0 && !res)
+					res = frames;
+			}
+		}
+		share->committed_ptr = appl_ptr;
+		changed = 1;
+	}
+	if (!changed)
+		return res;
+	frames = _snd_pcm_share_slave_forward(slave);
+	if (frames > 0) {
+		snd_pcm_sframes_t err;
+		err = snd_pcm_mmap_commit(spcm, snd_pcm_mmap_offset(spcm), frames);
+		if (err < 0) {
+			SYSMSG("snd_pcm_mmap_commit error");
+			return err;
+		}
+		if (err != frames) {
+			SYSMSG("commit returns %ld for size %ld", err, frames);
+			return err;
+		}
+	}
+	list_for_each(i, &slave->clients) {
+		snd_pcm_share_t *share = list_entry(i, snd_pcm_share_t, list);
+		if (share->state == SND_PCM_STATE_RUNNING)
+			_snd_pcm_share_update(share->pcm);
+	}
+	return res;
+}
+
+/*
+ * Release the slave mutex.  Clients publish their positions without
+ * taking it and only try to lock it, so whoever holds the mutex commits
+ * the published positions before it lets go, and takes it again if
+ * more were published while it was releasing.
+ */
+static int snd_pcm_share_slave_unlock(snd_pcm_share_slave_t *slave)
+{
+	int err, res = 0;
+	for (;;) {
+		while (__atomic_exchange_n(&slave->dirty, 0, __ATOMIC_SEQ_CST)) {
+			err = _snd_pcm_share_slave_commit(slave);
+			if (err < 0 && !res)
+				res = err;
+		}
+		Pthread_mutex_unlock(&slave->mutex);
+		if (!__atomic_load_n(&slave->dirty, __ATOMIC_SEQ_CST) ||
+		    pthread_mutex_trylock(&slave->mutex))
+			return res;
+	}
+}
+
+/*
+ * The thread sleeps on a timer armed for the next event of any client
+ * (ready, xrun, drain silencing, slave safety commit) and on an eventfd
+ * the clients kick when they move an event closer.
+ */
 static void *snd_pcm_share_thread(void *data)
 {
 	snd_pcm_share_slave_t *slave = data;
-	snd_pcm_t *spcm = slave->pcm;
 	struct pollfd pfd[2];
-	int err;
+	uint64_t count;
+	int expired = 0;
 
-	pfd[0].fd = slave->poll[0];
+	pfd[0].fd = slave->wake_fd;
 	pfd[0].events = POLLIN;
-	err = snd_pcm_poll_descriptors(spcm, &pfd[1], 1);
-	if (err != 1) {
-		SNDERR("invalid poll descriptors %d", err);
-		return NULL;
-	}
+	pfd[1].fd = slave->timer_fd;
+	pfd[1].events = POLLIN;
 	Pthread_mutex_lock(&slave->mutex);
-	err = pipe(slave->poll);
-	if (err < 0) {
-		SYSERR("can't create a pipe");
-		Pthread_mutex_unlock(&slave->mutex);
-		return NULL;
-	}
 	while (slave->open_count > 0) {
-		snd_pcm_uframes_t missing;
-		// printf("begin min_missing\n");
-		missing = _snd_pcm_share_slave_missing(slave);
-		// printf("min_missing=%ld\n", missing);
-		if (missing < INT_MAX) {
-			snd_pcm_uframes_t hw_ptr;
-			snd_pcm_sframes_t avail_min;
-			hw_ptr = slave->hw_ptr + missing;
-			hw_ptr += spcm->period_size - 1;
-			if (hw_ptr >= spcm->boundary)
-				hw_ptr -= spcm->boundary;
-			hw_ptr -= hw_ptr % spcm->period_size;
-			avail_min = hw_ptr - *spcm->appl.ptr;
-			if (spcm->stream == SND_PCM_STREAM_PLAYBACK)
-				avail_min += spcm->buffer_size;
-			if (avail_min < 0)
-				avail_min += spcm->boundary;
-			// printf("avail_min=%d\n", avail_min);
-			if ((snd_pcm_uframes_t)avail_min != spcm->avail_min) {
-				snd_pcm_sw_params_set_avail_min(spcm, &slave->sw_params, avail_min);
-				err = snd_pcm_sw_params(spcm, &slave->sw_params);
-				if (err < 0) {
-					SYSERR("snd_pcm_sw_params error");
-					Pthread_mutex_unlock(&slave->mutex);
-					return NULL;
-				}
-			}
-			slave->polling = 1;
-			Pthread_mutex_unlock(&slave->mutex);
-			err = poll(pfd, 2, -1);
-			Pthread_mutex_lock(&slave->mutex);
-			if (pfd[0].revents & POLLIN) {
-				char buf[1];
-				read(pfd[0].fd, buf, 1);
-			}
-		} else {
-			slave->polling = 0;
-			pthread_cond_wait(&slave->poll_cond, &slave->mutex);
+		snd_pcm_uframes_t missing = _snd_pcm_share_slave_missing(slave);
+		/* the timer expired and the slave did not move since it was
+		 * armed: its hw_ptr follows the period interrupts */
+		if (expired && slave->running_count &&
+		    slave->hw_ptr == slave->armed_hw_ptr)
+			slave->stepped = 1;
+		_snd_pcm_share_slave_arm(slave, missing);
+		snd_pcm_share_slave_unlock(slave);
+		if (poll(pfd, 2, -1) < 0 && errno != EINTR) {
+			SYSERR("poll error");
+			return NULL;
 		}
+		if (pfd[0].revents & POLLIN)
+			read(pfd[0].fd, &count, sizeof(count));
+		expired = pfd[1].revents & POLLIN;
+		if (expired)
+			read(pfd[1].fd, &count, sizeof(count));
+		Pthread_mutex_lock(&slave->mutex);
 	}
-	Pthread_mutex_unlock(&slave->mutex);
+	snd_pcm_share_slave_unlock(slave);
 	return NULL;
 }
 
+/* Warning: take the mutex before to call this */
 static void _snd_pcm_share_update(snd_pcm_t *pcm)
 {
 	snd_pcm_share_t *share = pcm->private_data;
 	snd_pcm_share_slave_t *slave = share->slave;
 	snd_pcm_t *spcm = slave->pcm;
-	snd_pcm_uframes_t missing;
+	snd_pcm_uframes_t missing, hw_ptr;
 	/* snd_pcm_sframes_t avail = */ snd_pcm_avail_update(spcm);
 	slave->hw_ptr = *slave->pcm->hw.ptr;
 	missing = _snd_pcm_share_missing(pcm);
-	// printf("missing %ld\n", missing);
-	if (!slave->polling) {
-		pthread_cond_signal(&slave->poll_cond);
+	if (missing >= INT_MAX)
 		return;
-	}
-	if (missing < INT_MAX) {
-		snd_pcm_uframes_t hw_ptr;
-		snd_pcm_sframes_t avail_min;
-		hw_ptr = slave->hw_ptr + missing;
-		hw_ptr += spcm->period_size - 1;
-		if (hw_ptr >= spcm->boundary)
-			hw_ptr -= spcm->boundary;
-		hw_ptr -= hw_ptr % spcm->period_size;
-		avail_min = hw_ptr - *spcm->appl.ptr;
-		if (spcm->stream == SND_PCM_STREAM_PLAYBACK)
-			avail_min += spcm->buffer_size;
-		if (avail_min < 0)
-			avail_min += spcm->boundary;
-		if ((snd_pcm_uframes_t)avail_min < spcm->avail_min) {
-			int err;
-			snd_pcm_sw_params_set_avail_min(spcm, &slave->sw_params, avail_min);
-			err = snd_pcm_sw_params(spcm, &slave->sw_params);
-			if (err < 0) {
-				SYSERR("snd_pcm_sw_params error");
-				return;
-			}
-		}
+	/* the thread only needs to know about an earlier event */
+	hw_ptr = snd_pcm_share_wakeup_ptr(slave, missing);
+	if (!slave->timer_armed ||
+	    snd_pcm_share_frames_to(slave, hw_ptr) <
+	    snd_pcm_share_frames_to(slave, slave->wakeup_ptr)) {
+		slave->timer_armed = 1;
+		slave->wakeup_ptr = hw_ptr;
+		snd_pcm_share_slave_kick(slave);
 	}
 }
 
@@ -616,6 +725,7 @@ static int snd_pcm_share_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 	snd_pcm_share_t *share = pcm->private_data;
 	snd_pcm_share_slave_t *slave = share->slave;
 	snd_pcm_t *spcm = slave->pcm;
+	snd_pcm_sw_params_t *sw_params;
 	int err = 0;
 	Pthread_mutex_lock(&slave->mutex);
 	if (slave->setup_count) {
@@ -651,19 +761,42 @@ static int snd_pcm_share_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 					      snd_pcm_share_hw_params_slave);
 		if (err < 0)
 			goto _end;
-		snd_pcm_sw_params_current(slave->pcm, &slave->sw_params);
 		/* >= 30 ms */
 		slave->safety_threshold = slave->pcm->rate * 30 / 1000;
 		slave->safety_threshold += slave->pcm->period_size - 1;
 		slave->safety_threshold -= slave->safety_threshold % slave->pcm->period_size;
+		/* but below the fill of a client refilling a period late, so
+		 * that short buffers don't go past the punctual clients */
+		if (slave->safety_threshold + 2 * slave->pcm->period_size >
+		    slave->pcm->buffer_size) {
+			if (slave->pcm->buffer_size > 2 * slave->pcm->period_size)
+				slave->safety_threshold = slave->pcm->buffer_size -
+					2 * slave->pcm->period_size;
+			else
+				slave->safety_threshold = 0;
+			slave->safety_threshold -= slave->safety_threshold % slave->pcm->period_size;
+			if (slave->safety_threshold == 0)
+				slave->safety_threshold = slave->pcm->period_size;
+		}
 		slave->silence_frames = slave->safety_threshold;
+		slave->stepped = 0;
+		/* the clients see their own xruns, the slave keeps running */
+		snd_pcm_sw_params_alloca(&sw_params);
+		snd_pcm_sw_params_current(slave->pcm, sw_params);
+		snd_pcm_sw_params_set_stop_threshold(slave->pcm, sw_params,
+						     slave->pcm->boundary);
+		err = snd_pcm_sw_params(slave->pcm, sw_params);
+		if (err < 0) {
+			SNDERR("cannot set the slave stop threshold");
+			goto _end;
+		}
 		if (slave->pcm->stream == SND_PCM_STREAM_PLAYBACK)
 			snd_pcm_areas_silence(slave->pcm->running_areas, 0, slave->pcm->channels, slave->pcm->buffer_size, slave->pcm->format);
 	}
 	share->state = SND_PCM_STATE_SETUP;
 	slave->setup_count++;
  _end:
-	Pthread_mutex_unlock(&slave->mutex);
+	snd_pcm_share_slave_unlock(slave);
 	return err;
 }
 
@@ -677,7 +810,7 @@ static int snd_pcm_share_hw_free(snd_pcm_t *pcm)
 	if (slave->setup_count == 0)
 		err = snd_pcm_hw_free(slave->pcm);
 	share->state = SND_PCM_STATE_OPEN;
-	Pthread_mutex_unlock(&slave->mutex);
+	snd_pcm_share_slave_unlock(slave);
 	return err;
 }
 
@@ -713,14 +846,14 @@ static int snd_pcm_share_status(snd_pcm_t *pcm, snd_pcm_status_t *status)
 	status->state = share->state;
 	status->trigger_tstamp = share->trigger_tstamp;
  _end:
-	Pthread_mutex_unlock(&slave->mutex);
+	snd_pcm_share_slave_unlock(slave);
 	return err;
 }
 
 static snd_pcm_state_t snd_pcm_share_state(snd_pcm_t *pcm)
 {
 	snd_pcm_share_t *share = pcm->private_data;
-	return share->state;
+	return __atomic_load_n(&share->state, __ATOMIC_ACQUIRE);
 }
 
 static int _snd_pcm_share_hwsync(snd_pcm_t *pcm)
@@ -743,7 +876,7 @@ static int snd_pcm_share_hwsync(snd_pcm_t *pcm)
 	int err;
 	Pthread_mutex_lock(&slave->mutex);
 	err = _snd_pcm_share_hwsync(pcm);
-	Pthread_mutex_unlock(&slave->mutex);
+	snd_pcm_share_slave_unlock(slave);
 	return err;
 }
 
@@ -773,7 +906,7 @@ static int snd_pcm_share_delay(snd_pcm_t *pcm, snd_pcm_sframes_t *delayp)
 	int err;
 	Pthread_mutex_lock(&slave->mutex);
 	err = _snd_pcm_share_delay(pcm, delayp);
-	Pthread_mutex_unlock(&slave->mutex);
+	snd_pcm_share_slave_unlock(slave);
 	return err;
 }
 
@@ -782,19 +915,28 @@ static snd_pcm_sframes_t snd_pcm_share_avail_update(snd_pcm_t *pcm)
 	snd_pcm_share_t *share = pcm->private_data;
 	snd_pcm_share_slave_t *slave = share->slave;
 	snd_pcm_sframes_t avail;
-	Pthread_mutex_lock(&slave->mutex);
-	if (share->state == SND_PCM_STATE_RUNNING) {
-		avail = snd_pcm_avail_update(slave->pcm);
-		if (avail < 0) {
-			Pthread_mutex_unlock(&slave->mutex);
-			return avail;
+	/* when the slave is busy, its holder or the thread refresh hw_ptr;
+	 * the state is checked again under the mutex */
+	if (__atomic_load_n(&share->state, __ATOMIC_ACQUIRE) == SND_PCM_STATE_RUNNING &&
+	    pthread_mutex_trylock(&slave->mutex) == 0) {
+		if (share->state == SND_PCM_STATE_RUNNING) {
+			avail = snd_pcm_avail_update(slave->pcm);
+			if (avail < 0) {
+				snd_pcm_share_slave_unlock(slave);
+				return avail;
+			}
+			share->hw_ptr = *slave->pcm->hw.ptr;
 		}
-		share->hw_ptr = *slave->pcm->hw.ptr;
+		snd_pcm_share_slave_unlock(slave);
 	}
-	Pthread_mutex_unlock(&slave->mutex);
 	avail = snd_pcm_mmap_avail(pcm);
-	if ((snd_pcm_uframes_t)avail > pcm->buffer_size)
+	if ((snd_pcm_uframes_t)avail > pcm->buffer_size) {
+		/* let the state follow before reporting the xrun */
+		Pthread_mutex_lock(&slave->mutex);
+		_snd_pcm_share_update(pcm);
+		snd_pcm_share_slave_unlock(slave);
 		return -EPIPE;
+	}
 	return avail;
 }
 
@@ -806,65 +948,42 @@ static int snd_pcm_share_htimestamp(snd_pcm_t *pcm, snd_pcm_uframes_t *avail,
 	int err;
 	Pthread_mutex_lock(&slave->mutex);
 	err = snd_pcm_htimestamp(slave->pcm, avail, tstamp);
-	Pthread_mutex_unlock(&slave->mutex);
+	snd_pcm_share_slave_unlock(slave);
 	return err;
 }
 
-/* Call it with mutex held */
-static snd_pcm_sframes_t _snd_pcm_share_mmap_commit(snd_pcm_t *pcm,
-						    snd_pcm_uframes_t offset ATTRIBUTE_UNUSED,
-						    snd_pcm_uframes_t size)
-{
-	snd_pcm_share_t *share = pcm->private_data;
-	snd_pcm_share_slave_t *slave = share->slave;
-	snd_pcm_t *spcm = slave->pcm;
-	snd_pcm_sframes_t ret;
-	snd_pcm_sframes_t frames;
-	if (pcm->stream == SND_PCM_STREAM_PLAYBACK &&
-	    share->state == SND_PCM_STATE_RUNNING) {
-		frames = *spcm->appl.ptr - share->appl_ptr;
-		if (frames > (snd_pcm_sframes_t)pcm->buffer_size)
-			frames -= pcm->boundary;
-		else if (frames < -(snd_pcm_sframes_t)pcm->buffer_size)
-			frames += pcm->boundary;
-		if (frames > 0) {
-			/* Latecomer PCM */
-			ret = snd_pcm_rewind(spcm, frames);
-			if (ret < 0)
-				return ret;
-		}
-	}
-	snd_pcm_mmap_appl_forward(pcm, size);
-	if (share->state == SND_PCM_STATE_RUNNING) {
-		frames = _snd_pcm_share_slave_forward(slave);
-		if (frames > 0) {
-			snd_pcm_sframes_t err;
-			err = snd_pcm_mmap_commit(spcm, snd_pcm_mmap_offset(spcm), frames);
-			if (err < 0) {
-				SYSMSG("snd_pcm_mmap_commit error");
-				return err;
-			}
-			if (err != frames) {
-				SYSMSG("commit returns %ld for size %ld", err, frames);
-				return err;
-			}
-		}
-		_snd_pcm_share_update(pcm);
-	}
-	return size;
-}
-
+/*
+ * A running client only publishes its new appl_ptr and commits it to the
+ * slave itself when nobody else holds the slave mutex, otherwise the
+ * holder does it when releasing the mutex.
+ */
 static snd_pcm_sframes_t snd_pcm_share_mmap_commit(snd_pcm_t *pcm,
-						   snd_pcm_uframes_t offset,
+						   snd_pcm_uframes_t offset ATTRIBUTE_UNUSED,
 						   snd_pcm_uframes_t size)
 {
 	snd_pcm_share_t *share = pcm->private_data;
 	snd_pcm_share_slave_t *slave = share->slave;
-	snd_pcm_sframes_t ret;
-	Pthread_mutex_lock(&slave->mutex);
-	ret = _snd_pcm_share_mmap_commit(pcm, offset, size);
-	Pthread_mutex_unlock(&slave->mutex);
-	return ret;
+	snd_pcm_uframes_t appl_ptr;
+	int err;
+	/* only the thread stops a running client behind its back, and the
+	 * holder doesn't commit the positions of stopped clients */
+	if (__atomic_load_n(&share->state, __ATOMIC_ACQUIRE) != SND_PCM_STATE_RUNNING) {
+		Pthread_mutex_lock(&slave->mutex);
+		snd_pcm_mmap_appl_forward(pcm, size);
+		share->committed_ptr = share->appl_ptr;
+		err = snd_pcm_share_slave_unlock(slave);
+		return err < 0 ? err : (snd_pcm_sframes_t)size;
+	}
+	appl_ptr = share->appl_ptr + size;
+	if (appl_ptr >= pcm->boundary)
+		appl_ptr -= pcm->boundary;
+	/* pairs with the acquire load of the mutex holder */
+	__atomic_store_n(&share->appl_ptr, appl_ptr, __ATOMIC_RELEASE);
+	__atomic_store_n(&slave->dirty, 1, __ATOMIC_SEQ_CST);
+	if (pthread_mutex_trylock(&slave->mutex))
+		return size;
+	err = snd_pcm_share_slave_unlock(slave);
+	return err < 0 ? err : (snd_pcm_sframes_t)size;
 }
 
 static int snd_pcm_share_prepare(snd_pcm_t *pcm)
@@ -894,9 +1013,10 @@ static int snd_pcm_share_prepare(snd_pcm_t *pcm)
 	slave->prepared_count++;
 	share->hw_ptr = 0;
 	share->appl_ptr = 0;
+	share->committed_ptr = 0;
 	share->state = SND_PCM_STATE_PREPARED;
  _end:
-	Pthread_mutex_unlock(&slave->mutex);
+	snd_pcm_share_slave_unlock(slave);
 	return err;
 }
 
@@ -910,7 +1030,8 @@ static int snd_pcm_share_reset(snd_pcm_t *pcm)
 	snd_pcm_areas_silence(pcm->running_areas, 0, pcm->channels, pcm->buffer_size, pcm->format);
 	share->hw_ptr = *slave->pcm->hw.ptr;
 	share->appl_ptr = share->hw_ptr;
-	Pthread_mutex_unlock(&slave->mutex);
+	share->committed_ptr = share->appl_ptr;
+	snd_pcm_share_slave_unlock(slave);
 	return err;
 }
 
@@ -923,7 +1044,6 @@ static int snd_pcm_share_start(snd_pcm_t *pcm)
 	if (share->state != SND_PCM_STATE_PREPARED)
 		return -EBADFD;
 	Pthread_mutex_lock(&slave->mutex);
-	share->state = SND_PCM_STATE_RUNNING;
 	if (pcm->stream == SND_PCM_STREAM_PLAYBACK) {
 		snd_pcm_uframes_t hw_avail = snd_pcm_mmap_playback_hw_avail(pcm);
 		snd_pcm_uframes_t xfer = 0;
@@ -936,9 +1056,12 @@ static int snd_pcm_share_start(snd_pcm_t *pcm)
 			err = snd_pcm_delay(spcm, &sd);
 			if (err < 0)
 				goto _end;
-			err = snd_pcm_rewind(spcm, sd);
-			if (err < 0)
-				goto _end;
+			/* the slave keeps running when it underruns */
+			if (sd > 0) {
+				err = snd_pcm_rewind(spcm, sd);
+				if (err < 0)
+					goto _end;
+			}
 		}
 		assert(share->hw_ptr == 0);
 		share->hw_ptr = *spcm->hw.ptr;
@@ -957,6 +1080,7 @@ static int snd_pcm_share_start(snd_pcm_t *pcm)
 			xfer += frames;
 		}
 		snd_pcm_mmap_appl_forward(pcm, hw_avail);
+		share->committed_ptr = share->appl_ptr;
 		if (slave->running_count == 0) {
 			snd_pcm_sframes_t res;
 			res = snd_pcm_mmap_commit(spcm, snd_pcm_mmap_offset(spcm), hw_avail);
@@ -972,11 +1096,13 @@ static int snd_pcm_share_start(snd_pcm_t *pcm)
 		if (err < 0)
 			goto _end;
 	}
+	/* only once it is counted, _snd_pcm_share_stop() uncounts it */
+	share->state = SND_PCM_STATE_RUNNING;
 	slave->running_count++;
 	_snd_pcm_share_update(pcm);
 	gettimestamp(&share->trigger_tstamp, pcm->tstamp_type);
  _end:
-	Pthread_mutex_unlock(&slave->mutex);
+	snd_pcm_share_slave_unlock(slave);
 	return err;
 }
 
@@ -1035,6 +1161,7 @@ static snd_pcm_sframes_t _snd_pcm_share_rewind(snd_pcm_t *pcm, snd_pcm_uframes_t
 		frames = ret;
 	}
 	snd_pcm_mmap_appl_backward(pcm, frames);
+	share->committed_ptr = share->appl_ptr;
 	_snd_pcm_share_update(pcm);
 	return n;
 }
@@ -1046,7 +1173,7 @@ static snd_pcm_sframes_t snd_pcm_share_rewindable(snd_pcm_t *pcm)
 	snd_pcm_sframes_t ret;
 	Pthread_mutex_lock(&slave->mutex);
 	ret = snd_pcm_rewindable(slave->pcm);
-	Pthread_mutex_unlock(&slave->mutex);
+	snd_pcm_share_slave_unlock(slave);
 	return ret;
 }
 
@@ -1057,7 +1184,7 @@ static snd_pcm_sframes_t snd_pcm_share_rewind(snd_pcm_t *pcm, snd_pcm_uframes_t
 	snd_pcm_sframes_t ret;
 	Pthread_mutex_lock(&slave->mutex);
 	ret = _snd_pcm_share_rewind(pcm, frames);
-	Pthread_mutex_unlock(&slave->mutex);
+	snd_pcm_share_slave_unlock(slave);
 	return ret;
 }
 
@@ -1092,6 +1219,7 @@ static snd_pcm_sframes_t _snd_pcm_share_forward(snd_pcm_t *pcm, snd_pcm_uframes_
 		frames = ret;
 	}
 	snd_pcm_mmap_appl_forward(pcm, frames);
+	share->committed_ptr = share->appl_ptr;
 	_snd_pcm_share_update(pcm);
 	return n;
 }
@@ -1103,7 +1231,7 @@ static snd_pcm_sframes_t snd_pcm_share_forwardable(snd_pcm_t *pcm)
 	snd_pcm_sframes_t ret;
 	Pthread_mutex_lock(&slave->mutex);
 	ret = snd_pcm_forwardable(slave->pcm);
-	Pthread_mutex_unlock(&slave->mutex);
+	snd_pcm_share_slave_unlock(slave);
 	return ret;
 }
 
@@ -1114,7 +1242,7 @@ static snd_pcm_sframes_t snd_pcm_share_forward(snd_pcm_t *pcm, snd_pcm_uframes_t
 	snd_pcm_sframes_t ret;
 	Pthread_mutex_lock(&slave->mutex);
 	ret = _snd_pcm_share_forward(pcm, frames);
-	Pthread_mutex_unlock(&slave->mutex);
+	snd_pcm_share_slave_unlock(slave);
 	return ret;
 }
 
@@ -1145,7 +1273,8 @@ static void _snd_pcm_share_stop(snd_pcm_t *pcm, snd_pcm_state_t state)
 			snd_pcm_rewind(slave->pcm, delay);
 		share->drain_silenced = 0;
 	}
-	share->state = state;
+	/* the client reads it without the mutex in its fast paths */
+	__atomic_store_n(&share->state, state, __ATOMIC_RELEASE);
 	slave->prepared_count--;
 	slave->running_count--;
 	if (slave->running_count == 0) {
@@ -1181,7 +1310,7 @@ static int snd_pcm_share_drain(snd_pcm_t *pcm)
 		case SND_PCM_STATE_RUNNING:
 			share->state = SND_PCM_STATE_DRAINING;
 			_snd_pcm_share_update(pcm);
-			Pthread_mutex_unlock(&slave->mutex);
+			snd_pcm_share_slave_unlock(slave);
 			if (!(pcm->mode & SND_PCM_NONBLOCK))
 				snd_pcm_wait(pcm, -1);
 			return 0;
@@ -1208,7 +1337,7 @@ static int snd_pcm_share_drain(snd_pcm_t *pcm)
 		}
 	}
  _end:
-	Pthread_mutex_unlock(&slave->mutex);
+	snd_pcm_share_slave_unlock(slave);
 	return err;
 }
 
@@ -1244,8 +1373,9 @@ static int snd_pcm_share_drop(snd_pcm_t *pcm)
 	}
 	
 	share->appl_ptr = share->hw_ptr = 0;
+	share->committed_ptr = 0;
  _end:
-	Pthread_mutex_unlock(&slave->mutex);
+	snd_pcm_share_slave_unlock(slave);
 	return err;
 }
 
@@ -1259,19 +1389,20 @@ static int snd_pcm_share_close(snd_pcm_t *pcm)
 	Pthread_mutex_lock(&slave->mutex);
 	slave->open_count--;
 	if (slave->open_count == 0) {
-		pthread_cond_signal(&slave->poll_cond);
-		Pthread_mutex_unlock(&slave->mutex);
+		snd_pcm_share_slave_kick(slave);
+		snd_pcm_share_slave_unlock(slave);
 		err = pthread_join(slave->thread, 0);
 		assert(err == 0);
 		err = snd_pcm_close(slave->pcm);
 		pthread_mutex_destroy(&slave->mutex);
-		pthread_cond_destroy(&slave->poll_cond);
+		close(slave->wake_fd);
+		close(slave->timer_fd);
+		list_del(&share->list);
 		list_del(&slave->list);
 		free(slave);
-		list_del(&share->list);
 	} else {
 		list_del(&share->list);
-		Pthread_mutex_unlock(&slave->mutex);
+		snd_pcm_share_slave_unlock(slave);
 	}
 	Pthread_mutex_unlock(&snd_pcm_share_slaves_mutex);
 	close(share->client_socket);
@@ -1471,9 +1602,7 @@ int snd_pcm_share_open(snd_pcm_t **pcmp, const char *name, const char *sname,
 			free(share);
 			return err;
 		}
-		/* FIXME: bellow is a real ugly hack to get things working */
-		/* there is a memory leak somewhere, but I'm unable to trace it --jk */
-		slave = calloc(1, sizeof(snd_pcm_share_slave_t) * 8);
+		slave = calloc(1, sizeof(snd_pcm_share_slave_t));
 		if (!slave) {
 			Pthread_mutex_unlock(&snd_pcm_share_slaves_mutex);
 			snd_pcm_close(spcm);
@@ -1491,8 +1620,27 @@ int snd_pcm_share_open(snd_pcm_t **pcmp, const char *name, const char *sname,
 		slave->rate = srate;
 		slave->period_time = speriod_time;
 		slave->buffer_time = sbuffer_time;
+		slave->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		slave->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+						 TFD_NONBLOCK | TFD_CLOEXEC);
+		if (slave->wake_fd < 0 || slave->timer_fd < 0) {
+			err = -errno;
+			SYSERR("cannot create the share thread descriptors");
+			if (slave->wake_fd >= 0)
+				close(slave->wake_fd);
+			if (slave->timer_fd >= 0)
+				close(slave->timer_fd);
+			free(slave);
+			Pthread_mutex_unlock(&snd_pcm_share_slaves_mutex);
+			snd_pcm_close(spcm);
+			close(sd[0]);
+			close(sd[1]);
+			snd_pcm_free(pcm);
+			free(share->slave_channels);
+			free(share);
+			return err;
+		}
 		pthread_mutex_init(&slave->mutex, NULL);
-		pthread_cond_init(&slave->poll_cond, NULL);
 		list_add_tail(&slave->list, &snd_pcm_share_slaves);
 		Pthread_mutex_lock(&slave->mutex);
 		err = pthread_create(&slave->thread, NULL, snd_pcm_share_thread, slave);
@@ -1506,7 +1654,7 @@ int snd_pcm_share_open(snd_pcm_t **pcmp, const char *name, const char *sname,
 			for (k = 0; k < sh->channels; ++k) {
 				if (slave_map[sh->slave_channels[k]]) {
 					SNDERR("Slave channel %d is already in use", sh->slave_channels[k]);
-					Pthread_mutex_unlock(&slave->mutex);
+					snd_pcm_share_slave_unlock(slave);
 					close(sd[0]);
 					close(sd[1]);
 					snd_pcm_free(pcm);
@@ -1536,7 +1684,7 @@ int snd_pcm_share_open(snd_pcm_t **pcmp, const char *name, const char *sname,
 	slave->open_count++;
 	list_add_tail(&share->list, &slave->clients);
 
-	Pthread_mutex_unlock(&slave->mutex);
+	snd_pcm_share_slave_unlock(slave);
 
 	*pcmp = pcm;
 	return 0;
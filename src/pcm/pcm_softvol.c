@@ -30,6 +30,7 @@
 #include <math.h>
 #include "pcm_local.h"
 #include "pcm_plugin.h"
+#include "pcm_softvol_simd.h"
 
 #ifndef PIC
 /* entry for static linking */
@@ -45,17 +46,38 @@ typedef struct {
 	unsigned int cchannels;
 	snd_ctl_t *ctl;
 	snd_ctl_elem_value_t elem;
+	int elem_events;	/* subscribed to the control events */
+	int elem_changed;	/* re-read the control on the next period */
+	int elem_polled;	/* events drained by poll_revents */
+	struct timespec elem_check;	/* next event check without poll */
+	snd_pcm_fast_ops_t fops;	/* the ctl fd is polled with the slave */
 	unsigned int cur_vol[2];
 	unsigned int max_val;     /* max index */
 	unsigned int zero_dB_val; /* index at 0 dB */
 	double min_dB;
 	double max_dB;
 	unsigned int *dB_value;
+	int ramp;		/* ramp the gain over a period on changes */
+	int simd_op;		/* SOFTVOL_SIMD_* of the format or -1 */
+	softvol_simd_func_t *kernel;	/* vector kernel for simd_op */
+	/* per channel gains, 0x10000 is the unity gain */
+	uint32_t *vol_from;	/* gain at the ramp start */
+	uint32_t *vol_to;	/* current (target) gain */
+	uint32_t vol_max;	/* highest gain in use */
+	int vol_valid;
+	snd_pcm_uframes_t ramp_pos;
+	snd_pcm_uframes_t ramp_len;	/* 0 = no ramp in progress */
+	uint32_t *gains;	/* gain per sample for SOFTVOL_BLOCK frames */
+	int gains_const;	/* gains holds the vol_to frame pattern */
 } snd_pcm_softvol_t;
 
 #define VOL_SCALE_SHIFT		16
 #define VOL_SCALE_MASK          ((1 << VOL_SCALE_SHIFT) - 1)
 
+#define SOFTVOL_BLOCK		256	/* frames per gain block */
+
+#define SOFTVOL_CHECK_MS	50	/* event checks when the app does not poll */
+
 #define PRESET_RESOLUTION	256
 #define PRESET_MIN_DB		-51.0
 #define ZERO_DB                  0.0
@@ -146,8 +168,8 @@ static inline int MULTI_DIV_24(int a, unsigned int b)
 		long long amp = (long long)a * gain + fraction;
 		if (amp > (int)0x7fffff)
 			amp = (int)0x7fffff;
-		else if (amp < (int)0x800000)
-			amp = (int)0x800000;
+		else if (amp < -(int)0x800000)
+			amp = -(int)0x800000;
 		return (int)amp;
 	}
 	return fraction;
@@ -170,10 +192,330 @@ static inline short MULTI_DIV_short(short a, unsigned int b, int swap)
 
 #endif /* DOC_HIDDEN */
 
+/*
+ * per channel gains, ramps and the vectorized path
+ */
+
+static softvol_simd_func_t *simd_kernels[SOFTVOL_SIMD_OPS];
+
+static void simd_kernels_init(void)
+{
+	static int probed = 0;
+	const softvol_simd_kernel_t *k;
+	int op;
+
+	if (probed)
+		return;
+	for (k = softvol_simd_kernels; k->name; k++) {
+		if (!k->available())
+			continue;
+		for (op = 0; op < SOFTVOL_SIMD_OPS; op++) {
+			if (!simd_kernels[op])
+				simd_kernels[op] = k->op[op];
+		}
+	}
+	probed = 1;
+}
+
+static int softvol_simd_op(snd_pcm_format_t format)
+{
+	switch (format) {
+	case SND_PCM_FORMAT_S16:
+		return SOFTVOL_SIMD_S16;
+	case SND_PCM_FORMAT_S32:
+		return SOFTVOL_SIMD_S32;
+	case SND_PCM_FORMAT_S24:
+		return SOFTVOL_SIMD_S24;
+	case SND_PCM_FORMAT_S24_3LE:
+		return SOFTVOL_SIMD_S24_3LE;
+	case SND_PCM_FORMAT_FLOAT:
+		return SOFTVOL_SIMD_FLOAT;
+	default:
+		return -1;
+	}
+}
+
+/* gain of the channel at the given ramp position */
+static uint32_t softvol_ramp_gain(snd_pcm_softvol_t *svol, unsigned int ch,
+				  snd_pcm_uframes_t pos)
+{
+	long long step;
+
+	if (pos >= svol->ramp_len)
+		return svol->vol_to[ch];
+	step = (((long long)svol->vol_to[ch] - svol->vol_from[ch]) << 16) /
+		(long long)svol->ramp_len;
+	return (((long long)svol->vol_from[ch] << 16) + step * (long long)pos) >> 16;
+}
+
+/*
+ * update the per channel gains from the current control values; the
+ * mapping follows softvol_convert_stereo_vol() and a change starts a
+ * ramp from the gain reached so far when enabled
+ */
+static void softvol_update_target(snd_pcm_t *pcm)
+{
+	snd_pcm_softvol_t *svol = pcm->private_data;
+	unsigned int vol[2], vol_c, ch, pass;
+	uint32_t v;
+
+	if (svol->max_val == 1) {
+		vol[0] = svol->cur_vol[0] ? 0xffff : 0;
+		vol[1] = svol->cur_vol[1] ? 0xffff : 0;
+		vol_c = vol[0] | vol[1];
+	} else {
+		vol[0] = svol->dB_value[svol->cur_vol[0]];
+		vol[1] = svol->dB_value[svol->cur_vol[1]];
+		vol_c = svol->dB_value[(svol->cur_vol[0] + svol->cur_vol[1]) / 2];
+	}
+	if (svol->cchannels == 1)
+		vol[1] = vol_c = vol[0];
+	if (svol->cur_vol[0] == 0 &&
+	    (svol->cchannels == 1 || svol->cur_vol[1] == 0))
+		vol[0] = vol[1] = vol_c = 0;
+
+	/* the first pass only checks for a change */
+	for (pass = 0; pass < 2; pass++) {
+		for (ch = 0; ch < pcm->channels; ch++) {
+			switch (ch) {
+			case 0:
+			case 2:
+				v = (pcm->channels == ch + 1) ? vol_c : vol[0];
+				break;
+			case 4:
+			case 5:
+				v = vol_c;
+				break;
+			default:
+				v = vol[ch & 1];
+				break;
+			}
+			if (v == 0xffff)
+				v = SOFTVOL_SIMD_UNITY;
+			if (!pass) {
+				if (v != svol->vol_to[ch])
+					break;
+				continue;
+			}
+			svol->vol_from[ch] = softvol_ramp_gain(svol, ch,
+							       svol->ramp_pos);
+			svol->vol_to[ch] = v;
+		}
+		if (!pass && ch == pcm->channels && svol->vol_valid)
+			return;
+	}
+
+	svol->ramp_pos = 0;
+	svol->ramp_len = svol->ramp && svol->vol_valid ? pcm->period_size : 0;
+	svol->vol_valid = 1;
+	svol->gains_const = 0;
+	svol->vol_max = 0;
+	for (ch = 0; ch < pcm->channels; ch++) {
+		if (svol->vol_to[ch] > svol->vol_max)
+			svol->vol_max = svol->vol_to[ch];
+		if (svol->ramp_len && svol->vol_from[ch] > svol->vol_max)
+			svol->vol_max = svol->vol_from[ch];
+	}
+}
+
+static void softvol_ramp_advance(snd_pcm_softvol_t *svol, unsigned int channels,
+				 snd_pcm_uframes_t frames)
+{
+	unsigned int ch;
+
+	if (!svol->ramp_len)
+		return;
+	svol->ramp_pos += frames;
+	if (svol->ramp_pos < svol->ramp_len)
+		return;
+	svol->ramp_pos = svol->ramp_len = 0;
+	svol->vol_max = 0;
+	for (ch = 0; ch < channels; ch++) {
+		if (svol->vol_to[ch] > svol->vol_max)
+			svol->vol_max = svol->vol_to[ch];
+	}
+}
+
+/* gains[frame * count + c] for the channels first .. first + count - 1 */
+static void softvol_fill_gains(snd_pcm_softvol_t *svol, uint32_t *gains,
+			       unsigned int first, unsigned int count,
+			       snd_pcm_uframes_t pos, unsigned int frames)
+{
+	unsigned int c, f;
+
+	for (c = 0; c < count; c++) {
+		unsigned int ch = first + c;
+		long long step, acc;
+
+		f = 0;
+		if (pos < svol->ramp_len) {
+			step = (((long long)svol->vol_to[ch] - svol->vol_from[ch]) << 16) /
+				(long long)svol->ramp_len;
+			acc = ((long long)svol->vol_from[ch] << 16) +
+				step * (long long)pos;
+			for (; f < frames && pos + f < svol->ramp_len; f++) {
+				gains[f * count + c] = acc >> 16;
+				acc += step;
+			}
+		}
+		for (; f < frames; f++)
+			gains[f * count + c] = svol->vol_to[ch];
+	}
+}
+
+/* one sample in any of the supported formats */
+static void softvol_sample(snd_pcm_softvol_t *svol, char *dst, const char *src,
+			   uint32_t gain)
+{
+	int swap = !snd_pcm_format_cpu_endian(svol->sformat);
+	int tmp;
+
+	switch (svol->sformat) {
+	case SND_PCM_FORMAT_S16_LE:
+	case SND_PCM_FORMAT_S16_BE:
+		*(short *)dst = MULTI_DIV_short(*(const short *)src, gain, swap);
+		break;
+	case SND_PCM_FORMAT_S32_LE:
+	case SND_PCM_FORMAT_S32_BE:
+		*(int *)dst = MULTI_DIV_int(*(const int *)src, gain, swap);
+		break;
+	case SND_PCM_FORMAT_S24_LE:
+		tmp = (signed int)(*(const int *)src << 8) >> 8;
+		*(int *)dst = MULTI_DIV_24(tmp, gain);
+		break;
+	case SND_PCM_FORMAT_S24_3LE:
+		tmp = (unsigned char)src[0] | ((unsigned char)src[1] << 8) |
+		      (((signed char *)src)[2] << 16);
+		tmp = MULTI_DIV_24(tmp, gain);
+		dst[0] = tmp;
+		dst[1] = tmp >> 8;
+		dst[2] = tmp >> 16;
+		break;
+	case SND_PCM_FORMAT_FLOAT:
+		*(float *)dst = *(const float *)src * ((float)gain * (1.0f / 65536));
+		break;
+	default:
+		break;
+	}
+}
+
+/* a run of contiguous samples */
+static void softvol_run(snd_pcm_softvol_t *svol, unsigned int size, char *dst,
+			const char *src, const uint32_t *gains, unsigned int width)
+{
+	unsigned int done = 0;
+
+	if (svol->simd_op < 0) {
+		for (; done < size; done++, dst += width, src += width)
+			softvol_sample(svol, dst, src, gains[done]);
+		return;
+	}
+	/* the integer kernels don't saturate */
+	if (svol->kernel && (svol->vol_max <= SOFTVOL_SIMD_UNITY ||
+			     svol->simd_op == SOFTVOL_SIMD_FLOAT))
+		done = svol->kernel(size, dst, src, gains);
+	if (done < size)
+		softvol_simd_scalar[svol->simd_op](size - done,
+						   dst + done * width,
+						   src + done * width,
+						   gains + done);
+}
+
+/* address of the first channel when the areas are plain interleaved */
+static char *softvol_interleaved(const snd_pcm_channel_area_t *areas,
+				 snd_pcm_uframes_t offset,
+				 unsigned int channels, unsigned int width)
+{
+	unsigned int ch;
+
+	if (areas[0].first % 8 || areas[0].step != channels * width * 8)
+		return NULL;
+	for (ch = 1; ch < channels; ch++) {
+		if (areas[ch].addr != areas[0].addr ||
+		    areas[ch].first != areas[0].first + ch * width * 8 ||
+		    areas[ch].step != areas[0].step)
+			return NULL;
+	}
+	return snd_pcm_channel_area_addr(&areas[0], offset);
+}
+
+/*
+ * apply the per channel gains (and the ramp in progress) with one gain
+ * per sample; interleaved areas are processed in one pass over all
+ * channels, others channel by channel
+ */
+static void softvol_convert_gains(snd_pcm_softvol_t *svol,
+				  const snd_pcm_channel_area_t *dst_areas,
+				  snd_pcm_uframes_t dst_offset,
+				  const snd_pcm_channel_area_t *src_areas,
+				  snd_pcm_uframes_t src_offset,
+				  unsigned int channels,
+				  snd_pcm_uframes_t frames)
+{
+	unsigned int width = snd_pcm_format_physical_width(svol->sformat) / 8;
+	snd_pcm_uframes_t done, pos = svol->ramp_pos;
+	unsigned int ch, n;
+	char *dst, *src;
+
+	dst = softvol_interleaved(dst_areas, dst_offset, channels, width);
+	src = softvol_interleaved(src_areas, src_offset, channels, width);
+	if (dst && src) {
+		for (done = 0; done < frames; done += n) {
+			n = frames - done;
+			if (n > SOFTVOL_BLOCK)
+				n = SOFTVOL_BLOCK;
+			if (svol->ramp_len) {
+				softvol_fill_gains(svol, svol->gains, 0, channels,
+						   svol->ramp_pos, n);
+				svol->gains_const = 0;
+			} else if (!svol->gains_const) {
+				softvol_fill_gains(svol, svol->gains, 0, channels,
+						   0, SOFTVOL_BLOCK);
+				svol->gains_const = 1;
+			}
+			softvol_run(svol, n * channels, dst, src, svol->gains,
+				    width);
+			dst += n * channels * width;
+			src += n * channels * width;
+			softvol_ramp_advance(svol, channels, n);
+		}
+		return;
+	}
+
+	svol->gains_const = 0;
+	for (ch = 0; ch < channels; ch++) {
+		unsigned int dst_step = snd_pcm_channel_area_step(&dst_areas[ch]);
+		unsigned int src_step = snd_pcm_channel_area_step(&src_areas[ch]);
+
+		dst = snd_pcm_channel_area_addr(&dst_areas[ch], dst_offset);
+		src = snd_pcm_channel_area_addr(&src_areas[ch], src_offset);
+		for (done = 0; done < frames; done += n) {
+			unsigned int i;
+
+			n = frames - done;
+			if (n > SOFTVOL_BLOCK)
+				n = SOFTVOL_BLOCK;
+			softvol_fill_gains(svol, svol->gains, ch, 1, pos + done, n);
+			if (dst_step == width && src_step == width)
+				softvol_run(svol, n, dst, src, svol->gains, width);
+			else
+				for (i = 0; i < n; i++)
+					softvol_sample(svol, dst + i * dst_step,
+						       src + i * src_step,
+						       svol->gains[i]);
+			dst += n * dst_step;
+			src += n * src_step;
+		}
+	}
+	softvol_ramp_advance(svol, channels, frames);
+}
+
 /*
  * apply volumue attenuation
  *
- * TODO: use SIMD operations
+ * The macros below handle the constant volume of the formats without
+ * a softvol_simd_op() (the swapped endian ones), the others go through
+ * softvol_convert_gains().
  */
 
 #ifndef DOC_HIDDEN
@@ -329,6 +671,10 @@ static void softvol_convert_stereo_vol(snd_pcm_softvol_t *svol,
 		snd_pcm_areas_copy(dst_areas, dst_offset, src_areas, src_offset,
 				   channels, frames, svol->sformat);
 		return;
+	} else if (svol->simd_op >= 0) {
+		softvol_convert_gains(svol, dst_areas, dst_offset, src_areas,
+				      src_offset, channels, frames);
+		return;
 	}
 
 	if (svol->max_val == 1) {
@@ -389,6 +735,10 @@ static void softvol_convert_mono_vol(snd_pcm_softvol_t *svol,
 		snd_pcm_areas_copy(dst_areas, dst_offset, src_areas, src_offset,
 				   channels, frames, svol->sformat);
 		return;
+	} else if (svol->simd_op >= 0) {
+		softvol_convert_gains(svol, dst_areas, dst_offset, src_areas,
+				      src_offset, channels, frames);
+		return;
 	}
 
 	if (svol->max_val == 1)
@@ -420,16 +770,95 @@ static void softvol_convert_mono_vol(snd_pcm_softvol_t *svol,
 	}
 }
 
+static void softvol_convert(snd_pcm_t *pcm,
+			    const snd_pcm_channel_area_t *dst_areas,
+			    snd_pcm_uframes_t dst_offset,
+			    const snd_pcm_channel_area_t *src_areas,
+			    snd_pcm_uframes_t src_offset,
+			    snd_pcm_uframes_t frames)
+{
+	snd_pcm_softvol_t *svol = pcm->private_data;
+
+	softvol_update_target(pcm);
+	if (svol->ramp_len)
+		softvol_convert_gains(svol, dst_areas, dst_offset, src_areas,
+				      src_offset, pcm->channels, frames);
+	else if (svol->cchannels == 1)
+		softvol_convert_mono_vol(svol, dst_areas, dst_offset, src_areas,
+					 src_offset, pcm->channels, frames);
+	else
+		softvol_convert_stereo_vol(svol, dst_areas, dst_offset,
+					   src_areas, src_offset,
+					   pcm->channels, frames);
+}
+
+/*
+ * drain the control events, flag a change of our element
+ */
+static void volume_read_events(snd_pcm_softvol_t *svol)
+{
+	snd_ctl_event_t event;
+	int err;
+
+	while ((err = snd_ctl_read(svol->ctl, &event)) > 0) {
+		if (snd_ctl_event_get_type(&event) != SND_CTL_EVENT_ELEM)
+			continue;
+		/* the numid is known after the first read */
+		if (!svol->elem.id.numid ||
+		    snd_ctl_event_elem_get_numid(&event) == svol->elem.id.numid)
+			svol->elem_changed = 1;
+	}
+	if (err < 0 && err != -EAGAIN) {
+		/* events lost, fall back to reading every period */
+		svol->elem_events = 0;
+		svol->elem_changed = 1;
+	}
+}
+
+/*
+ * without poll the events are read at most every SOFTVOL_CHECK_MS;
+ * CLOCK_MONOTONIC is read through the vDSO, not a syscall
+ */
+static int volume_check_due(snd_pcm_softvol_t *svol)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec < svol->elem_check.tv_sec ||
+	    (now.tv_sec == svol->elem_check.tv_sec &&
+	     now.tv_nsec < svol->elem_check.tv_nsec))
+		return 0;
+	now.tv_nsec += SOFTVOL_CHECK_MS * 1000000L;
+	if (now.tv_nsec >= 1000000000L) {
+		now.tv_nsec -= 1000000000L;
+		now.tv_sec++;
+	}
+	svol->elem_check = now;
+	return 1;
+}
+
 /*
  * get the current volume value from driver
  *
- * TODO: mmap support?
+ * With the control events the element is read only after it changed.
+ * The ctl fd is polled together with the slave, so an application that
+ * waits in poll gets the events drained by poll_revents and the plugin
+ * makes no syscall at all while the volume stays unchanged.
  */
 static void get_current_volume(snd_pcm_softvol_t *svol)
 {
 	unsigned int val;
 	unsigned int i;
 
+	if (svol->elem_events) {
+		if (svol->elem_polled)
+			svol->elem_polled = 0;
+		else if (volume_check_due(svol))
+			volume_read_events(svol);
+		if (!svol->elem_changed)
+			return;
+		svol->elem_changed = 0;
+	}
 	if (snd_ctl_elem_read(svol->ctl, &svol->elem) < 0)
 		return;
 	for (i = 0; i < svol->cchannels; i++) {
@@ -440,8 +869,17 @@ static void get_current_volume(snd_pcm_softvol_t *svol)
 	}
 }
 
+static void softvol_free_gains(snd_pcm_softvol_t *svol)
+{
+	free(svol->vol_from);
+	free(svol->vol_to);
+	free(svol->gains);
+	svol->vol_from = svol->vol_to = svol->gains = NULL;
+}
+
 static void softvol_free(snd_pcm_softvol_t *svol)
 {
+	softvol_free_gains(svol);
 	if (svol->plug.gen.close_slave)
 		snd_pcm_close(svol->plug.gen.slave);
 	if (svol->ctl)
@@ -470,7 +908,8 @@ static int snd_pcm_softvol_hw_refine_cprepare(snd_pcm_t *pcm,
 			(1ULL << SND_PCM_FORMAT_S16_BE) |
 			(1ULL << SND_PCM_FORMAT_S24_LE) |
 			(1ULL << SND_PCM_FORMAT_S32_LE) |
- 			(1ULL << SND_PCM_FORMAT_S32_BE),
+ 			(1ULL << SND_PCM_FORMAT_S32_BE) |
+			(1ULL << SND_PCM_FORMAT_FLOAT),
 			(1ULL << (SND_PCM_FORMAT_S24_3LE - 32))
 		}
 	};
@@ -626,15 +1065,42 @@ static int snd_pcm_softvol_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * param
 	    slave->format != SND_PCM_FORMAT_S24_3LE && 
 	    slave->format != SND_PCM_FORMAT_S24_LE &&
 	    slave->format != SND_PCM_FORMAT_S32_LE &&
-	    slave->format != SND_PCM_FORMAT_S32_BE) {
+	    slave->format != SND_PCM_FORMAT_S32_BE &&
+	    slave->format != SND_PCM_FORMAT_FLOAT) {
 		SNDERR("softvol supports only S16_LE, S16_BE, S24_LE, S24_3LE, "
-		       "S32_LE or S32_BE");
+		       "S32_LE, S32_BE or FLOAT");
 		return -EINVAL;
 	}
 	svol->sformat = slave->format;
+
+	softvol_free_gains(svol);
+	svol->vol_from = calloc(pcm->channels, sizeof(*svol->vol_from));
+	svol->vol_to = calloc(pcm->channels, sizeof(*svol->vol_to));
+	svol->gains = malloc(pcm->channels * SOFTVOL_BLOCK * sizeof(*svol->gains));
+	if (!svol->vol_from || !svol->vol_to || !svol->gains) {
+		softvol_free_gains(svol);
+		return -ENOMEM;
+	}
+	svol->vol_valid = 0;
+	svol->ramp_pos = svol->ramp_len = 0;
+	svol->gains_const = 0;
+	svol->simd_op = softvol_simd_op(svol->sformat);
+	svol->kernel = NULL;
+	if (svol->simd_op >= 0) {
+		simd_kernels_init();
+		svol->kernel = simd_kernels[svol->simd_op];
+	}
 	return 0;
 }
 
+static int snd_pcm_softvol_hw_free(snd_pcm_t *pcm)
+{
+	snd_pcm_softvol_t *svol = pcm->private_data;
+
+	softvol_free_gains(svol);
+	return snd_pcm_generic_hw_free(pcm);
+}
+
 static snd_pcm_uframes_t
 snd_pcm_softvol_write_areas(snd_pcm_t *pcm,
 			    const snd_pcm_channel_area_t *areas,
@@ -648,12 +1114,7 @@ snd_pcm_softvol_write_areas(snd_pcm_t *pcm,
 	if (size > *slave_sizep)
 		size = *slave_sizep;
 	get_current_volume(svol);
-	if (svol->cchannels == 1)
-		softvol_convert_mono_vol(svol, slave_areas, slave_offset,
-					 areas, offset, pcm->channels, size);
-	else
-		softvol_convert_stereo_vol(svol, slave_areas, slave_offset,
-					   areas, offset, pcm->channels, size);
+	softvol_convert(pcm, slave_areas, slave_offset, areas, offset, size);
 	*slave_sizep = size;
 	return size;
 }
@@ -671,12 +1132,7 @@ snd_pcm_softvol_read_areas(snd_pcm_t *pcm,
 	if (size > *slave_sizep)
 		size = *slave_sizep;
 	get_current_volume(svol);
-	if (svol->cchannels == 1)
-		softvol_convert_mono_vol(svol, areas, offset, slave_areas,
-					 slave_offset, pcm->channels, size);
-	else
-		softvol_convert_stereo_vol(svol, areas, offset, slave_areas,
-					   slave_offset, pcm->channels, size);
+	softvol_convert(pcm, areas, offset, slave_areas, slave_offset, size);
 	*slave_sizep = size;
 	return size;
 }
@@ -693,6 +1149,8 @@ static void snd_pcm_softvol_dump(snd_pcm_t *pcm, snd_output_t *out)
 		snd_output_printf(out, "max_dB: %g\n", svol->max_dB);
 		snd_output_printf(out, "resolution: %d\n", svol->max_val + 1);
 	}
+	if (svol->ramp)
+		snd_output_printf(out, "ramp: one period\n");
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -766,11 +1224,15 @@ static int softvol_load_control(snd_pcm_t *pcm, snd_pcm_softvol_t *svol,
 		}
 	}
 	sprintf(tmp_name, "hw:%d", ctl_card);
-	err = snd_ctl_open(&svol->ctl, tmp_name, 0);
+	err = snd_ctl_open(&svol->ctl, tmp_name, SND_CTL_NONBLOCK);
 	if (err < 0) {
 		SNDERR("Cannot open CTL %s", tmp_name);
 		return err;
 	}
+	/* without the events the control is read every period */
+	if (snd_ctl_subscribe_events(svol->ctl, 1) >= 0)
+		svol->elem_events = 1;
+	svol->elem_changed = 1;
 
 	svol->elem.id = *ctl_id;
 	svol->max_val = resolution - 1;
@@ -860,12 +1322,49 @@ static int softvol_load_control(snd_pcm_t *pcm, snd_pcm_softvol_t *svol,
 	return 0;
 }
 
+/* the ctl fd follows the slave descriptors */
+static int snd_pcm_softvol_poll_descriptors_count(snd_pcm_t *pcm)
+{
+	int count = snd_pcm_generic_poll_descriptors_count(pcm);
+
+	return count < 0 ? count : count + 1;
+}
+
+static int snd_pcm_softvol_poll_descriptors(snd_pcm_t *pcm,
+					    struct pollfd *pfds,
+					    unsigned int space)
+{
+	snd_pcm_softvol_t *svol = pcm->private_data;
+	int count, err;
+
+	count = snd_pcm_generic_poll_descriptors(pcm, pfds, space);
+	if (count < 0 || (unsigned int)count >= space)
+		return count;
+	err = snd_ctl_poll_descriptors(svol->ctl, pfds + count, space - count);
+	return err < 0 ? err : count + err;
+}
+
+static int snd_pcm_softvol_poll_revents(snd_pcm_t *pcm, struct pollfd *pfds,
+					unsigned int nfds,
+					unsigned short *revents)
+{
+	snd_pcm_softvol_t *svol = pcm->private_data;
+
+	if (!nfds)
+		return -EINVAL;
+	/* drain here, the wait loop would spin on a readable ctl fd */
+	if (pfds[nfds - 1].revents & POLLIN)
+		volume_read_events(svol);
+	svol->elem_polled = 1;
+	return snd_pcm_generic_poll_revents(pcm, pfds, nfds - 1, revents);
+}
+
 static const snd_pcm_ops_t snd_pcm_softvol_ops = {
 	.close = snd_pcm_softvol_close,
 	.info = snd_pcm_generic_info,
 	.hw_refine = snd_pcm_softvol_hw_refine,
 	.hw_params = snd_pcm_softvol_hw_params,
-	.hw_free = snd_pcm_generic_hw_free,
+	.hw_free = snd_pcm_softvol_hw_free,
 	.sw_params = snd_pcm_generic_sw_params,
 	.channel_info = snd_pcm_generic_channel_info,
 	.dump = snd_pcm_softvol_dump,
@@ -876,32 +1375,15 @@ static const snd_pcm_ops_t snd_pcm_softvol_ops = {
 	.query_chmaps = snd_pcm_generic_query_chmaps,
 	.get_chmap = snd_pcm_generic_get_chmap,
 	.set_chmap = snd_pcm_generic_set_chmap,
+	.get_slave = snd_pcm_generic_get_slave,
 };
 
-/**
- * \brief Creates a new SoftVolume PCM
- * \param pcmp Returns created PCM handle
- * \param name Name of PCM
- * \param sformat Slave format
- * \param ctl_card card index of the control
- * \param ctl_id The control element
- * \param cchannels PCM channels
- * \param min_dB minimal dB value
- * \param max_dB maximal dB value
- * \param resolution resolution of control
- * \param slave Slave PCM handle
- * \param close_slave When set, the slave PCM handle is closed with copy PCM
- * \retval zero on success otherwise a negative error code
- * \warning Using of this function might be dangerous in the sense
- *          of compatibility reasons. The prototype might be freely
- *          changed in future.
- */
-int snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
-			 snd_pcm_format_t sformat,
-			 int ctl_card, snd_ctl_elem_id_t *ctl_id,
-			 int cchannels,
-			 double min_dB, double max_dB, int resolution,
-			 snd_pcm_t *slave, int close_slave)
+static int softvol_open(snd_pcm_t **pcmp, const char *name,
+			snd_pcm_format_t sformat,
+			int ctl_card, snd_ctl_elem_id_t *ctl_id,
+			int cchannels,
+			double min_dB, double max_dB, int resolution,
+			int ramp, snd_pcm_t *slave, int close_slave)
 {
 	snd_pcm_t *pcm;
 	snd_pcm_softvol_t *svol;
@@ -913,7 +1395,8 @@ int snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 	    sformat != SND_PCM_FORMAT_S24_3LE && 
 	    sformat != SND_PCM_FORMAT_S24_LE &&
 	    sformat != SND_PCM_FORMAT_S32_LE &&
-	    sformat != SND_PCM_FORMAT_S32_BE)
+	    sformat != SND_PCM_FORMAT_S32_BE &&
+	    sformat != SND_PCM_FORMAT_FLOAT)
 		return -EINVAL;
 	svol = calloc(1, sizeof(*svol));
 	if (! svol)
@@ -936,6 +1419,7 @@ int snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 	snd_pcm_plugin_init(&svol->plug);
 	svol->sformat = sformat;
 	svol->cchannels = cchannels;
+	svol->ramp = ramp;
 	svol->plug.read = snd_pcm_softvol_read_areas;
 	svol->plug.write = snd_pcm_softvol_write_areas;
 	svol->plug.undo_read = snd_pcm_plugin_undo_read_generic;
@@ -950,6 +1434,13 @@ int snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 	}
 	pcm->ops = &snd_pcm_softvol_ops;
 	pcm->fast_ops = &snd_pcm_plugin_fast_ops;
+	if (svol->elem_events) {
+		svol->fops = snd_pcm_plugin_fast_ops;
+		svol->fops.poll_descriptors_count = snd_pcm_softvol_poll_descriptors_count;
+		svol->fops.poll_descriptors = snd_pcm_softvol_poll_descriptors;
+		svol->fops.poll_revents = snd_pcm_softvol_poll_revents;
+		pcm->fast_ops = &svol->fops;
+	}
 	pcm->private_data = svol;
 	pcm->poll_fd = slave->poll_fd;
 	pcm->poll_events = slave->poll_events;
@@ -967,6 +1458,35 @@ int snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 	return 0;
 }
 
+/**
+ * \brief Creates a new SoftVolume PCM
+ * \param pcmp Returns created PCM handle
+ * \param name Name of PCM
+ * \param sformat Slave format
+ * \param ctl_card card index of the control
+ * \param ctl_id The control element
+ * \param cchannels PCM channels
+ * \param min_dB minimal dB value
+ * \param max_dB maximal dB value
+ * \param resolution resolution of control
+ * \param slave Slave PCM handle
+ * \param close_slave When set, the slave PCM handle is closed with copy PCM
+ * \retval zero on success otherwise a negative error code
+ * \warning Using of this function might be dangerous in the sense
+ *          of compatibility reasons. The prototype might be freely
+ *          changed in future.
+ */
+int snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
+			 snd_pcm_format_t sformat,
+			 int ctl_card, snd_ctl_elem_id_t *ctl_id,
+			 int cchannels,
+			 double min_dB, double max_dB, int resolution,
+			 snd_pcm_t *slave, int close_slave)
+{
+	return softvol_open(pcmp, name, sformat, ctl_card, ctl_id, cchannels,
+			    min_dB, max_dB, resolution, 0, slave, close_slave);
+}
+
 /* in pcm_misc.c */
 int snd_pcm_parse_control_id(snd_config_t *conf, snd_ctl_elem_id_t *ctl_id, int *cardp,
 			     int *cchannelsp, int *hwctlp);
@@ -978,6 +1498,10 @@ int snd_pcm_parse_control_id(snd_config_t *conf, snd_ctl_elem_id_t *ctl_id, int
 This plugin applies the software volume attenuation.
 The format, rate and channels must match for both of source and destination.
 
+With \c ramp, a change of the control value is not applied at once but
+the gain of each channel moves linearly from the old to the new value
+over one period, which avoids the zipper noise of stepped volume changes.
+
 When the control is stereo (count=2), the channels are assumed to be either
 mono, 2.0, 2.1, 4.0, 4.1, 5.1 or 7.1.
 
@@ -994,7 +1518,8 @@ pcm.name {
                 pcm STR         # Slave PCM name
                 # or
                 pcm { }         # Slave PCM definition
-                [format STR]    # Slave format
+                [format STR]    # Slave format (S16_LE, S16_BE, S24_LE,
+                                # S24_3LE, S32_LE, S32_BE or FLOAT)
         }
         control {
 	        name STR        # control element id string
@@ -1009,6 +1534,8 @@ pcm.name {
 	[max_dB REAL]           # maximal dB value (default:   0.0)
 	[resolution INT]        # resolution (default: 256)
 				# resolution = 2 means a mute switch
+	[ramp BOOL]             # ramp the gain over a period on changes
+				# (default: no)
 }
 \endcode
 
@@ -1049,6 +1576,7 @@ int _snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 	double min_dB = PRESET_MIN_DB;
 	double max_dB = ZERO_DB;
 	int card = -1, cchannels = 2;
+	int ramp = 0;
 
 	snd_config_for_each(i, next, conf) {
 		snd_config_t *n = snd_config_iterator_entry(i);
@@ -1091,6 +1619,13 @@ int _snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 			}
 			continue;
 		}
+		if (strcmp(id, "ramp") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return err;
+			ramp = err;
+			continue;
+		}
 		SNDERR("Unknown field %s", id);
 		return -EINVAL;
 	}
@@ -1133,8 +1668,9 @@ int _snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 		    sformat != SND_PCM_FORMAT_S24_3LE && 
 		    sformat != SND_PCM_FORMAT_S24_LE &&
 		    sformat != SND_PCM_FORMAT_S32_LE &&
-		    sformat != SND_PCM_FORMAT_S32_BE) {
-			SNDERR("only S16_LE, S16_BE, S24_LE, S24_3LE, S32_LE or S32_BE format is supported");
+		    sformat != SND_PCM_FORMAT_S32_BE &&
+		    sformat != SND_PCM_FORMAT_FLOAT) {
+			SNDERR("only S16_LE, S16_BE, S24_LE, S24_3LE, S32_LE, S32_BE or FLOAT format is supported");
 			snd_config_delete(sconf);
 			return -EINVAL;
 		}
@@ -1148,9 +1684,9 @@ int _snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 			snd_pcm_close(spcm);
 			return err;
 		}
-		err = snd_pcm_softvol_open(pcmp, name, sformat, card, &ctl_id,
-					   cchannels, min_dB, max_dB,
-					   resolution, spcm, 1);
+		err = softvol_open(pcmp, name, sformat, card, &ctl_id,
+				   cchannels, min_dB, max_dB, resolution,
+				   ramp, spcm, 1);
 		if (err < 0)
 			snd_pcm_close(spcm);
 	}
@@ -0,0 +1,535 @@
+/*
+ *  Soft Volume Plugin - vectorized kernels
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Volume scaling of a run of native endian samples which follow each
+ * other in memory, with one gain per sample (so that a frame pattern
+ * of per-channel gains or a ramp can be applied in one pass).  The
+ * gain is the 16.16 fixed point value of the softvol dB table where
+ * 0x10000 is the unity gain; the result is (sample * gain) >> 16,
+ * saturated to the sample width, the same as the MULTI_DIV_*() helpers
+ * of pcm_softvol.c.
+ *
+ * The scalar versions take any gain.  The vector kernels of the
+ * integer formats take attenuations only (gain <= 0x10000), where no
+ * saturation can happen; the caller has to pick the scalar version
+ * otherwise.  Each vector kernel returns the number of samples
+ * processed (a multiple of its vector width); the caller finishes the
+ * tail with the scalar version.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+enum {
+	SOFTVOL_SIMD_S16,	/* S16 */
+	SOFTVOL_SIMD_S32,	/* S32 */
+	SOFTVOL_SIMD_S24,	/* S24 in the low three bytes of 32 bits */
+	SOFTVOL_SIMD_S24_3LE,	/* S24_3LE */
+	SOFTVOL_SIMD_FLOAT,	/* FLOAT */
+	SOFTVOL_SIMD_OPS
+};
+
+#define SOFTVOL_SIMD_UNITY	0x10000
+
+typedef unsigned int (softvol_simd_func_t)(unsigned int size, void *dst,
+					   const void *src,
+					   const uint32_t *gain);
+
+/*
+ * scalar versions
+ */
+static inline int64_t softvol_scale(int32_t a, uint32_t b)
+{
+	return ((int64_t)a * b) >> 16;
+}
+
+static inline int32_t softvol_clip(int64_t v, int32_t max)
+{
+	if (v > max)
+		return max;
+	if (v < -(int64_t)max - 1)
+		return -max - 1;
+	return (int32_t)v;
+}
+
+static unsigned int softvol_c_s16(unsigned int size, void *dst,
+				  const void *src, const uint32_t *gain)
+{
+	const int16_t *s = src;
+	int16_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n < size; n++)
+		d[n] = softvol_clip(softvol_scale(s[n], gain[n]), 0x7fff);
+	return size;
+}
+
+static unsigned int softvol_c_s32(unsigned int size, void *dst,
+				  const void *src, const uint32_t *gain)
+{
+	const int32_t *s = src;
+	int32_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n < size; n++)
+		d[n] = softvol_clip(softvol_scale(s[n], gain[n]), 0x7fffffff);
+	return size;
+}
+
+static unsigned int softvol_c_s24(unsigned int size, void *dst,
+				  const void *src, const uint32_t *gain)
+{
+	const int32_t *s = src;
+	int32_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n < size; n++) {
+		int32_t a = (int32_t)((uint32_t)s[n] << 8) >> 8;
+		d[n] = softvol_clip(softvol_scale(a, gain[n]), 0x7fffff);
+	}
+	return size;
+}
+
+static unsigned int softvol_c_s24_3le(unsigned int size, void *dst,
+				      const void *src, const uint32_t *gain)
+{
+	const uint8_t *s = src;
+	uint8_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n < size; n++, s += 3, d += 3) {
+		int32_t a = s[0] | (s[1] << 8) | (((int8_t *)s)[2] << 16);
+		a = softvol_clip(softvol_scale(a, gain[n]), 0x7fffff);
+		d[0] = a;
+		d[1] = a >> 8;
+		d[2] = a >> 16;
+	}
+	return size;
+}
+
+static unsigned int softvol_c_float(unsigned int size, void *dst,
+				    const void *src, const uint32_t *gain)
+{
+	const float *s = src;
+	float *d = dst;
+	unsigned int n;
+
+	for (n = 0; n < size; n++)
+		d[n] = s[n] * ((float)gain[n] * (1.0f / 65536));
+	return size;
+}
+
+static softvol_simd_func_t *const softvol_simd_scalar[SOFTVOL_SIMD_OPS] = {
+	[SOFTVOL_SIMD_S16] = softvol_c_s16,
+	[SOFTVOL_SIMD_S32] = softvol_c_s32,
+	[SOFTVOL_SIMD_S24] = softvol_c_s24,
+	[SOFTVOL_SIMD_S24_3LE] = softvol_c_s24_3le,
+	[SOFTVOL_SIMD_FLOAT] = softvol_c_float,
+};
+
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+#if defined(__x86_64__) || defined(__i386__)
+#define SOFTVOL_SIMD_X86
+#elif (defined(__aarch64__) || defined(__ARM_NEON)) && \
+      (!defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define SOFTVOL_SIMD_NEON
+#endif
+#endif
+
+#ifdef SOFTVOL_SIMD_X86
+#include <immintrin.h>
+
+#define SOFTVOL_SIMD_TARGET(isa)	__attribute__((target(isa)))
+
+/*
+ * (a * b) >> 16 for b <= 0x10000: the fraction is split into the
+ * signed upper and the unsigned lower half of the sample so that both
+ * products fit 32 bits, the unity gain adds the sample itself
+ */
+static inline __attribute__((always_inline)) SOFTVOL_SIMD_TARGET("sse4.1")
+__m128i softvol_sse41_mul32(__m128i a, __m128i b)
+{
+	const __m128i low = _mm_set1_epi32(0xffff);
+	__m128i f = _mm_and_si128(b, low);
+	__m128i unity = _mm_sub_epi32(_mm_setzero_si128(), _mm_srli_epi32(b, 16));
+	__m128i frac = _mm_add_epi32(
+		_mm_mullo_epi32(_mm_srai_epi32(a, 16), f),
+		_mm_srli_epi32(_mm_mullo_epi32(_mm_and_si128(a, low), f), 16));
+
+	return _mm_add_epi32(frac, _mm_and_si128(a, unity));
+}
+
+/* the same for 16 bit samples, where a * fraction fits 32 bits */
+static inline __attribute__((always_inline)) SOFTVOL_SIMD_TARGET("sse4.1")
+__m128i softvol_sse41_mul16(__m128i a, __m128i b)
+{
+	__m128i f = _mm_and_si128(b, _mm_set1_epi32(0xffff));
+	__m128i unity = _mm_sub_epi32(_mm_setzero_si128(), _mm_srli_epi32(b, 16));
+
+	return _mm_add_epi32(_mm_srai_epi32(_mm_mullo_epi32(a, f), 16),
+			     _mm_and_si128(a, unity));
+}
+
+static SOFTVOL_SIMD_TARGET("sse4.1")
+unsigned int softvol_sse41_s16(unsigned int size, void *dst, const void *src,
+			       const uint32_t *gain)
+{
+	const int16_t *s = src;
+	int16_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + n));
+		__m128i lo = softvol_sse41_mul16(_mm_cvtepi16_epi32(v),
+			_mm_loadu_si128((const __m128i *)(gain + n)));
+		__m128i hi = softvol_sse41_mul16(_mm_cvtepi16_epi32(_mm_srli_si128(v, 8)),
+			_mm_loadu_si128((const __m128i *)(gain + n + 4)));
+
+		_mm_storeu_si128((__m128i *)(d + n), _mm_packs_epi32(lo, hi));
+	}
+	return n;
+}
+
+static SOFTVOL_SIMD_TARGET("sse4.1")
+unsigned int softvol_sse41_s32(unsigned int size, void *dst, const void *src,
+			       const uint32_t *gain)
+{
+	const int32_t *s = src;
+	int32_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 4 <= size; n += 4)
+		_mm_storeu_si128((__m128i *)(d + n), softvol_sse41_mul32(
+			_mm_loadu_si128((const __m128i *)(s + n)),
+			_mm_loadu_si128((const __m128i *)(gain + n))));
+	return n;
+}
+
+static SOFTVOL_SIMD_TARGET("sse4.1")
+unsigned int softvol_sse41_s24(unsigned int size, void *dst, const void *src,
+			       const uint32_t *gain)
+{
+	const int32_t *s = src;
+	int32_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 4 <= size; n += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + n));
+
+		v = _mm_srai_epi32(_mm_slli_epi32(v, 8), 8);
+		_mm_storeu_si128((__m128i *)(d + n), softvol_sse41_mul32(v,
+			_mm_loadu_si128((const __m128i *)(gain + n))));
+	}
+	return n;
+}
+
+/*
+ * each step loads 16 bytes for four samples, so keep two samples of
+ * slack at the end of the source
+ */
+static SOFTVOL_SIMD_TARGET("sse4.1")
+unsigned int softvol_sse41_s24_3le(unsigned int size, void *dst,
+				   const void *src, const uint32_t *gain)
+{
+	const uint8_t *s = src;
+	uint8_t *d = dst;
+	const __m128i expand = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5,
+					     -1, 6, 7, 8, -1, 9, 10, 11);
+	const __m128i compact = _mm_setr_epi8(1, 2, 3, 5, 6, 7, 9, 10,
+					      11, 13, 14, 15, -1, -1, -1, -1);
+	unsigned int n;
+
+	for (n = 0; n + 6 <= size; n += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + n * 3));
+		int tail;
+
+		v = _mm_srai_epi32(_mm_shuffle_epi8(v, expand), 8);
+		v = softvol_sse41_mul32(v, _mm_loadu_si128((const __m128i *)(gain + n)));
+		v = _mm_shuffle_epi8(_mm_slli_epi32(v, 8), compact);
+		_mm_storel_epi64((__m128i *)(d + n * 3), v);
+		tail = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+		memcpy(d + n * 3 + 8, &tail, 4);
+	}
+	return n;
+}
+
+static SOFTVOL_SIMD_TARGET("sse4.1")
+unsigned int softvol_sse41_float(unsigned int size, void *dst, const void *src,
+				 const uint32_t *gain)
+{
+	const float *s = src;
+	float *d = dst;
+	const __m128 scale = _mm_set1_ps(1.0f / 65536);
+	unsigned int n;
+
+	for (n = 0; n + 4 <= size; n += 4) {
+		__m128 g = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(gain + n)));
+
+		_mm_storeu_ps(d + n, _mm_mul_ps(_mm_loadu_ps(s + n),
+						_mm_mul_ps(g, scale)));
+	}
+	return n;
+}
+
+static inline __attribute__((always_inline)) SOFTVOL_SIMD_TARGET("avx2")
+__m256i softvol_avx2_mul32(__m256i a, __m256i b)
+{
+	const __m256i low = _mm256_set1_epi32(0xffff);
+	__m256i f = _mm256_and_si256(b, low);
+	__m256i unity = _mm256_sub_epi32(_mm256_setzero_si256(),
+					 _mm256_srli_epi32(b, 16));
+	__m256i frac = _mm256_add_epi32(
+		_mm256_mullo_epi32(_mm256_srai_epi32(a, 16), f),
+		_mm256_srli_epi32(_mm256_mullo_epi32(_mm256_and_si256(a, low), f), 16));
+
+	return _mm256_add_epi32(frac, _mm256_and_si256(a, unity));
+}
+
+static inline __attribute__((always_inline)) SOFTVOL_SIMD_TARGET("avx2")
+__m256i softvol_avx2_mul16(__m256i a, __m256i b)
+{
+	__m256i f = _mm256_and_si256(b, _mm256_set1_epi32(0xffff));
+	__m256i unity = _mm256_sub_epi32(_mm256_setzero_si256(),
+					 _mm256_srli_epi32(b, 16));
+
+	return _mm256_add_epi32(_mm256_srai_epi32(_mm256_mullo_epi32(a, f), 16),
+				_mm256_and_si256(a, unity));
+}
+
+static SOFTVOL_SIMD_TARGET("avx2")
+unsigned int softvol_avx2_s16(unsigned int size, void *dst, const void *src,
+			      const uint32_t *gain)
+{
+	const int16_t *s = src;
+	int16_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 16 <= size; n += 16) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(s + n));
+		__m256i lo = softvol_avx2_mul16(
+			_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v)),
+			_mm256_loadu_si256((const __m256i *)(gain + n)));
+		__m256i hi = softvol_avx2_mul16(
+			_mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1)),
+			_mm256_loadu_si256((const __m256i *)(gain + n + 8)));
+
+		/* packs works per 128 bit lane, restore the order */
+		_mm256_storeu_si256((__m256i *)(d + n),
+			_mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xd8));
+	}
+	return n;
+}
+
+static SOFTVOL_SIMD_TARGET("avx2")
+unsigned int softvol_avx2_s32(unsigned int size, void *dst, const void *src,
+			      const uint32_t *gain)
+{
+	const int32_t *s = src;
+	int32_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8)
+		_mm256_storeu_si256((__m256i *)(d + n), softvol_avx2_mul32(
+			_mm256_loadu_si256((const __m256i *)(s + n)),
+			_mm256_loadu_si256((const __m256i *)(gain + n))));
+	return n;
+}
+
+static SOFTVOL_SIMD_TARGET("avx2")
+unsigned int softvol_avx2_s24(unsigned int size, void *dst, const void *src,
+			      const uint32_t *gain)
+{
+	const int32_t *s = src;
+	int32_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(s + n));
+
+		v = _mm256_srai_epi32(_mm256_slli_epi32(v, 8), 8);
+		_mm256_storeu_si256((__m256i *)(d + n), softvol_avx2_mul32(v,
+			_mm256_loadu_si256((const __m256i *)(gain + n))));
+	}
+	return n;
+}
+
+static SOFTVOL_SIMD_TARGET("avx2")
+unsigned int softvol_avx2_float(unsigned int size, void *dst, const void *src,
+				const uint32_t *gain)
+{
+	const float *s = src;
+	float *d = dst;
+	const __m256 scale = _mm256_set1_ps(1.0f / 65536);
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		__m256 g = _mm256_cvtepi32_ps(
+			_mm256_loadu_si256((const __m256i *)(gain + n)));
+
+		_mm256_storeu_ps(d + n, _mm256_mul_ps(_mm256_loadu_ps(s + n),
+						      _mm256_mul_ps(g, scale)));
+	}
+	return n;
+}
+
+static int softvol_simd_have_sse41(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse4.1");
+}
+
+static int softvol_simd_have_avx2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+#endif /* SOFTVOL_SIMD_X86 */
+
+#ifdef SOFTVOL_SIMD_NEON
+#include <arm_neon.h>
+
+static inline int32x4_t softvol_neon_mul32(int32x4_t a, uint32x4_t b)
+{
+	const uint32x4_t low = vdupq_n_u32(0xffff);
+	uint32x4_t f = vandq_u32(b, low);
+	int32x4_t unity = vnegq_s32(vreinterpretq_s32_u32(vshrq_n_u32(b, 16)));
+	int32x4_t frac = vaddq_s32(
+		vmulq_s32(vshrq_n_s32(a, 16), vreinterpretq_s32_u32(f)),
+		vreinterpretq_s32_u32(vshrq_n_u32(
+			vmulq_u32(vandq_u32(vreinterpretq_u32_s32(a), low), f), 16)));
+
+	return vaddq_s32(frac, vandq_s32(a, unity));
+}
+
+static inline int32x4_t softvol_neon_mul16(int32x4_t a, uint32x4_t b)
+{
+	int32x4_t f = vreinterpretq_s32_u32(vandq_u32(b, vdupq_n_u32(0xffff)));
+	int32x4_t unity = vnegq_s32(vreinterpretq_s32_u32(vshrq_n_u32(b, 16)));
+
+	return vaddq_s32(vshrq_n_s32(vmulq_s32(a, f), 16), vandq_s32(a, unity));
+}
+
+static unsigned int softvol_neon_s16(unsigned int size, void *dst,
+				     const void *src, const uint32_t *gain)
+{
+	const int16_t *s = src;
+	int16_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		int16x8_t v = vld1q_s16(s + n);
+		int32x4_t lo = softvol_neon_mul16(vmovl_s16(vget_low_s16(v)),
+						  vld1q_u32(gain + n));
+		int32x4_t hi = softvol_neon_mul16(vmovl_s16(vget_high_s16(v)),
+						  vld1q_u32(gain + n + 4));
+
+		vst1q_s16(d + n, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+	}
+	return n;
+}
+
+static unsigned int softvol_neon_s32(unsigned int size, void *dst,
+				     const void *src, const uint32_t *gain)
+{
+	const int32_t *s = src;
+	int32_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 4 <= size; n += 4)
+		vst1q_s32(d + n, softvol_neon_mul32(vld1q_s32(s + n),
+						    vld1q_u32(gain + n)));
+	return n;
+}
+
+static unsigned int softvol_neon_s24(unsigned int size, void *dst,
+				     const void *src, const uint32_t *gain)
+{
+	const int32_t *s = src;
+	int32_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 4 <= size; n += 4) {
+		int32x4_t v = vshrq_n_s32(vshlq_n_s32(vld1q_s32(s + n), 8), 8);
+
+		vst1q_s32(d + n, softvol_neon_mul32(v, vld1q_u32(gain + n)));
+	}
+	return n;
+}
+
+static unsigned int softvol_neon_float(unsigned int size, void *dst,
+				       const void *src, const uint32_t *gain)
+{
+	const float *s = src;
+	float *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 4 <= size; n += 4) {
+		float32x4_t g = vmulq_n_f32(vcvtq_f32_u32(vld1q_u32(gain + n)),
+					    1.0f / 65536);
+
+		vst1q_f32(d + n, vmulq_f32(vld1q_f32(s + n), g));
+	}
+	return n;
+}
+
+static int softvol_simd_have_neon(void)
+{
+	return 1;
+}
+
+#endif /* SOFTVOL_SIMD_NEON */
+
+/*
+ * kernel table, ordered by preference
+ */
+typedef struct {
+	const char *name;
+	int (*available)(void);
+	softvol_simd_func_t *op[SOFTVOL_SIMD_OPS];
+} softvol_simd_kernel_t;
+
+static const softvol_simd_kernel_t softvol_simd_kernels[] = {
+#ifdef SOFTVOL_SIMD_X86
+	{ "avx2", softvol_simd_have_avx2, {
+		[SOFTVOL_SIMD_S16] = softvol_avx2_s16,
+		[SOFTVOL_SIMD_S32] = softvol_avx2_s32,
+		[SOFTVOL_SIMD_S24] = softvol_avx2_s24,
+		[SOFTVOL_SIMD_FLOAT] = softvol_avx2_float,
+	} },
+	{ "sse4.1", softvol_simd_have_sse41, {
+		[SOFTVOL_SIMD_S16] = softvol_sse41_s16,
+		[SOFTVOL_SIMD_S32] = softvol_sse41_s32,
+		[SOFTVOL_SIMD_S24] = softvol_sse41_s24,
+		[SOFTVOL_SIMD_S24_3LE] = softvol_sse41_s24_3le,
+		[SOFTVOL_SIMD_FLOAT] = softvol_sse41_float,
+	} },
+#endif
+#ifdef SOFTVOL_SIMD_NEON
+	{ "neon", softvol_simd_have_neon, {
+		[SOFTVOL_SIMD_S16] = softvol_neon_s16,
+		[SOFTVOL_SIMD_S32] = softvol_neon_s32,
+		[SOFTVOL_SIMD_S24] = softvol_neon_s24,
+		[SOFTVOL_SIMD_FLOAT] = softvol_neon_float,
+	} },
+#endif
+	{ NULL, NULL, { NULL } }
+};
@@ -0,0 +1,335 @@
+/**
+ * \file pcm/pcm_stats.c
+ * \ingroup PCM
+ * \brief PCM Plugin Chain Statistics
+ * \date 2026
+ *
+ * Per-PCM accounting of the time spent in the plugin chain.
+ */
+/*
+ *  PCM Interface - plugin chain statistics
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "pcm_local.h"
+
+#ifndef DOC_HIDDEN
+
+void snd_pcm_stats_now(snd_htimestamp_t *tstamp)
+{
+	gettimestamp(tstamp, SND_PCM_TSTAMP_TYPE_MONOTONIC);
+}
+
+void snd_pcm_stats_add(snd_pcm_t *pcm, snd_pcm_stats_op_t op,
+		       const snd_htimestamp_t *start,
+		       snd_pcm_uframes_t frames, size_t bytes)
+{
+	snd_pcm_stats_counter_t *counter = &pcm->stats->op[op];
+	snd_htimestamp_t now;
+	long long ns;
+
+	/* enabled while the operation ran */
+	if (!start->tv_sec && !start->tv_nsec)
+		return;
+	snd_pcm_stats_now(&now);
+	ns = (now.tv_sec - start->tv_sec) * 1000000000LL +
+		now.tv_nsec - start->tv_nsec;
+	if (ns < 0)
+		ns = 0;
+	counter->calls++;
+	counter->time += ns;
+	if ((unsigned long long)ns > counter->max_time)
+		counter->max_time = ns;
+	pcm->stats->frames += frames;
+	pcm->stats->bytes += bytes;
+}
+
+static snd_pcm_t *stats_slave(snd_pcm_t *pcm)
+{
+	if (!pcm->ops->get_slave)
+		return NULL;
+	return pcm->ops->get_slave(pcm->op_arg);
+}
+
+/* enable the accounting on the slave chain when the PCM has it enabled */
+int snd_pcm_stats_inherit(snd_pcm_t *pcm, snd_pcm_t *slave)
+{
+	if (!pcm->stats)
+		return 0;
+	return snd_pcm_stats_enable(slave, 1);
+}
+
+#endif /* DOC_HIDDEN */
+
+/**
+ * \brief Enable or disable the statistics of a PCM chain
+ * \param pcm PCM handle
+ * \param enable 1 to enable the accounting, 0 to disable it
+ * \return 0 on success otherwise a negative error code
+ *
+ * The accounting is switched for the PCM and all its slaves.  Disabling
+ * it discards the counters.  Plugins inserted later by the plug PCM
+ * inherit the setting.
+ */
+int snd_pcm_stats_enable(snd_pcm_t *pcm, int enable)
+{
+	assert(pcm);
+	for (; pcm; pcm = stats_slave(pcm)) {
+		snd_pcm_lock(pcm);
+		if (!enable) {
+			free(pcm->stats);
+			pcm->stats = NULL;
+		} else if (!pcm->stats) {
+			pcm->stats = calloc(1, sizeof(*pcm->stats));
+			if (!pcm->stats) {
+				snd_pcm_unlock(pcm);
+				return -ENOMEM;
+			}
+		}
+		snd_pcm_unlock(pcm);
+	}
+	return 0;
+}
+
+/**
+ * \brief Reset the statistics of a PCM chain
+ * \param pcm PCM handle
+ * \return 0 on success otherwise a negative error code
+ */
+int snd_pcm_stats_reset(snd_pcm_t *pcm)
+{
+	assert(pcm);
+	for (; pcm; pcm = stats_slave(pcm)) {
+		snd_pcm_lock(pcm);
+		if (pcm->stats)
+			memset(pcm->stats, 0, sizeof(*pcm->stats));
+		snd_pcm_unlock(pcm);
+	}
+	return 0;
+}
+
+/* the delay of the PCM and its slaves in us */
+static long stats_delay(snd_pcm_t *pcm)
+{
+	snd_pcm_sframes_t delay;
+
+	if (!pcm->setup || !pcm->rate)
+		return 0;
+	if (snd_pcm_delay(pcm, &delay) < 0)
+		return 0;
+	return (long long)delay * 1000000LL / pcm->rate;
+}
+
+/**
+ * \brief Obtain the statistics of a PCM in a chain
+ * \param pcm PCM handle
+ * \param index position in the chain, 0 is the PCM itself, 1 its slave...
+ * \param stats Returned statistics
+ * \return 0 on success, -ENOENT past the end of the chain, otherwise a
+ *         negative error code
+ *
+ * The counters are zero when the accounting is not enabled for the PCM.
+ */
+int snd_pcm_stats(snd_pcm_t *pcm, unsigned int index, snd_pcm_stats_t *stats)
+{
+	snd_pcm_t *slave;
+	long latency;
+
+	assert(pcm && stats);
+	for (; index > 0 && pcm; index--)
+		pcm = stats_slave(pcm);
+	if (!pcm)
+		return -ENOENT;
+
+	snd_pcm_lock(pcm);
+	if (pcm->stats)
+		*stats = *pcm->stats;
+	else
+		memset(stats, 0, sizeof(*stats));
+	snd_pcm_unlock(pcm);
+	stats->type = pcm->type;
+	stats->name = pcm->name;
+
+	latency = stats_delay(pcm);
+	slave = stats_slave(pcm);
+	if (slave)
+		latency -= stats_delay(slave);
+	stats->latency = latency > 0 ? latency : 0;
+	return 0;
+}
+
+static const char *const stats_op_names[] = {
+	[SND_PCM_STATS_TRANSFER] = "transfer",
+	[SND_PCM_STATS_MMAP_COMMIT] = "mmap_commit",
+	[SND_PCM_STATS_AVAIL_UPDATE] = "avail_update",
+	[SND_PCM_STATS_HWSYNC] = "hwsync",
+};
+
+/**
+ * \brief get name of a PCM statistics operation
+ * \param op operation
+ * \return ascii name of the operation
+ */
+const char *snd_pcm_stats_op_name(const snd_pcm_stats_op_t op)
+{
+	if (op > SND_PCM_STATS_LAST)
+		return NULL;
+	return stats_op_names[op];
+}
+
+/**
+ * \brief get size of #snd_pcm_stats_t
+ * \return size in bytes
+ */
+size_t snd_pcm_stats_sizeof(void)
+{
+	return sizeof(snd_pcm_stats_t);
+}
+
+/**
+ * \brief allocate an invalid #snd_pcm_stats_t using standard malloc
+ * \param ptr returned pointer
+ * \return 0 on success otherwise negative error code
+ */
+int snd_pcm_stats_malloc(snd_pcm_stats_t **ptr)
+{
+	assert(ptr);
+	*ptr = calloc(1, sizeof(snd_pcm_stats_t));
+	if (!*ptr)
+		return -ENOMEM;
+	return 0;
+}
+
+/**
+ * \brief frees a previously allocated #snd_pcm_stats_t
+ * \param obj pointer to object to free
+ */
+void snd_pcm_stats_free(snd_pcm_stats_t *obj)
+{
+	free(obj);
+}
+
+/**
+ * \brief copy one #snd_pcm_stats_t to another
+ * \param dst pointer to destination
+ * \param src pointer to source
+ */
+void snd_pcm_stats_copy(snd_pcm_stats_t *dst, const snd_pcm_stats_t *src)
+{
+	assert(dst && src);
+	*dst = *src;
+}
+
+/**
+ * \brief Get the name of the PCM from its statistics
+ * \param obj #snd_pcm_stats_t pointer
+ * \return PCM name, valid until the PCM is closed
+ */
+const char *snd_pcm_stats_get_name(const snd_pcm_stats_t *obj)
+{
+	assert(obj);
+	return obj->name;
+}
+
+/**
+ * \brief Get the type of the PCM from its statistics
+ * \param obj #snd_pcm_stats_t pointer
+ * \return PCM type
+ */
+snd_pcm_type_t snd_pcm_stats_get_type(const snd_pcm_stats_t *obj)
+{
+	assert(obj);
+	return obj->type;
+}
+
+/**
+ * \brief Get the number of calls of an operation
+ * \param obj #snd_pcm_stats_t pointer
+ * \param op operation
+ * \return number of calls
+ */
+unsigned long long snd_pcm_stats_get_calls(const snd_pcm_stats_t *obj,
+					   snd_pcm_stats_op_t op)
+{
+	assert(obj && op <= SND_PCM_STATS_LAST);
+	return obj->op[op].calls;
+}
+
+/**
+ * \brief Get the total time spent in an operation
+ * \param obj #snd_pcm_stats_t pointer
+ * \param op operation
+ * \return time in nanoseconds
+ */
+unsigned long long snd_pcm_stats_get_time(const snd_pcm_stats_t *obj,
+					  snd_pcm_stats_op_t op)
+{
+	assert(obj && op <= SND_PCM_STATS_LAST);
+	return obj->op[op].time;
+}
+
+/**
+ * \brief Get the longest call of an operation
+ * \param obj #snd_pcm_stats_t pointer
+ * \param op operation
+ * \return time in nanoseconds
+ */
+unsigned long long snd_pcm_stats_get_max_time(const snd_pcm_stats_t *obj,
+					      snd_pcm_stats_op_t op)
+{
+	assert(obj && op <= SND_PCM_STATS_LAST);
+	return obj->op[op].max_time;
+}
+
+/**
+ * \brief Get the number of frames converted by the PCM itself
+ * \param obj #snd_pcm_stats_t pointer
+ * \return frames
+ */
+unsigned long long snd_pcm_stats_get_frames(const snd_pcm_stats_t *obj)
+{
+	assert(obj);
+	return obj->frames;
+}
+
+/**
+ * \brief Get the number of bytes read and written by the conversion
+ * \param obj #snd_pcm_stats_t pointer
+ * \return bytes
+ */
+unsigned long long snd_pcm_stats_get_bytes(const snd_pcm_stats_t *obj)
+{
+	assert(obj);
+	return obj->bytes;
+}
+
+/**
+ * \brief Get the latency the PCM adds on top of its slave
+ * \param obj #snd_pcm_stats_t pointer
+ * \return latency in microseconds
+ *
+ * This is the time of the samples buffered by the PCM itself when the
+ * snapshot was taken.
+ */
+long snd_pcm_stats_get_latency(const snd_pcm_stats_t *obj)
+{
+	assert(obj);
+	return obj->latency;
+}
@@ -0,0 +1,673 @@
+/*
+ *  Plugin sample operators - vectorized kernels for contiguous areas
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * The most common conversions of the linear and lfloat plugins between
+ * native endian formats, working on a run of samples which follow each
+ * other in memory (interleaved areas, or a single channel with the
+ * sample width as step).  The scalar versions are the reference and
+ * give the same results as the plugin_ops.h labels.
+ *
+ * Each vector kernel returns the number of samples processed (a
+ * multiple of its vector width); the caller finishes the tail with the
+ * scalar version.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+enum {
+	CONV_SIMD_S16_S32,	/* S16 -> S32 */
+	CONV_SIMD_S32_S16,	/* S32 -> S16 */
+	CONV_SIMD_S24_3LE_S32,	/* S24_3LE -> S32 */
+	CONV_SIMD_S32_S24_3LE,	/* S32 -> S24_3LE */
+	CONV_SIMD_S16_FLOAT,	/* S16 -> FLOAT */
+	CONV_SIMD_FLOAT_S16,	/* FLOAT -> S16 */
+	CONV_SIMD_S32_FLOAT,	/* S32 -> FLOAT */
+	CONV_SIMD_FLOAT_S32,	/* FLOAT -> S32 */
+	CONV_SIMD_OPS
+};
+
+typedef unsigned int (conv_simd_func_t)(unsigned int size, void *dst,
+					const void *src);
+
+/*
+ * scalar versions
+ */
+static inline int32_t conv_float_to_s32(float f)
+{
+	if (f >= 1.0)
+		return 0x7fffffff;
+	if (f <= -1.0)
+		return (int32_t)0x80000000;
+	return (int32_t)(f * (float)0x80000000UL);
+}
+
+static unsigned int conv_c_s16_s32(unsigned int size, void *dst, const void *src)
+{
+	const int16_t *s = src;
+	int32_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n < size; n++)
+		d[n] = (int32_t)((uint32_t)(uint16_t)s[n] << 16);
+	return size;
+}
+
+static unsigned int conv_c_s32_s16(unsigned int size, void *dst, const void *src)
+{
+	const int32_t *s = src;
+	int16_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n < size; n++)
+		d[n] = s[n] >> 16;
+	return size;
+}
+
+static unsigned int conv_c_s24_3le_s32(unsigned int size, void *dst,
+				       const void *src)
+{
+	const uint8_t *s = src;
+	int32_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n < size; n++, s += 3)
+		d[n] = (int32_t)((uint32_t)s[0] << 8 | (uint32_t)s[1] << 16 |
+				 (uint32_t)s[2] << 24);
+	return size;
+}
+
+static unsigned int conv_c_s32_s24_3le(unsigned int size, void *dst,
+				       const void *src)
+{
+	const int32_t *s = src;
+	uint8_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n < size; n++, d += 3) {
+		d[0] = s[n] >> 8;
+		d[1] = s[n] >> 16;
+		d[2] = s[n] >> 24;
+	}
+	return size;
+}
+
+static unsigned int conv_c_s16_float(unsigned int size, void *dst,
+				     const void *src)
+{
+	const int16_t *s = src;
+	float *d = dst;
+	unsigned int n;
+
+	for (n = 0; n < size; n++)
+		d[n] = (float)s[n] / (float)0x8000;
+	return size;
+}
+
+static unsigned int conv_c_float_s16(unsigned int size, void *dst,
+				     const void *src)
+{
+	const float *s = src;
+	int16_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n < size; n++)
+		d[n] = conv_float_to_s32(s[n]) >> 16;
+	return size;
+}
+
+static unsigned int conv_c_s32_float(unsigned int size, void *dst,
+				     const void *src)
+{
+	const int32_t *s = src;
+	float *d = dst;
+	unsigned int n;
+
+	for (n = 0; n < size; n++)
+		d[n] = (float)s[n] / (float)0x80000000UL;
+	return size;
+}
+
+static unsigned int conv_c_float_s32(unsigned int size, void *dst,
+				     const void *src)
+{
+	const float *s = src;
+	int32_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n < size; n++)
+		d[n] = conv_float_to_s32(s[n]);
+	return size;
+}
+
+static conv_simd_func_t *const conv_simd_scalar[CONV_SIMD_OPS] = {
+	[CONV_SIMD_S16_S32] = conv_c_s16_s32,
+	[CONV_SIMD_S32_S16] = conv_c_s32_s16,
+	[CONV_SIMD_S24_3LE_S32] = conv_c_s24_3le_s32,
+	[CONV_SIMD_S32_S24_3LE] = conv_c_s32_s24_3le,
+	[CONV_SIMD_S16_FLOAT] = conv_c_s16_float,
+	[CONV_SIMD_FLOAT_S16] = conv_c_float_s16,
+	[CONV_SIMD_S32_FLOAT] = conv_c_s32_float,
+	[CONV_SIMD_FLOAT_S32] = conv_c_float_s32,
+};
+
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+#if defined(__x86_64__) || defined(__i386__)
+#define CONV_SIMD_X86
+#elif (defined(__aarch64__) || defined(__ARM_NEON)) && \
+      (!defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define CONV_SIMD_NEON
+#endif
+#endif
+
+#ifdef CONV_SIMD_X86
+#include <immintrin.h>
+
+#define CONV_SIMD_TARGET(isa)	__attribute__((target(isa)))
+
+static CONV_SIMD_TARGET("sse2")
+unsigned int conv_sse2_s16_s32(unsigned int size, void *dst, const void *src)
+{
+	const int16_t *s = src;
+	int32_t *d = dst;
+	const __m128i zero = _mm_setzero_si128();
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + n));
+
+		/* the sample lands in the upper half of each dword */
+		_mm_storeu_si128((__m128i *)(d + n), _mm_unpacklo_epi16(zero, v));
+		_mm_storeu_si128((__m128i *)(d + n + 4), _mm_unpackhi_epi16(zero, v));
+	}
+	return n;
+}
+
+static CONV_SIMD_TARGET("sse2")
+unsigned int conv_sse2_s32_s16(unsigned int size, void *dst, const void *src)
+{
+	const int32_t *s = src;
+	int16_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		__m128i lo = _mm_loadu_si128((const __m128i *)(s + n));
+		__m128i hi = _mm_loadu_si128((const __m128i *)(s + n + 4));
+
+		lo = _mm_srai_epi32(lo, 16);
+		hi = _mm_srai_epi32(hi, 16);
+		_mm_storeu_si128((__m128i *)(d + n), _mm_packs_epi32(lo, hi));
+	}
+	return n;
+}
+
+/* float -> s32 with the clipping of conv_float_to_s32() */
+static inline __attribute__((always_inline)) CONV_SIMD_TARGET("sse2")
+__m128i conv_sse2_float_to_s32(__m128 f)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	__m128i v = _mm_cvttps_epi32(_mm_mul_ps(f, _mm_set1_ps(2147483648.0f)));
+	__m128i over = _mm_castps_si128(_mm_cmpge_ps(f, one));
+
+	/* cvttps gives 0x80000000 for anything out of range */
+	return _mm_or_si128(_mm_andnot_si128(over, v),
+			    _mm_and_si128(over, _mm_set1_epi32(0x7fffffff)));
+}
+
+static CONV_SIMD_TARGET("sse2")
+unsigned int conv_sse2_s16_float(unsigned int size, void *dst, const void *src)
+{
+	const int16_t *s = src;
+	float *d = dst;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + n));
+		__m128i lo = _mm_unpacklo_epi16(zero, v);
+		__m128i hi = _mm_unpackhi_epi16(zero, v);
+
+		_mm_storeu_ps(d + n, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(d + n + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+	return n;
+}
+
+static CONV_SIMD_TARGET("sse2")
+unsigned int conv_sse2_float_s16(unsigned int size, void *dst, const void *src)
+{
+	const float *s = src;
+	int16_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		__m128i lo = conv_sse2_float_to_s32(_mm_loadu_ps(s + n));
+		__m128i hi = conv_sse2_float_to_s32(_mm_loadu_ps(s + n + 4));
+
+		lo = _mm_srai_epi32(lo, 16);
+		hi = _mm_srai_epi32(hi, 16);
+		_mm_storeu_si128((__m128i *)(d + n), _mm_packs_epi32(lo, hi));
+	}
+	return n;
+}
+
+static CONV_SIMD_TARGET("sse2")
+unsigned int conv_sse2_s32_float(unsigned int size, void *dst, const void *src)
+{
+	const int32_t *s = src;
+	float *d = dst;
+	const __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+	unsigned int n;
+
+	for (n = 0; n + 4 <= size; n += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + n));
+
+		_mm_storeu_ps(d + n, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+	}
+	return n;
+}
+
+static CONV_SIMD_TARGET("sse2")
+unsigned int conv_sse2_float_s32(unsigned int size, void *dst, const void *src)
+{
+	const float *s = src;
+	int32_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 4 <= size; n += 4)
+		_mm_storeu_si128((__m128i *)(d + n),
+				 conv_sse2_float_to_s32(_mm_loadu_ps(s + n)));
+	return n;
+}
+
+/*
+ * S24_3LE: each step loads 16 bytes for four samples, so keep two
+ * samples of slack at the end of the source
+ */
+static CONV_SIMD_TARGET("ssse3")
+unsigned int conv_ssse3_s24_3le_s32(unsigned int size, void *dst,
+				    const void *src)
+{
+	const uint8_t *s = src;
+	int32_t *d = dst;
+	const __m128i expand = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5,
+					     -1, 6, 7, 8, -1, 9, 10, 11);
+	unsigned int n;
+
+	for (n = 0; n + 6 <= size; n += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + n * 3));
+
+		_mm_storeu_si128((__m128i *)(d + n), _mm_shuffle_epi8(v, expand));
+	}
+	return n;
+}
+
+static CONV_SIMD_TARGET("ssse3")
+unsigned int conv_ssse3_s32_s24_3le(unsigned int size, void *dst,
+				    const void *src)
+{
+	const int32_t *s = src;
+	uint8_t *d = dst;
+	const __m128i compact = _mm_setr_epi8(1, 2, 3, 5, 6, 7, 9, 10,
+					      11, 13, 14, 15, -1, -1, -1, -1);
+	unsigned int n;
+
+	for (n = 0; n + 4 <= size; n += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + n));
+		int tail;
+
+		v = _mm_shuffle_epi8(v, compact);
+		_mm_storel_epi64((__m128i *)(d + n * 3), v);
+		tail = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+		memcpy(d + n * 3 + 8, &tail, 4);
+	}
+	return n;
+}
+
+static CONV_SIMD_TARGET("avx2")
+unsigned int conv_avx2_s16_s32(unsigned int size, void *dst, const void *src)
+{
+	const int16_t *s = src;
+	int32_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 16 <= size; n += 16) {
+		__m128i lo = _mm_loadu_si128((const __m128i *)(s + n));
+		__m128i hi = _mm_loadu_si128((const __m128i *)(s + n + 8));
+
+		_mm256_storeu_si256((__m256i *)(d + n),
+				    _mm256_slli_epi32(_mm256_cvtepi16_epi32(lo), 16));
+		_mm256_storeu_si256((__m256i *)(d + n + 8),
+				    _mm256_slli_epi32(_mm256_cvtepi16_epi32(hi), 16));
+	}
+	return n;
+}
+
+static CONV_SIMD_TARGET("avx2")
+unsigned int conv_avx2_s32_s16(unsigned int size, void *dst, const void *src)
+{
+	const int32_t *s = src;
+	int16_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 16 <= size; n += 16) {
+		__m256i lo = _mm256_loadu_si256((const __m256i *)(s + n));
+		__m256i hi = _mm256_loadu_si256((const __m256i *)(s + n + 8));
+
+		lo = _mm256_srai_epi32(lo, 16);
+		hi = _mm256_srai_epi32(hi, 16);
+		/* packs works per 128-bit lane, restore the sample order */
+		_mm256_storeu_si256((__m256i *)(d + n),
+				    _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xd8));
+	}
+	return n;
+}
+
+static inline __attribute__((always_inline)) CONV_SIMD_TARGET("avx2")
+__m256i conv_avx2_float_to_s32(__m256 f)
+{
+	__m256i v = _mm256_cvttps_epi32(_mm256_mul_ps(f, _mm256_set1_ps(2147483648.0f)));
+	__m256 over = _mm256_cmp_ps(f, _mm256_set1_ps(1.0f), _CMP_GE_OQ);
+
+	return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(v),
+						    _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff)),
+						    over));
+}
+
+static CONV_SIMD_TARGET("avx2")
+unsigned int conv_avx2_s16_float(unsigned int size, void *dst, const void *src)
+{
+	const int16_t *s = src;
+	float *d = dst;
+	const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		__m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(s + n)));
+
+		_mm256_storeu_ps(d + n, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+	}
+	return n;
+}
+
+static CONV_SIMD_TARGET("avx2")
+unsigned int conv_avx2_float_s16(unsigned int size, void *dst, const void *src)
+{
+	const float *s = src;
+	int16_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 16 <= size; n += 16) {
+		__m256i lo = conv_avx2_float_to_s32(_mm256_loadu_ps(s + n));
+		__m256i hi = conv_avx2_float_to_s32(_mm256_loadu_ps(s + n + 8));
+
+		lo = _mm256_srai_epi32(lo, 16);
+		hi = _mm256_srai_epi32(hi, 16);
+		_mm256_storeu_si256((__m256i *)(d + n),
+				    _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xd8));
+	}
+	return n;
+}
+
+static CONV_SIMD_TARGET("avx2")
+unsigned int conv_avx2_s32_float(unsigned int size, void *dst, const void *src)
+{
+	const int32_t *s = src;
+	float *d = dst;
+	const __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(s + n));
+
+		_mm256_storeu_ps(d + n, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+	}
+	return n;
+}
+
+static CONV_SIMD_TARGET("avx2")
+unsigned int conv_avx2_float_s32(unsigned int size, void *dst, const void *src)
+{
+	const float *s = src;
+	int32_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8)
+		_mm256_storeu_si256((__m256i *)(d + n),
+				    conv_avx2_float_to_s32(_mm256_loadu_ps(s + n)));
+	return n;
+}
+
+static int conv_simd_have_sse2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+}
+
+static int conv_simd_have_ssse3(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("ssse3");
+}
+
+static int conv_simd_have_avx2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+#endif /* CONV_SIMD_X86 */
+
+#ifdef CONV_SIMD_NEON
+#include <arm_neon.h>
+
+static unsigned int conv_neon_s16_s32(unsigned int size, void *dst,
+				      const void *src)
+{
+	const int16_t *s = src;
+	int32_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		int16x8_t v = vld1q_s16(s + n);
+
+		vst1q_s32(d + n, vshll_n_s16(vget_low_s16(v), 16));
+		vst1q_s32(d + n + 4, vshll_n_s16(vget_high_s16(v), 16));
+	}
+	return n;
+}
+
+static unsigned int conv_neon_s32_s16(unsigned int size, void *dst,
+				      const void *src)
+{
+	const int32_t *s = src;
+	int16_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8)
+		vst1q_s16(d + n, vcombine_s16(vshrn_n_s32(vld1q_s32(s + n), 16),
+					      vshrn_n_s32(vld1q_s32(s + n + 4), 16)));
+	return n;
+}
+
+static unsigned int conv_neon_s24_3le_s32(unsigned int size, void *dst,
+					  const void *src)
+{
+	const uint8_t *s = src;
+	int32_t *d = dst;
+	const uint8x16_t zero = vdupq_n_u8(0);
+	unsigned int n;
+
+	for (n = 0; n + 16 <= size; n += 16) {
+		uint8x16x3_t v = vld3q_u8(s + n * 3);
+		/* (0, b0) and (b1, b2) byte pairs, then both pairs per dword */
+		uint8x16x2_t lo = vzipq_u8(zero, v.val[0]);
+		uint8x16x2_t hi = vzipq_u8(v.val[1], v.val[2]);
+		uint16x8x2_t a = vzipq_u16(vreinterpretq_u16_u8(lo.val[0]),
+					   vreinterpretq_u16_u8(hi.val[0]));
+		uint16x8x2_t b = vzipq_u16(vreinterpretq_u16_u8(lo.val[1]),
+					   vreinterpretq_u16_u8(hi.val[1]));
+
+		vst1q_s32(d + n, vreinterpretq_s32_u16(a.val[0]));
+		vst1q_s32(d + n + 4, vreinterpretq_s32_u16(a.val[1]));
+		vst1q_s32(d + n + 8, vreinterpretq_s32_u16(b.val[0]));
+		vst1q_s32(d + n + 12, vreinterpretq_s32_u16(b.val[1]));
+	}
+	return n;
+}
+
+static unsigned int conv_neon_s32_s24_3le(unsigned int size, void *dst,
+					  const void *src)
+{
+	const int32_t *s = src;
+	uint8_t *d = dst;
+	unsigned int n;
+
+	for (n = 0; n + 16 <= size; n += 16) {
+		uint8x16x4_t v = vld4q_u8((const uint8_t *)(s + n));
+		uint8x16x3_t o;
+
+		o.val[0] = v.val[1];
+		o.val[1] = v.val[2];
+		o.val[2] = v.val[3];
+		vst3q_u8(d + n * 3, o);
+	}
+	return n;
+}
+
+/* vcvtq saturates like conv_float_to_s32() clips */
+static unsigned int conv_neon_s16_float(unsigned int size, void *dst,
+					const void *src)
+{
+	const int16_t *s = src;
+	float *d = dst;
+	const float32x4_t scale = vdupq_n_f32(1.0f / 32768.0f);
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		int16x8_t v = vld1q_s16(s + n);
+
+		vst1q_f32(d + n, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))),
+					   scale));
+		vst1q_f32(d + n + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))),
+					       scale));
+	}
+	return n;
+}
+
+static unsigned int conv_neon_float_s16(unsigned int size, void *dst,
+					const void *src)
+{
+	const float *s = src;
+	int16_t *d = dst;
+	const float32x4_t scale = vdupq_n_f32(2147483648.0f);
+	unsigned int n;
+
+	for (n = 0; n + 8 <= size; n += 8) {
+		int32x4_t lo = vcvtq_s32_f32(vmulq_f32(vld1q_f32(s + n), scale));
+		int32x4_t hi = vcvtq_s32_f32(vmulq_f32(vld1q_f32(s + n + 4), scale));
+
+		vst1q_s16(d + n, vcombine_s16(vshrn_n_s32(lo, 16),
+					      vshrn_n_s32(hi, 16)));
+	}
+	return n;
+}
+
+static unsigned int conv_neon_s32_float(unsigned int size, void *dst,
+					const void *src)
+{
+	const int32_t *s = src;
+	float *d = dst;
+	const float32x4_t scale = vdupq_n_f32(1.0f / 2147483648.0f);
+	unsigned int n;
+
+	for (n = 0; n + 4 <= size; n += 4)
+		vst1q_f32(d + n, vmulq_f32(vcvtq_f32_s32(vld1q_s32(s + n)), scale));
+	return n;
+}
+
+static unsigned int conv_neon_float_s32(unsigned int size, void *dst,
+					const void *src)
+{
+	const float *s = src;
+	int32_t *d = dst;
+	const float32x4_t scale = vdupq_n_f32(2147483648.0f);
+	unsigned int n;
+
+	for (n = 0; n + 4 <= size; n += 4)
+		vst1q_s32(d + n, vcvtq_s32_f32(vmulq_f32(vld1q_f32(s + n), scale)));
+	return n;
+}
+
+static int conv_simd_have_neon(void)
+{
+	return 1;
+}
+
+#endif /* CONV_SIMD_NEON */
+
+/*
+ * kernel table, ordered by preference
+ */
+typedef struct {
+	const char *name;
+	int (*available)(void);
+	conv_simd_func_t *op[CONV_SIMD_OPS];
+} conv_simd_kernel_t;
+
+static const conv_simd_kernel_t conv_simd_kernels[] = {
+#ifdef CONV_SIMD_X86
+	{ "avx2", conv_simd_have_avx2, {
+		[CONV_SIMD_S16_S32] = conv_avx2_s16_s32,
+		[CONV_SIMD_S32_S16] = conv_avx2_s32_s16,
+		[CONV_SIMD_S16_FLOAT] = conv_avx2_s16_float,
+		[CONV_SIMD_FLOAT_S16] = conv_avx2_float_s16,
+		[CONV_SIMD_S32_FLOAT] = conv_avx2_s32_float,
+		[CONV_SIMD_FLOAT_S32] = conv_avx2_float_s32,
+	} },
+	{ "ssse3", conv_simd_have_ssse3, {
+		[CONV_SIMD_S24_3LE_S32] = conv_ssse3_s24_3le_s32,
+		[CONV_SIMD_S32_S24_3LE] = conv_ssse3_s32_s24_3le,
+	} },
+	{ "sse2", conv_simd_have_sse2, {
+		[CONV_SIMD_S16_S32] = conv_sse2_s16_s32,
+		[CONV_SIMD_S32_S16] = conv_sse2_s32_s16,
+		[CONV_SIMD_S16_FLOAT] = conv_sse2_s16_float,
+		[CONV_SIMD_FLOAT_S16] = conv_sse2_float_s16,
+		[CONV_SIMD_S32_FLOAT] = conv_sse2_s32_float,
+		[CONV_SIMD_FLOAT_S32] = conv_sse2_float_s32,
+	} },
+#endif
+#ifdef CONV_SIMD_NEON
+	{ "neon", conv_simd_have_neon, {
+		[CONV_SIMD_S16_S32] = conv_neon_s16_s32,
+		[CONV_SIMD_S32_S16] = conv_neon_s32_s16,
+		[CONV_SIMD_S24_3LE_S32] = conv_neon_s24_3le_s32,
+		[CONV_SIMD_S32_S24_3LE] = conv_neon_s32_s24_3le,
+		[CONV_SIMD_S16_FLOAT] = conv_neon_s16_float,
+		[CONV_SIMD_FLOAT_S16] = conv_neon_float_s16,
+		[CONV_SIMD_S32_FLOAT] = conv_neon_s32_float,
+		[CONV_SIMD_FLOAT_S32] = conv_neon_float_s32,
+	} },
+#endif
+	{ NULL, NULL, { NULL } }
+};
@@ -0,0 +1,258 @@
+/*
+ * throughput benchmark for snd_pcm_areas_copy() and the silence helpers
+ *
+ * Copies between interleaved buffers with different frame sizes, from
+ * planar to interleaved and from interleaved to planar buffers for
+ * 16, 24 and 32 bit samples and a range of channel counts, and fills
+ * buffers with the non-zero silence of the unsigned formats.  Each case
+ * is run through the library and through a channel by channel, sample
+ * by sample reference loop (the generic code path), the results are
+ * compared and the throughput of both is printed in million frames per
+ * second.
+ *
+ * Usage: areas-bench [-f frames] [-l loops]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include "../include/asoundlib.h"
+
+#define MAX_CHANNELS	8
+
+static unsigned int frames = 4096;
+static unsigned int loops = 2000;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void ref_copy(const snd_pcm_channel_area_t *dst, const snd_pcm_channel_area_t *src,
+		     unsigned int channels, unsigned int bytes)
+{
+	unsigned int chn, n;
+
+	for (chn = 0; chn < channels; chn++) {
+		char *d = (char *)dst[chn].addr + dst[chn].first / 8;
+		const char *s = (const char *)src[chn].addr + src[chn].first / 8;
+
+		/* the typed moves of the generic snd_pcm_area_copy() */
+		for (n = 0; n < frames; n++) {
+			switch (bytes) {
+			case 2:
+				*(uint16_t *)d = *(const uint16_t *)s;
+				break;
+			case 3:
+				d[0] = s[0];
+				d[1] = s[1];
+				d[2] = s[2];
+				break;
+			default:
+				*(uint32_t *)d = *(const uint32_t *)s;
+				break;
+			}
+			d += dst[chn].step / 8;
+			s += src[chn].step / 8;
+		}
+	}
+}
+
+static void ref_silence(void *buf, unsigned int samples, snd_pcm_format_t format)
+{
+	unsigned int bytes = snd_pcm_format_physical_width(format) / 8;
+	uint64_t silence = snd_pcm_format_silence_64(format);
+	char *p = buf;
+
+	/* the per sample stores of the generic code, little endian hosts */
+	while (samples-- > 0) {
+		switch (bytes) {
+		case 2:
+			*(uint16_t *)p = silence;
+			break;
+		case 3:
+			p[0] = silence;
+			p[1] = silence >> 8;
+			p[2] = silence >> 16;
+			break;
+		default:
+			*(uint32_t *)p = silence;
+			break;
+		}
+		p += bytes;
+	}
+}
+
+/* interleaved areas of channels samples within frames of frame_channels */
+static void setup_interleaved(snd_pcm_channel_area_t *areas, void *buf,
+			      unsigned int channels, unsigned int frame_channels,
+			      unsigned int width)
+{
+	unsigned int chn;
+
+	for (chn = 0; chn < channels; chn++) {
+		areas[chn].addr = buf;
+		areas[chn].first = chn * width;
+		areas[chn].step = frame_channels * width;
+	}
+}
+
+static void setup_planar(snd_pcm_channel_area_t *areas, void *buf,
+			 unsigned int channels, unsigned int width)
+{
+	unsigned int chn;
+
+	for (chn = 0; chn < channels; chn++) {
+		areas[chn].addr = (char *)buf + (size_t)chn * frames * width / 8;
+		areas[chn].first = 0;
+		areas[chn].step = width;
+	}
+}
+
+enum { I2I, P2I, I2P };
+static const char *const layout_names[] = { "inter->inter", "planar->inter", "inter->planar" };
+
+static int run_copy(int layout, snd_pcm_format_t format, unsigned int channels,
+		    char *src, char *dst, char *ref)
+{
+	snd_pcm_channel_area_t sa[MAX_CHANNELS], da[MAX_CHANNELS], ra[MAX_CHANNELS];
+	unsigned int width = snd_pcm_format_physical_width(format);
+	size_t size = (size_t)frames * (MAX_CHANNELS + 2) * width / 8;
+	double t_lib, t_ref;
+	unsigned int l;
+
+	switch (layout) {
+	case I2I:
+		/* into the first channels of a wider frame */
+		setup_interleaved(sa, src, channels, channels, width);
+		setup_interleaved(da, dst, channels, channels + 2, width);
+		setup_interleaved(ra, ref, channels, channels + 2, width);
+		break;
+	case P2I:
+		setup_planar(sa, src, channels, width);
+		setup_interleaved(da, dst, channels, channels, width);
+		setup_interleaved(ra, ref, channels, channels, width);
+		break;
+	default:
+		setup_interleaved(sa, src, channels, channels, width);
+		setup_planar(da, dst, channels, width);
+		setup_planar(ra, ref, channels, width);
+		break;
+	}
+	memset(dst, 0x55, size);
+	memset(ref, 0x55, size);
+
+	t_lib = now();
+	for (l = 0; l < loops; l++)
+		snd_pcm_areas_copy(da, 0, sa, 0, channels, frames, format);
+	t_lib = now() - t_lib;
+	t_ref = now();
+	for (l = 0; l < loops; l++)
+		ref_copy(ra, sa, channels, width / 8);
+	t_ref = now() - t_ref;
+
+	printf("%-14s %-8s %2u ch %10.1f %10.1f %7.2fx\n",
+	       layout_names[layout], snd_pcm_format_name(format), channels,
+	       (double)frames * loops / t_ref / 1e6,
+	       (double)frames * loops / t_lib / 1e6, t_ref / t_lib);
+	if (memcmp(dst, ref, size)) {
+		fprintf(stderr, "MISMATCH: %s %s %u channels\n",
+			layout_names[layout], snd_pcm_format_name(format), channels);
+		return -1;
+	}
+	return 0;
+}
+
+static int run_silence(snd_pcm_format_t format, char *dst, char *ref)
+{
+	unsigned int samples = frames * 2;
+	size_t size = (size_t)samples * snd_pcm_format_physical_width(format) / 8;
+	double t_lib, t_ref;
+	unsigned int l;
+
+	memset(dst, 0x55, size);
+	memset(ref, 0x55, size);
+	t_lib = now();
+	for (l = 0; l < loops; l++)
+		snd_pcm_format_set_silence(format, dst, samples);
+	t_lib = now() - t_lib;
+	t_ref = now();
+	for (l = 0; l < loops; l++)
+		ref_silence(ref, samples, format);
+	t_ref = now() - t_ref;
+
+	printf("%-14s %-8s %2u ch %10.1f %10.1f %7.2fx\n",
+	       "silence", snd_pcm_format_name(format), 2,
+	       (double)frames * loops / t_ref / 1e6,
+	       (double)frames * loops / t_lib / 1e6, t_ref / t_lib);
+	if (memcmp(dst, ref, size)) {
+		fprintf(stderr, "MISMATCH: silence %s\n", snd_pcm_format_name(format));
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	static const snd_pcm_format_t formats[] = {
+		SND_PCM_FORMAT_S16_LE, SND_PCM_FORMAT_S24_3LE, SND_PCM_FORMAT_S32_LE,
+	};
+	static const snd_pcm_format_t silence_formats[] = {
+		SND_PCM_FORMAT_U16_LE, SND_PCM_FORMAT_U24_3LE, SND_PCM_FORMAT_U32_LE,
+		SND_PCM_FORMAT_U24_LE,
+	};
+	static const unsigned int channel_counts[] = { 2, 4, 6, 8 };
+	unsigned int f, c, i;
+	size_t size;
+	char *src, *dst, *ref;
+	int c_opt, layout, err = 0;
+
+	while ((c_opt = getopt(argc, argv, "f:l:")) >= 0) {
+		switch (c_opt) {
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: areas-bench [-f frames] [-l loops]\n");
+			return 1;
+		}
+	}
+	if (!frames || !loops) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	size = (size_t)frames * (MAX_CHANNELS + 2) * 4;
+	src = malloc(size);
+	dst = malloc(size);
+	ref = malloc(size);
+	if (!src || !dst || !ref)
+		return 1;
+	for (i = 0; i < size; i++)
+		src[i] = rand();
+
+	printf("%u frames, %u loops, Mframes/s\n", frames, loops);
+	printf("%-14s %-8s %5s %10s %10s %8s\n", "layout", "format", "", "reference", "library", "speedup");
+	for (layout = I2I; layout <= I2P; layout++)
+		for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+			for (c = 0; c < sizeof(channel_counts) / sizeof(channel_counts[0]); c++)
+				if (run_copy(layout, formats[f], channel_counts[c],
+					     src, dst, ref) < 0)
+					err = 1;
+	for (f = 0; f < sizeof(silence_formats) / sizeof(silence_formats[0]); f++)
+		if (run_silence(silence_formats[f], dst, ref) < 0)
+			err = 1;
+
+	free(src);
+	free(dst);
+	free(ref);
+	return err;
+}
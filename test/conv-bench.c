@@ -0,0 +1,302 @@
+/*
+ * throughput benchmark for the sample format conversions
+ *
+ * First runs the scalar reference and each vectorized kernel available
+ * on this CPU for the contiguous fast paths of the linear and lfloat
+ * plugins, verifies that they produce the same output and prints the
+ * throughput in million samples per second.
+ *
+ * Then plays every linear format through the linear plugin into a null
+ * PCM with S32 and with S24_3LE samples (the latter always takes the
+ * get/put path, so each index returned by snd_pcm_linear_get_index()
+ * for a format the plugin accepts is covered), the float formats
+ * through lfloat and mu-law/A-law through their plugins, and prints the
+ * throughput for each pair.
+ *
+ * Usage: conv-bench [-c channels] [-f frames] [-l loops]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include "../include/asoundlib.h"
+#include "../src/pcm/plugin_ops_simd.h"
+
+static unsigned int channels = 2;
+static unsigned int frames = 1024;
+static unsigned int loops = 2000;
+
+static const struct {
+	const char *name;
+	unsigned int src_bytes, dst_bytes;
+	int float_src;
+} ops[CONV_SIMD_OPS] = {
+	[CONV_SIMD_S16_S32] = { "S16 -> S32", 2, 4, 0 },
+	[CONV_SIMD_S32_S16] = { "S32 -> S16", 4, 2, 0 },
+	[CONV_SIMD_S24_3LE_S32] = { "S24_3LE -> S32", 3, 4, 0 },
+	[CONV_SIMD_S32_S24_3LE] = { "S32 -> S24_3LE", 4, 3, 0 },
+	[CONV_SIMD_S16_FLOAT] = { "S16 -> FLOAT", 2, 4, 0 },
+	[CONV_SIMD_FLOAT_S16] = { "FLOAT -> S16", 4, 2, 1 },
+	[CONV_SIMD_S32_FLOAT] = { "S32 -> FLOAT", 4, 4, 0 },
+	[CONV_SIMD_FLOAT_S32] = { "FLOAT -> S32", 4, 4, 1 },
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* random samples, floats slightly beyond the full scale */
+static void fill(unsigned char *buf, unsigned int size, unsigned int bytes,
+		 int float_src)
+{
+	unsigned int i;
+
+	if (float_src) {
+		float *f = (float *)buf;
+		for (i = 0; i < size; i++)
+			f[i] = (rand() / (float)RAND_MAX) * 2.4f - 1.2f;
+		/* the exact limits */
+		if (size > 2) {
+			f[0] = 1.0f;
+			f[1] = -1.0f;
+		}
+		return;
+	}
+	for (i = 0; i < size * bytes; i++)
+		buf[i] = rand();
+}
+
+static void run(conv_simd_func_t *kernel, int op, unsigned int size,
+		unsigned char *dst, const unsigned char *src)
+{
+	unsigned int done = kernel(size, dst, src);
+
+	if (done < size)
+		conv_simd_scalar[op](size - done, dst + done * ops[op].dst_bytes,
+				     src + done * ops[op].src_bytes);
+}
+
+static double bench(conv_simd_func_t *kernel, int op, unsigned int size,
+		    unsigned char *dst, const unsigned char *src)
+{
+	unsigned int i;
+	double t;
+
+	t = now();
+	for (i = 0; i < loops; i++)
+		run(kernel, op, size, dst, src);
+	t = now() - t;
+	return (double)size * loops / t / 1e6;
+}
+
+static int bench_kernels(void)
+{
+	unsigned int size = channels * frames;
+	const conv_simd_kernel_t *k;
+	unsigned char *src, *dst, *ref;
+	int op, err = 0;
+
+	src = malloc(size * 4);
+	dst = malloc(size * 4);
+	ref = malloc(size * 4);
+	if (!src || !dst || !ref)
+		return 1;
+	printf("kernels, %u samples, %u loops (Msamples/s):\n", size, loops);
+	for (op = 0; op < CONV_SIMD_OPS; op++) {
+		fill(src, size, ops[op].src_bytes, ops[op].float_src);
+		conv_simd_scalar[op](size, ref, src);
+		printf("  %-16s %-8s %10.1f\n", ops[op].name, "scalar",
+		       bench(conv_simd_scalar[op], op, size, dst, src));
+		for (k = conv_simd_kernels; k->name; k++) {
+			if (!k->available() || !k->op[op])
+				continue;
+			memset(dst, 0, size * 4);
+			run(k->op[op], op, size, dst, src);
+			if (memcmp(dst, ref, size * ops[op].dst_bytes)) {
+				printf("  %-16s %-8s   MISMATCH\n", ops[op].name,
+				       k->name);
+				err = 1;
+				continue;
+			}
+			printf("  %-16s %-8s %10.1f\n", ops[op].name, k->name,
+			       bench(k->op[op], op, size, dst, src));
+		}
+	}
+	free(src);
+	free(dst);
+	free(ref);
+	return err;
+}
+
+static const char config_fmt[] =
+	"pcm.conv_bench {\n"
+	"	type %s\n"
+	"	slave {\n"
+	"		pcm { type null }\n"
+	"		format %s\n"
+	"	}\n"
+	"}\n";
+
+static int open_plugin(snd_pcm_t **pcm, const char *type,
+		       snd_pcm_format_t format, snd_pcm_format_t sformat)
+{
+	char buf[sizeof(config_fmt) + 64];
+	snd_pcm_hw_params_t *params;
+	snd_config_t *top;
+	snd_input_t *in;
+	int err;
+
+	snprintf(buf, sizeof(buf), config_fmt, type,
+		 snd_pcm_format_name(sformat));
+	err = snd_config_top(&top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&in, buf, strlen(buf));
+	if (err < 0) {
+		snd_config_delete(top);
+		return err;
+	}
+	err = snd_config_load(top, in);
+	snd_input_close(in);
+	if (err >= 0)
+		err = snd_pcm_open_lconf(pcm, "conv_bench",
+					 SND_PCM_STREAM_PLAYBACK, 0, top);
+	snd_config_delete(top);
+	if (err < 0)
+		return err;
+	/* skip the formats the plugin doesn't take */
+	snd_pcm_hw_params_alloca(&params);
+	snd_pcm_hw_params_any(*pcm, params);
+	if (snd_pcm_hw_params_test_format(*pcm, params, format) < 0) {
+		snd_pcm_close(*pcm);
+		return -ENOTSUP;
+	}
+	err = snd_pcm_set_params(*pcm, format, SND_PCM_ACCESS_RW_INTERLEAVED,
+				 channels, 48000, 0, 500000);
+	if (err < 0)
+		snd_pcm_close(*pcm);
+	return err;
+}
+
+/* returns the throughput in Msamples/s or a negative error code */
+static double bench_plugin(const char *type, snd_pcm_format_t format,
+			   snd_pcm_format_t sformat)
+{
+	snd_pcm_uframes_t buffer_size, period_size, size = frames;
+	snd_pcm_t *pcm;
+	unsigned char *buf;
+	unsigned int i;
+	double t;
+	int err;
+
+	err = open_plugin(&pcm, type, format, sformat);
+	if (err < 0)
+		return err;
+	snd_pcm_get_params(pcm, &buffer_size, &period_size);
+	if (size > buffer_size)
+		size = buffer_size;
+	buf = malloc(snd_pcm_frames_to_bytes(pcm, size));
+	if (!buf) {
+		snd_pcm_close(pcm);
+		return -ENOMEM;
+	}
+	snd_pcm_format_set_silence(format, buf, size * channels);
+	t = now();
+	for (i = 0; i < loops; i++) {
+		snd_pcm_sframes_t r = snd_pcm_writei(pcm, buf, size);
+		if (r < 0) {
+			err = r;
+			break;
+		}
+	}
+	t = now() - t;
+	snd_pcm_close(pcm);
+	free(buf);
+	if (err < 0)
+		return err;
+	return (double)size * channels * loops / t / 1e6;
+}
+
+static int bench_pair(const char *type, snd_pcm_format_t format,
+		      snd_pcm_format_t sformat)
+{
+	double r;
+
+	if (format == sformat)
+		return 0;
+	r = bench_plugin(type, format, sformat);
+	if (r == -ENOTSUP)
+		return 0;
+	if (r < 0) {
+		printf("  %-7s %-12s -> %-12s %s\n", type,
+		       snd_pcm_format_name(format), snd_pcm_format_name(sformat),
+		       snd_strerror(r));
+		return 1;
+	}
+	printf("  %-7s %-12s -> %-12s %10.1f\n", type,
+	       snd_pcm_format_name(format), snd_pcm_format_name(sformat), r);
+	return 0;
+}
+
+static int bench_plugins(void)
+{
+	snd_pcm_format_t format;
+	int err = 0;
+
+	printf("plugins, %u channels, %u frames per write, %u loops (Msamples/s):\n",
+	       channels, frames, loops);
+	for (format = 0; format <= SND_PCM_FORMAT_LAST; format++) {
+		if (!snd_pcm_format_name(format))
+			continue;
+		if (snd_pcm_format_linear(format)) {
+			err |= bench_pair("linear", format, SND_PCM_FORMAT_S32);
+			err |= bench_pair("linear", format, SND_PCM_FORMAT_S24_3LE);
+			err |= bench_pair("lfloat", format, SND_PCM_FORMAT_FLOAT);
+		} else if (snd_pcm_format_float(format)) {
+			err |= bench_pair("lfloat", format, SND_PCM_FORMAT_S32);
+			err |= bench_pair("lfloat", format, SND_PCM_FORMAT_S16);
+		} else if (format == SND_PCM_FORMAT_MU_LAW) {
+			err |= bench_pair("mulaw", SND_PCM_FORMAT_S16, format);
+			err |= bench_pair("mulaw", format, SND_PCM_FORMAT_S16);
+		} else if (format == SND_PCM_FORMAT_A_LAW) {
+			err |= bench_pair("alaw", SND_PCM_FORMAT_S16, format);
+			err |= bench_pair("alaw", format, SND_PCM_FORMAT_S16);
+		}
+	}
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	int c, err;
+
+	while ((c = getopt(argc, argv, "c:f:l:")) >= 0) {
+		switch (c) {
+		case 'c':
+			channels = atoi(optarg);
+			break;
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: conv-bench [-c channels] [-f frames] [-l loops]\n");
+			return 1;
+		}
+	}
+	if (!channels || !frames || !loops) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+	err = bench_kernels();
+	err |= bench_plugins();
+	return err;
+}
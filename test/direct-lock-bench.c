@@ -0,0 +1,278 @@
+/*
+ * contention benchmark for the locks of the direct plugins
+ *
+ * Forks 1 to N client processes which take the streams lock of a
+ * shared memory area in a loop, like the dmix clients do for every
+ * mixed period, once with the SysV semaphore and once with the futex
+ * word of pcm_direct_lock.h.  Inside the lock each client sums a small
+ * block of shared memory and bumps a shared counter, outside it does
+ * the same amount of private work.  The counter is checked against the
+ * number of acquisitions and the time per acquisition is printed.
+ * Finally a client exits holding the futex lock, the lock must pass to
+ * the next locker.
+ *
+ * Usage: direct-lock-bench [-n max_clients] [-l loops] [-w work]
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/mman.h>
+#include <sys/sem.h>
+#include <sys/wait.h>
+#include "../src/pcm/pcm_direct_lock.h"
+
+#define MAX_WORK	4096
+
+struct shared {
+	direct_futex_t futex;
+	unsigned long long counter;
+	int data[MAX_WORK];
+};
+
+static unsigned int max_clients = 32;
+static unsigned int loops = 20000;
+static unsigned int work = 256;
+
+static struct shared *shm;
+static int semid = -1;
+
+/* same operations as snd_pcm_direct_semaphore_down/up */
+static int sem_lock(void)
+{
+	struct sembuf op[2] = { { 0, 0, 0 }, { 0, 1, SEM_UNDO } };
+
+	return semop(semid, op, 2);
+}
+
+static int sem_unlock(void)
+{
+	struct sembuf op = { 0, -1, SEM_UNDO | IPC_NOWAIT };
+
+	return semop(semid, &op, 1);
+}
+
+static int touch(int *data, unsigned int size)
+{
+	unsigned int i;
+	int sum = 0;
+
+	for (i = 0; i < size; i++) {
+		sum += data[i];
+		data[i] = sum;
+	}
+	return sum;
+}
+
+static void client(int futex)
+{
+	int local[MAX_WORK];
+	unsigned int n;
+
+	memset(local, 0, sizeof(local));
+	for (n = 0; n < loops; n++) {
+		if (futex ? direct_futex_lock(&shm->futex) : sem_lock()) {
+			perror("lock");
+			_exit(1);
+		}
+		touch(shm->data, work);
+		shm->counter++;
+		if (futex)
+			direct_futex_unlock(&shm->futex);
+		else
+			sem_unlock();
+		touch(local, work);
+	}
+	_exit(0);
+}
+
+/* a client dies holding the lock */
+static int owner_death(void)
+{
+	int status, err;
+	pid_t pid;
+
+	memset(shm, 0, sizeof(*shm));
+	if (direct_futex_init(&shm->futex) < 0)
+		return -1;
+	pid = fork();
+	if (pid < 0)
+		return -1;
+	if (pid == 0) {
+		direct_futex_lock(&shm->futex);
+		_exit(0);
+	}
+	if (waitpid(pid, &status, 0) < 0)
+		return -1;
+	err = direct_futex_lock(&shm->futex);
+	if (err < 0) {
+		fprintf(stderr, "lock of a dead client not recovered: %s\n",
+			strerror(-err));
+		return -1;
+	}
+	direct_futex_unlock(&shm->futex);
+	return 0;
+}
+
+/* a held lock stays busy for trylock, a dead holder's lock is free */
+static int owner_claim(void)
+{
+	int fds[2], status, err;
+	char c;
+	pid_t pid;
+
+	memset(shm, 0, sizeof(*shm));
+	if (direct_futex_init(&shm->futex) < 0 || pipe(fds) < 0)
+		return -1;
+	pid = fork();
+	if (pid < 0)
+		return -1;
+	if (pid == 0) {
+		close(fds[1]);
+		direct_futex_lock(&shm->futex);
+		/* wait for the parent closing the pipe */
+		while (read(fds[0], &c, 1) < 0)
+			;
+		_exit(0);
+	}
+	close(fds[0]);
+	while ((err = direct_futex_trylock(&shm->futex)) == 0) {
+		/* the child has not taken it yet */
+		direct_futex_unlock(&shm->futex);
+		usleep(1000);
+	}
+	if (err != -EBUSY) {
+		fprintf(stderr, "trylock of a held lock: %s\n", strerror(-err));
+		close(fds[1]);
+		waitpid(pid, &status, 0);
+		return -1;
+	}
+	close(fds[1]);
+	if (waitpid(pid, &status, 0) < 0)
+		return -1;
+	err = direct_futex_trylock(&shm->futex);
+	if (err < 0) {
+		fprintf(stderr, "trylock of a dead client's lock: %s\n",
+			strerror(-err));
+		return -1;
+	}
+	direct_futex_unlock(&shm->futex);
+	return 0;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* returns ns per acquisition, negative on failure */
+static double run(unsigned int clients, int futex)
+{
+	unsigned int i;
+	int status, ok = 1;
+	double t;
+
+	memset(shm, 0, sizeof(*shm));
+	if (futex && direct_futex_init(&shm->futex) < 0) {
+		fprintf(stderr, "futex lock not supported\n");
+		return -1;
+	}
+	t = now();
+	for (i = 0; i < clients; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0) {
+			perror("fork");
+			return -1;
+		}
+		if (pid == 0)
+			client(futex);
+	}
+	for (i = 0; i < clients; i++) {
+		if (wait(&status) < 0 || !WIFEXITED(status) ||
+		    WEXITSTATUS(status))
+			ok = 0;
+	}
+	t = now() - t;
+	if (!ok)
+		return -1;
+	if (shm->counter != (unsigned long long)clients * loops) {
+		fprintf(stderr, "lock broken: %llu acquisitions counted, %llu expected\n",
+			shm->counter, (unsigned long long)clients * loops);
+		return -1;
+	}
+	return t * 1e9 / ((double)clients * loops);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int clients;
+	double sem_ns, futex_ns;
+	int c, err = 0;
+
+	while ((c = getopt(argc, argv, "n:l:w:")) >= 0) {
+		switch (c) {
+		case 'n':
+			max_clients = atoi(optarg);
+			break;
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		case 'w':
+			work = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: direct-lock-bench [-n max_clients] [-l loops] [-w work]\n");
+			return 1;
+		}
+	}
+	if (!max_clients || !loops || work > MAX_WORK) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shm == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	semid = semget(IPC_PRIVATE, 1, IPC_CREAT | 0600);
+	if (semid < 0) {
+		perror("semget");
+		return 1;
+	}
+
+	printf("%u acquisitions per client, %u ints of work\n", loops, work);
+	printf("%8s %14s %14s %8s\n", "clients", "sem ns/lock", "futex ns/lock", "speedup");
+	for (clients = 1; clients <= max_clients; clients *= 2) {
+		sem_ns = run(clients, 0);
+		futex_ns = run(clients, 1);
+		if (sem_ns < 0 || futex_ns < 0) {
+			err = 1;
+			break;
+		}
+		printf("%8u %14.1f %14.1f %7.2fx\n", clients, sem_ns, futex_ns,
+		       sem_ns / futex_ns);
+	}
+	if (!err) {
+		err = owner_death() < 0;
+		printf("dead holder: %s\n", err ? "FAILED" : "recovered");
+	}
+	if (!err) {
+		err = owner_claim() < 0;
+		printf("dead slot owner: %s\n", err ? "FAILED" : "reclaimed");
+	}
+
+	semctl(semid, 0, IPC_RMID);
+	munmap(shm, sizeof(*shm));
+	return err;
+}
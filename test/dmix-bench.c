@@ -0,0 +1,327 @@
+/*
+ * throughput benchmark for the dmix mixing kernels
+ *
+ * Runs the scalar reference loop (same semantics as the generic
+ * native-endian dmix callbacks) and each vectorized kernel available
+ * on this CPU over an interleaved buffer, verifies that the kernels
+ * produce the same sum and output buffers, and prints the throughput
+ * in million samples per second.  The accumulate/store kernels used by
+ * the staged mixing mode are checked as well.
+ *
+ * Usage: dmix-bench [-c channels] [-f frames] [-l loops]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include "../src/pcm/pcm_dmix_simd.h"
+
+static unsigned int channels = 8;
+static unsigned int frames = 1024;
+static unsigned int loops = 2000;
+
+static inline int clamp(int v, int lo, int hi)
+{
+	return v > hi ? hi : v < lo ? lo : v;
+}
+
+static unsigned int ref_16(unsigned int size, signed short *dst,
+			   const signed short *src, signed int *sum, int remix)
+{
+	unsigned int n;
+
+	for (n = 0; n < size; n++) {
+		int s = remix ? -src[n] : src[n];
+		sum[n] = dst[n] ? sum[n] + s : s;
+		dst[n] = clamp(sum[n], -0x8000, 0x7fff);
+	}
+	return size;
+}
+
+static unsigned int ref_32(unsigned int size, signed int *dst,
+			   const signed int *src, signed int *sum, int remix)
+{
+	unsigned int n;
+
+	for (n = 0; n < size; n++) {
+		int s = remix ? -(src[n] >> 8) : src[n] >> 8;
+		if (!dst[n]) {
+			sum[n] = s;
+			dst[n] = remix ? -src[n] : src[n];
+		} else {
+			sum[n] += s;
+			if (sum[n] > 0x7fffff)
+				dst[n] = 0x7fffffff;
+			else
+				dst[n] = clamp(sum[n], -0x800000, 0x7fffff) * 256;
+		}
+	}
+	return size;
+}
+
+static unsigned int ref_24(unsigned int size, unsigned char *dst,
+			   const unsigned char *src, signed int *sum, int remix)
+{
+	unsigned int n;
+
+	for (n = 0; n < size; n++, dst += 3, src += 3) {
+		int s = src[0] | (src[1] << 8) | (((signed char *)src)[2] << 16);
+		if (remix)
+			s = -s;
+		sum[n] = (dst[0] | dst[1] | dst[2]) ? sum[n] + s : s;
+		s = clamp(sum[n], -0x800000, 0x7fffff);
+		dst[0] = s;
+		dst[1] = s >> 8;
+		dst[2] = s >> 16;
+	}
+	return size;
+}
+
+static unsigned int ref_mix_16(unsigned int size, signed short *dst,
+			       const signed short *src, signed int *sum)
+{
+	return ref_16(size, dst, src, sum, 0);
+}
+
+static unsigned int ref_mix_32(unsigned int size, signed int *dst,
+			       const signed int *src, signed int *sum)
+{
+	return ref_32(size, dst, src, sum, 0);
+}
+
+static unsigned int ref_mix_24(unsigned int size, unsigned char *dst,
+			       const unsigned char *src, signed int *sum)
+{
+	return ref_24(size, dst, src, sum, 0);
+}
+
+static unsigned int ref_remix_16(unsigned int size, signed short *dst,
+				 const signed short *src, signed int *sum)
+{
+	return ref_16(size, dst, src, sum, 1);
+}
+
+static unsigned int ref_remix_32(unsigned int size, signed int *dst,
+				 const signed int *src, signed int *sum)
+{
+	return ref_32(size, dst, src, sum, 1);
+}
+
+static unsigned int ref_remix_24(unsigned int size, unsigned char *dst,
+				 const unsigned char *src, signed int *sum)
+{
+	return ref_24(size, dst, src, sum, 1);
+}
+
+static const dmix_simd_kernel_t ref_kernel = {
+	"scalar", NULL,
+	ref_mix_16, ref_remix_16,
+	ref_mix_32, ref_remix_32,
+	ref_mix_24, ref_remix_24
+};
+
+/* run the kernel and finish the tail with the reference loop */
+static void run(const dmix_simd_kernel_t *k, int width, int remix,
+		unsigned int size, void *dst, const void *src, int *sum)
+{
+	unsigned int done;
+
+	switch (width) {
+	case 16:
+		done = (remix ? k->remix_16 : k->mix_16)(size, dst, src, sum);
+		ref_16(size - done, (short *)dst + done,
+		       (const short *)src + done, sum + done, remix);
+		break;
+	case 32:
+		done = (remix ? k->remix_32 : k->mix_32)(size, dst, src, sum);
+		ref_32(size - done, (int *)dst + done,
+		       (const int *)src + done, sum + done, remix);
+		break;
+	case 24:
+		done = (remix ? k->remix_24 : k->mix_24)(size, dst, src, sum);
+		ref_24(size - done, (unsigned char *)dst + done * 3,
+		       (const unsigned char *)src + done * 3, sum + done, remix);
+		break;
+	}
+}
+
+static int has_width(const dmix_simd_kernel_t *k, int width)
+{
+	return width == 16 ? k->mix_16 != NULL :
+	       width == 32 ? k->mix_32 != NULL : k->mix_24 != NULL;
+}
+
+static void fill(unsigned char *buf, size_t bytes)
+{
+	size_t i;
+
+	for (i = 0; i < bytes; i++)
+		buf[i] = rand();
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int verify(const dmix_simd_kernel_t *k, int width, size_t bytes,
+		  unsigned int size, const unsigned char *src)
+{
+	unsigned char *dst_ref, *dst;
+	int *sum_ref, *sum;
+	int remix, err = 0;
+	unsigned int i;
+
+	dst_ref = malloc(bytes);
+	dst = malloc(bytes);
+	sum_ref = malloc(size * sizeof(int));
+	sum = malloc(size * sizeof(int));
+	for (remix = 0; remix < 2 && !err; remix++) {
+		fill(dst_ref, bytes);
+		/* clear every 7th sample to exercise the "fresh area" path */
+		for (i = 0; i < size; i += 7)
+			memset(dst_ref + i * (bytes / size), 0, bytes / size);
+		for (i = 0; i < size; i++)
+			sum_ref[i] = (rand() % 0x200000) - 0x100000;
+		memcpy(dst, dst_ref, bytes);
+		memcpy(sum, sum_ref, size * sizeof(int));
+		run(&ref_kernel, width, remix, size, dst_ref, src, sum_ref);
+		run(k, width, remix, size, dst, src, sum);
+		if (memcmp(sum, sum_ref, size * sizeof(int)) ||
+		    memcmp(dst, dst_ref, bytes)) {
+			printf("  %s %s_%d: MISMATCH\n", k->name,
+			       remix ? "remix" : "mix", width);
+			err = 1;
+		}
+	}
+	free(dst_ref);
+	free(dst);
+	free(sum_ref);
+	free(sum);
+	return err;
+}
+
+static double bench(const dmix_simd_kernel_t *k, int width, size_t bytes,
+		    unsigned int size, const unsigned char *src)
+{
+	unsigned char *dst = calloc(1, bytes);
+	int *sum = calloc(size, sizeof(int));
+	unsigned int i;
+	double t;
+
+	fill(dst, bytes);
+	t = now();
+	for (i = 0; i < loops; i++)
+		run(k, width, i & 1, size, dst, src, sum);
+	t = now() - t;
+	free(dst);
+	free(sum);
+	return (double)size * loops / t / 1e6;
+}
+
+static int verify_stage(const dmix_simd_kernel_t *k, unsigned int size)
+{
+	short *s16 = malloc(size * sizeof(short)), *d16 = malloc(size * sizeof(short));
+	int *s32 = malloc(size * sizeof(int)), *d32 = malloc(size * sizeof(int));
+	int *acc = malloc(size * sizeof(int)), *ref = malloc(size * sizeof(int));
+	unsigned int i, n;
+	int err = 0;
+
+	fill((unsigned char *)s16, size * sizeof(short));
+	fill((unsigned char *)s32, size * sizeof(int));
+	for (i = 0; i < size; i++)
+		acc[i] = ref[i] = (rand() % 0x2000000) - 0x1000000;
+	n = k->add_16(size, acc, s16);
+	for (i = 0; i < size; i++)
+		ref[i] += s16[i];
+	for (i = n; i < size; i++)
+		acc[i] += s16[i];
+	n = k->add_32(size, acc, s32);
+	for (i = 0; i < size; i++)
+		ref[i] += s32[i] >> 8;
+	for (i = n; i < size; i++)
+		acc[i] += s32[i] >> 8;
+	if (memcmp(acc, ref, size * sizeof(int)))
+		err = 1;
+	n = k->store_16(size, d16, acc);
+	for (i = 0; i < n; i++)
+		if (d16[i] != clamp(ref[i], -0x8000, 0x7fff))
+			err = 1;
+	n = k->store_32(size, d32, acc);
+	for (i = 0; i < n; i++)
+		if (d32[i] != (ref[i] > 0x7fffff ? 0x7fffffff :
+			       clamp(ref[i], -0x800000, 0x7fffff) * 256))
+			err = 1;
+	if (err)
+		printf("  %s stage: MISMATCH\n", k->name);
+	free(s16);
+	free(d16);
+	free(s32);
+	free(d32);
+	free(acc);
+	free(ref);
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	static const int widths[] = { 16, 24, 32 };
+	const dmix_simd_kernel_t *k;
+	unsigned int size, w;
+	int c, err = 0;
+
+	while ((c = getopt(argc, argv, "c:f:l:")) >= 0) {
+		switch (c) {
+		case 'c':
+			channels = atoi(optarg);
+			break;
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: dmix-bench [-c channels] [-f frames] [-l loops]\n");
+			return 1;
+		}
+	}
+	if (!channels || !frames || !loops) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+	size = channels * frames;
+	printf("%u channels, %u frames, %u loops (Msamples/s)\n",
+	       channels, frames, loops);
+	for (w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+		int width = widths[w];
+		size_t bytes = (size_t)size * (width == 16 ? 2 : width == 24 ? 3 : 4);
+		unsigned char *src = malloc(bytes);
+
+		fill(src, bytes);
+		printf("%d-bit:\n", width);
+		printf("  %-8s %10.1f\n", ref_kernel.name,
+		       bench(&ref_kernel, width, bytes, size, src));
+		for (k = dmix_simd_kernels; k->name; k++) {
+			if (!k->available() || !has_width(k, width))
+				continue;
+			if (verify(k, width, bytes, size, src)) {
+				err = 1;
+				continue;
+			}
+			printf("  %-8s %10.1f\n", k->name,
+			       bench(k, width, bytes, size, src));
+		}
+		free(src);
+	}
+	for (k = dmix_simd_kernels; k->name; k++) {
+		if (k->available() && k->add_16 && verify_stage(k, size))
+			err = 1;
+	}
+	return err;
+}
@@ -0,0 +1,191 @@
+/*
+ * multi-process stress test for dmix
+ *
+ * Forks a growing number of client processes which all play into the
+ * same PCM (normally a dmix instance) for a given time, and prints the
+ * CPU time used per client for each client count.  Compare a regular
+ * dmix definition with one using "staged true" to see how the mixing
+ * cost scales with the number of clients.
+ *
+ * Usage: dmix-stress [-D device] [-n max_clients] [-t seconds]
+ *                    [-c channels] [-r rate] [-f format]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "../include/asoundlib.h"
+
+static const char *devname = "dmix";
+static unsigned int max_clients = 16;
+static unsigned int seconds = 5;
+static unsigned int channels = 2;
+static unsigned int rate = 48000;
+static snd_pcm_format_t format = SND_PCM_FORMAT_S16;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int client(unsigned int id)
+{
+	snd_pcm_t *pcm;
+	snd_pcm_uframes_t buffer_size, period_size;
+	snd_pcm_sframes_t r;
+	unsigned char *buf;
+	size_t bytes;
+	double end;
+	int err;
+
+	err = snd_pcm_open(&pcm, devname, SND_PCM_STREAM_PLAYBACK, 0);
+	if (err < 0) {
+		fprintf(stderr, "client %u: open %s: %s\n", id, devname,
+			snd_strerror(err));
+		return 1;
+	}
+	err = snd_pcm_set_params(pcm, format, SND_PCM_ACCESS_RW_INTERLEAVED,
+				 channels, rate, 1, 100000);
+	if (err < 0) {
+		fprintf(stderr, "client %u: set_params: %s\n", id,
+			snd_strerror(err));
+		snd_pcm_close(pcm);
+		return 1;
+	}
+	snd_pcm_get_params(pcm, &buffer_size, &period_size);
+	bytes = snd_pcm_frames_to_bytes(pcm, period_size);
+	buf = malloc(bytes);
+	if (!buf) {
+		snd_pcm_close(pcm);
+		return 1;
+	}
+	/* low level noise, so the sum doesn't saturate all the time */
+	snd_pcm_format_set_silence(format, buf, period_size * channels);
+	if (format == SND_PCM_FORMAT_S16) {
+		short *s = (short *)buf;
+		size_t i;
+		srand(id);
+		for (i = 0; i < period_size * channels; i++)
+			s[i] = (rand() % 2048) - 1024;
+	}
+
+	end = now() + seconds;
+	while (now() < end) {
+		r = snd_pcm_writei(pcm, buf, period_size);
+		if (r < 0) {
+			r = snd_pcm_recover(pcm, r, 1);
+			if (r < 0) {
+				fprintf(stderr, "client %u: write: %s\n", id,
+					snd_strerror(r));
+				break;
+			}
+		}
+	}
+	snd_pcm_drop(pcm);
+	snd_pcm_close(pcm);
+	free(buf);
+	return 0;
+}
+
+static int run(unsigned int clients)
+{
+	pid_t *pids;
+	struct rusage ru;
+	double cpu = 0;
+	unsigned int i, failed = 0;
+	int status;
+
+	pids = calloc(clients, sizeof(*pids));
+	if (!pids)
+		return -1;
+	for (i = 0; i < clients; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			perror("fork");
+			clients = i;
+			break;
+		}
+		if (pids[i] == 0)
+			exit(client(i));
+	}
+	for (i = 0; i < clients; i++) {
+		if (wait4(pids[i], &status, 0, &ru) < 0) {
+			failed++;
+			continue;
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			failed++;
+		cpu += ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+		       ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+	}
+	free(pids);
+	if (!clients)
+		return -1;
+	printf("%3u clients: %6.2f%% CPU per client, %6.2f%% total%s\n",
+	       clients, cpu * 100 / seconds / clients, cpu * 100 / seconds,
+	       failed ? " (some clients failed)" : "");
+	fflush(stdout);
+	return failed ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int n;
+	int c, err = 0;
+
+	while ((c = getopt(argc, argv, "D:n:t:c:r:f:")) >= 0) {
+		switch (c) {
+		case 'D':
+			devname = optarg;
+			break;
+		case 'n':
+			max_clients = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'c':
+			channels = atoi(optarg);
+			break;
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		case 'f':
+			format = snd_pcm_format_value(optarg);
+			if (format == SND_PCM_FORMAT_UNKNOWN) {
+				fprintf(stderr, "invalid format %s\n", optarg);
+				return 1;
+			}
+			break;
+		default:
+			fprintf(stderr, "usage: dmix-stress [-D device] [-n max_clients] [-t seconds] [-c channels] [-r rate] [-f format]\n");
+			return 1;
+		}
+	}
+	if (!max_clients || !seconds) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	printf("device %s, %u channels, %u Hz, %s, %u seconds per run\n",
+	       devname, channels, rate, snd_pcm_format_name(format), seconds);
+	for (n = 1; ; n *= 2) {
+		if (n > max_clients)
+			n = max_clients;
+		if (run(n) < 0)
+			err = 1;
+		if (n == max_clients)
+			break;
+	}
+	return err;
+}
@@ -0,0 +1,6 @@
+/*
+ * the linear conversions of dsnoop-convert, built in since they aren't
+ * exported by the library
+ */
+
+#include "../src/pcm/pcm_linear_conv.c"
@@ -0,0 +1,272 @@
+/*
+ * check of the dsnoop conversion to the client format
+ *
+ * Runs snoop_conversion_init() and snoop_convert_areas() of the dsnoop
+ * plugin on a slave setup made up here, so no card is needed.  The
+ * format pairs cover the vectorized, the get/put and the convert
+ * paths.  Each pair is converted with all slave channels bound in
+ * order, which the vectorized path takes as they are when the client
+ * buffer is interleaved, and with channel subsets, which are gathered
+ * in blocks of SNOOP_GATHER_FRAMES first.  The client buffer is
+ * interleaved or planar, its channels start at an offset in bits, and
+ * the transfers start in the middle of both buffers and straddle the
+ * gather blocks.  The whole client buffer is compared with a per-sample
+ * conversion.
+ *
+ * Usage: dsnoop-convert
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/sem.h>
+#include "../src/pcm/pcm_direct.h"
+#include "../src/pcm/pcm_plugin.h"
+#include "../src/pcm/pcm_dsnoop_conv.h"
+#include "../src/pcm/plugin_ops_simd.h"
+
+#define SLAVE_CHANNELS	6
+#define FRAMES		(4 * SNOOP_GATHER_FRAMES + 64)
+#define HEAD_BITS	64	/* client channels start after a header */
+#define SRC_OFS		37
+#define DST_OFS		11
+
+static const struct {
+	snd_pcm_format_t sformat, format;
+} pairs[] = {
+	{ SND_PCM_FORMAT_S16, SND_PCM_FORMAT_S32 },
+	{ SND_PCM_FORMAT_S16, SND_PCM_FORMAT_FLOAT },
+	{ SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S16 },
+	{ SND_PCM_FORMAT_S24_3LE, SND_PCM_FORMAT_S32 },
+	{ SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S24_3LE },
+	{ SND_PCM_FORMAT_FLOAT, SND_PCM_FORMAT_S16 },
+	{ SND_PCM_FORMAT_S16, SND_PCM_FORMAT_S24_3LE },	/* get/put */
+	{ SND_PCM_FORMAT_S16, SND_PCM_FORMAT_U8 },	/* convert */
+	{ SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S16_BE },	/* convert */
+};
+
+static unsigned int order[SLAVE_CHANNELS] = { 0, 1, 2, 3, 4, 5 };
+static unsigned int subset[] = { 4, 1, 5 };
+static unsigned int adjacent[] = { 2, 3 };
+
+static const struct {
+	const char *name;
+	unsigned int *bindings;
+	unsigned int channels;
+} bindings[] = {
+	{ "all", NULL, SLAVE_CHANNELS },
+	{ "in order", order, SLAVE_CHANNELS },
+	{ "subset", subset, sizeof(subset) / sizeof(subset[0]) },
+	{ "adjacent", adjacent, sizeof(adjacent) / sizeof(adjacent[0]) },
+};
+
+static const snd_pcm_uframes_t sizes[] = {
+	1, SNOOP_GATHER_FRAMES - 1, SNOOP_GATHER_FRAMES,
+	SNOOP_GATHER_FRAMES + 1, 3 * SNOOP_GATHER_FRAMES + 5,
+};
+
+/* a sample as S32 */
+static int32_t get_s32(snd_pcm_format_t format, const unsigned char *p)
+{
+	int16_t s16;
+	int32_t s32;
+	float f;
+
+	switch (format) {
+	case SND_PCM_FORMAT_S16:
+		memcpy(&s16, p, 2);
+		return (int32_t)((uint32_t)(uint16_t)s16 << 16);
+	case SND_PCM_FORMAT_S32:
+		memcpy(&s32, p, 4);
+		return s32;
+	case SND_PCM_FORMAT_S24_3LE:
+		return (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 |
+				 (uint32_t)p[2] << 24);
+	case SND_PCM_FORMAT_FLOAT:
+		memcpy(&f, p, 4);
+		return conv_float_to_s32(f);
+	default:
+		abort();
+	}
+}
+
+static void put_s32(snd_pcm_format_t format, unsigned char *p, int32_t x)
+{
+	int16_t s16 = x >> 16;
+	float f = (float)x / (float)0x80000000UL;
+
+	switch (format) {
+	case SND_PCM_FORMAT_S16:
+		memcpy(p, &s16, 2);
+		break;
+	case SND_PCM_FORMAT_S32:
+		memcpy(p, &x, 4);
+		break;
+	case SND_PCM_FORMAT_S24_3LE:
+		p[0] = x >> 8;
+		p[1] = x >> 16;
+		p[2] = x >> 24;
+		break;
+	case SND_PCM_FORMAT_FLOAT:
+		memcpy(p, &f, 4);
+		break;
+	case SND_PCM_FORMAT_U8:
+		p[0] = (x >> 24) ^ 0x80;
+		break;
+	case SND_PCM_FORMAT_S16_BE:
+		p[0] = x >> 24;
+		p[1] = x >> 16;
+		break;
+	default:
+		abort();
+	}
+}
+
+static void fill(snd_pcm_format_t format, unsigned char *buf, size_t bytes)
+{
+	size_t n;
+	float f;
+
+	srand(1);
+	if (format != SND_PCM_FORMAT_FLOAT) {
+		for (n = 0; n < bytes; n++)
+			buf[n] = rand();
+		return;
+	}
+	for (n = 0; n + 4 <= bytes; n += 4) {
+		f = rand() / (RAND_MAX / 2.0f) - 1.0f;
+		memcpy(buf + n, &f, 4);
+	}
+}
+
+static void client_areas(snd_pcm_channel_area_t *areas, void *buf,
+			 unsigned int channels, unsigned int width, int planar)
+{
+	unsigned int chn;
+
+	for (chn = 0; chn < channels; chn++) {
+		areas[chn].addr = buf;
+		areas[chn].first = HEAD_BITS +
+			(planar ? chn * FRAMES * width : chn * width);
+		areas[chn].step = planar ? width : channels * width;
+	}
+}
+
+/* returns 0 if the conversion matches, 1 if not, negative on error */
+static int check(snd_pcm_format_t sformat, snd_pcm_format_t format,
+		 unsigned int *binding, unsigned int channels, int planar,
+		 int *fast)
+{
+	unsigned int swidth = snd_pcm_format_physical_width(sformat);
+	unsigned int width = snd_pcm_format_physical_width(format);
+	size_t sbytes = FRAMES * SLAVE_CHANNELS * swidth / 8;
+	size_t bytes = HEAD_BITS / 8 + FRAMES * channels * width / 8;
+	snd_pcm_channel_area_t sareas[SLAVE_CHANNELS], areas[SLAVE_CHANNELS];
+	snd_pcm_direct_share_t shm;
+	snd_pcm_direct_t dsnoop;
+	unsigned char *sbuf, *buf, *ref;
+	unsigned int i, chn, schn;
+	snd_pcm_uframes_t n;
+	int err, bad = 0;
+
+	*fast = 0;
+	memset(&shm, 0, sizeof(shm));
+	memset(&dsnoop, 0, sizeof(dsnoop));
+	shm.s.format = sformat;
+	dsnoop.shmptr = &shm;
+	dsnoop.channels = channels;
+	dsnoop.bindings = binding;
+	err = snoop_conversion_init(&dsnoop, format);
+	if (err < 0)
+		return err;
+	*fast = dsnoop.u.dsnoop.fast_idx >= 0;
+
+	sbuf = malloc(sbytes);
+	buf = malloc(bytes);
+	ref = malloc(bytes);
+	if (!sbuf || !buf || !ref) {
+		err = -ENOMEM;
+		goto _end;
+	}
+	fill(sformat, sbuf, sbytes);
+	for (chn = 0; chn < SLAVE_CHANNELS; chn++) {
+		sareas[chn].addr = sbuf;
+		sareas[chn].first = chn * swidth;
+		sareas[chn].step = SLAVE_CHANNELS * swidth;
+	}
+	client_areas(areas, buf, channels, width, planar);
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		memset(buf, 0xa5, bytes);
+		memset(ref, 0xa5, bytes);
+		snoop_convert_areas(&dsnoop, sareas, areas, SRC_OFS, DST_OFS,
+				    sizes[i]);
+		for (chn = 0; chn < channels; chn++) {
+			schn = binding ? binding[chn] : chn;
+			for (n = 0; n < sizes[i]; n++) {
+				const unsigned char *s = sbuf +
+					((SRC_OFS + n) * SLAVE_CHANNELS + schn) * swidth / 8;
+				unsigned char *d = ref +
+					(areas[chn].first + (DST_OFS + n) * areas[chn].step) / 8;
+				put_s32(format, d, get_s32(sformat, s));
+			}
+		}
+		if (memcmp(buf, ref, bytes)) {
+			if (!bad)
+				fprintf(stderr, "%s -> %s: %lu frames differ\n",
+					snd_pcm_format_name(sformat),
+					snd_pcm_format_name(format),
+					(unsigned long)sizes[i]);
+			bad = 1;
+		}
+	}
+	err = bad;
+ _end:
+	free(sbuf);
+	free(buf);
+	free(ref);
+	free(dsnoop.u.dsnoop.areas);
+	free(dsnoop.u.dsnoop.gather);
+	return err;
+}
+
+int main(void)
+{
+	unsigned int i, j, planar;
+	int err, fast, ret = 0;
+	snd_pcm_direct_share_t shm;
+	snd_pcm_direct_t dsnoop;
+
+	for (i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++) {
+		for (j = 0; j < sizeof(bindings) / sizeof(bindings[0]); j++) {
+			for (planar = 0; planar < 2; planar++) {
+				err = check(pairs[i].sformat, pairs[i].format,
+					    bindings[j].bindings,
+					    bindings[j].channels, planar, &fast);
+				printf("%-8s -> %-8s %-8s %-11s %s%s\n",
+				       snd_pcm_format_name(pairs[i].sformat),
+				       snd_pcm_format_name(pairs[i].format),
+				       bindings[j].name,
+				       planar ? "planar" : "interleaved",
+				       err < 0 ? snd_strerror(err) :
+				       err ? "FAILED" : "ok",
+				       fast ? " (vectorized)" : "");
+				if (err)
+					ret = 1;
+			}
+		}
+	}
+
+	/* not linear and no vectorized kernel */
+	memset(&shm, 0, sizeof(shm));
+	memset(&dsnoop, 0, sizeof(dsnoop));
+	shm.s.format = SND_PCM_FORMAT_S24_3LE;
+	dsnoop.shmptr = &shm;
+	dsnoop.channels = 1;
+	err = snoop_conversion_init(&dsnoop, SND_PCM_FORMAT_FLOAT);
+	printf("S24_3LE  -> FLOAT_LE rejected: %s\n", err == -EINVAL ? "ok" : "FAILED");
+	if (err != -EINVAL)
+		ret = 1;
+	return ret;
+}
@@ -0,0 +1,234 @@
+/*
+ * latency test for the infile reader thread of the file plugin
+ *
+ * Captures from a file PCM with a null slave whose infile is a pipe.  A
+ * child process writes a counting pattern into the pipe like a disk
+ * which stalls for a while at regular intervals.  The capture is paced
+ * in real time, one period per period time, once with the infile read
+ * on demand and once with infile_prefetch_time.  The longest
+ * snd_pcm_readi() call, the number of periods which took longer than a
+ * period, the frames which did not continue the pattern and the frames
+ * of silence inserted for the late reader are printed.
+ *
+ * Usage: file-prefetch-bench [-s seconds] [-r rate] [-c channels]
+ *                            [-p period_frames] [-t stall_ms]
+ *                            [-i stall_interval_ms] [-b prefetch_ms]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../include/asoundlib.h"
+
+static unsigned int seconds = 3;
+static unsigned int rate = 192000;
+static unsigned int channels = 32;
+static unsigned int period = 1024;
+static unsigned int stall = 200;
+static unsigned int stall_interval = 1000;
+static unsigned int prefetch = 1000;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* writes the pattern, sleeping stall ms every stall_interval ms */
+static void writer(int fd)
+{
+	unsigned int frames = 256;
+	unsigned int *buf = malloc(frames * channels * sizeof(*buf));
+	unsigned int value = 1, i;
+	double next_stall = now() + stall_interval / 1e3;
+
+	if (!buf)
+		_exit(1);
+	for (;;) {
+		for (i = 0; i < frames * channels; i++)
+			buf[i] = value++;
+		if (write(fd, buf, frames * channels * sizeof(*buf)) < 0)
+			_exit(0);
+		if (now() >= next_stall) {
+			usleep(stall * 1000);
+			next_stall = now() + stall_interval / 1e3;
+		}
+	}
+}
+
+static int open_pcm(snd_pcm_t **pcm, int fd, int prefetch_time)
+{
+	char buf[512];
+	snd_config_t *top;
+	snd_input_t *in;
+	int err;
+
+	snprintf(buf, sizeof(buf),
+		 "pcm.file_prefetch_bench {\n"
+		 "	type file\n"
+		 "	slave.pcm { type null }\n"
+		 "	file \"/dev/null\"\n"
+		 "	infile %d\n"
+		 "	format raw\n"
+		 "	infile_prefetch_time %d\n"
+		 "}\n", fd, prefetch_time);
+	err = snd_config_top(&top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&in, buf, strlen(buf));
+	if (err < 0) {
+		snd_config_delete(top);
+		return err;
+	}
+	err = snd_config_load(top, in);
+	snd_input_close(in);
+	if (err >= 0)
+		err = snd_pcm_open_lconf(pcm, "file_prefetch_bench",
+					 SND_PCM_STREAM_CAPTURE, 0, top);
+	snd_config_delete(top);
+	if (err < 0)
+		return err;
+	return snd_pcm_set_params(*pcm, SND_PCM_FORMAT_S32_LE,
+				  SND_PCM_ACCESS_RW_INTERLEAVED, channels,
+				  rate, 0, (unsigned long long)period * 4 *
+				  1000000 / rate);
+}
+
+static int run(int prefetch_time)
+{
+	unsigned int periods, late = 0, bad = 0, silent = 0, i, f;
+	unsigned int expect = 1;
+	double period_time = (double)period / rate;
+	double start, t, max = 0;
+	struct timespec ts;
+	snd_pcm_t *pcm;
+	unsigned int *buf;
+	int fds[2], status, err;
+	pid_t pid;
+
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		return -1;
+	}
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return -1;
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		writer(fds[1]);
+	}
+	close(fds[1]);
+
+	err = open_pcm(&pcm, fds[0], prefetch_time);
+	if (err < 0) {
+		fprintf(stderr, "cannot open the file PCM: %s\n", snd_strerror(err));
+		return -1;
+	}
+	buf = calloc(period, channels * sizeof(*buf));
+	if (!buf)
+		return -1;
+
+	periods = seconds * rate / period;
+	start = now();
+	for (i = 0; i < periods; i++) {
+		double deadline;
+
+		t = now();
+		err = snd_pcm_readi(pcm, buf, period);
+		t = now() - t;
+		if (err < 0) {
+			fprintf(stderr, "read error: %s\n", snd_strerror(err));
+			break;
+		}
+		if (t > max)
+			max = t;
+		if (t > period_time)
+			late++;
+		for (f = 0; f < (unsigned int)err; f++) {
+			unsigned int *frame = buf + f * channels;
+
+			if (frame[0] == 0) {
+				silent++;
+				continue;
+			}
+			if (frame[0] != expect ||
+			    frame[channels - 1] != expect + channels - 1)
+				bad++;
+			expect = frame[0] + channels;
+		}
+		/* pace the stream like a device would */
+		deadline = start + (i + 1) * period_time;
+		t = deadline - now();
+		if (t > 0) {
+			ts.tv_sec = t;
+			ts.tv_nsec = (t - ts.tv_sec) * 1e9;
+			nanosleep(&ts, NULL);
+		}
+	}
+	snd_pcm_close(pcm);
+	close(fds[0]);
+	kill(pid, SIGTERM);
+	waitpid(pid, &status, 0);
+
+	printf("%-9s %13.2f %8u %10u %10u\n",
+	       prefetch_time ? "prefetch" : "on demand",
+	       max * 1e3, late, bad, silent);
+	free(buf);
+	return prefetch_time && bad ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "s:r:c:p:t:i:b:")) >= 0) {
+		switch (c) {
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		case 'c':
+			channels = atoi(optarg);
+			break;
+		case 'p':
+			period = atoi(optarg);
+			break;
+		case 't':
+			stall = atoi(optarg);
+			break;
+		case 'i':
+			stall_interval = atoi(optarg);
+			break;
+		case 'b':
+			prefetch = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: file-prefetch-bench [-s seconds] [-r rate] [-c channels] [-p period_frames] [-t stall_ms] [-i stall_interval_ms] [-b prefetch_ms]\n");
+			return 1;
+		}
+	}
+	if (!seconds || !rate || !channels || !period || !prefetch) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	printf("%u s, %u Hz, %u channels, %u frame periods (%.2f ms), writer stalls %u ms every %u ms\n",
+	       seconds, rate, channels, period, period * 1e3 / rate,
+	       stall, stall_interval);
+	printf("%-9s %13s %8s %10s %10s\n", "infile", "max read ms",
+	       "late", "bad frames", "silenced");
+	if (run(0) < 0 || run(prefetch) < 0)
+		return 1;
+	return 0;
+}
@@ -0,0 +1,226 @@
+/*
+ * check of the file rotation and the rf64 headers of the file plugin
+ *
+ * Plays a counting pattern into a file PCM with a null slave, writing
+ * rf64 files which rotate every second, with or without the writer
+ * thread.  The finished files are parsed while the stream is still
+ * open, the last one after closing: the sizes in each header must match
+ * its data, all files but the last must hold exactly one second and the
+ * pattern must continue across the files without a lost or repeated
+ * frame.
+ *
+ * Usage: file-rotate [-d directory] [-s seconds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/asoundlib.h"
+
+#define RATE		8000
+#define CHANNELS	2
+#define PERIOD		300	/* not a divider of RATE */
+
+static const char *dir = "/tmp";
+static unsigned int seconds = 3;
+
+static unsigned int le32(const unsigned char *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+}
+
+static int open_pcm(snd_pcm_t **pcm, int async)
+{
+	char buf[512];
+	snd_config_t *top;
+	snd_input_t *in;
+	int err;
+
+	snprintf(buf, sizeof(buf),
+		 "pcm.file_rotate {\n"
+		 "	type file\n"
+		 "	slave.pcm { type null }\n"
+		 "	file \"%s/file-rotate-%%n.wav\"\n"
+		 "	format rf64\n"
+		 "	rotate_time 1\n"
+		 "	header_update_time 1\n"
+		 "	async %d\n"
+		 "}\n", dir, async);
+	err = snd_config_top(&top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&in, buf, strlen(buf));
+	if (err < 0) {
+		snd_config_delete(top);
+		return err;
+	}
+	err = snd_config_load(top, in);
+	snd_input_close(in);
+	if (err >= 0)
+		err = snd_pcm_open_lconf(pcm, "file_rotate",
+					 SND_PCM_STREAM_PLAYBACK, 0, top);
+	snd_config_delete(top);
+	if (err < 0)
+		return err;
+	return snd_pcm_set_params(*pcm, SND_PCM_FORMAT_S16_LE,
+				  SND_PCM_ACCESS_RW_INTERLEAVED, CHANNELS,
+				  RATE, 0, 100000);
+}
+
+/*
+ * parse one file, check its pattern from *next on; returns the frames in
+ * it, -1 on error
+ */
+static long check_file(unsigned int index, unsigned short *next, int partial)
+{
+	char name[256];
+	unsigned char *buf;
+	unsigned int riff_len, chunk_len, i;
+	long size, pos = 12, data = -1, data_len = 0;
+	FILE *f;
+
+	snprintf(name, sizeof(name), "%s/file-rotate-%04u.wav", dir, index);
+	f = fopen(name, "rb");
+	if (!f)
+		return -1;
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	rewind(f);
+	buf = malloc(size);
+	if (!buf || fread(buf, 1, size, f) != (size_t)size) {
+		fclose(f);
+		free(buf);
+		return -1;
+	}
+	fclose(f);
+
+	riff_len = le32(buf + 4);
+	if (memcmp(buf, "RIFF", 4) || memcmp(buf + 8, "WAVE", 4) ||
+	    riff_len != size - 8) {
+		fprintf(stderr, "%s: bad RIFF header (%u bytes for %ld)\n",
+			name, riff_len, size);
+		goto error;
+	}
+	while (pos + 8 <= size) {
+		chunk_len = le32(buf + pos + 4);
+		if (!memcmp(buf + pos, "data", 4)) {
+			data = pos + 8;
+			data_len = chunk_len;
+			break;
+		}
+		pos += 8 + chunk_len;
+	}
+	if (data < 0 || data + data_len != size) {
+		fprintf(stderr, "%s: bad data chunk\n", name);
+		goto error;
+	}
+	if (!partial && data_len != RATE * CHANNELS * 2) {
+		fprintf(stderr, "%s: %ld bytes of data instead of one second\n",
+			name, data_len);
+		goto error;
+	}
+	for (i = 0; i < data_len / 2; i += CHANNELS) {
+		unsigned short *frame = (unsigned short *)(buf + data) + i;
+
+		if (frame[0] != *next || frame[1] != (unsigned short)~*next) {
+			fprintf(stderr, "%s: frame %u breaks the pattern\n",
+				name, i / CHANNELS);
+			goto error;
+		}
+		(*next)++;
+	}
+	free(buf);
+	return data_len / 2 / CHANNELS;
+
+ error:
+	free(buf);
+	return -1;
+}
+
+static int run(int async)
+{
+	unsigned int frames = seconds * RATE + RATE / 2;
+	unsigned short buf[PERIOD * CHANNELS], value = 0, next = 0;
+	unsigned int written = 0, files, i, f;
+	long total = 0, n;
+	snd_pcm_t *pcm;
+	char name[256];
+	int err;
+
+	err = open_pcm(&pcm, async);
+	if (err < 0) {
+		fprintf(stderr, "cannot open the file PCM: %s\n", snd_strerror(err));
+		return -1;
+	}
+	while (written < frames) {
+		n = frames - written < PERIOD ? frames - written : PERIOD;
+		for (f = 0; f < n; f++) {
+			buf[f * CHANNELS] = value;
+			buf[f * CHANNELS + 1] = ~value;
+			value++;
+		}
+		err = snd_pcm_writei(pcm, buf, n);
+		if (err < 0) {
+			fprintf(stderr, "write error: %s\n", snd_strerror(err));
+			snd_pcm_close(pcm);
+			return -1;
+		}
+		written += err;
+		/* let the header update interval pass now and then */
+		usleep(1000);
+	}
+	snd_pcm_drain(pcm);
+	files = seconds + 1;
+	for (i = 0; i < files - 1; i++)
+		total += check_file(i, &next, 0);
+	snd_pcm_close(pcm);
+	n = check_file(files - 1, &next, 1);
+	if (n < 0 || total != (long)(files - 1) * RATE) {
+		fprintf(stderr, "%s: rotated files are broken\n",
+			async ? "async" : "sync");
+		return -1;
+	}
+	total += n;
+	snprintf(name, sizeof(name), "%s/file-rotate-%04u.wav", dir, files);
+	if (total != frames || access(name, F_OK) == 0) {
+		fprintf(stderr, "%s: %ld frames in the files, %u written\n",
+			async ? "async" : "sync", total, frames);
+		return -1;
+	}
+	for (i = 0; i < files; i++) {
+		snprintf(name, sizeof(name), "%s/file-rotate-%04u.wav", dir, i);
+		unlink(name);
+	}
+	printf("%-6s %u files, %ld frames: ok\n", async ? "async" : "sync",
+	       files, total);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "d:s:")) >= 0) {
+		switch (c) {
+		case 'd':
+			dir = optarg;
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: file-rotate [-d directory] [-s seconds]\n");
+			return 1;
+		}
+	}
+	if (!seconds) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+	if (run(0) < 0 || run(1) < 0)
+		return 1;
+	return 0;
+}
@@ -0,0 +1,214 @@
+/*
+ * latency test for the writer thread of the file plugin
+ *
+ * Plays into a file PCM with a null slave whose output goes to a pipe.
+ * A child process reads the pipe like a disk which stalls for a while
+ * at regular intervals.  The playback is paced in real time, one period
+ * per period time, once with the plugin writing synchronously and once
+ * with the async writer thread.  The longest snd_pcm_writei() call, the
+ * number of periods which took longer than a period (an xrun on a real
+ * device) and the bytes which reached the reader are printed.
+ *
+ * Usage: file-writer-bench [-s seconds] [-p period_frames] [-t stall_ms]
+ *                          [-i stall_interval_ms] [-b async_buffer_ms]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "../include/asoundlib.h"
+
+#define RATE		48000
+#define CHANNELS	2
+
+static unsigned int seconds = 4;
+static unsigned int period = 1024;
+static unsigned int stall = 500;
+static unsigned int stall_interval = 1000;
+static unsigned int async_buffer = 2000;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* reads the pipe, sleeping stall ms every stall_interval ms */
+static void reader(int fd, unsigned long long *received)
+{
+	char buf[4096];
+	double next_stall = now() + stall_interval / 1e3;
+	ssize_t n;
+
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		*received += n;
+		if (now() >= next_stall) {
+			usleep(stall * 1000);
+			next_stall = now() + stall_interval / 1e3;
+		}
+	}
+	_exit(0);
+}
+
+static int open_pcm(snd_pcm_t **pcm, int fd, int async)
+{
+	char buf[512];
+	snd_config_t *top;
+	snd_input_t *in;
+	int err;
+
+	snprintf(buf, sizeof(buf),
+		 "pcm.file_writer_bench {\n"
+		 "	type file\n"
+		 "	slave.pcm { type null }\n"
+		 "	file %d\n"
+		 "	format raw\n"
+		 "	async %d\n"
+		 "	async_buffer_time %u\n"
+		 "}\n", fd, async, async_buffer);
+	err = snd_config_top(&top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&in, buf, strlen(buf));
+	if (err < 0) {
+		snd_config_delete(top);
+		return err;
+	}
+	err = snd_config_load(top, in);
+	snd_input_close(in);
+	if (err >= 0)
+		err = snd_pcm_open_lconf(pcm, "file_writer_bench",
+					 SND_PCM_STREAM_PLAYBACK, 0, top);
+	snd_config_delete(top);
+	if (err < 0)
+		return err;
+	return snd_pcm_set_params(*pcm, SND_PCM_FORMAT_S16_LE,
+				  SND_PCM_ACCESS_RW_INTERLEAVED, CHANNELS,
+				  RATE, 0, (unsigned long long)period * 4 *
+				  1000000 / RATE);
+}
+
+static int run(int async)
+{
+	unsigned long long *received;
+	unsigned long long written = 0;
+	unsigned int periods, late = 0, i;
+	double period_time = (double)period / RATE;
+	double start, t, max = 0;
+	struct timespec ts;
+	snd_pcm_t *pcm;
+	short *buf;
+	int fds[2], status, err;
+	pid_t pid;
+
+	received = mmap(NULL, sizeof(*received), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (received == MAP_FAILED || pipe(fds) < 0) {
+		perror("setup");
+		return -1;
+	}
+	*received = 0;
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return -1;
+	}
+	if (pid == 0) {
+		close(fds[1]);
+		reader(fds[0], received);
+	}
+	close(fds[0]);
+
+	err = open_pcm(&pcm, fds[1], async);
+	if (err < 0) {
+		fprintf(stderr, "cannot open the file PCM: %s\n", snd_strerror(err));
+		return -1;
+	}
+	buf = calloc(period, CHANNELS * sizeof(*buf));
+	if (!buf)
+		return -1;
+
+	periods = seconds * RATE / period;
+	start = now();
+	for (i = 0; i < periods; i++) {
+		double deadline;
+
+		t = now();
+		err = snd_pcm_writei(pcm, buf, period);
+		t = now() - t;
+		if (err < 0) {
+			fprintf(stderr, "write error: %s\n", snd_strerror(err));
+			break;
+		}
+		written += (unsigned long long)err * CHANNELS * sizeof(*buf);
+		if (t > max)
+			max = t;
+		if (t > period_time)
+			late++;
+		/* pace the stream like a device would */
+		deadline = start + (i + 1) * period_time;
+		t = deadline - now();
+		if (t > 0) {
+			ts.tv_sec = t;
+			ts.tv_nsec = (t - ts.tv_sec) * 1e9;
+			nanosleep(&ts, NULL);
+		}
+	}
+	snd_pcm_drain(pcm);
+	snd_pcm_close(pcm);
+	close(fds[1]);
+	waitpid(pid, &status, 0);
+
+	printf("%-6s %14.2f %10u %14llu %14llu\n", async ? "async" : "sync",
+	       max * 1e3, late, written, *received);
+	free(buf);
+	munmap(received, sizeof(*received));
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "s:p:t:i:b:")) >= 0) {
+		switch (c) {
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'p':
+			period = atoi(optarg);
+			break;
+		case 't':
+			stall = atoi(optarg);
+			break;
+		case 'i':
+			stall_interval = atoi(optarg);
+			break;
+		case 'b':
+			async_buffer = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: file-writer-bench [-s seconds] [-p period_frames] [-t stall_ms] [-i stall_interval_ms] [-b async_buffer_ms]\n");
+			return 1;
+		}
+	}
+	if (!seconds || !period || !async_buffer) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	printf("%u s, %u frame periods (%.1f ms), reader stalls %u ms every %u ms\n",
+	       seconds, period, period * 1e3 / RATE, stall, stall_interval);
+	printf("%-6s %14s %10s %14s %14s\n", "mode", "max write ms",
+	       "late", "bytes written", "bytes read");
+	if (run(0) < 0 || run(1) < 0)
+		return 1;
+	return 0;
+}
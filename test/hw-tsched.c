@@ -0,0 +1,223 @@
+/*
+ * check of the timer scheduling arithmetic of the hw plugin
+ *
+ * Runs the watermark and deadline helpers of pcm_hw_tsched.h without a
+ * card: the wakeup point and the timer value, the growth of the
+ * watermark on late wakeups and its decay after wakeups in time, and the
+ * estimate of the frames the hw_ptr in the status data lags behind,
+ * across the boundary, too.  Then a playback stream with one period per
+ * buffer is simulated: the status hw_ptr is refreshed only at the
+ * wakeups, the timer is armed again from the stale status some time
+ * after each refill, and the wakeups come late by a random time below a
+ * half of the watermark.  The buffer must never run empty and the
+ * watermark must not grow, which it would if the timer were armed from
+ * the stale hw_ptr as it is.
+ *
+ * Usage: hw-tsched [-s seconds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include "../include/asoundlib.h"
+#include "../src/pcm/pcm_hw_tsched.h"
+
+#define RATE		48000
+#define BUFFER		8192
+#define BOUNDARY	(BUFFER * 1024UL)
+#define WATERMARK	20000	/* usec */
+#define NS		1000000000ULL
+
+static unsigned int seconds = 60;
+
+static int fail(const char *what)
+{
+	printf("%s: FAILED\n", what);
+	return 1;
+}
+
+static int check_setup(void)
+{
+	snd_pcm_tsched_t ts = { 0 };
+
+	tsched_setup(&ts, WATERMARK, RATE, BUFFER);
+	if (ts.min_watermark != 960 || ts.watermark != 960)
+		return fail("setup");
+	/* a raised watermark is kept, up to a half of the buffer */
+	ts.watermark = 2000;
+	tsched_setup(&ts, WATERMARK, RATE, BUFFER);
+	if (ts.watermark != 2000)
+		return fail("setup keeps the watermark");
+	tsched_setup(&ts, WATERMARK, RATE, 1024);
+	if (ts.min_watermark != 512 || ts.watermark != 512)
+		return fail("setup on a small buffer");
+	printf("setup: ok\n");
+	return 0;
+}
+
+static int check_wait(void)
+{
+	snd_pcm_tsched_t ts = { 0 };
+	unsigned long long ns;
+
+	tsched_setup(&ts, WATERMARK, RATE, BUFFER);
+	/* avail_min is before the watermark */
+	if (tsched_wait(&ts, 0, 4800, BUFFER, RATE, 0, &ns) ||
+	    ns != 100000000ULL || !ts.deadline)
+		return fail("wait for avail_min");
+	/* the watermark is before avail_min */
+	if (tsched_wait(&ts, 1232, BUFFER, BUFFER, RATE, 0, &ns) ||
+	    ns != 125000000ULL)
+		return fail("wait for the watermark");
+	if (!tsched_wait(&ts, 4800, 4800, BUFFER, RATE, 0, &ns) || ns ||
+	    ts.deadline)
+		return fail("wakeup point reached");
+	printf("wait: ok\n");
+	return 0;
+}
+
+static int check_adapt(void)
+{
+	snd_pcm_tsched_t ts = { 0 };
+	unsigned long long ns;
+	unsigned int i;
+
+	tsched_setup(&ts, WATERMARK, RATE, BUFFER);
+	/* late by more than a half of the watermark */
+	tsched_wait(&ts, 0, BUFFER, BUFFER, RATE, 0, &ns);
+	tsched_wait(&ts, BUFFER - 960 + 481, BUFFER, BUFFER, RATE, 1, &ns);
+	if (ts.watermark != 1440)
+		return fail("grow on a late wakeup");
+	/* no deadline, no adaption */
+	tsched_wait(&ts, BUFFER, BUFFER, BUFFER, RATE, 1, &ns);
+	if (ts.watermark != 1440 || ts.on_time)
+		return fail("wakeup without a deadline");
+	for (i = 0; i < 8; i++) {
+		tsched_wait(&ts, 0, BUFFER, BUFFER, RATE, 0, &ns);
+		tsched_wait(&ts, BUFFER, BUFFER, BUFFER, RATE, 1, &ns);
+	}
+	if (ts.watermark != BUFFER / 2)
+		return fail("grow up to a half of the buffer");
+	for (i = 0; i < 64 * 64; i++) {
+		tsched_wait(&ts, 0, BUFFER, BUFFER, RATE, 0, &ns);
+		tsched_wait(&ts, BUFFER - ts.watermark, BUFFER, BUFFER, RATE,
+			    1, &ns);
+		if (i == TSCHED_SHRINK_WAKEUPS - 1 &&
+		    ts.watermark != BUFFER / 2 - BUFFER / 16)
+			return fail("shrink after wakeups in time");
+	}
+	if (ts.watermark != ts.min_watermark)
+		return fail("shrink down to the configured watermark");
+	printf("adapt: ok\n");
+	return 0;
+}
+
+static int check_lag(void)
+{
+	snd_pcm_tsched_t ts = { 0 };
+	unsigned long long t = 5 * NS;
+
+	if (tsched_lag(&ts, 1000, BOUNDARY, RATE, t))
+		return fail("lag without a sync");
+	tsched_sync(&ts, 1000, t);
+	t += 10000000ULL;	/* 480 frames */
+	if (tsched_lag(&ts, 1000, BOUNDARY, RATE, t) != 480)
+		return fail("lag of the stale status");
+	if (tsched_lag(&ts, 1200, BOUNDARY, RATE, t) != 280)
+		return fail("lag after a period interrupt");
+	if (tsched_lag(&ts, 1600, BOUNDARY, RATE, t) != 0)
+		return fail("lag behind the kernel");
+	tsched_sync(&ts, BOUNDARY - 100, t);
+	if (tsched_lag(&ts, 50, BOUNDARY, RATE, t + 10000000ULL) != 330)
+		return fail("lag across the boundary");
+	/* a long time without a sync */
+	if (tsched_lag(&ts, BOUNDARY - 100, BOUNDARY, RATE,
+		       t + 100000ULL * NS) != BOUNDARY)
+		return fail("lag after a long time");
+	printf("lag: ok\n");
+	return 0;
+}
+
+/*
+ * playback with the device consuming RATE frames per second; the status
+ * hw_ptr is synced at each wakeup only, then the application refills the
+ * buffer and arms the timer from the stale status after a while
+ */
+static int check_stream(void)
+{
+	snd_pcm_tsched_t ts = { 0 };
+	unsigned long long t = NS, timer, ns, lag;
+	snd_pcm_uframes_t hw, status, appl = BUFFER, avail, left, min_left = BUFFER;
+	unsigned long wakeups = 0, early = 0;
+	snd_pcm_uframes_t max_wm = 0;
+
+	srand(1);
+	tsched_setup(&ts, WATERMARK, RATE, BUFFER);
+	/* the stream starts at t = 1 s */
+	hw = 0;
+	status = 0;
+	tsched_sync(&ts, status, t);
+	/* armed after writing the full buffer at the start */
+	tsched_wait(&ts, 0, BUFFER, BUFFER, RATE, 0, &ns);
+	timer = t + ns;
+	while (t < (unsigned long long)seconds * NS) {
+		/* the wakeup comes up to 9 ms late */
+		t = timer + (unsigned long long)(rand() % 9000) * 1000;
+		hw = (t - NS) * RATE / NS;
+		if (hw > appl)
+			return fail("stream ran empty");
+		left = appl - hw;
+		if (left < min_left)
+			min_left = left;
+		wakeups++;
+		/* poll_revents syncs the status */
+		status = hw;
+		tsched_sync(&ts, status, t);
+		avail = BUFFER - (appl - status);
+		if (!tsched_wait(&ts, avail, BUFFER, BUFFER, RATE, 1, &ns)) {
+			early++;
+			timer = t + ns;
+			continue;
+		}
+		if (ts.watermark > max_wm)
+			max_wm = ts.watermark;
+		if (max_wm > ts.min_watermark)
+			return fail("stream woke up late");
+		/* refill, then arm from the stale status a bit later */
+		appl = status + BUFFER;
+		t += (unsigned long long)(rand() % 10000) * 1000;
+		lag = tsched_lag(&ts, status, BOUNDARY, RATE, t);
+		avail = BUFFER - (appl - status) + lag;
+		if (tsched_wait(&ts, avail, BUFFER, BUFFER, RATE, 0, &ns))
+			ns = 0;
+		timer = t + ns;
+	}
+	printf("stream: %lu wakeups, %lu early, %lu frames left at least, "
+	       "watermark %lu..%lu: ok\n", wakeups, early,
+	       (unsigned long)min_left, (unsigned long)ts.min_watermark,
+	       (unsigned long)max_wm);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int c, ret = 0;
+
+	while ((c = getopt(argc, argv, "s:")) >= 0) {
+		switch (c) {
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: hw-tsched [-s seconds]\n");
+			return 1;
+		}
+	}
+
+	ret |= check_setup();
+	ret |= check_wait();
+	ret |= check_adapt();
+	ret |= check_lag();
+	ret |= check_stream();
+	return ret;
+}
@@ -0,0 +1,195 @@
+/*
+ * check of the linear conversions of the 3 byte and 20 bit formats
+ *
+ * These go through the get/put pair via S32 (snd_pcm_linear_use_getput()),
+ * which the linear plugin and the dsnoop client format conversion share.
+ * Plays a ramp over the whole sample range through a linear plugin into
+ * a raw file, reads the file back and compares every sample with the
+ * expected value.
+ *
+ * Usage: linear-convert [-d dir]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include "../include/asoundlib.h"
+
+#define CHANNELS	2
+#define FRAMES		4096
+
+static const char *dir = "/tmp";
+
+static const struct {
+	snd_pcm_format_t src, dst;
+} pairs[] = {
+	{ SND_PCM_FORMAT_S24_3LE, SND_PCM_FORMAT_S16_LE },
+	{ SND_PCM_FORMAT_S16_LE, SND_PCM_FORMAT_S24_3LE },
+	{ SND_PCM_FORMAT_S20_3LE, SND_PCM_FORMAT_S16_LE },
+	{ SND_PCM_FORMAT_S24_3LE, SND_PCM_FORMAT_S32_LE },
+};
+
+/* sample n of the ramp as a 32 bit value */
+static int ramp(unsigned int n)
+{
+	return (int)(n * (0xffffffffU / (FRAMES * CHANNELS - 1)) + 0x80000000U);
+}
+
+static void put_sample(unsigned char *p, snd_pcm_format_t format, int val)
+{
+	unsigned int bytes = snd_pcm_format_physical_width(format) / 8;
+	unsigned int width = snd_pcm_format_width(format);
+	unsigned int i, v = (unsigned int)val >> (32 - width);
+
+	for (i = 0; i < bytes; i++)
+		p[i] = v >> (i * 8);
+}
+
+static int get_sample(const unsigned char *p, snd_pcm_format_t format)
+{
+	unsigned int bytes = snd_pcm_format_physical_width(format) / 8;
+	unsigned int width = snd_pcm_format_width(format);
+	unsigned int i, v = 0;
+
+	for (i = 0; i < bytes; i++)
+		v |= p[i] << (i * 8);
+	return (int)(v << (32 - width));
+}
+
+static int open_pcm(snd_pcm_t **pcm, snd_pcm_format_t dst, const char *file)
+{
+	snd_config_t *top;
+	snd_input_t *in;
+	char buf[512];
+	int err, len;
+
+	len = snprintf(buf, sizeof(buf),
+		       "pcm.linear_convert {\n"
+		       "	type linear\n"
+		       "	slave {\n"
+		       "		pcm { type file slave.pcm { type null } file \"%s\" format raw }\n"
+		       "		format %s\n"
+		       "	}\n"
+		       "}\n", file, snd_pcm_format_name(dst));
+	err = snd_config_top(&top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&in, buf, len);
+	if (err < 0) {
+		snd_config_delete(top);
+		return err;
+	}
+	err = snd_config_load(top, in);
+	snd_input_close(in);
+	if (err >= 0)
+		err = snd_pcm_open_lconf(pcm, "linear_convert",
+					 SND_PCM_STREAM_PLAYBACK, 0, top);
+	snd_config_delete(top);
+	return err;
+}
+
+/* returns the number of wrong samples, negative on error */
+static int check_pair(snd_pcm_format_t src, snd_pcm_format_t dst)
+{
+	unsigned int sbytes = snd_pcm_format_physical_width(src) / 8;
+	unsigned int dbytes = snd_pcm_format_physical_width(dst) / 8;
+	unsigned int swidth = snd_pcm_format_width(src);
+	unsigned int dwidth = snd_pcm_format_width(dst);
+	unsigned char *in = NULL, *out = NULL;
+	unsigned int n, bad = 0;
+	char file[256];
+	snd_pcm_t *pcm;
+	FILE *fp;
+	int err, val, expected;
+
+	snprintf(file, sizeof(file), "%s/linear-convert-%d.raw", dir, getpid());
+	err = open_pcm(&pcm, dst, file);
+	if (err < 0) {
+		fprintf(stderr, "open: %s\n", snd_strerror(err));
+		return err;
+	}
+	err = snd_pcm_set_params(pcm, src, SND_PCM_ACCESS_RW_INTERLEAVED,
+				 CHANNELS, 48000, 0, 100000);
+	if (err < 0) {
+		fprintf(stderr, "setup: %s\n", snd_strerror(err));
+		snd_pcm_close(pcm);
+		return err;
+	}
+	in = malloc(FRAMES * CHANNELS * sbytes);
+	out = malloc(FRAMES * CHANNELS * dbytes);
+	if (!in || !out) {
+		err = -ENOMEM;
+		goto _end;
+	}
+	for (n = 0; n < FRAMES * CHANNELS; n++)
+		put_sample(in + n * sbytes, src, ramp(n));
+	err = snd_pcm_writei(pcm, in, FRAMES);
+	if (err != FRAMES) {
+		fprintf(stderr, "write: %s\n", snd_strerror(err));
+		err = err < 0 ? err : -EIO;
+		goto _end;
+	}
+	snd_pcm_close(pcm);
+	pcm = NULL;
+
+	fp = fopen(file, "rb");
+	if (!fp || fread(out, dbytes, FRAMES * CHANNELS, fp) != FRAMES * CHANNELS) {
+		fprintf(stderr, "%s: short or missing output\n", file);
+		if (fp)
+			fclose(fp);
+		err = -EIO;
+		goto _end;
+	}
+	fclose(fp);
+	for (n = 0; n < FRAMES * CHANNELS; n++) {
+		/* the source precision, truncated to the destination */
+		val = ramp(n) & (int)(~0U << (32 - swidth));
+		expected = val & (int)(~0U << (32 - dwidth));
+		val = get_sample(out + n * dbytes, dst);
+		if (val != expected && bad++ < 4)
+			fprintf(stderr, "sample %u: 0x%08x, expected 0x%08x\n",
+				n, (unsigned int)val, (unsigned int)expected);
+	}
+	err = bad;
+ _end:
+	if (pcm)
+		snd_pcm_close(pcm);
+	unlink(file);
+	free(in);
+	free(out);
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i;
+	int c, err, ret = 0;
+
+	while ((c = getopt(argc, argv, "d:")) >= 0) {
+		switch (c) {
+		case 'd':
+			dir = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: linear-convert [-d dir]\n");
+			return 1;
+		}
+	}
+
+	for (i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++) {
+		err = check_pair(pairs[i].src, pairs[i].dst);
+		printf("%s -> %s: ", snd_pcm_format_name(pairs[i].src),
+		       snd_pcm_format_name(pairs[i].dst));
+		if (err < 0)
+			printf("error %s\n", snd_strerror(err));
+		else if (err > 0)
+			printf("%d wrong samples\n", err);
+		else
+			printf("ok\n");
+		if (err)
+			ret = 1;
+	}
+	return ret;
+}
@@ -0,0 +1,183 @@
+/*
+ * check of the peak pseudo scope of the meter plugin
+ *
+ * Plays a sine per channel, each with its own amplitude, into a meter
+ * PCM with a paced null slave in S16, S32 and FLOAT.  While the stream
+ * runs the peak and RMS levels of the scope are sampled; once the scope
+ * has seen a couple of updates they must match the amplitude and
+ * amplitude / sqrt(2) of each channel.
+ *
+ * Usage: meter-peak [-r rate] [-c channels] [-s seconds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <math.h>
+#include "../include/asoundlib.h"
+
+#define TONE		1000	/* Hz */
+#define PERIOD_TIME	10000	/* us */
+#define TOLERANCE	0.02
+
+static unsigned int rate = 48000;
+static unsigned int channels = 4;
+static unsigned int seconds = 1;
+
+static double amplitude(unsigned int channel)
+{
+	return 0.9 / (channel + 1);
+}
+
+static int open_pcm(snd_pcm_t **pcm)
+{
+	static const char conf[] =
+		"pcm.meter_peak {\n"
+		"	type meter\n"
+		"	slave.pcm { type null paced 1 }\n"
+		"	frequency 50\n"
+		"}\n";
+	snd_config_t *top;
+	snd_input_t *in;
+	int err;
+
+	err = snd_config_top(&top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&in, conf, strlen(conf));
+	if (err < 0) {
+		snd_config_delete(top);
+		return err;
+	}
+	err = snd_config_load(top, in);
+	snd_input_close(in);
+	if (err >= 0)
+		err = snd_pcm_open_lconf(pcm, "meter_peak",
+					 SND_PCM_STREAM_PLAYBACK, 0, top);
+	snd_config_delete(top);
+	return err;
+}
+
+static void fill(void *buf, snd_pcm_format_t format, unsigned long long pos,
+		 unsigned int frames)
+{
+	unsigned int f, c;
+
+	for (f = 0; f < frames; f++) {
+		double s = sin(2 * M_PI * TONE * (pos + f) / rate);
+
+		for (c = 0; c < channels; c++) {
+			double v = s * amplitude(c);
+			unsigned int i = f * channels + c;
+
+			switch (format) {
+			case SND_PCM_FORMAT_S16:
+				((int16_t *)buf)[i] = lrint(v * 32767);
+				break;
+			case SND_PCM_FORMAT_S32:
+				((int32_t *)buf)[i] = lrint(v * 2147483647.0);
+				break;
+			default:
+				((float *)buf)[i] = v;
+				break;
+			}
+		}
+	}
+}
+
+static int run(snd_pcm_format_t format)
+{
+	unsigned int period = rate * (PERIOD_TIME / 1000) / 1000;
+	unsigned long long pos = 0, total = (unsigned long long)rate * seconds;
+	unsigned int checked = 0, bad = 0, c;
+	snd_pcm_scope_t *scope;
+	snd_pcm_t *pcm;
+	void *buf;
+	int err;
+
+	err = open_pcm(&pcm);
+	if (err < 0) {
+		fprintf(stderr, "cannot open the meter PCM: %s\n", snd_strerror(err));
+		return -1;
+	}
+	err = snd_pcm_scope_peak_open(pcm, "peak", &scope);
+	if (err >= 0)
+		err = snd_pcm_set_params(pcm, format,
+					 SND_PCM_ACCESS_RW_INTERLEAVED,
+					 channels, rate, 0, PERIOD_TIME * 4);
+	if (err < 0) {
+		fprintf(stderr, "cannot set up %s: %s\n",
+			snd_pcm_format_name(format), snd_strerror(err));
+		snd_pcm_close(pcm);
+		return -1;
+	}
+	buf = malloc(period * snd_pcm_format_physical_width(format) / 8 *
+		     channels);
+	if (!buf)
+		return -1;
+
+	while (pos < total) {
+		fill(buf, format, pos, period);
+		err = snd_pcm_writei(pcm, buf, period);
+		if (err < 0) {
+			fprintf(stderr, "write error: %s\n", snd_strerror(err));
+			break;
+		}
+		pos += err;
+		/* let the scope settle for a tenth of a second */
+		if (pos < rate / 10)
+			continue;
+		for (c = 0; c < channels; c++) {
+			double a = amplitude(c);
+			double p = snd_pcm_scope_peak_get_peak(scope, c);
+			double r = snd_pcm_scope_peak_get_rms(scope, c);
+
+			if (fabs(p - a) > a * TOLERANCE ||
+			    fabs(r - a / M_SQRT2) > a * TOLERANCE) {
+				if (!bad)
+					fprintf(stderr, "%s: channel %u peak %.4f rms %.4f, expected %.4f %.4f\n",
+						snd_pcm_format_name(format), c,
+						p, r, a, a / M_SQRT2);
+				bad++;
+			}
+			checked++;
+		}
+	}
+	snd_pcm_drop(pcm);
+	snd_pcm_close(pcm);
+	free(buf);
+	printf("%-8s %u levels checked, %u bad\n", snd_pcm_format_name(format),
+	       checked, bad);
+	return err < 0 || !checked || bad ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "r:c:s:")) >= 0) {
+		switch (c) {
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		case 'c':
+			channels = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: meter-peak [-r rate] [-c channels] [-s seconds]\n");
+			return 1;
+		}
+	}
+	if (rate < 8000 || !channels || !seconds) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+	if (run(SND_PCM_FORMAT_S16) < 0 || run(SND_PCM_FORMAT_S32) < 0 ||
+	    run(SND_PCM_FORMAT_FLOAT) < 0)
+		return 1;
+	return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * check of the skew monitoring and the worker threads of the multi plugin
+ *
+ * Plays into a multi PCM made of paced null slaves, once with the slaves
+ * serviced one after the other and once from worker threads.  The slaves
+ * run from the same clock, so after the run the drift of each slave
+ * reported by snd_pcm_multi_get_skew() must stay within a few ppm and
+ * the skew within a period.  The mean and longest snd_pcm_writen() call
+ * and the skews are printed.
+ *
+ * Usage: multi-skew [-n slaves] [-s seconds] [-p period_us]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include "../include/asoundlib.h"
+
+#define RATE		48000
+#define CHANNELS	2	/* per slave */
+#define MAX_SLAVES	16
+#define MAX_DRIFT	5	/* ppm */
+
+static unsigned int slaves = 4;
+static unsigned int seconds = 5;
+static unsigned int period_time = 5000;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int open_pcm(snd_pcm_t **pcm, int parallel)
+{
+	char buf[4096];
+	unsigned int i, len;
+	snd_config_t *top;
+	snd_input_t *in;
+	int err;
+
+	len = snprintf(buf, sizeof(buf),
+		       "pcm.multi_skew {\n"
+		       "	type multi\n"
+		       "	parallel %d\n", parallel);
+	for (i = 0; i < slaves; i++)
+		len += snprintf(buf + len, sizeof(buf) - len,
+				"	slaves.%u { pcm { type null paced 1 } channels %u }\n",
+				i, CHANNELS);
+	for (i = 0; i < slaves * CHANNELS; i++)
+		len += snprintf(buf + len, sizeof(buf) - len,
+				"	bindings.%u { slave %u channel %u }\n",
+				i, i / CHANNELS, i % CHANNELS);
+	snprintf(buf + len, sizeof(buf) - len, "}\n");
+
+	err = snd_config_top(&top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&in, buf, strlen(buf));
+	if (err < 0) {
+		snd_config_delete(top);
+		return err;
+	}
+	err = snd_config_load(top, in);
+	snd_input_close(in);
+	if (err >= 0)
+		err = snd_pcm_open_lconf(pcm, "multi_skew",
+					 SND_PCM_STREAM_PLAYBACK, 0, top);
+	snd_config_delete(top);
+	if (err < 0)
+		return err;
+	return snd_pcm_set_params(*pcm, SND_PCM_FORMAT_S16,
+				  SND_PCM_ACCESS_RW_NONINTERLEAVED,
+				  slaves * CHANNELS, RATE, 0, period_time * 4);
+}
+
+static int run(int parallel)
+{
+	snd_pcm_uframes_t period = (unsigned long long)RATE * period_time / 1000000;
+	unsigned long long pos = 0, total = (unsigned long long)RATE * seconds;
+	unsigned int calls = 0, bad = 0, i;
+	void *bufs[MAX_SLAVES * CHANNELS];
+	double t, sum = 0, max = 0;
+	snd_pcm_t *pcm;
+	short *buf;
+	int err;
+
+	err = open_pcm(&pcm, parallel);
+	if (err < 0) {
+		fprintf(stderr, "cannot open the multi PCM: %s\n", snd_strerror(err));
+		return -1;
+	}
+	buf = calloc(period, sizeof(*buf));
+	if (!buf)
+		return -1;
+	for (i = 0; i < slaves * CHANNELS; i++)
+		bufs[i] = buf;
+
+	while (pos < total) {
+		t = now();
+		err = snd_pcm_writen(pcm, bufs, period);
+		t = now() - t;
+		if (err < 0) {
+			fprintf(stderr, "write error: %s\n", snd_strerror(err));
+			break;
+		}
+		pos += err;
+		sum += t;
+		if (t > max)
+			max = t;
+		calls++;
+	}
+
+	printf("%-10s %13.3f %12.3f", parallel ? "parallel" : "sequential",
+	       sum / calls * 1e3, max * 1e3);
+	for (i = 0; i < slaves; i++) {
+		snd_pcm_sframes_t skew;
+		double drift;
+
+		if (snd_pcm_multi_get_skew(pcm, i, &skew, &drift) < 0) {
+			printf("  -");
+			bad++;
+			continue;
+		}
+		printf("  %ld/%.0f", (long)skew, drift);
+		if (skew < -(snd_pcm_sframes_t)period ||
+		    skew > (snd_pcm_sframes_t)period ||
+		    drift < -MAX_DRIFT || drift > MAX_DRIFT)
+			bad++;
+	}
+	printf("\n");
+	snd_pcm_drop(pcm);
+	snd_pcm_close(pcm);
+	free(buf);
+	if (bad)
+		fprintf(stderr, "%s: %u slaves out of range\n",
+			parallel ? "parallel" : "sequential", bad);
+	return err < 0 || bad ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "n:s:p:")) >= 0) {
+		switch (c) {
+		case 'n':
+			slaves = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'p':
+			period_time = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: multi-skew [-n slaves] [-s seconds] [-p period_us]\n");
+			return 1;
+		}
+	}
+	if (!slaves || slaves > MAX_SLAVES || seconds < 2 ||
+	    period_time < 1000) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	printf("%u slaves, %u s, %u us periods\n", slaves, seconds, period_time);
+	printf("%-10s %13s %12s  %s\n", "mode", "mean write ms",
+	       "max write ms", "skew frames/drift ppm per slave");
+	if (run(0) < 0 || run(1) < 0)
+		return 1;
+	return 0;
+}
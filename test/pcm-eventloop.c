@@ -0,0 +1,297 @@
+/*
+ * check and benchmark of the PCM event loop
+ *
+ * Plays into many paced null PCMs, started a fraction of a period apart,
+ * once with the classic loop (collect the poll descriptors of all PCMs,
+ * poll() and call snd_pcm_poll_descriptors_revents() for each of them)
+ * and once with snd_pcm_eventloop_wait().  A pipe is registered twice
+ * next to the PCMs, so both registrations must be reported when it gets
+ * written.  For each loop the wakeups, the handles visited per wakeup,
+ * the xruns and the CPU time used per second are printed.
+ *
+ * Usage: pcm-eventloop [-n pcms] [-s seconds] [-p period_us]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "../include/asoundlib.h"
+
+#define RATE		48000
+#define CHANNELS	2
+#define MAX_PCMS	256
+
+static unsigned int npcms = 64;
+static unsigned int seconds = 2;
+static unsigned int period_time = 10000;
+
+static snd_pcm_t *pcms[MAX_PCMS];
+static short *silence;
+static snd_pcm_uframes_t buffer_size;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpu_time(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+	       ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static int open_pcm(snd_pcm_t **pcm)
+{
+	static const char conf[] = "pcm.eventloop { type null paced 1 }\n";
+	snd_config_t *top;
+	snd_input_t *in;
+	int err;
+
+	err = snd_config_top(&top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&in, conf, strlen(conf));
+	if (err < 0) {
+		snd_config_delete(top);
+		return err;
+	}
+	err = snd_config_load(top, in);
+	snd_input_close(in);
+	if (err >= 0)
+		err = snd_pcm_open_lconf(pcm, "eventloop", SND_PCM_STREAM_PLAYBACK,
+					 SND_PCM_NONBLOCK, top);
+	snd_config_delete(top);
+	if (err < 0)
+		return err;
+	return snd_pcm_set_params(*pcm, SND_PCM_FORMAT_S16,
+				  SND_PCM_ACCESS_RW_INTERLEAVED,
+				  CHANNELS, RATE, 0, period_time * 4);
+}
+
+static void close_pcms(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < npcms; i++) {
+		if (pcms[i])
+			snd_pcm_close(pcms[i]);
+		pcms[i] = NULL;
+	}
+}
+
+/* fill up the buffers and start the PCMs a fraction of a period apart */
+static int open_pcms(void)
+{
+	snd_pcm_uframes_t period;
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < npcms; i++) {
+		err = open_pcm(&pcms[i]);
+		if (err < 0) {
+			fprintf(stderr, "cannot open PCM %u: %s\n", i, snd_strerror(err));
+			close_pcms();
+			return err;
+		}
+	}
+	snd_pcm_get_params(pcms[0], &buffer_size, &period);
+	free(silence);
+	silence = calloc(buffer_size * CHANNELS, sizeof(*silence));
+	if (!silence)
+		return -ENOMEM;
+	for (i = 0; i < npcms; i++) {
+		snd_pcm_writei(pcms[i], silence, buffer_size);
+		snd_pcm_start(pcms[i]);
+		usleep(period_time / npcms);
+	}
+	return 0;
+}
+
+/* refill a PCM, returns 1 on an xrun */
+static int refill(snd_pcm_t *pcm, snd_pcm_sframes_t avail)
+{
+	if (avail == -EPIPE || snd_pcm_writei(pcm, silence, avail) == -EPIPE) {
+		snd_pcm_prepare(pcm);
+		snd_pcm_writei(pcm, silence, buffer_size);
+		snd_pcm_start(pcm);
+		return 1;
+	}
+	return 0;
+}
+
+static void report(const char *name, unsigned long wakeups,
+		   unsigned long visits, unsigned int xruns, double cpu)
+{
+	printf("%-10s %9lu %14.1f %6u %12.1f\n", name, wakeups,
+	       wakeups ? (double)visits / wakeups : 0.0, xruns,
+	       cpu / seconds * 1e3);
+}
+
+static int run_poll(void)
+{
+	struct pollfd pfds[MAX_PCMS * 4];
+	unsigned int xruns = 0, i, n;
+	unsigned long wakeups = 0, visits = 0;
+	unsigned short revents;
+	int count[MAX_PCMS];
+	double end, cpu;
+	int err;
+
+	err = open_pcms();
+	if (err < 0)
+		return err;
+	cpu = cpu_time();
+	end = now() + seconds;
+	while (now() < end) {
+		/* what a server has to do on each wakeup */
+		for (i = 0, n = 0; i < npcms; i++) {
+			count[i] = snd_pcm_poll_descriptors(pcms[i], pfds + n,
+							    MAX_PCMS * 4 - n);
+			n += count[i];
+		}
+		err = poll(pfds, n, 1000);
+		if (err < 0)
+			break;
+		wakeups++;
+		for (i = 0, n = 0; i < npcms; n += count[i], i++) {
+			visits++;
+			snd_pcm_poll_descriptors_revents(pcms[i], pfds + n,
+							 count[i], &revents);
+			if (revents & POLLOUT)
+				xruns += refill(pcms[i], snd_pcm_avail_update(pcms[i]));
+		}
+	}
+	report("poll", wakeups, visits, xruns, cpu_time() - cpu);
+	close_pcms();
+	return err < 0 ? -1 : 0;
+}
+
+static int run_eventloop(void)
+{
+	snd_pcm_eventloop_event_t events[MAX_PCMS + 2];
+	snd_pcm_eventloop_t *loop;
+	unsigned int xruns = 0, piped = 0, i;
+	unsigned long wakeups = 0, visits = 0;
+	struct pollfd pfd;
+	int fds[2], err, n;
+	double end, cpu;
+	char c = 0;
+
+	err = open_pcms();
+	if (err < 0)
+		return err;
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		close_pcms();
+		return -1;
+	}
+	err = snd_pcm_eventloop_open(&loop);
+	for (i = 0; i < npcms && err >= 0; i++)
+		err = snd_pcm_eventloop_add_pcm(loop, pcms[i], pcms[i]);
+	pfd.fd = fds[0];
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if (err >= 0)
+		err = snd_pcm_eventloop_add_poll(loop, &pfd, 1, &fds[0]);
+	if (err >= 0)
+		err = snd_pcm_eventloop_add_poll(loop, &pfd, 1, &fds[1]);
+	if (err < 0) {
+		fprintf(stderr, "cannot set up the event loop: %s\n", snd_strerror(err));
+		goto _close;
+	}
+
+	cpu = cpu_time();
+	end = now() + seconds;
+	while (now() < end) {
+		if (!c && now() > end - seconds / 2.0) {
+			c = 1;
+			if (write(fds[1], &c, 1) != 1)
+				break;
+		}
+		n = snd_pcm_eventloop_wait(loop, events, MAX_PCMS + 2, 1000);
+		if (n < 0) {
+			err = n;
+			fprintf(stderr, "wait error: %s\n", snd_strerror(err));
+			break;
+		}
+		wakeups++;
+		visits += n;
+		for (i = 0; i < (unsigned int)n; i++) {
+			if (!events[i].pcm) {
+				if (events[i].revents & POLLIN) {
+					piped |= events[i].private_data == &fds[0] ? 1 : 2;
+					snd_pcm_eventloop_remove_poll(loop, events[i].private_data);
+				}
+				continue;
+			}
+			if (events[i].private_data != events[i].pcm) {
+				fprintf(stderr, "wrong private data\n");
+				err = -EINVAL;
+			}
+			if (events[i].revents & (POLLOUT | POLLERR))
+				xruns += refill(events[i].pcm, events[i].avail);
+		}
+	}
+	report("eventloop", wakeups, visits, xruns, cpu_time() - cpu);
+	if (piped != 3) {
+		fprintf(stderr, "pipe reported %s\n", piped ? "for one registration" : "never");
+		err = -EINVAL;
+	}
+	if (xruns) {
+		fprintf(stderr, "%u xruns\n", xruns);
+		err = -EPIPE;
+	}
+
+ _close:
+	for (i = 0; i < npcms; i++)
+		snd_pcm_eventloop_remove_pcm(loop, pcms[i]);
+	snd_pcm_eventloop_close(loop);
+	close(fds[0]);
+	close(fds[1]);
+	close_pcms();
+	return err < 0 ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "n:s:p:")) >= 0) {
+		switch (c) {
+		case 'n':
+			npcms = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'p':
+			period_time = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: pcm-eventloop [-n pcms] [-s seconds] [-p period_us]\n");
+			return 1;
+		}
+	}
+	if (!npcms || npcms > MAX_PCMS || !seconds || period_time < 1000) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	printf("%u PCMs, %u s, %u us periods\n", npcms, seconds, period_time);
+	printf("%-10s %9s %14s %6s %12s\n", "loop", "wakeups",
+	       "visits/wakeup", "xruns", "cpu ms/s");
+	if (run_poll() < 0 || run_eventloop() < 0)
+		return 1;
+	snd_config_update_free_global();
+	return 0;
+}
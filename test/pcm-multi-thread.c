@@ -15,11 +15,23 @@
  * (0-9).  In addition, it puts the mode suffix ('a' for avail, 'd' for
  * delay, etc) for the random mode, as well as the suffix '!' indicating
  * the error from the called function.
+ *
+ * With -B, this runs as a lock contention benchmark for the given number
+ * of seconds instead: the worker threads call their function as fast as
+ * they can, and at the end the write (read) calls of the main thread and
+ * the calls of each worker thread are printed together with the mean and
+ * the longest call, and the number of calls taking longer than 100 us.  The -N option uses a plug PCM converting to S32 on a
+ * null PCM, so that no sound card is needed and the main thread holds the
+ * PCM lock for the conversion most of the time.  Run it again with
+ * LIBASOUND_PCM_SNAPSHOT=0 to compare with the workers always waiting for
+ * the lock.
  */
 
 #include <stdio.h>
+#include <string.h>
 #include <pthread.h>
 #include <getopt.h>
+#include <time.h>
 #include "../include/asoundlib.h"
 
 #define MAX_THREADS	10
@@ -49,11 +61,41 @@ static snd_pcm_format_t format = SND_PCM_FORMAT_S16_LE;
 static int running_mode = MODE_AVAIL_UPDATE;
 static int show_value = 0;
 static int quiet = 0;
+static int use_null = 0;
+static int bench_time = 0;
+
+#define SLOW_CALL	100e-6	/* s */
+
+struct call_stat {
+	unsigned long calls;
+	unsigned long slow;
+	double sum;
+	double max;
+};
 
 static pthread_t peeper_threads[MAX_THREADS];
+static struct call_stat peeper_stats[MAX_THREADS];
 static int running = 1;
 static snd_pcm_t *pcm;
 
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void add_call(struct call_stat *st, double t)
+{
+	st->calls++;
+	if (t > SLOW_CALL)
+		st->slow++;
+	st->sum += t;
+	if (t > st->max)
+		st->max = t;
+}
+
 static void *peeper(void *data)
 {
 	int thread_no = (long)data;
@@ -61,12 +103,15 @@ static void *peeper(void *data)
 	snd_pcm_status_t *stat;
 	snd_htimestamp_t tstamp;
 	int mode = running_mode, err;
+	double t = 0;
 
 	snd_pcm_status_alloca(&stat);
 
 	while (running) {
 		if (running_mode == MODE_RANDOM)
 			mode = rand() % MODE_RANDOM;
+		if (bench_time)
+			t = now();
 		switch (mode) {
 		case MODE_AVAIL_UPDATE:
 			val = snd_pcm_avail_update(pcm);
@@ -88,6 +133,8 @@ static void *peeper(void *data)
 			break;
 		}
 
+		if (bench_time)
+			add_call(&peeper_stats[thread_no], now() - t);
 		if (quiet)
 			continue;
 		if (running_mode == MODE_RANDOM) {
@@ -118,13 +165,15 @@ static void usage(void)
 	fprintf(stderr, "  -m str  Running mode (avail, status, hwsync, timestamp, delay, random)\n");
 	fprintf(stderr, "  -v      Show value\n");
 	fprintf(stderr, "  -q      Quiet mode\n");
+	fprintf(stderr, "  -N      Use a plug PCM on a null PCM instead of a device\n");
+	fprintf(stderr, "  -B val  Run a contention benchmark for the given seconds\n");
 }
 
 static int parse_options(int argc, char **argv)
 {
 	int c, i;
 
-	while ((c = getopt(argc, argv, "D:r:f:p:b:s:t:m:vq")) >= 0) {
+	while ((c = getopt(argc, argv, "D:r:f:p:b:s:t:m:vqNB:")) >= 0) {
 		switch (c) {
 		case 'D':
 			devname = optarg;
@@ -177,6 +226,17 @@ static int parse_options(int argc, char **argv)
 		case 'q':
 			quiet = 1;
 			break;
+		case 'N':
+			use_null = 1;
+			break;
+		case 'B':
+			bench_time = atoi(optarg);
+			if (bench_time < 1) {
+				fprintf(stderr, "invalid benchmark time\n");
+				return 1;
+			}
+			quiet = 1;
+			break;
 		default:
 			usage();
 			return 1;
@@ -185,6 +245,41 @@ static int parse_options(int argc, char **argv)
 	return 0;
 }
 
+static int open_null(void)
+{
+	static const char conf[] =
+		"pcm.multi_thread {\n"
+		"	type plug\n"
+		"	slave { pcm { type null } format S32_LE }\n"
+		"}\n";
+	snd_config_t *top;
+	snd_input_t *in;
+	int err;
+
+	err = snd_config_top(&top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&in, conf, strlen(conf));
+	if (err < 0) {
+		snd_config_delete(top);
+		return err;
+	}
+	err = snd_config_load(top, in);
+	snd_input_close(in);
+	if (err >= 0)
+		err = snd_pcm_open_lconf(&pcm, "multi_thread", stream, 0, top);
+	snd_config_delete(top);
+	return err;
+}
+
+static void print_stat(const char *name, const struct call_stat *st)
+{
+	printf("%-8s %12.0f %12.2f %12.2f %10lu\n", name,
+	       st->calls / (double)bench_time,
+	       st->calls ? st->sum / st->calls * 1e6 : 0.0, st->max * 1e6,
+	       st->slow);
+}
+
 static int setup_params(void)
 {
 	snd_pcm_hw_params_t *hw;
@@ -207,15 +302,20 @@ static int setup_params(void)
 
 int main(int argc, char **argv)
 {
-	char *buf;
+	struct call_stat main_stat = { 0 };
+	char *buf, name[16];
+	double end = 0, t;
 	int i, err;
 
 	if (parse_options(argc, argv))
 		return 1;
 
-	err = snd_pcm_open(&pcm, devname, stream, 0);
+	if (use_null)
+		err = open_null();
+	else
+		err = snd_pcm_open(&pcm, devname, stream, 0);
 	if (err < 0) {
-		fprintf(stderr, "cannot open pcm %s\n", devname);
+		fprintf(stderr, "cannot open pcm %s\n", use_null ? "null" : devname);
 		return 1;
 	}
 
@@ -237,12 +337,20 @@ int main(int argc, char **argv)
 
 	if (stream == SND_PCM_STREAM_CAPTURE)
 		snd_pcm_start(pcm);
+	if (bench_time)
+		end = now() + bench_time;
 	for (;;) {
 		int size = rand() % (bufsize / 2);
+
+		t = now();
+		if (bench_time && t >= end)
+			break;
 		if (stream == SND_PCM_STREAM_PLAYBACK)
 			err = snd_pcm_writei(pcm, buf, size);
 		else
 			err = snd_pcm_readi(pcm, buf, size);
+		if (bench_time)
+			add_call(&main_stat, now() - t);
 		if (err < 0) {
 			fprintf(stderr, "read/write error %d\n", err);
 			err = snd_pcm_recover(pcm, err, 0);
@@ -254,10 +362,24 @@ int main(int argc, char **argv)
 	}
 
 	running = 0;
-	for (i = 0; i < num_threads; i++)
-		pthread_cancel(peeper_threads[i]);
+	/* let the workers finish their call for the statistics */
+	if (!bench_time)
+		for (i = 0; i < num_threads; i++)
+			pthread_cancel(peeper_threads[i]);
 	for (i = 0; i < num_threads; i++)
 		pthread_join(peeper_threads[i], NULL);
+	if (!bench_time)
+		return 1;
 
-	return 1;
+	printf("%-8s %12s %12s %12s %10s\n", "thread", "calls/s", "mean us",
+	       "max us", ">100 us");
+	print_stat(stream == SND_PCM_STREAM_PLAYBACK ? "write" : "read",
+		   &main_stat);
+	for (i = 0; i < num_threads; i++) {
+		snprintf(name, sizeof(name), "%d%c", i, mode_suffix[running_mode]);
+		print_stat(name, &peeper_stats[i]);
+	}
+	snd_pcm_close(pcm);
+	free(buf);
+	return err < 0;
 }
@@ -0,0 +1,169 @@
+/*
+ * check and benchmark of the PCM refinement cache
+ *
+ * Opens a plug -> rate -> linear -> null chain and sets it up over and
+ * over, once with defaults.pcm.refine_cache off and once with it on.
+ * The setup chosen with the cache must be the same as without it.  With
+ * -f the cache is also written to the given file, which must exist after
+ * the run; running the test again with the same file starts warm.  The
+ * mean and longest open and setup times are printed.
+ *
+ * Usage: pcm-refine-cache [-n loops] [-f file]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/asoundlib.h"
+
+static unsigned int loops = 200;
+static const char *file;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int load_config(snd_config_t **top, int cache)
+{
+	char buf[1024];
+	snd_input_t *in;
+	int err;
+
+	snprintf(buf, sizeof(buf),
+		 "defaults.pcm.refine_cache %d\n"
+		 "defaults.pcm.refine_cache_file \"%s\"\n"
+		 "pcm.refine {\n"
+		 "	type plug\n"
+		 "	slave.pcm {\n"
+		 "		type rate\n"
+		 "		slave {\n"
+		 "			pcm {\n"
+		 "				type linear\n"
+		 "				slave { pcm { type null } format S32_LE }\n"
+		 "			}\n"
+		 "			rate 44100\n"
+		 "		}\n"
+		 "	}\n"
+		 "}\n", cache, cache && file ? file : "");
+	err = snd_config_top(top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&in, buf, strlen(buf));
+	if (err < 0) {
+		snd_config_delete(*top);
+		return err;
+	}
+	err = snd_config_load(*top, in);
+	snd_input_close(in);
+	if (err < 0)
+		snd_config_delete(*top);
+	return err;
+}
+
+/* the setup as text, to compare the runs */
+static int setup(snd_config_t *top, char *dump, size_t size)
+{
+	snd_pcm_hw_params_t *params;
+	snd_output_t *out;
+	snd_pcm_t *pcm;
+	char *str;
+	size_t len;
+	int err;
+
+	err = snd_pcm_open_lconf(&pcm, "refine", SND_PCM_STREAM_PLAYBACK, 0, top);
+	if (err < 0)
+		return err;
+	err = snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16_LE,
+				 SND_PCM_ACCESS_RW_INTERLEAVED,
+				 2, 48000, 1, 100000);
+	if (err >= 0 && dump) {
+		snd_pcm_hw_params_alloca(&params);
+		snd_pcm_hw_params_current(pcm, params);
+		snd_output_buffer_open(&out);
+		snd_pcm_hw_params_dump(params, out);
+		len = snd_output_buffer_string(out, &str);
+		snprintf(dump, size, "%.*s", (int)len, str);
+		snd_output_close(out);
+	}
+	snd_pcm_close(pcm);
+	return err;
+}
+
+static int run(int cache, char *dump, size_t size)
+{
+	double t, sum = 0, max = 0;
+	snd_config_t *top;
+	unsigned int i;
+	int err;
+
+	err = load_config(&top, cache);
+	if (err < 0)
+		return err;
+	for (i = 0; i < loops; i++) {
+		t = now();
+		err = setup(top, i ? NULL : dump, size);
+		t = now() - t;
+		if (err < 0)
+			break;
+		sum += t;
+		if (t > max)
+			max = t;
+	}
+	snd_config_delete(top);
+	if (err < 0) {
+		fprintf(stderr, "setup error: %s\n", snd_strerror(err));
+		return err;
+	}
+	printf("%-6s %14.1f %13.1f\n", cache ? "cached" : "off",
+	       sum / loops * 1e6, max * 1e6);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	char off[4096], cached[4096];
+	int c;
+
+	while ((c = getopt(argc, argv, "n:f:")) >= 0) {
+		switch (c) {
+		case 'n':
+			loops = atoi(optarg);
+			break;
+		case 'f':
+			file = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: pcm-refine-cache [-n loops] [-f file]\n");
+			return 1;
+		}
+	}
+	if (!loops || (file && *file != '/')) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	printf("%u loops\n", loops);
+	printf("%-6s %14s %13s\n", "cache", "mean setup us", "max setup us");
+	if (run(0, off, sizeof(off)) < 0 || run(1, cached, sizeof(cached)) < 0)
+		return 1;
+	/* the first cached setup may be cold, compare a warm one too */
+	if (run(1, cached, sizeof(cached)) < 0)
+		return 1;
+	if (strcmp(off, cached)) {
+		fprintf(stderr, "the setup differs with the cache:\n%s\n%s\n",
+			off, cached);
+		return 1;
+	}
+	if (file && access(file, R_OK)) {
+		fprintf(stderr, "%s was not written\n", file);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * live breakdown of the time spent in a PCM plugin chain
+ *
+ * Plays silence through a PCM with the plugin chain statistics enabled
+ * and prints every second, for each PCM of the chain, the time spent in
+ * each accounted operation (it includes the time spent in the slaves),
+ * the longest call, the frames and bytes its own conversion touched and
+ * the latency it adds on top of its slave.
+ *
+ * Without -D a plug PCM converts S16 stereo at 48 kHz to S32 with six
+ * channels at 44.1 kHz into a null PCM.
+ *
+ * Usage: pcm-stats [-D device] [-s seconds] [-f format] [-c channels] [-r rate]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include "../include/asoundlib.h"
+
+static const char default_conf[] =
+	"pcm.stats_default {\n"
+	"	type plug\n"
+	"	slave {\n"
+	"		pcm { type null }\n"
+	"		format S32_LE\n"
+	"		rate 44100\n"
+	"		channels 6\n"
+	"	}\n"
+	"}\n";
+
+static const char *device;
+static unsigned int seconds = 5;
+static snd_pcm_format_t format = SND_PCM_FORMAT_S16;
+static unsigned int channels = 2;
+static unsigned int rate = 48000;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int open_pcm(snd_pcm_t **pcm)
+{
+	snd_config_t *top;
+	snd_input_t *in;
+	int err;
+
+	if (device)
+		return snd_pcm_open(pcm, device, SND_PCM_STREAM_PLAYBACK, 0);
+	err = snd_config_top(&top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&in, default_conf, strlen(default_conf));
+	if (err < 0) {
+		snd_config_delete(top);
+		return err;
+	}
+	err = snd_config_load(top, in);
+	snd_input_close(in);
+	if (err >= 0)
+		err = snd_pcm_open_lconf(pcm, "stats_default",
+					 SND_PCM_STREAM_PLAYBACK, 0, top);
+	snd_config_delete(top);
+	return err;
+}
+
+static void print_stats(snd_pcm_t *pcm, double interval)
+{
+	snd_pcm_stats_t *stats;
+	unsigned int index;
+	int op;
+
+	snd_pcm_stats_alloca(&stats);
+	printf("%-2s %-8s %-16s", "#", "type", "name");
+	for (op = 0; op <= SND_PCM_STATS_LAST; op++)
+		printf(" %18s", snd_pcm_stats_op_name(op));
+	printf(" %10s %8s %8s\n", "frames/s", "MB/s", "lat(us)");
+	for (index = 0; snd_pcm_stats(pcm, index, stats) >= 0; index++) {
+		const char *name = snd_pcm_stats_get_name(stats);
+
+		printf("%-2u %-8s %-16.16s", index,
+		       snd_pcm_type_name(snd_pcm_stats_get_type(stats)),
+		       name ? name : "");
+		for (op = 0; op <= SND_PCM_STATS_LAST; op++)
+			/* the share of the interval and the longest call */
+			printf(" %7.2f%% %7.1fus",
+			       snd_pcm_stats_get_time(stats, op) / interval / 1e7,
+			       snd_pcm_stats_get_max_time(stats, op) / 1e3);
+		printf(" %10.0f %8.1f %8ld\n",
+		       snd_pcm_stats_get_frames(stats) / interval,
+		       snd_pcm_stats_get_bytes(stats) / interval / 1e6,
+		       snd_pcm_stats_get_latency(stats));
+	}
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	snd_pcm_uframes_t buffer_size, period_size;
+	double start, last, t;
+	snd_pcm_t *pcm;
+	void *buf;
+	int c, err;
+
+	while ((c = getopt(argc, argv, "D:s:f:c:r:")) >= 0) {
+		switch (c) {
+		case 'D':
+			device = optarg;
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'f':
+			format = snd_pcm_format_value(optarg);
+			break;
+		case 'c':
+			channels = atoi(optarg);
+			break;
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: pcm-stats [-D device] [-s seconds] [-f format] [-c channels] [-r rate]\n");
+			return 1;
+		}
+	}
+	if (format == SND_PCM_FORMAT_UNKNOWN || !channels || !rate) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	err = open_pcm(&pcm);
+	if (err < 0) {
+		fprintf(stderr, "open: %s\n", snd_strerror(err));
+		return 1;
+	}
+	/* before the setup, the plugins inserted by plug inherit it */
+	err = snd_pcm_stats_enable(pcm, 1);
+	if (err >= 0)
+		err = snd_pcm_set_params(pcm, format, SND_PCM_ACCESS_RW_INTERLEAVED,
+					 channels, rate, 1, 100000);
+	if (err < 0) {
+		fprintf(stderr, "setup: %s\n", snd_strerror(err));
+		snd_pcm_close(pcm);
+		return 1;
+	}
+	snd_pcm_get_params(pcm, &buffer_size, &period_size);
+	buf = calloc(period_size, snd_pcm_frames_to_bytes(pcm, 1));
+	if (!buf) {
+		snd_pcm_close(pcm);
+		return 1;
+	}
+	snd_pcm_format_set_silence(format, buf, period_size * channels);
+
+	start = last = now();
+	do {
+		snd_pcm_sframes_t r = snd_pcm_writei(pcm, buf, period_size);
+
+		if (r < 0) {
+			r = snd_pcm_recover(pcm, r, 0);
+			if (r < 0) {
+				fprintf(stderr, "write: %s\n", snd_strerror(r));
+				break;
+			}
+		}
+		t = now();
+		if (t - last >= 1.0) {
+			print_stats(pcm, t - last);
+			snd_pcm_stats_reset(pcm);
+			last = t;
+		}
+	} while (t - start < seconds);
+
+	snd_pcm_drop(pcm);
+	snd_pcm_close(pcm);
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,200 @@
+/*
+ * clock drift test for the adaptive rate plugin
+ *
+ * Bridges a paced null capture PCM to a rate PCM in the adaptive mode
+ * playing into a paced null PCM.  The capture runs slightly faster
+ * (or slower, with a negative -p) than the nominal rate of the
+ * playback side, like two sound cards with their own clocks.  The
+ * playback delay is printed every second; without compensation (-n) it
+ * drifts away until the buffer runs full or empty, with it it has to stay
+ * around the level seen after the start.
+ *
+ * Usage: rate-drift [-r rate] [-s slave_rate] [-p ppm] [-t seconds]
+ *                   [-l latency_us] [-n]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "../include/asoundlib.h"
+
+static unsigned int rate = 44100;
+static unsigned int slave_rate = 48000;
+static int ppm = 1000;
+static unsigned int seconds = 30;
+static unsigned int latency = 100000;
+static int adaptive = 1;
+
+static const char config_fmt[] =
+	"pcm.drift_capture {\n"
+	"	type null\n"
+	"	paced true\n"
+	"}\n"
+	"pcm.drift_playback {\n"
+	"	type rate\n"
+	"	converter \"linear\"\n"
+	"	adaptive %s\n"
+	"	adaptive_ppm %d\n"
+	"	slave {\n"
+	"		pcm { type null paced true }\n"
+	"		rate %u\n"
+	"	}\n"
+	"}\n";
+
+static int load_config(snd_config_t **top)
+{
+	char buf[sizeof(config_fmt) + 64];
+	snd_input_t *in;
+	int err;
+
+	snprintf(buf, sizeof(buf), config_fmt, adaptive ? "true" : "false",
+		 abs(ppm) * 2 + 100, slave_rate);
+	err = snd_config_top(top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&in, buf, strlen(buf));
+	if (err < 0)
+		return err;
+	err = snd_config_load(*top, in);
+	snd_input_close(in);
+	return err;
+}
+
+static int setup(snd_pcm_t *pcm, unsigned int r, snd_pcm_uframes_t *period)
+{
+	snd_pcm_sw_params_t *sw;
+	snd_pcm_uframes_t buffer_size;
+	int err;
+
+	err = snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16,
+				 SND_PCM_ACCESS_RW_INTERLEAVED, 2, r, 0, latency);
+	if (err < 0)
+		return err;
+	snd_pcm_get_params(pcm, &buffer_size, period);
+	/*
+	 * start the playback with a half filled buffer plus one period, the
+	 * rate plugin converts whole periods only
+	 */
+	snd_pcm_sw_params_alloca(&sw);
+	snd_pcm_sw_params_current(pcm, sw);
+	snd_pcm_sw_params_set_start_threshold(pcm, sw, buffer_size / 2 + *period);
+	return snd_pcm_sw_params(pcm, sw);
+}
+
+int main(int argc, char **argv)
+{
+	snd_config_t *top;
+	snd_pcm_t *capture, *playback;
+	snd_pcm_uframes_t cperiod, pperiod, buffer_size;
+	snd_pcm_sframes_t delay, first = 0, moved = 0;
+	unsigned int capture_rate, sec;
+	long frames = 0;
+	short *buf;
+	int c, err, ret = 0;
+
+	while ((c = getopt(argc, argv, "r:s:p:t:l:n")) >= 0) {
+		switch (c) {
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		case 's':
+			slave_rate = atoi(optarg);
+			break;
+		case 'p':
+			ppm = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'l':
+			latency = atoi(optarg);
+			break;
+		case 'n':
+			adaptive = 0;
+			break;
+		default:
+			fprintf(stderr, "usage: rate-drift [-r rate] [-s slave_rate] [-p ppm] [-t seconds] [-l latency_us] [-n]\n");
+			return 1;
+		}
+	}
+	if (!rate || !slave_rate || seconds < 4 || !latency) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+	capture_rate = (unsigned int)(rate * (1.0 + ppm / 1e6) + 0.5);
+
+	err = load_config(&top);
+	if (err < 0) {
+		fprintf(stderr, "config: %s\n", snd_strerror(err));
+		return 1;
+	}
+	err = snd_pcm_open_lconf(&capture, "drift_capture",
+				 SND_PCM_STREAM_CAPTURE, 0, top);
+	if (err < 0) {
+		fprintf(stderr, "capture open: %s\n", snd_strerror(err));
+		return 1;
+	}
+	err = snd_pcm_open_lconf(&playback, "drift_playback",
+				 SND_PCM_STREAM_PLAYBACK, 0, top);
+	if (err < 0) {
+		fprintf(stderr, "playback open: %s\n", snd_strerror(err));
+		return 1;
+	}
+	err = setup(capture, capture_rate, &cperiod);
+	if (err >= 0)
+		err = setup(playback, rate, &pperiod);
+	if (err < 0) {
+		fprintf(stderr, "setup: %s\n", snd_strerror(err));
+		return 1;
+	}
+	snd_pcm_get_params(playback, &buffer_size, &pperiod);
+	buf = calloc(buffer_size, 2 * sizeof(short));
+	if (!buf)
+		return 1;
+
+	printf("capture %u Hz (%+d ppm), playback %u Hz -> %u Hz, %s\n",
+	       capture_rate, ppm, rate, slave_rate,
+	       adaptive ? "adaptive" : "fixed ratio");
+	/* prefill, then run the capture side as the master clock */
+	snd_pcm_writei(playback, buf, buffer_size / 2 + pperiod);
+	snd_pcm_start(capture);
+	for (sec = 0; sec < seconds; ) {
+		snd_pcm_sframes_t r = snd_pcm_readi(capture, buf, cperiod);
+		if (r < 0) {
+			fprintf(stderr, "capture: %s\n", snd_strerror(r));
+			ret = 1;
+			break;
+		}
+		r = snd_pcm_writei(playback, buf, r);
+		if (r < 0) {
+			fprintf(stderr, "playback: %s\n", snd_strerror(r));
+			ret = 1;
+			break;
+		}
+		frames += r;
+		if (frames < (long)capture_rate)
+			continue;
+		frames -= capture_rate;
+		sec++;
+		if (snd_pcm_delay(playback, &delay) < 0)
+			delay = 0;
+		printf("%3us: playback delay %6ld frames\n", sec, delay);
+		fflush(stdout);
+		/* compare with the level after the start settled */
+		if (sec == 2)
+			first = delay;
+		else if (sec > 2 && labs(delay - first) > labs(moved))
+			moved = delay - first;
+	}
+	if (!ret && labs(moved) > (long)buffer_size / 8) {
+		printf("delay moved by %ld frames\n", moved);
+		ret = 1;
+	}
+	printf("%s\n", ret ? "FAILED" : "OK");
+	snd_pcm_close(playback);
+	snd_pcm_close(capture);
+	snd_config_delete(top);
+	free(buf);
+	return ret;
+}
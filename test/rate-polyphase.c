@@ -0,0 +1,305 @@
+/*
+ * check of the polyphase rate converter
+ *
+ * Plays a sine through a rate PCM with converter "polyphase" into a raw
+ * file and checks the number of converted frames and the signal to
+ * noise and distortion ratio of the output: a sine of the same
+ * frequency is fitted to the steady part of the output and the residual
+ * is taken as noise.  The vector dot product kernels are compared with
+ * the scalar one.
+ *
+ * Usage: rate-polyphase [-d dir] [-m min_snr_db]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <math.h>
+#include <unistd.h>
+#include "../include/asoundlib.h"
+#include "../src/pcm/pcm_rate_polyphase_simd.h"
+
+#define CHANNELS	2
+#define SECONDS		2
+#define FREQ		997.0
+#define AMPLITUDE	0.5
+
+static const char *dir = "/tmp";
+static double min_snr = 84.0;
+
+static const struct {
+	unsigned int in_rate, out_rate;
+} pairs[] = {
+	{ 44100, 48000 },
+	{ 48000, 96000 },
+	{ 44100, 96000 },	/* interpolated phases */
+};
+
+static int open_pcm(snd_pcm_t **pcm, unsigned int out_rate, const char *file)
+{
+	snd_config_t *top;
+	snd_input_t *in;
+	char buf[512];
+	int err, len;
+
+	len = snprintf(buf, sizeof(buf),
+		       "pcm.rate_polyphase {\n"
+		       "	type rate\n"
+		       "	converter \"polyphase\"\n"
+		       "	slave {\n"
+		       "		pcm { type file slave.pcm { type null } file \"%s\" format raw }\n"
+		       "		rate %u\n"
+		       "	}\n"
+		       "}\n", file, out_rate);
+	err = snd_config_top(&top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&in, buf, len);
+	if (err < 0) {
+		snd_config_delete(top);
+		return err;
+	}
+	err = snd_config_load(top, in);
+	snd_input_close(in);
+	if (err >= 0)
+		err = snd_pcm_open_lconf(pcm, "rate_polyphase",
+					 SND_PCM_STREAM_PLAYBACK, 0, top);
+	snd_config_delete(top);
+	return err;
+}
+
+/*
+ * fit a sin + b cos + c of the known frequency to one channel of the
+ * samples [from, to) and return the ratio of the fit to the residual
+ */
+static double snr_db(const float *x, unsigned int from, unsigned int to,
+		     double w)
+{
+	double m[3][3] = { { 0 } }, v[3] = { 0 }, f[3], p, q, sig = 0, err = 0;
+	unsigned int n, i, j, k;
+
+	for (n = from; n < to; n++) {
+		f[0] = sin(w * n);
+		f[1] = cos(w * n);
+		f[2] = 1;
+		for (i = 0; i < 3; i++) {
+			v[i] += f[i] * x[n * CHANNELS];
+			for (j = 0; j < 3; j++)
+				m[i][j] += f[i] * f[j];
+		}
+	}
+	/* gauss elimination, the matrix is well conditioned */
+	for (i = 0; i < 3; i++) {
+		for (j = i + 1; j < 3; j++) {
+			q = m[j][i] / m[i][i];
+			for (k = i; k < 3; k++)
+				m[j][k] -= q * m[i][k];
+			v[j] -= q * v[i];
+		}
+	}
+	for (i = 3; i-- > 0; ) {
+		for (j = i + 1; j < 3; j++)
+			v[i] -= m[i][j] * v[j];
+		v[i] /= m[i][i];
+	}
+	for (n = from; n < to; n++) {
+		p = v[0] * sin(w * n) + v[1] * cos(w * n);
+		q = x[n * CHANNELS] - p - v[2];
+		sig += p * p;
+		err += q * q;
+	}
+	if (err <= 0)
+		return 1000;
+	return 10 * log10(sig / err);
+}
+
+/*
+ * periods of 1/10 s: pcm_rate takes the ratio from the period sizes, so
+ * they must match the rates exactly for the expected length and pitch
+ */
+static int setup(snd_pcm_t *pcm, unsigned int rate)
+{
+	snd_pcm_hw_params_t *params;
+	int err;
+
+	snd_pcm_hw_params_alloca(&params);
+	err = snd_pcm_hw_params_any(pcm, params);
+	if (err >= 0)
+		err = snd_pcm_hw_params_set_access(pcm, params,
+						   SND_PCM_ACCESS_RW_INTERLEAVED);
+	if (err >= 0)
+		err = snd_pcm_hw_params_set_format(pcm, params,
+						   SND_PCM_FORMAT_FLOAT);
+	if (err >= 0)
+		err = snd_pcm_hw_params_set_channels(pcm, params, CHANNELS);
+	if (err >= 0)
+		err = snd_pcm_hw_params_set_rate(pcm, params, rate, 0);
+	if (err >= 0)
+		err = snd_pcm_hw_params_set_period_size(pcm, params,
+							rate / 10, 0);
+	if (err >= 0)
+		err = snd_pcm_hw_params_set_periods(pcm, params, 4, 0);
+	if (err >= 0)
+		err = snd_pcm_hw_params(pcm, params);
+	return err;
+}
+
+/* returns 0 if the conversion is good, 1 if not, negative on error */
+static int check_rate(unsigned int in_rate, unsigned int out_rate)
+{
+	snd_pcm_uframes_t frames = in_rate * SECONDS, expected, got;
+	float *in = NULL, *out = NULL;
+	unsigned int n, c;
+	char file[256];
+	snd_pcm_t *pcm;
+	snd_pcm_sframes_t written;
+	FILE *fp;
+	double snr;
+	int err;
+
+	snprintf(file, sizeof(file), "%s/rate-polyphase-%d.raw", dir, getpid());
+	err = open_pcm(&pcm, out_rate, file);
+	if (err < 0) {
+		fprintf(stderr, "open: %s\n", snd_strerror(err));
+		return err;
+	}
+	err = setup(pcm, in_rate);
+	if (err < 0) {
+		fprintf(stderr, "setup: %s\n", snd_strerror(err));
+		snd_pcm_close(pcm);
+		return err;
+	}
+	in = malloc(frames * CHANNELS * sizeof(float));
+	out = malloc(2 * frames * (out_rate / in_rate + 1) * CHANNELS *
+		     sizeof(float));
+	if (!in || !out) {
+		err = -ENOMEM;
+		goto _end;
+	}
+	for (n = 0; n < frames; n++)
+		for (c = 0; c < CHANNELS; c++)
+			in[n * CHANNELS + c] = AMPLITUDE *
+				sin(2 * M_PI * FREQ * n / in_rate);
+	written = snd_pcm_writei(pcm, in, frames);
+	if (written != (snd_pcm_sframes_t)frames) {
+		fprintf(stderr, "write: %s\n", snd_strerror(written));
+		err = written < 0 ? written : -EIO;
+		goto _end;
+	}
+	snd_pcm_close(pcm);
+	pcm = NULL;
+
+	fp = fopen(file, "rb");
+	if (!fp) {
+		fprintf(stderr, "%s: missing output\n", file);
+		err = -EIO;
+		goto _end;
+	}
+	got = fread(out, CHANNELS * sizeof(float),
+		    2 * frames * (out_rate / in_rate + 1), fp);
+	fclose(fp);
+	expected = (unsigned long long)frames * out_rate / in_rate;
+	printf("%u -> %u: %lu frames, expected %lu", in_rate, out_rate,
+	       (unsigned long)got, (unsigned long)expected);
+	if (got != expected) {
+		printf("\n");
+		err = 1;
+		goto _end;
+	}
+	/* skip the filter delay and settling at both ends */
+	snr = snr_db(out, out_rate / 10, got - out_rate / 10,
+		     2 * M_PI * FREQ / out_rate);
+	printf(", SNR %.1f dB\n", snr);
+	err = snr < min_snr;
+ _end:
+	if (pcm)
+		snd_pcm_close(pcm);
+	unlink(file);
+	free(in);
+	free(out);
+	return err;
+}
+
+static int check_dot(const char *name, dot_func_t dot)
+{
+	float *a, *b, ref, val, scale;
+	unsigned int n, i, bad = 0;
+
+	if (posix_memalign((void **)&a, 32, 512 * sizeof(float)) ||
+	    posix_memalign((void **)&b, 32, 513 * sizeof(float)))
+		return -ENOMEM;
+	srand(1);
+	for (i = 0; i < 512; i++)
+		a[i] = rand() / (float)RAND_MAX - 0.5f;
+	for (i = 0; i < 513; i++)
+		b[i] = rand() / (float)RAND_MAX - 0.5f;
+	for (n = 8; n <= 512; n += 8) {
+		/* the samples may be unaligned */
+		ref = dot_generic(a, b + 1, n);
+		val = dot(a, b + 1, n);
+		for (i = 0, scale = 0; i < n; i++)
+			scale += fabsf(a[i] * b[i + 1]);
+		if (fabsf(val - ref) > 1e-5f * scale) {
+			if (bad++ < 4)
+				fprintf(stderr, "%s: n %u: %g, scalar %g\n",
+					name, n, val, ref);
+		}
+	}
+	printf("dot %s: %s\n", name, bad ? "FAILED" : "ok");
+	free(a);
+	free(b);
+	return bad != 0;
+}
+
+static int check_dots(void)
+{
+	int err = 0;
+
+#ifdef POLYPHASE_SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse"))
+		err |= check_dot("sse", dot_sse);
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		err |= check_dot("avx2", dot_avx2);
+#endif
+#ifdef POLYPHASE_SIMD_NEON
+	err |= check_dot("neon", dot_neon);
+#endif
+	if (select_dot() != dot_generic)
+		return err;
+	printf("dot: scalar only\n");
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i;
+	int c, err, ret = 0;
+
+	while ((c = getopt(argc, argv, "d:m:")) >= 0) {
+		switch (c) {
+		case 'd':
+			dir = optarg;
+			break;
+		case 'm':
+			min_snr = atof(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: rate-polyphase [-d dir] [-m min_snr_db]\n");
+			return 1;
+		}
+	}
+
+	if (check_dots())
+		ret = 1;
+	for (i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++) {
+		err = check_rate(pairs[i].in_rate, pairs[i].out_rate);
+		if (err < 0)
+			printf("%u -> %u: error %s\n", pairs[i].in_rate,
+			       pairs[i].out_rate, snd_strerror(err));
+		if (err)
+			ret = 1;
+	}
+	return ret;
+}
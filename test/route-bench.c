@@ -0,0 +1,301 @@
+/*
+ * throughput benchmark for the route plugin mixing
+ *
+ * First mixes an interleaved S32 buffer through a routing matrix with
+ * a few attenuated sources per destination, once frame by frame the
+ * way snd_pcm_route_convert1_many() sums the samples and once with the
+ * blocked gather kernels (the scalar version and each vectorized kernel
+ * available on this CPU), verifies that they produce the same output
+ * and prints the throughput in million output samples per second.
+ *
+ * Then plays S16 through a route plugin with the same matrix into a
+ * null PCM and prints the throughput of the whole plugin.
+ *
+ * Usage: route-bench [-c channels] [-s sources] [-f frames] [-l loops]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include "../include/asoundlib.h"
+#include "../src/pcm/pcm_route_simd.h"
+
+#define BLOCK	256
+
+static unsigned int channels = 64;
+static unsigned int sources = 3;
+static unsigned int frames = 1024;
+static unsigned int loops = 200;
+
+/* the routing matrix, sources per destination */
+static unsigned int *chan;
+static float *coef;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void make_matrix(void)
+{
+	unsigned int d, k;
+
+	for (d = 0; d < channels; d++) {
+		for (k = 0; k < sources; k++) {
+			chan[d * sources + k] = (d + k * 7) % channels;
+			coef[d * sources + k] = 1.0f / (k + 2);
+		}
+	}
+}
+
+/* frame by frame, reading the interleaved buffer for each destination */
+static void mix_frames(int32_t *dst, const int32_t *src)
+{
+	unsigned int i, d, k;
+
+	for (d = 0; d < channels; d++) {
+		for (i = 0; i < frames; i++) {
+			const int32_t *s = src + i * channels;
+			float sum = 0.0f;
+
+			for (k = 0; k < sources; k++)
+				sum += s[chan[d * sources + k]] * coef[d * sources + k];
+			dst[i * channels + d] = route_float_to_s32(sum);
+		}
+	}
+}
+
+/* load each source once per block, then gather the destinations */
+static void mix_blocks(route_simd_func_t *kernel, int32_t *dst,
+		       const int32_t *src, float *buf, const float **srcs,
+		       int32_t *out)
+{
+	unsigned int done, n, i, c, d, k;
+
+	for (done = 0; done < frames; done += n) {
+		n = frames - done < BLOCK ? frames - done : BLOCK;
+		for (c = 0; c < channels; c++)
+			for (i = 0; i < n; i++)
+				buf[c * BLOCK + i] = src[(done + i) * channels + c];
+		for (d = 0; d < channels; d++) {
+			for (k = 0; k < sources; k++)
+				srcs[k] = buf + chan[d * sources + k] * BLOCK;
+			if (kernel == route_c_mix)
+				kernel(n, out, srcs, coef + d * sources, sources);
+			else
+				kernel((n + ROUTE_SIMD_PAD - 1) & ~(ROUTE_SIMD_PAD - 1),
+				       out, srcs, coef + d * sources, sources);
+			for (i = 0; i < n; i++)
+				dst[(done + i) * channels + d] = out[i];
+		}
+	}
+}
+
+static int bench_kernels(void)
+{
+	unsigned int size = channels * frames, i;
+	const route_simd_kernel_t *k;
+	int32_t *src, *dst, *ref, *out;
+	const float **srcs;
+	float *buf;
+	double t;
+	int err = 0;
+
+	src = malloc(size * sizeof(*src));
+	dst = malloc(size * sizeof(*dst));
+	ref = malloc(size * sizeof(*ref));
+	buf = calloc(channels * BLOCK, sizeof(*buf));
+	out = malloc(BLOCK * sizeof(*out));
+	srcs = malloc(sources * sizeof(*srcs));
+	if (!src || !dst || !ref || !buf || !out || !srcs)
+		return 1;
+	for (i = 0; i < size; i++)
+		src[i] = ((unsigned int)rand() << 16) ^ rand();
+	printf("kernels, %u channels, %u sources per channel, %u frames, %u loops (Msamples/s):\n",
+	       channels, sources, frames, loops);
+
+	mix_frames(ref, src);
+	t = now();
+	for (i = 0; i < loops; i++)
+		mix_frames(dst, src);
+	t = now() - t;
+	printf("  %-10s %10.1f\n", "per frame", (double)size * loops / t / 1e6);
+
+	mix_blocks(route_c_mix, dst, src, buf, srcs, out);
+	if (memcmp(dst, ref, size * sizeof(*dst))) {
+		printf("  %-10s   MISMATCH\n", "scalar");
+		err = 1;
+	} else {
+		t = now();
+		for (i = 0; i < loops; i++)
+			mix_blocks(route_c_mix, dst, src, buf, srcs, out);
+		t = now() - t;
+		printf("  %-10s %10.1f\n", "scalar", (double)size * loops / t / 1e6);
+	}
+	for (k = route_simd_kernels; k->name; k++) {
+		if (!k->available())
+			continue;
+		memset(dst, 0, size * sizeof(*dst));
+		mix_blocks(k->mix, dst, src, buf, srcs, out);
+		if (memcmp(dst, ref, size * sizeof(*dst))) {
+			printf("  %-10s   MISMATCH\n", k->name);
+			err = 1;
+			continue;
+		}
+		t = now();
+		for (i = 0; i < loops; i++)
+			mix_blocks(k->mix, dst, src, buf, srcs, out);
+		t = now() - t;
+		printf("  %-10s %10.1f\n", k->name, (double)size * loops / t / 1e6);
+	}
+	free(src);
+	free(dst);
+	free(ref);
+	free(buf);
+	free(out);
+	free(srcs);
+	return err;
+}
+
+static int open_plugin(snd_pcm_t **pcm)
+{
+	snd_config_t *top;
+	snd_input_t *in;
+	unsigned int d, k;
+	size_t len, pos;
+	char *buf;
+	int err;
+
+	len = 256 + channels * (16 + sources * 24);
+	buf = malloc(len);
+	if (!buf)
+		return -ENOMEM;
+	pos = snprintf(buf, len,
+		       "pcm.route_bench {\n"
+		       "	type route\n"
+		       "	slave {\n"
+		       "		pcm { type null }\n"
+		       "		channels %u\n"
+		       "	}\n"
+		       "	ttable {\n", channels);
+	for (d = 0; d < channels; d++) {
+		for (k = 0; k < sources; k++)
+			pos += snprintf(buf + pos, len - pos, "		%u.%u %g\n",
+					chan[d * sources + k], d,
+					coef[d * sources + k]);
+	}
+	pos += snprintf(buf + pos, len - pos, "	}\n}\n");
+
+	err = snd_config_top(&top);
+	if (err < 0)
+		goto _end;
+	err = snd_input_buffer_open(&in, buf, pos);
+	if (err < 0) {
+		snd_config_delete(top);
+		goto _end;
+	}
+	err = snd_config_load(top, in);
+	snd_input_close(in);
+	if (err >= 0)
+		err = snd_pcm_open_lconf(pcm, "route_bench",
+					 SND_PCM_STREAM_PLAYBACK, 0, top);
+	snd_config_delete(top);
+	if (err < 0)
+		goto _end;
+	err = snd_pcm_set_params(*pcm, SND_PCM_FORMAT_S16,
+				 SND_PCM_ACCESS_RW_INTERLEAVED,
+				 channels, 48000, 0, 500000);
+	if (err < 0)
+		snd_pcm_close(*pcm);
+ _end:
+	free(buf);
+	return err;
+}
+
+static int bench_plugin(void)
+{
+	snd_pcm_uframes_t buffer_size, period_size, size = frames;
+	snd_pcm_t *pcm;
+	int16_t *buf;
+	unsigned int i;
+	double t;
+	int err;
+
+	err = open_plugin(&pcm);
+	if (err < 0) {
+		printf("plugin: %s\n", snd_strerror(err));
+		return 1;
+	}
+	snd_pcm_get_params(pcm, &buffer_size, &period_size);
+	if (size > buffer_size)
+		size = buffer_size;
+	buf = malloc(snd_pcm_frames_to_bytes(pcm, size));
+	if (!buf) {
+		snd_pcm_close(pcm);
+		return 1;
+	}
+	for (i = 0; i < size * channels; i++)
+		buf[i] = rand();
+	t = now();
+	for (i = 0; i < loops; i++) {
+		snd_pcm_sframes_t r = snd_pcm_writei(pcm, buf, size);
+		if (r < 0) {
+			err = r;
+			break;
+		}
+	}
+	t = now() - t;
+	snd_pcm_close(pcm);
+	free(buf);
+	if (err < 0) {
+		printf("plugin: %s\n", snd_strerror(err));
+		return 1;
+	}
+	printf("plugin, S16, %lu frames per write (Msamples/s):\n  %-10s %10.1f\n",
+	       size, "route", (double)size * channels * loops / t / 1e6);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int c, err;
+
+	while ((c = getopt(argc, argv, "c:s:f:l:")) >= 0) {
+		switch (c) {
+		case 'c':
+			channels = atoi(optarg);
+			break;
+		case 's':
+			sources = atoi(optarg);
+			break;
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: route-bench [-c channels] [-s sources] [-f frames] [-l loops]\n");
+			return 1;
+		}
+	}
+	if (!channels || !sources || !frames || !loops) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+	chan = malloc(channels * sources * sizeof(*chan));
+	coef = malloc(channels * sources * sizeof(*coef));
+	if (!chan || !coef)
+		return 1;
+	make_matrix();
+	err = bench_kernels();
+	err |= bench_plugin();
+	free(chan);
+	free(coef);
+	return err;
+}
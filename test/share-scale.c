@@ -0,0 +1,224 @@
+/*
+ * scaling test for the share plugin
+ *
+ * Opens 1, 2, 4, ... share clients on one paced null slave, each bound
+ * to its own slave channel, and lets each client play from its own
+ * thread in blocking mode.  The share and slave PCMs are defined in a
+ * temporary configuration file passed in ALSA_CONFIG_PATH, since the
+ * share plugin opens its slave by name.  For each client count the
+ * frames played per second of all clients, the xruns, the longest
+ * snd_pcm_writei() call and the CPU time used per second are printed.
+ * The test fails when any client sees an xrun.
+ *
+ * Usage: share-scale [-n max_clients] [-s seconds] [-p period_us]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "../include/asoundlib.h"
+
+#define RATE		48000
+#define MAX_CLIENTS	32
+
+static unsigned int max_clients = 16;
+static unsigned int seconds = 2;
+static unsigned int period_time = 5000;
+
+struct client {
+	pthread_t thread;
+	snd_pcm_t *pcm;
+	unsigned long long frames;
+	unsigned int xruns;
+	double max;
+	int err;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpu_time(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+	       ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static int write_config(char *path)
+{
+	unsigned int i;
+	FILE *f;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		return -1;
+	f = fdopen(fd, "w");
+	if (!f) {
+		close(fd);
+		return -1;
+	}
+	fprintf(f, "pcm.share_scale_slave { type null paced 1 }\n");
+	for (i = 0; i < MAX_CLIENTS; i++)
+		fprintf(f, "pcm.share_scale_%u {\n"
+			"	type share\n"
+			"	slave {\n"
+			"		pcm \"share_scale_slave\"\n"
+			"		format S16_LE\n"
+			"		channels %u\n"
+			"		rate %u\n"
+			"		period_time %u\n"
+			"		buffer_time %u\n"
+			"	}\n"
+			"	bindings.0 %u\n"
+			"}\n", i, MAX_CLIENTS, RATE, period_time,
+			period_time * 4, i);
+	return fclose(f);
+}
+
+static void *client_thread(void *data)
+{
+	struct client *c = data;
+	snd_pcm_uframes_t period = (unsigned long long)RATE * period_time / 1000000;
+	unsigned long long total = (unsigned long long)RATE * seconds;
+	short *buf = calloc(period, sizeof(*buf));
+	double t;
+	int err;
+
+	if (!buf) {
+		c->err = -ENOMEM;
+		return NULL;
+	}
+	while (c->frames < total) {
+		t = now();
+		err = snd_pcm_writei(c->pcm, buf, period);
+		t = now() - t;
+		if (t > c->max)
+			c->max = t;
+		if (err == -EPIPE) {
+			c->xruns++;
+			err = snd_pcm_prepare(c->pcm);
+		}
+		if (err < 0) {
+			c->err = err;
+			break;
+		}
+		c->frames += err;
+	}
+	snd_pcm_drop(c->pcm);
+	free(buf);
+	return NULL;
+}
+
+/* returns 1 if a client saw an xrun, negative on error */
+static int run(unsigned int clients)
+{
+	static struct client c[MAX_CLIENTS];
+	unsigned long long frames = 0;
+	unsigned int xruns = 0, i;
+	double start, cpu, max = 0;
+	char name[32];
+	int err = 0;
+
+	memset(c, 0, sizeof(c));
+	for (i = 0; i < clients; i++) {
+		snprintf(name, sizeof(name), "share_scale_%u", i);
+		err = snd_pcm_open(&c[i].pcm, name, SND_PCM_STREAM_PLAYBACK, 0);
+		if (err >= 0)
+			err = snd_pcm_set_params(c[i].pcm, SND_PCM_FORMAT_S16_LE,
+						 SND_PCM_ACCESS_RW_INTERLEAVED,
+						 1, RATE, 0, period_time * 4);
+		if (err < 0) {
+			fprintf(stderr, "cannot open %s: %s\n", name,
+				snd_strerror(err));
+			if (c[i].pcm)
+				snd_pcm_close(c[i].pcm);
+			clients = i;
+			goto _close;
+		}
+	}
+	start = now();
+	cpu = cpu_time();
+	for (i = 0; i < clients; i++)
+		pthread_create(&c[i].thread, NULL, client_thread, &c[i]);
+	for (i = 0; i < clients; i++) {
+		pthread_join(c[i].thread, NULL);
+		frames += c[i].frames;
+		xruns += c[i].xruns;
+		if (c[i].max > max)
+			max = c[i].max;
+		if (c[i].err < 0 && !err) {
+			fprintf(stderr, "client %u: %s\n", i, snd_strerror(c[i].err));
+			err = c[i].err;
+		}
+	}
+	start = now() - start;
+	cpu = cpu_time() - cpu;
+	printf("%7u %14.0f %6u %14.2f %12.1f\n", clients, frames / start,
+	       xruns, max * 1e3, cpu / start * 1e3);
+	if (!err && xruns)
+		err = 1;
+ _close:
+	for (i = 0; i < clients; i++)
+		snd_pcm_close(c[i].pcm);
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	char path[] = "/tmp/share-scale-XXXXXX";
+	unsigned int n;
+	int c, err = 0, ret = 0;
+
+	while ((c = getopt(argc, argv, "n:s:p:")) >= 0) {
+		switch (c) {
+		case 'n':
+			max_clients = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'p':
+			period_time = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: share-scale [-n max_clients] [-s seconds] [-p period_us]\n");
+			return 1;
+		}
+	}
+	if (!max_clients || max_clients > MAX_CLIENTS || !seconds ||
+	    period_time < 1000) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+	if (write_config(path) < 0) {
+		perror("config");
+		return 1;
+	}
+	/* before the first access to the global configuration */
+	setenv("ALSA_CONFIG_PATH", path, 1);
+
+	printf("%u s, %u Hz, %u us periods\n", seconds, RATE, period_time);
+	printf("%7s %14s %6s %14s %12s\n", "clients", "frames/s", "xruns",
+	       "max write ms", "cpu ms/s");
+	for (n = 1; n <= max_clients && err >= 0; n *= 2) {
+		err = run(n);
+		if (err)
+			ret = 1;
+	}
+	unlink(path);
+	snd_config_update_free_global();
+	return ret;
+}
@@ -0,0 +1,174 @@
+/*
+ * throughput benchmark for the softvol kernels
+ *
+ * Runs the scalar reference and each vectorized kernel available on
+ * this CPU over an interleaved buffer with a per-channel gain pattern
+ * and with a gain ramp from mute to the unity gain, verifies that the
+ * kernels produce the same output and prints the throughput in million
+ * samples per second.
+ *
+ * Usage: softvol-bench [-c channels] [-f frames] [-l loops]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include "../src/pcm/pcm_softvol_simd.h"
+
+static unsigned int channels = 2;
+static unsigned int frames = 1024;
+static unsigned int loops = 2000;
+
+static const struct {
+	const char *name;
+	unsigned int bytes;
+} ops[SOFTVOL_SIMD_OPS] = {
+	[SOFTVOL_SIMD_S16] = { "S16", 2 },
+	[SOFTVOL_SIMD_S32] = { "S32", 4 },
+	[SOFTVOL_SIMD_S24] = { "S24", 4 },
+	[SOFTVOL_SIMD_S24_3LE] = { "S24_3LE", 3 },
+	[SOFTVOL_SIMD_FLOAT] = { "FLOAT", 4 },
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fill(unsigned char *buf, unsigned int size, int op)
+{
+	unsigned int i;
+
+	if (op == SOFTVOL_SIMD_FLOAT) {
+		float *f = (float *)buf;
+		for (i = 0; i < size; i++)
+			f[i] = (rand() / (float)RAND_MAX) * 2.0f - 1.0f;
+		return;
+	}
+	for (i = 0; i < size * ops[op].bytes; i++)
+		buf[i] = rand();
+}
+
+/* constant gains per channel, the edge values included */
+static void gain_pattern(uint32_t *gain, unsigned int size)
+{
+	static const uint32_t edge[] = { 0, 1, 0x8000, 0xffff, SOFTVOL_SIMD_UNITY };
+	unsigned int i;
+
+	for (i = 0; i < size; i++) {
+		unsigned int ch = i % channels;
+		gain[i] = ch < 5 ? edge[ch] : (uint32_t)rand() % SOFTVOL_SIMD_UNITY;
+	}
+}
+
+static void gain_ramp(uint32_t *gain, unsigned int size)
+{
+	unsigned int i;
+
+	for (i = 0; i < size; i++)
+		gain[i] = (unsigned long long)SOFTVOL_SIMD_UNITY * (i / channels) /
+			(size / channels);
+}
+
+static void run(softvol_simd_func_t *kernel, int op, unsigned int size,
+		unsigned char *dst, const unsigned char *src, const uint32_t *gain)
+{
+	unsigned int done = kernel(size, dst, src, gain);
+
+	if (done < size)
+		softvol_simd_scalar[op](size - done, dst + done * ops[op].bytes,
+					src + done * ops[op].bytes, gain + done);
+}
+
+static double bench(softvol_simd_func_t *kernel, int op, unsigned int size,
+		    unsigned char *dst, const unsigned char *src,
+		    const uint32_t *gain)
+{
+	unsigned int i;
+	double t;
+
+	t = now();
+	for (i = 0; i < loops; i++)
+		run(kernel, op, size, dst, src, gain);
+	t = now() - t;
+	return (double)size * loops / t / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+	const softvol_simd_kernel_t *k;
+	unsigned char *src, *dst, *ref;
+	uint32_t *gain;
+	unsigned int size;
+	int c, op, ramp, err = 0;
+
+	while ((c = getopt(argc, argv, "c:f:l:")) >= 0) {
+		switch (c) {
+		case 'c':
+			channels = atoi(optarg);
+			break;
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: softvol-bench [-c channels] [-f frames] [-l loops]\n");
+			return 1;
+		}
+	}
+	if (!channels || !frames || !loops) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+	size = channels * frames;
+	src = malloc(size * 4);
+	dst = malloc(size * 4);
+	ref = malloc(size * 4);
+	gain = malloc(size * sizeof(*gain));
+	if (!src || !dst || !ref || !gain)
+		return 1;
+	printf("%u channels, %u frames, %u loops (Msamples/s)\n",
+	       channels, frames, loops);
+	for (op = 0; op < SOFTVOL_SIMD_OPS; op++) {
+		for (ramp = 0; ramp < 2; ramp++) {
+			const char *mode = ramp ? "ramp" : "const";
+
+			fill(src, size, op);
+			if (ramp)
+				gain_ramp(gain, size);
+			else
+				gain_pattern(gain, size);
+			softvol_simd_scalar[op](size, ref, src, gain);
+			printf("  %-8s %-6s %-8s %10.1f\n", ops[op].name, mode,
+			       "scalar", bench(softvol_simd_scalar[op], op, size,
+					       dst, src, gain));
+			for (k = softvol_simd_kernels; k->name; k++) {
+				if (!k->available() || !k->op[op])
+					continue;
+				memset(dst, 0, size * 4);
+				run(k->op[op], op, size, dst, src, gain);
+				if (memcmp(dst, ref, size * ops[op].bytes)) {
+					printf("  %-8s %-6s %-8s   MISMATCH\n",
+					       ops[op].name, mode, k->name);
+					err = 1;
+					continue;
+				}
+				printf("  %-8s %-6s %-8s %10.1f\n", ops[op].name,
+				       mode, k->name,
+				       bench(k->op[op], op, size, dst, src, gain));
+			}
+		}
+	}
+	free(src);
+	free(dst);
+	free(ref);
+	free(gain);
+	return err;
+}
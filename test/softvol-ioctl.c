@@ -0,0 +1,222 @@
+/*
+ * syscall load of the softvol plugin under steady playback
+ *
+ * Plays silence through a softvol PCM over a null PCM, paced by the
+ * period time like a sound card would pace it, counts the ioctl(),
+ * read() and poll() calls made by the library and prints them per
+ * second and per period.  In the middle of the run the volume is
+ * changed through a separate control handle, the plugin is expected to
+ * re-read the element once.
+ *
+ * The null PCM never waits, so this is the case of an application
+ * which does not poll; an application waiting in poll makes the plugin
+ * read the control events only when the ctl fd is readable.
+ *
+ * The softvol control lives on a real sound card (-C, card 0 by
+ * default).  The run fails when the plugin issues a syscall per period.
+ *
+ * Usage: softvol-ioctl [-C card] [-s seconds] [-p period_us]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include "../include/asoundlib.h"
+
+#define CONTROL_NAME	"Softvol Test Volume"
+
+static int card;
+static unsigned int seconds = 4;
+static unsigned int period_time = 1000;
+
+static unsigned long syscalls;
+
+/* the library calls land here, the real calls are the raw syscalls */
+int ioctl(int fd, unsigned long request, ...)
+{
+	va_list ap;
+	void *arg;
+
+	va_start(ap, request);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+	syscalls++;
+	return syscall(SYS_ioctl, fd, request, arg);
+}
+
+ssize_t read(int fd, void *buf, size_t count)
+{
+	syscalls++;
+	return syscall(SYS_read, fd, buf, count);
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+	struct timespec ts, *tsp = NULL;
+
+	syscalls++;
+	if (timeout >= 0) {
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (timeout % 1000) * 1000000L;
+		tsp = &ts;
+	}
+	return syscall(SYS_ppoll, fds, nfds, tsp, NULL, 0);
+}
+
+static int open_pcm(snd_pcm_t **pcm)
+{
+	snd_config_t *top;
+	snd_input_t *in;
+	char buf[256];
+	int err, len;
+
+	len = snprintf(buf, sizeof(buf),
+		       "pcm.softvol_ioctl {\n"
+		       "	type softvol\n"
+		       "	slave.pcm { type null }\n"
+		       "	control { name \"%s\" card %d }\n"
+		       "}\n", CONTROL_NAME, card);
+	err = snd_config_top(&top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&in, buf, len);
+	if (err < 0) {
+		snd_config_delete(top);
+		return err;
+	}
+	err = snd_config_load(top, in);
+	snd_input_close(in);
+	if (err >= 0)
+		err = snd_pcm_open_lconf(pcm, "softvol_ioctl",
+					 SND_PCM_STREAM_PLAYBACK, 0, top);
+	snd_config_delete(top);
+	return err;
+}
+
+static int set_volume(long value)
+{
+	snd_ctl_elem_value_t *val;
+	snd_ctl_t *ctl;
+	char name[16];
+	int err;
+
+	snd_ctl_elem_value_alloca(&val);
+	sprintf(name, "hw:%d", card);
+	err = snd_ctl_open(&ctl, name, 0);
+	if (err < 0)
+		return err;
+	snd_ctl_elem_value_set_interface(val, SND_CTL_ELEM_IFACE_MIXER);
+	snd_ctl_elem_value_set_name(val, CONTROL_NAME);
+	snd_ctl_elem_value_set_integer(val, 0, value);
+	snd_ctl_elem_value_set_integer(val, 1, value);
+	err = snd_ctl_elem_write(ctl, val);
+	snd_ctl_close(ctl);
+	return err;
+}
+
+static void sleep_until(struct timespec *ts, unsigned int us)
+{
+	ts->tv_nsec += us * 1000;
+	while (ts->tv_nsec >= 1000000000) {
+		ts->tv_nsec -= 1000000000;
+		ts->tv_sec++;
+	}
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, ts, NULL);
+}
+
+int main(int argc, char **argv)
+{
+	snd_pcm_uframes_t buffer_size, period_size;
+	unsigned long periods, count, total = 0, total_periods = 0;
+	unsigned int sec;
+	struct timespec ts;
+	snd_pcm_t *pcm;
+	int16_t *buf;
+	int c, err;
+
+	while ((c = getopt(argc, argv, "C:s:p:")) >= 0) {
+		switch (c) {
+		case 'C':
+			card = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'p':
+			period_time = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: softvol-ioctl [-C card] [-s seconds] [-p period_us]\n");
+			return 1;
+		}
+	}
+	if (!seconds || period_time < 100) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	err = open_pcm(&pcm);
+	if (err < 0) {
+		fprintf(stderr, "open: %s\n", snd_strerror(err));
+		return 1;
+	}
+	err = snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16,
+				 SND_PCM_ACCESS_RW_INTERLEAVED, 2, 48000, 0,
+				 period_time * 4);
+	if (err < 0) {
+		fprintf(stderr, "setup: %s\n", snd_strerror(err));
+		snd_pcm_close(pcm);
+		return 1;
+	}
+	snd_pcm_get_params(pcm, &buffer_size, &period_size);
+	buf = calloc(period_size, 2 * sizeof(*buf));
+	if (!buf) {
+		snd_pcm_close(pcm);
+		return 1;
+	}
+	/* one period time per write */
+	period_time = period_size * 1000000ULL / 48000;
+	printf("%lu frames per period, %u us\n", period_size, period_time);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	for (sec = 0; sec < seconds; sec++) {
+		if (sec == seconds / 2) {
+			unsigned long saved = syscalls;
+
+			err = set_volume(sec & 1 ? 128 : 64);
+			if (err < 0)
+				fprintf(stderr, "volume: %s\n", snd_strerror(err));
+			syscalls = saved;
+		}
+		count = syscalls;
+		for (periods = 0; periods < 1000000 / period_time; periods++) {
+			snd_pcm_sframes_t r = snd_pcm_writei(pcm, buf, period_size);
+
+			if (r < 0 && snd_pcm_recover(pcm, r, 0) < 0) {
+				fprintf(stderr, "write: %s\n", snd_strerror(r));
+				goto _end;
+			}
+			sleep_until(&ts, period_time);
+		}
+		count = syscalls - count;
+		printf("%u: %lu periods, %lu syscalls, %.3f per period%s\n",
+		       sec, periods, count, (double)count / periods,
+		       sec == seconds / 2 ? " (volume changed)" : "");
+		total += count;
+		total_periods += periods;
+	}
+ _end:
+	snd_pcm_close(pcm);
+	free(buf);
+	if (!total_periods)
+		return 1;
+	printf("%.3f syscalls per period\n", (double)total / total_periods);
+	return total >= total_periods;
+}